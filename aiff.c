@@ -0,0 +1,483 @@
+/* aiff.c (beta)*/
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+/* include prototype header file */
+#include "aiff.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//sample encodings
+#define AIFF_INT 0 /* signed integer */
+#define AIFF_UINT8 1 /* unsigned 8bit (AIFC "raw ") */
+#define AIFF_FLOAT 2 /* IEEE float (32 or 64bit) */
+
+//chunks looked at in the header
+#define AIFF_MAX_CHUNKS 64
+
+//Sound data description shared by AIFF and CAF
+typedef struct{
+    uint64_t fs; /* Sampling frequency */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    int16_t bits; /* container bits (8, 16, 24, 32, or 64 for double) */
+    int encoding; /* AIFF_INT, AIFF_UINT8 or AIFF_FLOAT */
+    int big_endian; /* byte order of the samples */
+    int64_t frames; /* number of frames */
+    int64_t offset; /* file offset of the first frame */
+} AIFF_FORMAT;
+
+//Big-endian integers
+static uint32_t aiff_get16(const uint8_t *p){
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static uint32_t aiff_get32(const uint8_t *p){
+    return (aiff_get16(p) << 16) | aiff_get16(p + 2);
+}
+
+static uint64_t aiff_get64(const uint8_t *p){
+    return ((uint64_t)aiff_get32(p) << 32) | aiff_get32(p + 4);
+}
+
+//80bit IEEE extended (sample rate of the COMM chunk)
+static double aiff_extended(const uint8_t *p){
+    int exponent = (int)(((p[0] & 0x7F) << 8) | p[1]);
+    uint64_t mantissa = aiff_get64(p + 2);
+    double x;
+
+    if(exponent == 0 && mantissa == 0){
+        return 0.0;
+    }
+    x = ldexp((double)mantissa, exponent - 16383 - 63);
+
+    return (p[0] & 0x80) ? -x : x;
+}
+
+//Read n bytes at a file offset
+static int aiff_read_at(FILE *fp, int64_t offset, uint8_t *buf, size_t n){
+    return fseek(fp, (long)offset, SEEK_SET) == 0 && fread(buf, 1, n, fp) == n;
+}
+
+//Parse the FORM header, COMM and SSND chunks of an AIFF or AIFC file (-1 after reporting the error)
+static int aiff_parse(FILE *fp, AIFF_FORMAT *format){
+    WAVIO_CHUNK chunk[AIFF_MAX_CHUNKS];
+    uint8_t head[12], comm[22], ssnd[8];
+    int32_t count, i;
+    int aifc, bytes;
+    int64_t comm_size = -1, ssnd_offset = -1, ssnd_size = 0;
+    double fs;
+
+    if(!aiff_read_at(fp, 0, head, 12) || memcmp(head, "FORM", 4) != 0 || (memcmp(head + 8, "AIFF", 4) != 0 && memcmp(head + 8, "AIFC", 4) != 0)){
+        return wavio_report_error(WAVIO_ERROR_FORMAT, "The file is not AIFF file.");
+    }
+    aifc = (memcmp(head + 8, "AIFC", 4) == 0);
+
+    //chunks (big-endian sizes, padded to even sizes)
+    count = wavio_walk_chunks(fp, 12, WAVIO_WALK_BIG_ENDIAN | WAVIO_WALK_EVEN, chunk, AIFF_MAX_CHUNKS);
+    for(i = 0; i < count; i++){
+        if(memcmp(chunk[i].id, "COMM", 4) == 0 && comm_size < 0 && chunk[i].size >= 18){
+            comm_size = chunk[i].size;
+            if(!aiff_read_at(fp, chunk[i].offset, comm, (comm_size >= 22) ? 22 : 18)){
+                comm_size = -1;
+            }
+        }
+        if(memcmp(chunk[i].id, "SSND", 4) == 0 && ssnd_offset < 0 && chunk[i].size >= 8){
+            ssnd_offset = chunk[i].offset;
+            ssnd_size = chunk[i].size;
+        }
+    }
+    if(comm_size < 0 || ssnd_offset < 0){
+        return wavio_report_error(WAVIO_ERROR_FORMAT, "The file does not have COMM or SSND chunk.");
+    }
+
+    //COMM: channels, frames, sample size, sample rate (and compression type of AIFC)
+    format->channel = (int16_t)aiff_get16(comm);
+    format->frames = aiff_get32(comm + 2);
+    bytes = ((int)aiff_get16(comm + 6) + 7) / 8;
+    fs = aiff_extended(comm + 8);
+    format->fs = (uint64_t)(fs + 0.5);
+    format->encoding = AIFF_INT;
+    format->big_endian = 1;
+    if(aifc){
+        if(comm_size < 22){
+            return wavio_report_error(WAVIO_ERROR_FORMAT, "The file does not have COMM or SSND chunk.");
+        }
+        if(memcmp(comm + 18, "NONE", 4) == 0 || memcmp(comm + 18, "twos", 4) == 0){
+            //big-endian integer
+        }else if(memcmp(comm + 18, "sowt", 4) == 0){
+            format->big_endian = 0;
+        }else if(memcmp(comm + 18, "raw ", 4) == 0 && bytes == 1){
+            format->encoding = AIFF_UINT8;
+        }else if(memcmp(comm + 18, "fl32", 4) == 0 || memcmp(comm + 18, "FL32", 4) == 0){
+            format->encoding = AIFF_FLOAT;
+            bytes = 4;
+        }else if(memcmp(comm + 18, "fl64", 4) == 0 || memcmp(comm + 18, "FL64", 4) == 0){
+            format->encoding = AIFF_FLOAT;
+            bytes = 8;
+        }else{
+            return wavio_report_error(WAVIO_ERROR_FORMAT, "Unsupported compression type.");
+        }
+    }
+    format->bits = (int16_t)(8 * bytes);
+
+    //SSND: offset and block size, then the sound data (samples are left-justified)
+    if(!aiff_read_at(fp, ssnd_offset, ssnd, 8)){
+        return wavio_report_error(WAVIO_ERROR_FORMAT, "The file does not have COMM or SSND chunk.");
+    }
+    format->offset = ssnd_offset + 8 + aiff_get32(ssnd);
+    if(format->channel > 0 && bytes > 0 && (ssnd_size - 8 - (int64_t)aiff_get32(ssnd)) / (format->channel * bytes) < format->frames){
+        format->frames = (ssnd_size - 8 - (int64_t)aiff_get32(ssnd)) / (format->channel * bytes);
+    }
+
+    return 0;
+}
+
+//Parse the header, desc and data chunks of a CAF file (-1 after reporting the error)
+static int caf_parse(FILE *fp, AIFF_FORMAT *format){
+    WAVIO_CHUNK chunk[AIFF_MAX_CHUNKS];
+    uint8_t head[8], desc[32];
+    int32_t count, i;
+    int64_t data_offset = -1, data_size = 0;
+    uint32_t flags, packet, per_packet, channel, bits;
+    uint64_t rate;
+    double fs;
+    int found = 0;
+
+    if(!aiff_read_at(fp, 0, head, 8) || memcmp(head, "caff", 4) != 0){
+        return wavio_report_error(WAVIO_ERROR_FORMAT, "The file is not CAF file.");
+    }
+
+    //chunks (64bit big-endian sizes, no padding)
+    count = wavio_walk_chunks(fp, 8, WAVIO_WALK_BIG_ENDIAN | WAVIO_WALK_SIZE64, chunk, AIFF_MAX_CHUNKS);
+    for(i = 0; i < count; i++){
+        if(memcmp(chunk[i].id, "desc", 4) == 0 && !found && chunk[i].size >= 32){
+            found = aiff_read_at(fp, chunk[i].offset, desc, 32);
+        }
+        if(memcmp(chunk[i].id, "data", 4) == 0 && data_offset < 0 && chunk[i].size >= 4){
+            data_offset = chunk[i].offset + 4; /* after the edit count */
+            data_size = chunk[i].size - 4;
+        }
+    }
+    if(!found || data_offset < 0){
+        return wavio_report_error(WAVIO_ERROR_FORMAT, "The file does not have desc or data chunk.");
+    }
+
+    //desc: sample rate (double), format ID, flags, bytes per packet, frames per packet, channels, bits
+    rate = aiff_get64(desc);
+    memcpy(&fs, &rate, sizeof(fs));
+    flags = aiff_get32(desc + 12);
+    packet = aiff_get32(desc + 16);
+    per_packet = aiff_get32(desc + 20);
+    channel = aiff_get32(desc + 24);
+    bits = aiff_get32(desc + 28);
+    if(memcmp(desc + 8, "lpcm", 4) != 0 || per_packet != 1 || channel == 0 || packet != channel * ((bits + 7) / 8)){
+        return wavio_report_error(WAVIO_ERROR_FORMAT, "Unsupported compression type.");
+    }
+
+    format->fs = (uint64_t)(fs + 0.5);
+    format->channel = (int16_t)channel;
+    format->encoding = (flags & 1) ? AIFF_FLOAT : AIFF_INT;
+    format->big_endian = !(flags & 2);
+    format->bits = (int16_t)(8 * ((bits + 7) / 8));
+    format->frames = data_size / packet;
+    format->offset = data_offset;
+
+    return 0;
+}
+
+//Read the sound data block by block into NATIVE and/or [-1, 1] channel arrays (-1 after reporting the error)
+static int aiff_read_data(FILE *fp, AIFF_FORMAT *format, int32_t **native, double **pcm){
+    int bytes = format->bits / 8;
+    int16_t bits = (format->encoding == AIFF_FLOAT) ? 32 : format->bits; /* NATIVE width */
+    uint64_t frame = (uint64_t)format->channel * bytes; /* bytes per frame */
+    uint8_t *buf = (uint8_t *)malloc(AIFF_BLOCK_FRAMES * frame);
+    int32_t *tmp = (int32_t *)malloc(AIFF_BLOCK_FRAMES * format->channel * sizeof(int32_t));
+    double *ftmp = (format->encoding == AIFF_FLOAT) ? (double *)malloc(AIFF_BLOCK_FRAMES * format->channel * sizeof(double)) : NULL;
+    int32_t *line = (int32_t *)malloc(AIFF_BLOCK_FRAMES * sizeof(int32_t));
+    double *dline = (double *)malloc(AIFF_BLOCK_FRAMES * sizeof(double));
+    int64_t done = 0, n, j, k;
+    uint64_t u;
+    uint32_t w;
+    float f;
+    int c, b;
+
+    if(buf == NULL || tmp == NULL || (format->encoding == AIFF_FLOAT && ftmp == NULL) || line == NULL || dline == NULL){
+        free(buf);
+        free(tmp);
+        free(ftmp);
+        free(line);
+        free(dline);
+        return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the read buffer.");
+    }
+
+    fseek(fp, (long)format->offset, SEEK_SET);
+    while(done < format->frames){
+        n = (format->frames - done < AIFF_BLOCK_FRAMES) ? format->frames - done : AIFF_BLOCK_FRAMES;
+        n = (int64_t)fread(buf, frame, (size_t)n, fp);
+        if(n <= 0){
+            break;
+        }
+
+        //interleaved samples: integers as NATIVE, floats as double
+        if(format->encoding == AIFF_FLOAT && bytes == 4){
+            wavio_unpack_signed(buf, tmp, n * format->channel, 32, format->big_endian);
+            for(k = 0; k < n * format->channel; k++){
+                w = (uint32_t)tmp[k];
+                memcpy(&f, &w, 4);
+                ftmp[k] = f;
+            }
+        }else if(format->encoding == AIFF_FLOAT){
+            for(k = 0; k < n * format->channel; k++){
+                u = 0;
+                for(b = 0; b < 8; b++){
+                    u = (u << 8) | buf[8 * k + (format->big_endian ? b : 7 - b)];
+                }
+                memcpy(&ftmp[k], &u, 8);
+            }
+        }else if(format->encoding == AIFF_UINT8){
+            for(k = 0; k < n * format->channel; k++){
+                tmp[k] = buf[k];
+            }
+        }else{
+            wavio_unpack_signed(buf, tmp, n * format->channel, format->bits, format->big_endian);
+            if(bits == 8){
+                for(k = 0; k < n * format->channel; k++){
+                    tmp[k] += 128; /* NATIVE 8bit is unsigned */
+                }
+            }
+        }
+
+        //deinterleave (and convert)
+        for(c = 0; c < format->channel && c < 2; c++){
+            if(format->encoding == AIFF_FLOAT){
+                for(j = 0; j < n; j++){
+                    dline[j] = ftmp[j * format->channel + c];
+                }
+                if(pcm != NULL && pcm[c] != NULL){
+                    memcpy(pcm[c] + done, dline, n * sizeof(double));
+                }
+                if(native != NULL && native[c] != NULL){
+                    wavio_pcm_to_native(dline, native[c] + done, (int32_t)n, bits);
+                }
+            }else{
+                for(j = 0; j < n; j++){
+                    line[j] = tmp[j * format->channel + c];
+                }
+                if(native != NULL && native[c] != NULL){
+                    memcpy(native[c] + done, line, n * sizeof(int32_t));
+                }
+                if(pcm != NULL && pcm[c] != NULL){
+                    wavio_native_to_pcm(line, pcm[c] + done, (int32_t)n, bits);
+                }
+            }
+        }
+        done += n;
+    }
+    format->frames = done;
+
+    free(buf);
+    free(tmp);
+    free(ftmp);
+    free(line);
+    free(dline);
+
+    return 0;
+}
+
+//Open a file and parse its header (caf: CAF instead of AIFF), check the channel number
+//returns NULL after reporting the error (wavio_set_error_mode)
+static FILE *aiff_open(char *filename, int caf, int16_t channel, AIFF_FORMAT *format){
+    FILE *fp = fopen(filename, "rb");
+
+    if(fp == NULL){
+        wavio_report_error(WAVIO_ERROR_OPEN, "Cannot open the file.");
+        return NULL;
+    }
+    if((caf ? caf_parse(fp, format) : aiff_parse(fp, format)) != 0){
+        fclose(fp);
+        return NULL;
+    }
+    if(format->channel != channel){
+        fclose(fp);
+        wavio_report_error(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+        return NULL;
+    }
+    if(format->encoding != AIFF_FLOAT && format->bits != 8 && format->bits != 16 && format->bits != 24 && format->bits != 32){
+        fclose(fp);
+        wavio_report_error(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+        return NULL;
+    }
+
+    return fp;
+}
+
+//Fill PCM_SPEC (floats are returned as 32bit NATIVE)
+static void aiff_spec(PCM_SPEC *pcm_spec, AIFF_FORMAT *format){
+    pcm_spec->fs = format->fs;
+    pcm_spec->bits = (format->encoding == AIFF_FLOAT) ? 32 : format->bits;
+    pcm_spec->length = (int32_t)format->frames;
+}
+
+//Read a file into STEREO_PCM_NATIVE (only filled in on success, see wavio_set_error_mode)
+static void aiff_stereo_native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename, int caf){
+    AIFF_FORMAT format;
+    int32_t *data[2];
+    FILE *fp = aiff_open(filename, caf, 2, &format);
+
+    if(fp == NULL){
+        return;
+    }
+    data[0] = (int32_t *)calloc(format.frames > 0 ? format.frames : 1, sizeof(int32_t));
+    data[1] = (int32_t *)calloc(format.frames > 0 ? format.frames : 1, sizeof(int32_t));
+    if(data[0] == NULL || data[1] == NULL){
+        free(data[0]);
+        free(data[1]);
+        fclose(fp);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+    if(aiff_read_data(fp, &format, data, NULL) != 0){
+        free(data[0]);
+        free(data[1]);
+        fclose(fp);
+        return;
+    }
+    stereo_pcm_native->data[0] = data[0];
+    stereo_pcm_native->data[1] = data[1];
+    aiff_spec(&stereo_pcm_native->pcm_spec, &format);
+    fclose(fp);
+}
+
+//Read a file into STEREO_PCM
+static void aiff_stereo(STEREO_PCM *stereo_pcm, char *filename, int caf){
+    AIFF_FORMAT format;
+    double *data[2];
+    FILE *fp = aiff_open(filename, caf, 2, &format);
+
+    if(fp == NULL){
+        return;
+    }
+    data[0] = (double *)calloc(format.frames > 0 ? format.frames : 1, sizeof(double));
+    data[1] = (double *)calloc(format.frames > 0 ? format.frames : 1, sizeof(double));
+    if(data[0] == NULL || data[1] == NULL){
+        free(data[0]);
+        free(data[1]);
+        fclose(fp);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+    if(aiff_read_data(fp, &format, NULL, data) != 0){
+        free(data[0]);
+        free(data[1]);
+        fclose(fp);
+        return;
+    }
+    stereo_pcm->data[0] = data[0];
+    stereo_pcm->data[1] = data[1];
+    aiff_spec(&stereo_pcm->pcm_spec, &format);
+    fclose(fp);
+}
+
+//Read a file into MONO_PCM_NATIVE
+static void aiff_mono_native(MONO_PCM_NATIVE *mono_pcm_native, char *filename, int caf){
+    AIFF_FORMAT format;
+    int32_t *data;
+    FILE *fp = aiff_open(filename, caf, 1, &format);
+
+    if(fp == NULL){
+        return;
+    }
+    data = (int32_t *)calloc(format.frames > 0 ? format.frames : 1, sizeof(int32_t));
+    if(data == NULL){
+        fclose(fp);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+    if(aiff_read_data(fp, &format, &data, NULL) != 0){
+        free(data);
+        fclose(fp);
+        return;
+    }
+    mono_pcm_native->data = data;
+    aiff_spec(&mono_pcm_native->pcm_spec, &format);
+    fclose(fp);
+}
+
+//Read a file into MONO_PCM
+static void aiff_mono(MONO_PCM *mono_pcm, char *filename, int caf){
+    AIFF_FORMAT format;
+    double *data;
+    FILE *fp = aiff_open(filename, caf, 1, &format);
+
+    if(fp == NULL){
+        return;
+    }
+    data = (double *)calloc(format.frames > 0 ? format.frames : 1, sizeof(double));
+    if(data == NULL){
+        fclose(fp);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+    if(aiff_read_data(fp, &format, NULL, &data) != 0){
+        free(data);
+        fclose(fp);
+        return;
+    }
+    mono_pcm->data = data;
+    aiff_spec(&mono_pcm->pcm_spec, &format);
+    fclose(fp);
+}
+
+//Read AIFF data and insert MONO_PCM_NATIVE struct
+void aiffread_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename){
+    aiff_mono_native(mono_pcm_native, filename, 0);
+}
+
+//Read AIFF data and insert MONO_PCM struct
+void aiffread_Mono(MONO_PCM *mono_pcm, char *filename){
+    aiff_mono(mono_pcm, filename, 0);
+}
+
+//Read AIFF data and insert STEREO_PCM_NATIVE struct
+void aiffread_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename){
+    aiff_stereo_native(stereo_pcm_native, filename, 0);
+}
+
+//Read AIFF data and insert STEREO_PCM struct
+void aiffread_Stereo(STEREO_PCM *stereo_pcm, char *filename){
+    aiff_stereo(stereo_pcm, filename, 0);
+}
+
+//Read CAF data and insert MONO_PCM_NATIVE struct
+void cafread_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename){
+    aiff_mono_native(mono_pcm_native, filename, 1);
+}
+
+//Read CAF data and insert MONO_PCM struct
+void cafread_Mono(MONO_PCM *mono_pcm, char *filename){
+    aiff_mono(mono_pcm, filename, 1);
+}
+
+//Read CAF data and insert STEREO_PCM_NATIVE struct
+void cafread_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename){
+    aiff_stereo_native(stereo_pcm_native, filename, 1);
+}
+
+//Read CAF data and insert STEREO_PCM struct
+void cafread_Stereo(STEREO_PCM *stereo_pcm, char *filename){
+    aiff_stereo(stereo_pcm, filename, 1);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,38 @@
+/*aiff.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_AIFF
+#define INCLUDED_AIFF
+
+#include <stdint.h>
+#include "wavio.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//frames decoded at once from the sound data
+#define AIFF_BLOCK_FRAMES 16384
+
+//Prototype declaration for aiff.c
+/* AIFF and AIFC (uncompressed, sowt, fl32, fl64) */
+void aiffread_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename);
+void aiffread_Mono(MONO_PCM *mono_pcm, char *filename);
+void aiffread_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename);
+void aiffread_Stereo(STEREO_PCM *stereo_pcm, char *filename);
+
+/* CAF (linear PCM) */
+void cafread_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename);
+void cafread_Mono(MONO_PCM *mono_pcm, char *filename);
+void cafread_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename);
+void cafread_Stereo(STEREO_PCM *stereo_pcm, char *filename);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
@@ -0,0 +1,212 @@
+/* dither.c (beta)*/
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+/* include prototype header file */
+#include "dither.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//frames requantized at once (random numbers are generated per chunk)
+#define DITHER_CHUNK 1024
+
+//adding and subtracting 1.5 * 2^52 rounds to the nearest integer without floor() (which does not vectorize)
+#define DITHER_ROUND 6755399441055744.0
+
+//F-weighted noise shaping filter (Wannamaker, 9 taps)
+static const double dither_shape[DITHER_ORDER] = {
+    2.412, -3.370, 3.937, -4.174, 3.353, -2.205, 1.281, -0.569, 0.0847
+};
+
+//Counter based random number (splitmix64), independent per index so the loop vectorizes
+static uint64_t dither_random(uint64_t seed, uint64_t index){
+    uint64_t z = seed + index * 0x9E3779B97F4A7C15ULL;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+    return z ^ (z >> 31);
+}
+
+//Requantize n independent samples (no feedback, vectorizes)
+static void dither_quantize(const double *src, const double *noise, int32_t *dst, int32_t n, double scale, double offset, double low, double high){
+    double v, q;
+    int32_t j;
+
+    for(j = 0; j < n; j++){
+        v = src[j];
+        v = (v < -1.0) ? -1.0 : (v > 1.0) ? 1.0 : v;
+        q = (v * scale + offset + noise[j] + DITHER_ROUND) - DITHER_ROUND;
+        q = (q < low) ? low : (q > high) ? high : q;
+        dst[j] = (int32_t)q;
+    }
+}
+
+//Allocate DITHER struct
+//returns NULL after reporting the error (wavio_set_error_mode)
+DITHER *alloc_Dither(int16_t bits, int16_t channel, int type, uint64_t seed){
+    //allocate DITHER struct
+    DITHER *dither;
+
+    if(bits != 8 && bits != 16 && bits != 24 && bits != 32){
+        wavio_report_error(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+        return NULL;
+    }
+    if(channel < 1 || channel > 2){
+        wavio_report_error(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+        return NULL;
+    }
+
+    dither = (DITHER *)malloc(sizeof(DITHER));
+    if(dither == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the requantizer.");
+        return NULL;
+    }
+    dither->bits = bits;
+    dither->channel = channel;
+    dither->type = type;
+    dither->seed = seed;
+    dither->position = 0;
+    memset(dither->error, 0, sizeof(dither->error));
+
+    return dither;
+}
+
+//Free DITHER struct
+void free_Dither(DITHER *dither){
+    free(dither);
+}
+
+//Requantize frames of [-1, 1] channel arrays into NATIVE channel arrays
+//(8bit is unsigned like the files, the others are signed)
+void dither_Block(DITHER *dither, double **in, int32_t **out, int32_t frames){
+    double scale = (pow(2.0, dither->bits) - 1.0) / 2.0; /* [-1, 1] to steps */
+    double offset = (dither->bits == 8) ? scale : scale - pow(2.0, dither->bits - 1); /* -1 to the lowest code */
+    double low = (dither->bits == 8) ? 0.0 : -pow(2.0, dither->bits - 1); /* lowest code */
+    double high = (dither->bits == 8) ? 255.0 : pow(2.0, dither->bits - 1) - 1.0; /* highest code */
+    double noise[DITHER_CHUNK]; /* TPDF dither of the chunk (LSB) */
+    double v, q;
+    double *e;
+    uint64_t r;
+    int32_t i, j, n;
+    int c, k;
+
+    for(c = 0; c < dither->channel; c++){
+        const double *src = in[c];
+        int32_t *dst = out[c];
+        e = dither->error[c];
+
+        for(i = 0; i < frames; i += n){
+            n = (frames - i < DITHER_CHUNK) ? frames - i : DITHER_CHUNK;
+
+            //triangular noise: difference of two uniform numbers in [0, 1)
+            if(dither->type == DITHER_NONE){
+                for(j = 0; j < n; j++){
+                    noise[j] = 0.0;
+                }
+            }else{
+                for(j = 0; j < n; j++){
+                    r = dither_random(dither->seed, 2 * (dither->position + i + j) + c);
+                    noise[j] = ((double)(r >> 32) - (double)(r & 0xFFFFFFFFULL)) * (1.0 / 4294967296.0);
+                }
+            }
+
+            if(dither->type != DITHER_SHAPED){
+                //no feedback: each sample is independent
+                dither_quantize(src + i, noise, dst + i, n, scale, offset, low, high);
+            }else{
+                //error feedback pushes the requantization noise to where the ear is least sensitive
+                for(j = 0; j < n; j++){
+                    v = src[i + j];
+                    v = (v < -1.0) ? -1.0 : (v > 1.0) ? 1.0 : v;
+                    v = v * scale + offset;
+                    for(k = 0; k < DITHER_ORDER; k++){
+                        v -= dither_shape[k] * e[k];
+                    }
+                    q = (v + noise[j] + DITHER_ROUND) - DITHER_ROUND;
+                    q = (q < low) ? low : (q > high) ? high : q;
+                    dst[i + j] = (int32_t)q;
+
+                    memmove(e + 1, e, (DITHER_ORDER - 1) * sizeof(double));
+                    e[0] = q - v;
+                    e[0] = (e[0] < -4.0) ? -4.0 : (e[0] > 4.0) ? 4.0 : e[0];
+                }
+            }
+        }
+    }
+
+    dither->position += frames;
+}
+
+//Requantize MONO_PCM struct to bits (out is allocated by alloc_Mono_Native, and only filled in on success)
+void dither_Mono(MONO_PCM *in, MONO_PCM_NATIVE *out, int16_t bits, int type){
+    DITHER *dither = alloc_Dither(bits, 1, type, 0);
+    int32_t *data;
+
+    if(dither == NULL){
+        return;
+    }
+
+    //initialize the data vector
+    data = (int32_t *)calloc(in->pcm_spec.length > 0 ? in->pcm_spec.length : 1, sizeof(int32_t));
+    if(data == NULL){
+        free_Dither(dither);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+
+    //requantize
+    dither_Block(dither, &in->data, &data, in->pcm_spec.length);
+    free_Dither(dither);
+
+    //copy pcm_spec with the new quantization bits
+    out->pcm_spec.fs = in->pcm_spec.fs;
+    out->pcm_spec.bits = bits;
+    out->pcm_spec.length = in->pcm_spec.length;
+    out->data = data;
+}
+
+//Requantize STEREO_PCM struct to bits (out is allocated by alloc_Stereo_Native, and only filled in on success)
+void dither_Stereo(STEREO_PCM *in, STEREO_PCM_NATIVE *out, int16_t bits, int type){
+    DITHER *dither = alloc_Dither(bits, 2, type, 0);
+    int32_t *data[2];
+
+    if(dither == NULL){
+        return;
+    }
+
+    //initialize the data vector
+    data[0] = (int32_t *)calloc(in->pcm_spec.length > 0 ? in->pcm_spec.length : 1, sizeof(int32_t));
+    data[1] = (int32_t *)calloc(in->pcm_spec.length > 0 ? in->pcm_spec.length : 1, sizeof(int32_t));
+    if(data[0] == NULL || data[1] == NULL){
+        free(data[0]);
+        free(data[1]);
+        free_Dither(dither);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+
+    //requantize
+    dither_Block(dither, in->data, data, in->pcm_spec.length);
+    free_Dither(dither);
+
+    //copy pcm_spec with the new quantization bits
+    out->pcm_spec.fs = in->pcm_spec.fs;
+    out->pcm_spec.bits = bits;
+    out->pcm_spec.length = in->pcm_spec.length;
+    out->data[0] = data[0];
+    out->data[1] = data[1];
+}
+
+#ifdef __cplusplus
+}
+#endif
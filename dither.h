@@ -0,0 +1,50 @@
+/*dither.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_DITHER
+#define INCLUDED_DITHER
+
+#include <stdint.h>
+#include "wavio.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Requantization types
+#define DITHER_NONE 0 /* rounding only */
+#define DITHER_TPDF 1 /* triangular PDF dither (2 LSB peak to peak) */
+#define DITHER_SHAPED 2 /* TPDF dither with 9th order noise shaping (F-weighted, 44.1/48 kHz) */
+
+//order of the noise shaping filter
+#define DITHER_ORDER 9
+
+//Requantizer from [-1, 1] to NATIVE integers of the target bits
+typedef struct{
+    int16_t bits; /* target quantization bits */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    int type; /* DITHER_NONE, DITHER_TPDF or DITHER_SHAPED */
+    uint64_t seed; /* seed of the random sequence */
+    uint64_t position; /* frames already processed (position in the random sequence) */
+    double error[2][DITHER_ORDER]; /* past quantization errors (noise shaping) */
+} DITHER;
+
+//Prototype declaration for dither.c
+/* using DITHER struct (streaming) */
+DITHER *alloc_Dither(int16_t bits, int16_t channel, int type, uint64_t seed);
+void free_Dither(DITHER *dither);
+void dither_Block(DITHER *dither, double **in, int32_t **out, int32_t frames);
+
+/* using MONO_PCM and STEREO_PCM struct */
+void dither_Mono(MONO_PCM *in, MONO_PCM_NATIVE *out, int16_t bits, int type);
+void dither_Stereo(STEREO_PCM *in, STEREO_PCM_NATIVE *out, int16_t bits, int type);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
@@ -0,0 +1,449 @@
+/* fft.c (beta)*/
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+/* include prototype header file */
+#include "fft.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//Bit reversal table of n (power of 2), NULL if it cannot be allocated
+static int32_t *fft_bitrev(int32_t n){
+    int32_t *table = (int32_t *)malloc((n > 0 ? n : 1) * sizeof(int32_t));
+    int32_t i, j, bit;
+
+    if(table == NULL){
+        return NULL;
+    }
+    for(i = 0; i < n; i++){
+        j = 0;
+        for(bit = 1; bit < n; bit <<= 1){
+            j = (j << 1) | ((i & bit) ? 1 : 0);
+        }
+        table[i] = j;
+    }
+
+    return table;
+}
+
+//Radix-2 butterflies of one block (contiguous data and twiddles, so the loop vectorizes)
+static void fft_butterfly(double *ar, double *ai, double *br, double *bi, const double *wr, const double *wi, int32_t h){
+    double tr, ti;
+    int32_t k;
+
+    for(k = 0; k < h; k++){
+        tr = br[k] * wr[k] - bi[k] * wi[k];
+        ti = br[k] * wi[k] + bi[k] * wr[k];
+        br[k] = ar[k] - tr;
+        bi[k] = ai[k] - ti;
+        ar[k] += tr;
+        ai[k] += ti;
+    }
+}
+
+//In-place complex FFT of n points (n divides plan->n)
+static void fft_core(const FFT_PLAN *plan, double *re, double *im, int32_t n, const int32_t *bitrev){
+    double t;
+    int32_t i, j, h, s;
+
+    //bit reversal permutation
+    for(i = 0; i < n; i++){
+        j = bitrev[i];
+        if(i < j){
+            t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    //first stage (twiddle 1)
+    for(s = 0; s + 1 < n; s += 2){
+        t = re[s + 1];
+        re[s + 1] = re[s] - t;
+        re[s] += t;
+        t = im[s + 1];
+        im[s + 1] = im[s] - t;
+        im[s] += t;
+    }
+
+    //the other stages
+    for(h = 2; h < n; h *= 2){
+        for(s = 0; s < n; s += 2 * h){
+            fft_butterfly(re + s, im + s, re + s + h, im + s + h, plan->tw_re + h - 1, plan->tw_im + h - 1, h);
+        }
+    }
+}
+
+//Allocate FFT_PLAN struct (n: power of 2, at least 2)
+//returns NULL after reporting the error (wavio_set_error_mode)
+FFT_PLAN *alloc_FFT(int32_t n){
+    //allocate FFT_PLAN struct
+    FFT_PLAN *plan;
+    int32_t h, k;
+
+    if(n < 2 || (n & (n - 1)) != 0){
+        wavio_report_error(WAVIO_ERROR_ARGUMENT, "FFT size must be a power of 2.");
+        return NULL;
+    }
+
+    plan = (FFT_PLAN *)malloc(sizeof(FFT_PLAN));
+    if(plan == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the FFT plan.");
+        return NULL;
+    }
+    plan->n = n;
+
+    //tables and work buffers
+    plan->tw_re = (double *)malloc(n * sizeof(double));
+    plan->tw_im = (double *)malloc(n * sizeof(double));
+    plan->bitrev = fft_bitrev(n);
+    plan->bitrev_half = fft_bitrev(n / 2);
+    plan->work_re = (double *)malloc(n * sizeof(double));
+    plan->work_im = (double *)malloc(n * sizeof(double));
+    if(plan->tw_re == NULL || plan->tw_im == NULL || plan->bitrev == NULL || plan->bitrev_half == NULL || plan->work_re == NULL || plan->work_im == NULL){
+        free_FFT(plan);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the FFT plan.");
+        return NULL;
+    }
+
+    //twiddles exp(-i * pi * k / h) of every stage
+    for(h = 1; h < n; h *= 2){
+        for(k = 0; k < h; k++){
+            plan->tw_re[h - 1 + k] = cos(M_PI * k / h);
+            plan->tw_im[h - 1 + k] = -sin(M_PI * k / h);
+        }
+    }
+
+    return plan;
+}
+
+//Free FFT_PLAN struct
+void free_FFT(FFT_PLAN *plan){
+    //free tables and work buffers
+    free(plan->tw_re);
+    free(plan->tw_im);
+    free(plan->bitrev);
+    free(plan->bitrev_half);
+    free(plan->work_re);
+    free(plan->work_im);
+
+    //free FFT_PLAN struct
+    free(plan);
+}
+
+//Complex forward FFT (in place, n points)
+void fft_Forward(FFT_PLAN *plan, double *re, double *im){
+    fft_core(plan, re, im, plan->n, plan->bitrev);
+}
+
+//Complex inverse FFT (in place, n points, scaled by 1 / n)
+void fft_Inverse(FFT_PLAN *plan, double *re, double *im){
+    double scale = 1.0 / plan->n;
+    int32_t i;
+
+    //swapping the real and imaginary parts turns the forward transform into the inverse
+    fft_core(plan, im, re, plan->n, plan->bitrev);
+
+    for(i = 0; i < plan->n; i++){
+        re[i] *= scale;
+        im[i] *= scale;
+    }
+}
+
+//Real forward FFT (n samples to n / 2 + 1 bins) via an n / 2 point complex FFT
+void fft_Real(FFT_PLAN *plan, const double *in, double *re, double *im){
+    int32_t half = plan->n / 2;
+    double *zr = plan->work_re;
+    double *zi = plan->work_im;
+    const double *wr = plan->tw_re + half - 1; /* exp(-2 * pi * i * k / n) */
+    const double *wi = plan->tw_im + half - 1;
+    double er, ei, or_, oi, cr, ci;
+    int32_t k;
+
+    //pack even samples into the real part, odd samples into the imaginary part
+    for(k = 0; k < half; k++){
+        zr[k] = in[2 * k];
+        zi[k] = in[2 * k + 1];
+    }
+    fft_core(plan, zr, zi, half, plan->bitrev_half);
+
+    //DC and Nyquist
+    re[0] = zr[0] + zi[0];
+    im[0] = 0.0;
+    re[half] = zr[0] - zi[0];
+    im[half] = 0.0;
+
+    //split the even and odd spectra
+    for(k = 1; k < half; k++){
+        cr = zr[half - k];
+        ci = -zi[half - k];
+        er = 0.5 * (zr[k] + cr);
+        ei = 0.5 * (zi[k] + ci);
+        or_ = 0.5 * (zi[k] - ci);
+        oi = -0.5 * (zr[k] - cr);
+        re[k] = er + or_ * wr[k] - oi * wi[k];
+        im[k] = ei + or_ * wi[k] + oi * wr[k];
+    }
+}
+
+//Real inverse FFT (n / 2 + 1 bins to n samples, scaled by 1 / n)
+void fft_Real_Inverse(FFT_PLAN *plan, const double *re, const double *im, double *out){
+    int32_t half = plan->n / 2;
+    double *zr = plan->work_re;
+    double *zi = plan->work_im;
+    const double *wr = plan->tw_re + half - 1; /* exp(-2 * pi * i * k / n) */
+    const double *wi = plan->tw_im + half - 1;
+    double er, ei, dr, di, or_, oi;
+    double scale = 1.0 / half;
+    int32_t k;
+
+    //rebuild the spectrum of the packed even/odd sequence
+    for(k = 0; k < half; k++){
+        er = 0.5 * (re[k] + re[half - k]);
+        ei = 0.5 * (im[k] - im[half - k]);
+        dr = 0.5 * (re[k] - re[half - k]);
+        di = 0.5 * (im[k] + im[half - k]);
+        or_ = dr * wr[k] + di * wi[k];
+        oi = di * wr[k] - dr * wi[k];
+        zr[k] = er - oi;
+        zi[k] = ei + or_;
+    }
+
+    //inverse n / 2 point FFT (swapped real and imaginary parts)
+    fft_core(plan, zi, zr, half, plan->bitrev_half);
+
+    for(k = 0; k < half; k++){
+        out[2 * k] = zr[k] * scale;
+        out[2 * k + 1] = zi[k] * scale;
+    }
+}
+
+//Window one frame and transform it
+static void stft_frame(FFT_PLAN *plan, const double *window, const double *src, double *frame, double *re, double *im){
+    int32_t i;
+
+    for(i = 0; i < plan->n; i++){
+        frame[i] = src[i] * window[i];
+    }
+    fft_Real(plan, frame, re, im);
+}
+
+//Periodic Hann window (NULL if it cannot be allocated)
+static double *stft_window(int32_t size){
+    double *window = (double *)malloc(size * sizeof(double));
+    int32_t i;
+
+    if(window == NULL){
+        return NULL;
+    }
+    for(i = 0; i < size; i++){
+        window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / size);
+    }
+
+    return window;
+}
+
+//Allocate STFT struct (size: power of 2, hop: samples between frames)
+//returns NULL after reporting the error (wavio_set_error_mode)
+STFT *alloc_STFT(int32_t size, int32_t hop){
+    //allocate STFT struct
+    STFT *stft;
+    FFT_PLAN *plan;
+
+    if(hop < 1){
+        wavio_report_error(WAVIO_ERROR_ARGUMENT, "STFT hop size must be positive.");
+        return NULL;
+    }
+
+    plan = alloc_FFT(size);
+    if(plan == NULL){
+        return NULL;
+    }
+    stft = (STFT *)malloc(sizeof(STFT));
+    if(stft == NULL){
+        free_FFT(plan);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the STFT.");
+        return NULL;
+    }
+    stft->plan = plan;
+    stft->size = size;
+    stft->hop = hop;
+    stft->window = stft_window(size);
+    stft->frame = (double *)malloc(size * sizeof(double));
+    stft->cap = 2 * size;
+    stft->buffer = (double *)malloc(stft->cap * sizeof(double));
+    if(stft->window == NULL || stft->frame == NULL || stft->buffer == NULL){
+        free_STFT(stft);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the STFT.");
+        return NULL;
+    }
+    stft->fill = 0;
+    stft->skip = 0;
+    stft->position = 0;
+
+    return stft;
+}
+
+//Free STFT struct
+void free_STFT(STFT *stft){
+    //free plan and buffers
+    free_FFT(stft->plan);
+    free(stft->window);
+    free(stft->frame);
+    free(stft->buffer);
+
+    //free STFT struct
+    free(stft);
+}
+
+//Append samples (e.g. a block from wavread_Reader) to the STFT
+//returns -1 after reporting the error if the buffer cannot grow (the samples already pushed are kept)
+int stft_Push(STFT *stft, const double *in, int32_t len){
+    double *grown;
+    int32_t cap;
+
+    //samples between frames when hop is larger than size
+    if(stft->skip > 0){
+        int32_t n = (len < stft->skip) ? len : stft->skip;
+        in += n;
+        len -= n;
+        stft->skip -= n;
+    }
+
+    if(stft->fill + len > stft->cap){
+        cap = 2 * (stft->fill + len);
+        grown = (double *)realloc(stft->buffer, cap * sizeof(double));
+        if(grown == NULL){
+            return wavio_report_error(WAVIO_ERROR_IO, "Cannot grow the STFT buffer.");
+        }
+        stft->buffer = grown;
+        stft->cap = cap;
+    }
+    memcpy(stft->buffer + stft->fill, in, len * sizeof(double));
+    stft->fill += len;
+
+    return 0;
+}
+
+//Produce the next frame (re, im: size / 2 + 1 bins)
+//returns 1 if a frame was produced, 0 if more samples are needed
+int stft_Next(STFT *stft, double *re, double *im){
+    if(stft->fill < stft->size){
+        return 0;
+    }
+
+    stft_frame(stft->plan, stft->window, stft->buffer, stft->frame, re, im);
+
+    //advance by hop
+    if(stft->hop < stft->fill){
+        memmove(stft->buffer, stft->buffer + stft->hop, (stft->fill - stft->hop) * sizeof(double));
+        stft->fill -= stft->hop;
+    }else{
+        stft->skip = stft->hop - stft->fill;
+        stft->fill = 0;
+    }
+    stft->position++;
+
+    return 1;
+}
+
+//Allocate SPECTROGRAM struct
+SPECTROGRAM *alloc_Spectrogram(void){
+    //allocate SPECTROGRAM struct
+    SPECTROGRAM *spectrogram = (SPECTROGRAM *)malloc(sizeof(SPECTROGRAM));
+
+    if(spectrogram == NULL){
+        return NULL;
+    }
+
+    //pointer for data vector
+    spectrogram->re = NULL;
+    spectrogram->im = NULL;
+
+    return spectrogram;
+}
+
+//Free SPECTROGRAM struct
+void free_Spectrogram(SPECTROGRAM *spectrogram){
+    //free data vector
+    free(spectrogram->re);
+    free(spectrogram->im);
+
+    //free SPECTROGRAM struct
+    free(spectrogram);
+}
+
+//STFT of one channel array into SPECTROGRAM struct (frames start at 0, no padding)
+//returns -1 after reporting the error (out is left without frames)
+static int stft_channel(const double *data, int32_t length, uint64_t fs, SPECTROGRAM *out, FFT_PLAN *plan, const double *window, double *frame){
+    int32_t size = plan->n;
+    int32_t f;
+
+    //copy properties
+    out->fs = fs;
+    out->size = size;
+    out->frames = (length >= size) ? 1 + (length - size) / out->hop : 0;
+    out->bins = size / 2 + 1;
+
+    //initialize the data vector
+    out->re = (double *)calloc((size_t)out->frames * out->bins + 1, sizeof(double));
+    out->im = (double *)calloc((size_t)out->frames * out->bins + 1, sizeof(double));
+    if(out->re == NULL || out->im == NULL){
+        free(out->re);
+        free(out->im);
+        out->re = out->im = NULL;
+        out->frames = 0;
+        return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the spectrogram.");
+    }
+
+    for(f = 0; f < out->frames; f++){
+        stft_frame(plan, window, data + (size_t)f * out->hop, frame, out->re + (size_t)f * out->bins, out->im + (size_t)f * out->bins);
+    }
+
+    return 0;
+}
+
+//STFT of MONO_PCM struct (out is allocated by alloc_Spectrogram)
+void stft_Mono(MONO_PCM *in, SPECTROGRAM *out, int32_t size, int32_t hop){
+    STFT *stft = alloc_STFT(size, hop);
+
+    if(stft == NULL){
+        return;
+    }
+    out->hop = hop;
+    stft_channel(in->data, in->pcm_spec.length, in->pcm_spec.fs, out, stft->plan, stft->window, stft->frame);
+
+    free_STFT(stft);
+}
+
+//STFT of each channel of STEREO_PCM struct (left and right are allocated by alloc_Spectrogram)
+void stft_Stereo(STEREO_PCM *in, SPECTROGRAM *left, SPECTROGRAM *right, int32_t size, int32_t hop){
+    STFT *stft = alloc_STFT(size, hop);
+
+    if(stft == NULL){
+        return;
+    }
+    left->hop = hop;
+    right->hop = hop;
+    if(stft_channel(in->data[0], in->pcm_spec.length, in->pcm_spec.fs, left, stft->plan, stft->window, stft->frame) == 0){
+        stft_channel(in->data[1], in->pcm_spec.length, in->pcm_spec.fs, right, stft->plan, stft->window, stft->frame);
+    }
+
+    free_STFT(stft);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,79 @@
+/*fft.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_FFT
+#define INCLUDED_FFT
+
+#include <stdint.h>
+#include "wavio.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//FFT plan (n: power of 2, complex n-point and real n-point transforms)
+typedef struct{
+    int32_t n; /* transform size */
+    double *tw_re; /* twiddles of every stage (stage with half size h starts at h - 1) */
+    double *tw_im;
+    int32_t *bitrev; /* bit reversal of n */
+    int32_t *bitrev_half; /* bit reversal of n / 2 (real transforms) */
+    double *work_re; /* work buffers (real transforms) */
+    double *work_im;
+} FFT_PLAN;
+
+//Short-time Fourier transform (streaming)
+typedef struct{
+    FFT_PLAN *plan; /* plan of the frame size */
+    int32_t size; /* frame size (power of 2) */
+    int32_t hop; /* hop size */
+    double *window; /* analysis window (periodic Hann) */
+    double *frame; /* windowed frame */
+    double *buffer; /* samples not yet consumed */
+    int32_t fill; /* samples in buffer */
+    int32_t cap; /* capacity of buffer */
+    int32_t skip; /* samples still to be skipped (hop larger than size) */
+    uint64_t position; /* frames produced */
+} STFT;
+
+//Spectrogram (frames x bins, bins = size / 2 + 1)
+typedef struct{
+    uint64_t fs; /* Sampling frequency */
+    int32_t size; /* frame size */
+    int32_t hop; /* hop size */
+    int32_t frames; /* number of frames */
+    int32_t bins; /* bins per frame */
+    double *re; /* real part (frame-major) */
+    double *im; /* imaginary part (frame-major) */
+} SPECTROGRAM;
+
+//Prototype declaration for fft.c
+/* using FFT_PLAN struct */
+FFT_PLAN *alloc_FFT(int32_t n);
+void free_FFT(FFT_PLAN *plan);
+void fft_Forward(FFT_PLAN *plan, double *re, double *im);
+void fft_Inverse(FFT_PLAN *plan, double *re, double *im);
+void fft_Real(FFT_PLAN *plan, const double *in, double *re, double *im);
+void fft_Real_Inverse(FFT_PLAN *plan, const double *re, const double *im, double *out);
+
+/* using STFT struct (streaming) */
+STFT *alloc_STFT(int32_t size, int32_t hop);
+void free_STFT(STFT *stft);
+int stft_Push(STFT *stft, const double *in, int32_t len);
+int stft_Next(STFT *stft, double *re, double *im);
+
+/* using SPECTROGRAM struct */
+SPECTROGRAM *alloc_Spectrogram(void);
+void free_Spectrogram(SPECTROGRAM *spectrogram);
+void stft_Mono(MONO_PCM *in, SPECTROGRAM *out, int32_t size, int32_t hop);
+void stft_Stereo(STEREO_PCM *in, SPECTROGRAM *left, SPECTROGRAM *right, int32_t size, int32_t hop);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
@@ -0,0 +1,584 @@
+/* filter.c (beta)*/
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+/* include prototype header file */
+#include "filter.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//partition size limits of alloc_FIR_Kernel (partition = 0 chooses one between them)
+#define FIR_MIN_PARTITION 64
+#define FIR_MAX_PARTITION 8192
+
+//states below this are flushed to zero at the end of a block (denormals are very slow)
+#define FILTER_DENORMAL 1e-30
+
+//Design one biquad (f0: cutoff or center frequency, q: quality factor, gain: dB for peaking and shelves)
+//returns -1 after reporting an unknown type (wavio_set_error_mode), biquad is untouched then
+int biquad_Design(BIQUAD *biquad, int type, uint64_t fs, double f0, double q, double gain){
+    double w0 = 2.0 * M_PI * f0 / fs;
+    double cw = cos(w0);
+    double alpha = sin(w0) / (2.0 * q);
+    double A = pow(10.0, gain / 40.0);
+    double sq = 2.0 * sqrt(A) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+
+    switch(type){
+        case FILTER_LOWPASS:
+            b0 = (1.0 - cw) / 2.0; b1 = 1.0 - cw; b2 = (1.0 - cw) / 2.0;
+            a0 = 1.0 + alpha; a1 = -2.0 * cw; a2 = 1.0 - alpha;
+            break;
+        case FILTER_HIGHPASS:
+            b0 = (1.0 + cw) / 2.0; b1 = -(1.0 + cw); b2 = (1.0 + cw) / 2.0;
+            a0 = 1.0 + alpha; a1 = -2.0 * cw; a2 = 1.0 - alpha;
+            break;
+        case FILTER_BANDPASS:
+            b0 = alpha; b1 = 0.0; b2 = -alpha;
+            a0 = 1.0 + alpha; a1 = -2.0 * cw; a2 = 1.0 - alpha;
+            break;
+        case FILTER_NOTCH:
+            b0 = 1.0; b1 = -2.0 * cw; b2 = 1.0;
+            a0 = 1.0 + alpha; a1 = -2.0 * cw; a2 = 1.0 - alpha;
+            break;
+        case FILTER_ALLPASS:
+            b0 = 1.0 - alpha; b1 = -2.0 * cw; b2 = 1.0 + alpha;
+            a0 = 1.0 + alpha; a1 = -2.0 * cw; a2 = 1.0 - alpha;
+            break;
+        case FILTER_PEAKING:
+            b0 = 1.0 + alpha * A; b1 = -2.0 * cw; b2 = 1.0 - alpha * A;
+            a0 = 1.0 + alpha / A; a1 = -2.0 * cw; a2 = 1.0 - alpha / A;
+            break;
+        case FILTER_LOWSHELF:
+            b0 = A * ((A + 1.0) - (A - 1.0) * cw + sq);
+            b1 = 2.0 * A * ((A - 1.0) - (A + 1.0) * cw);
+            b2 = A * ((A + 1.0) - (A - 1.0) * cw - sq);
+            a0 = (A + 1.0) + (A - 1.0) * cw + sq;
+            a1 = -2.0 * ((A - 1.0) + (A + 1.0) * cw);
+            a2 = (A + 1.0) + (A - 1.0) * cw - sq;
+            break;
+        case FILTER_HIGHSHELF:
+            b0 = A * ((A + 1.0) + (A - 1.0) * cw + sq);
+            b1 = -2.0 * A * ((A - 1.0) + (A + 1.0) * cw);
+            b2 = A * ((A + 1.0) + (A - 1.0) * cw - sq);
+            a0 = (A + 1.0) - (A - 1.0) * cw + sq;
+            a1 = 2.0 * ((A - 1.0) - (A + 1.0) * cw);
+            a2 = (A + 1.0) - (A - 1.0) * cw - sq;
+            break;
+        default:
+            return wavio_report_error(WAVIO_ERROR_ARGUMENT, "Inappropriate filter type.");
+    }
+
+    biquad->b0 = b0 / a0;
+    biquad->b1 = b1 / a0;
+    biquad->b2 = b2 / a0;
+    biquad->a1 = a1 / a0;
+    biquad->a2 = a2 / a0;
+
+    return 0;
+}
+
+//Allocate IIR struct (coefficients are copied)
+//returns NULL after reporting the error (wavio_set_error_mode)
+IIR *alloc_IIR(const BIQUAD *coef, int32_t sections, int16_t channel){
+    //allocate IIR struct
+    IIR *iir;
+    int16_t ch;
+
+    if(sections < 1){
+        wavio_report_error(WAVIO_ERROR_ARGUMENT, "Inappropriate filter parameter.");
+        return NULL;
+    }
+    if(channel < 1 || channel > 2){
+        wavio_report_error(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+        return NULL;
+    }
+
+    iir = (IIR *)malloc(sizeof(IIR));
+    if(iir == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the filter.");
+        return NULL;
+    }
+    iir->sections = sections;
+    iir->channel = channel;
+    iir->coef = (BIQUAD *)malloc(sections * sizeof(BIQUAD));
+
+    //initialize the state
+    for(ch = 0; ch < 2; ch++){
+        iir->state[ch] = (ch < channel) ? (double *)calloc(2 * sections, sizeof(double)) : NULL;
+    }
+    if(iir->coef == NULL || iir->state[0] == NULL || (channel == 2 && iir->state[1] == NULL)){
+        free_IIR(iir);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the filter.");
+        return NULL;
+    }
+    memcpy(iir->coef, coef, sections * sizeof(BIQUAD));
+
+    return iir;
+}
+
+//Free IIR struct
+void free_IIR(IIR *iir){
+    //free coefficients and state
+    free(iir->coef);
+    free(iir->state[0]);
+    free(iir->state[1]);
+
+    //free IIR struct
+    free(iir);
+}
+
+//Clear the state of IIR struct
+void iir_Reset(IIR *iir){
+    int16_t ch;
+
+    for(ch = 0; ch < iir->channel; ch++){
+        memset(iir->state[ch], 0, 2 * iir->sections * sizeof(double));
+    }
+}
+
+//Filter consecutive frames of channel arrays in place
+void iir_Block(IIR *iir, double **data, int32_t frames){
+    const BIQUAD *c;
+    double *x, *z;
+    double x0, y0, z1, z2;
+    int32_t s, i;
+    int16_t ch;
+
+    for(ch = 0; ch < iir->channel; ch++){
+        x = data[ch];
+
+        //one section over the whole block at a time (coefficients and state stay in registers)
+        for(s = 0; s < iir->sections; s++){
+            c = iir->coef + s;
+            z = iir->state[ch] + 2 * s;
+            z1 = z[0];
+            z2 = z[1];
+            for(i = 0; i < frames; i++){
+                x0 = x[i];
+                y0 = c->b0 * x0 + z1;
+                z1 = c->b1 * x0 - c->a1 * y0 + z2;
+                z2 = c->b2 * x0 - c->a2 * y0;
+                x[i] = y0;
+            }
+            z[0] = (fabs(z1) < FILTER_DENORMAL) ? 0.0 : z1;
+            z[1] = (fabs(z2) < FILTER_DENORMAL) ? 0.0 : z2;
+        }
+    }
+}
+
+//Filter MONO_PCM struct in place (state is kept, so consecutive buffers are filtered seamlessly)
+//returns -1 after reporting a channel mismatch (wavio_set_error_mode)
+int iir_Mono(IIR *iir, MONO_PCM *pcm){
+    if(iir->channel != 1){
+        return wavio_report_error(WAVIO_ERROR_CHANNEL, "Channel number of the filter does not match.");
+    }
+
+    iir_Block(iir, &pcm->data, pcm->pcm_spec.length);
+
+    return 0;
+}
+
+//Filter STEREO_PCM struct in place (state is kept, so consecutive buffers are filtered seamlessly)
+//returns -1 after reporting a channel mismatch (wavio_set_error_mode)
+int iir_Stereo(IIR *iir, STEREO_PCM *pcm){
+    if(iir->channel != 2){
+        return wavio_report_error(WAVIO_ERROR_CHANNEL, "Channel number of the filter does not match.");
+    }
+
+    iir_Block(iir, pcm->data, pcm->pcm_spec.length);
+
+    return 0;
+}
+
+//Allocate FIR_KERNEL struct (partition: power of 2, or 0 to choose from the number of taps)
+//returns NULL after reporting the error (wavio_set_error_mode)
+FIR_KERNEL *alloc_FIR_Kernel(const double *h, int32_t taps, int32_t partition){
+    //allocate FIR_KERNEL struct
+    FIR_KERNEL *kernel;
+    FFT_PLAN *plan;
+    double *frame;
+    int32_t bins, p, i, n;
+
+    if(taps < 1 || partition < 0 || (partition & (partition - 1)) != 0){
+        wavio_report_error(WAVIO_ERROR_ARGUMENT, "Inappropriate filter parameter.");
+        return NULL;
+    }
+
+    //direct cost (partition per sample) balances FFT cost (about 4 x parts per sample)
+    if(partition == 0){
+        partition = FIR_MIN_PARTITION;
+        while(partition < FIR_MAX_PARTITION && (int64_t)partition * partition < 4 * (int64_t)taps){
+            partition *= 2;
+        }
+    }
+
+    kernel = (FIR_KERNEL *)malloc(sizeof(FIR_KERNEL));
+    if(kernel == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the filter.");
+        return NULL;
+    }
+    kernel->taps = taps;
+    kernel->partition = partition;
+    kernel->parts = (taps + partition - 1) / partition;
+    kernel->head = (taps < partition) ? taps : partition;
+
+    //first partition, reversed for the direct part
+    bins = partition + 1;
+    kernel->head_taps = (double *)malloc(kernel->head * sizeof(double));
+    kernel->spec_re = (double *)malloc((size_t)kernel->parts * bins * sizeof(double));
+    kernel->spec_im = (double *)malloc((size_t)kernel->parts * bins * sizeof(double));
+    frame = (double *)calloc(2 * partition, sizeof(double));
+    if(kernel->head_taps == NULL || kernel->spec_re == NULL || kernel->spec_im == NULL || frame == NULL){
+        free(frame);
+        free_FIR_Kernel(kernel);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the filter.");
+        return NULL;
+    }
+    plan = alloc_FFT(2 * partition);
+    if(plan == NULL){
+        free(frame);
+        free_FIR_Kernel(kernel);
+        return NULL;
+    }
+    for(i = 0; i < kernel->head; i++){
+        kernel->head_taps[i] = h[kernel->head - 1 - i];
+    }
+
+    //spectra of the zero padded partitions
+    for(p = 0; p < kernel->parts; p++){
+        n = (taps - p * partition < partition) ? taps - p * partition : partition;
+        memset(frame, 0, 2 * partition * sizeof(double));
+        memcpy(frame, h + (size_t)p * partition, n * sizeof(double));
+        fft_Real(plan, frame, kernel->spec_re + (size_t)p * bins, kernel->spec_im + (size_t)p * bins);
+    }
+    free(frame);
+    free_FFT(plan);
+
+    return kernel;
+}
+
+//Free FIR_KERNEL struct
+void free_FIR_Kernel(FIR_KERNEL *kernel){
+    //free taps and spectra
+    free(kernel->head_taps);
+    free(kernel->spec_re);
+    free(kernel->spec_im);
+
+    //free FIR_KERNEL struct
+    free(kernel);
+}
+
+//Allocate FIR struct (the kernel must outlive it)
+//returns NULL after reporting the error (wavio_set_error_mode)
+FIR *alloc_FIR(FIR_KERNEL *kernel, int16_t channel){
+    //allocate FIR struct
+    FIR *fir;
+    int32_t B = kernel->partition;
+    size_t spec = (size_t)kernel->parts * (B + 1);
+    int16_t ch;
+
+    if(channel < 1 || channel > 2){
+        wavio_report_error(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+        return NULL;
+    }
+
+    fir = (FIR *)malloc(sizeof(FIR));
+    if(fir == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the filter.");
+        return NULL;
+    }
+    fir->kernel = kernel;
+    fir->channel = channel;
+
+    //initialize the state
+    for(ch = 0; ch < 2; ch++){
+        if(ch < channel){
+            fir->line[ch] = (double *)calloc(kernel->head - 1 + B, sizeof(double));
+            fir->block[ch] = (double *)calloc(2 * B, sizeof(double));
+            fir->tail[ch] = (double *)calloc(B, sizeof(double));
+            fir->fdl_re[ch] = (double *)calloc(spec, sizeof(double));
+            fir->fdl_im[ch] = (double *)calloc(spec, sizeof(double));
+        }else{
+            fir->line[ch] = NULL;
+            fir->block[ch] = NULL;
+            fir->tail[ch] = NULL;
+            fir->fdl_re[ch] = NULL;
+            fir->fdl_im[ch] = NULL;
+        }
+    }
+    fir->acc_re = (double *)malloc((B + 1) * sizeof(double));
+    fir->acc_im = (double *)malloc((B + 1) * sizeof(double));
+    fir->frame = (double *)malloc(2 * B * sizeof(double));
+    fir->plan = NULL;
+    fir->pos = 0;
+    fir->ring = 0;
+    for(ch = 0; ch < channel; ch++){
+        if(fir->line[ch] == NULL || fir->block[ch] == NULL || fir->tail[ch] == NULL || fir->fdl_re[ch] == NULL || fir->fdl_im[ch] == NULL){
+            break;
+        }
+    }
+    if(ch < channel || fir->acc_re == NULL || fir->acc_im == NULL || fir->frame == NULL){
+        free_FIR(fir);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the filter.");
+        return NULL;
+    }
+    fir->plan = alloc_FFT(2 * B);
+    if(fir->plan == NULL){
+        free_FIR(fir);
+        return NULL;
+    }
+
+    return fir;
+}
+
+//Free FIR struct
+void free_FIR(FIR *fir){
+    int16_t ch;
+
+    //free state
+    for(ch = 0; ch < 2; ch++){
+        free(fir->line[ch]);
+        free(fir->block[ch]);
+        free(fir->tail[ch]);
+        free(fir->fdl_re[ch]);
+        free(fir->fdl_im[ch]);
+    }
+    free(fir->acc_re);
+    free(fir->acc_im);
+    free(fir->frame);
+    if(fir->plan != NULL){
+        free_FFT(fir->plan);
+    }
+
+    //free FIR struct
+    free(fir);
+}
+
+//Clear the state of FIR struct
+void fir_Reset(FIR *fir){
+    FIR_KERNEL *kernel = fir->kernel;
+    int32_t B = kernel->partition;
+    size_t spec = (size_t)kernel->parts * (B + 1);
+    int16_t ch;
+
+    for(ch = 0; ch < fir->channel; ch++){
+        memset(fir->line[ch], 0, (kernel->head - 1 + B) * sizeof(double));
+        memset(fir->block[ch], 0, 2 * B * sizeof(double));
+        memset(fir->tail[ch], 0, B * sizeof(double));
+        memset(fir->fdl_re[ch], 0, spec * sizeof(double));
+        memset(fir->fdl_im[ch], 0, spec * sizeof(double));
+    }
+    fir->pos = 0;
+    fir->ring = 0;
+}
+
+//Direct convolution of n outputs (8 outputs per pass held in registers: one vector load and multiply-add per tap, no reassociation needed)
+static void fir_direct(const double *taps, int32_t head, const double *line, double *out, int32_t n){
+    double a0, a1, a2, a3, a4, a5, a6, a7, t;
+    const double *x;
+    int32_t i, k;
+
+    for(i = 0; i + 8 <= n; i += 8){
+        a0 = a1 = a2 = a3 = a4 = a5 = a6 = a7 = 0.0;
+        x = line + i;
+        for(k = 0; k < head; k++){
+            t = taps[k];
+            a0 += t * x[k];
+            a1 += t * x[k + 1];
+            a2 += t * x[k + 2];
+            a3 += t * x[k + 3];
+            a4 += t * x[k + 4];
+            a5 += t * x[k + 5];
+            a6 += t * x[k + 6];
+            a7 += t * x[k + 7];
+        }
+        out[i] = a0;
+        out[i + 1] = a1;
+        out[i + 2] = a2;
+        out[i + 3] = a3;
+        out[i + 4] = a4;
+        out[i + 5] = a5;
+        out[i + 6] = a6;
+        out[i + 7] = a7;
+    }
+
+    //remaining outputs
+    for(; i < n; i++){
+        a0 = 0.0;
+        for(k = 0; k < head; k++){
+            a0 += taps[k] * line[i + k];
+        }
+        out[i] = a0;
+    }
+}
+
+//Spectrum multiply-accumulate (acc += h x)
+static void fir_accumulate(double *acc_re, double *acc_im, const double *h_re, const double *h_im, const double *x_re, const double *x_im, int32_t bins){
+    int32_t k;
+
+    for(k = 0; k < bins; k++){
+        acc_re[k] += h_re[k] * x_re[k] - h_im[k] * x_im[k];
+        acc_im[k] += h_re[k] * x_im[k] + h_im[k] * x_re[k];
+    }
+}
+
+//Input block of one channel is complete: compute the FFT part of the next block (overlap-save)
+static void fir_next_block(FIR *fir, int16_t ch){
+    FIR_KERNEL *kernel = fir->kernel;
+    int32_t B = kernel->partition;
+    int32_t bins = B + 1;
+    int32_t p, slot;
+
+    //spectrum of the previous and current input block
+    fft_Real(fir->plan, fir->block[ch], fir->fdl_re[ch] + (size_t)fir->ring * bins, fir->fdl_im[ch] + (size_t)fir->ring * bins);
+    memcpy(fir->block[ch], fir->block[ch] + B, B * sizeof(double));
+
+    //partition p (p >= 1) meets the input block p - 1 blocks before the newest one
+    memset(fir->acc_re, 0, bins * sizeof(double));
+    memset(fir->acc_im, 0, bins * sizeof(double));
+    for(p = 1; p < kernel->parts; p++){
+        slot = (fir->ring - (p - 1) + kernel->parts) % kernel->parts;
+        fir_accumulate(fir->acc_re, fir->acc_im, kernel->spec_re + (size_t)p * bins, kernel->spec_im + (size_t)p * bins,
+                       fir->fdl_re[ch] + (size_t)slot * bins, fir->fdl_im[ch] + (size_t)slot * bins, bins);
+    }
+
+    //the last half of the circular convolution is the linear one
+    fft_Real_Inverse(fir->plan, fir->acc_re, fir->acc_im, fir->frame);
+    memcpy(fir->tail[ch], fir->frame + B, B * sizeof(double));
+}
+
+//Filter consecutive frames of channel arrays in place (any number of frames per call)
+void fir_Block(FIR *fir, double **data, int32_t frames){
+    FIR_KERNEL *kernel = fir->kernel;
+    int32_t B = kernel->partition;
+    int32_t head = kernel->head;
+    int32_t done = 0;
+    int32_t n, pos, i;
+    double *x, *line;
+    int16_t ch;
+
+    while(done < frames){
+        //up to the end of the current block
+        pos = fir->pos;
+        n = (frames - done < B - pos) ? frames - done : B - pos;
+
+        for(ch = 0; ch < fir->channel; ch++){
+            x = data[ch] + done;
+            line = fir->line[ch];
+
+            //keep the input for both parts before overwriting it
+            memcpy(line + head - 1, x, n * sizeof(double));
+            if(kernel->parts > 1){
+                memcpy(fir->block[ch] + B + pos, x, n * sizeof(double));
+            }
+
+            //direct part plus the FFT part of the other partitions
+            fir_direct(kernel->head_taps, head, line, x, n);
+            if(kernel->parts > 1){
+                for(i = 0; i < n; i++){
+                    x[i] += fir->tail[ch][pos + i];
+                }
+            }
+            memmove(line, line + n, (head - 1) * sizeof(double));
+
+            if(pos + n == B && kernel->parts > 1){
+                fir_next_block(fir, ch);
+            }
+        }
+
+        fir->pos = (pos + n == B) ? 0 : pos + n;
+        if(pos + n == B && kernel->parts > 1){
+            fir->ring = (fir->ring + 1) % kernel->parts;
+        }
+        done += n;
+    }
+}
+
+//Full linear convolution of one channel by overlap-save (y: out_len samples, in_len + taps - 1 keeps the whole tail)
+//every partition goes through the FFT (a block of latency does not matter for a whole signal), returns -1 after reporting the error
+int fir_Convolve(FIR_KERNEL *kernel, const double *x, int32_t in_len, double *y, int32_t out_len){
+    //the FIR struct of one channel gives the work buffers
+    FIR *fir = alloc_FIR(kernel, 1);
+    int32_t B = kernel->partition;
+    int32_t bins = B + 1;
+    int32_t P = kernel->parts;
+    int32_t m, p, n, slot, start;
+
+    if(fir == NULL){
+        return -1;
+    }
+
+    for(m = 0; (int64_t)m * B < out_len; m++){
+        start = m * B;
+
+        //shift in the next input block (zero after the end of the signal)
+        memcpy(fir->block[0], fir->block[0] + B, B * sizeof(double));
+        n = (start < in_len) ? ((in_len - start < B) ? in_len - start : B) : 0;
+        memcpy(fir->block[0] + B, x + start, n * sizeof(double));
+        memset(fir->block[0] + B + n, 0, (B - n) * sizeof(double));
+
+        //spectrum of the block, stored in the frequency-domain delay line
+        slot = m % P;
+        fft_Real(fir->plan, fir->block[0], fir->fdl_re[0] + (size_t)slot * bins, fir->fdl_im[0] + (size_t)slot * bins);
+
+        //partition p meets the input block p blocks before
+        memset(fir->acc_re, 0, bins * sizeof(double));
+        memset(fir->acc_im, 0, bins * sizeof(double));
+        for(p = 0; p < P && p <= m; p++){
+            slot = (m - p) % P;
+            fir_accumulate(fir->acc_re, fir->acc_im, kernel->spec_re + (size_t)p * bins, kernel->spec_im + (size_t)p * bins,
+                           fir->fdl_re[0] + (size_t)slot * bins, fir->fdl_im[0] + (size_t)slot * bins, bins);
+        }
+
+        //the last half of the circular convolution is the linear one
+        fft_Real_Inverse(fir->plan, fir->acc_re, fir->acc_im, fir->frame);
+        n = (out_len - start < B) ? out_len - start : B;
+        memcpy(y + start, fir->frame + B, n * sizeof(double));
+    }
+
+    free_FIR(fir);
+
+    return 0;
+}
+
+//Filter MONO_PCM struct in place (state is kept, so consecutive buffers are filtered seamlessly)
+//returns -1 after reporting a channel mismatch (wavio_set_error_mode)
+int fir_Mono(FIR *fir, MONO_PCM *pcm){
+    if(fir->channel != 1){
+        return wavio_report_error(WAVIO_ERROR_CHANNEL, "Channel number of the filter does not match.");
+    }
+
+    fir_Block(fir, &pcm->data, pcm->pcm_spec.length);
+
+    return 0;
+}
+
+//Filter STEREO_PCM struct in place (state is kept, so consecutive buffers are filtered seamlessly)
+//returns -1 after reporting a channel mismatch (wavio_set_error_mode)
+int fir_Stereo(FIR *fir, STEREO_PCM *pcm){
+    if(fir->channel != 2){
+        return wavio_report_error(WAVIO_ERROR_CHANNEL, "Channel number of the filter does not match.");
+    }
+
+    fir_Block(fir, pcm->data, pcm->pcm_spec.length);
+
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,99 @@
+/*filter.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_FILTER
+#define INCLUDED_FILTER
+
+#include <stdint.h>
+#include "wavio.h"
+#include "fft.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Biquad types (RBJ audio EQ cookbook)
+#define FILTER_LOWPASS 0
+#define FILTER_HIGHPASS 1
+#define FILTER_BANDPASS 2 /* constant 0 dB peak gain */
+#define FILTER_NOTCH 3
+#define FILTER_ALLPASS 4
+#define FILTER_PEAKING 5 /* gain in dB */
+#define FILTER_LOWSHELF 6 /* gain in dB */
+#define FILTER_HIGHSHELF 7 /* gain in dB */
+
+//Biquad coefficients (a0 normalized to 1)
+typedef struct{
+    double b0;
+    double b1;
+    double b2;
+    double a1;
+    double a2;
+} BIQUAD;
+
+//Cascade of biquads (transposed direct form II) with per-channel state
+typedef struct{
+    int32_t sections; /* number of biquads */
+    BIQUAD *coef; /* coefficients of each section */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    double *state[2]; /* 2 delay elements per section */
+} IIR;
+
+//FIR kernel split into partitions of equal size (read only once built, may be shared by FIR structs)
+typedef struct{
+    int32_t taps; /* kernel length */
+    int32_t partition; /* partition size (power of 2, FFT size is twice this) */
+    int32_t parts; /* number of partitions */
+    int32_t head; /* taps of the first partition (computed directly) */
+    double *head_taps; /* first partition, reversed */
+    double *spec_re; /* spectra of every partition (parts x (partition + 1)) */
+    double *spec_im;
+} FIR_KERNEL;
+
+//FIR filter (first partition direct, the others by FFT, no latency) with per-channel state
+typedef struct{
+    FIR_KERNEL *kernel; /* not owned */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    FFT_PLAN *plan; /* plan of 2 x partition */
+    int32_t pos; /* samples of the current block */
+    int32_t ring; /* slot of the newest input spectrum */
+    double *line[2]; /* delay line of the direct part (head - 1 + partition) */
+    double *block[2]; /* previous and current input block (2 x partition) */
+    double *tail[2]; /* FFT part of the output of the current block */
+    double *fdl_re[2]; /* spectra of past input blocks (parts x (partition + 1)) */
+    double *fdl_im[2];
+    double *acc_re; /* spectrum accumulator */
+    double *acc_im;
+    double *frame; /* work buffer (2 x partition) */
+} FIR;
+
+//Prototype declaration for filter.c (alloc_* return NULL and int functions -1 after reporting an error, see wavio_set_error_mode)
+/* using BIQUAD and IIR struct */
+int biquad_Design(BIQUAD *biquad, int type, uint64_t fs, double f0, double q, double gain);
+IIR *alloc_IIR(const BIQUAD *coef, int32_t sections, int16_t channel);
+void free_IIR(IIR *iir);
+void iir_Reset(IIR *iir);
+void iir_Block(IIR *iir, double **data, int32_t frames);
+int iir_Mono(IIR *iir, MONO_PCM *pcm);
+int iir_Stereo(IIR *iir, STEREO_PCM *pcm);
+
+/* using FIR_KERNEL and FIR struct */
+FIR_KERNEL *alloc_FIR_Kernel(const double *h, int32_t taps, int32_t partition);
+void free_FIR_Kernel(FIR_KERNEL *kernel);
+FIR *alloc_FIR(FIR_KERNEL *kernel, int16_t channel);
+void free_FIR(FIR *fir);
+void fir_Reset(FIR *fir);
+void fir_Block(FIR *fir, double **data, int32_t frames);
+int fir_Convolve(FIR_KERNEL *kernel, const double *x, int32_t in_len, double *y, int32_t out_len);
+int fir_Mono(FIR *fir, MONO_PCM *pcm);
+int fir_Stereo(FIR *fir, STEREO_PCM *pcm);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
@@ -0,0 +1,1855 @@
+/* flac.c (beta)*/
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/* include pthread (frames are encoded in parallel, disable with -DWAVIO_NO_THREADS) */
+#ifndef WAVIO_NO_THREADS
+#include <pthread.h>
+#endif
+
+/* include prototype header file */
+#include "flac.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//subframe types
+#define FLAC_CONSTANT 0
+#define FLAC_VERBATIM 1
+#define FLAC_FIXED 2
+#define FLAC_LPC 3
+
+//channel assignments of a stereo frame
+#define FLAC_INDEPENDENT 1
+#define FLAC_LEFT_SIDE 8
+#define FLAC_SIDE_RIGHT 9
+#define FLAC_MID_SIDE 10
+
+//CRC-8 (header) and CRC-16 (frame) tables
+typedef struct{
+    uint8_t crc8[256]; /* polynomial x^8 + x^2 + x + 1 */
+    uint16_t crc16[256]; /* polynomial x^16 + x^15 + x^2 + 1 */
+} FLAC_CRC;
+
+//Bit buffer of the encoder (MSB first, grows on demand)
+typedef struct{
+    uint8_t *buf; /* bytes already complete */
+    size_t len; /* number of complete bytes */
+    size_t cap; /* capacity of buf */
+    uint64_t acc; /* pending bits (low bits) */
+    int bits; /* number of pending bits */
+    int error; /* set when buf cannot grow (the bits are dropped) */
+} FLAC_BITS;
+
+//Bit reader of the decoder (MSB first, over the whole file in memory)
+typedef struct{
+    const uint8_t *buf; /* file contents */
+    size_t len; /* file size */
+    size_t pos; /* next byte to load into the cache */
+    uint64_t cache; /* loaded bits (MSB aligned) */
+    int bits; /* number of loaded bits */
+    int error; /* set when the stream ends too early */
+} FLAC_READER;
+
+//Rice parameters of one residual
+typedef struct{
+    int method; /* 0: 4bit parameters, 1: 5bit parameters */
+    int order; /* partition order */
+    uint8_t k[1 << FLAC_MAX_PARTITION_ORDER]; /* parameter of each partition */
+} FLAC_RICE;
+
+//Encoding of one subframe
+typedef struct{
+    int type; /* FLAC_CONSTANT, FLAC_VERBATIM, FLAC_FIXED or FLAC_LPC */
+    int bits; /* bits per sample of the subframe (before removing wasted bits) */
+    int wasted; /* zero low bits shared by every sample */
+    int order; /* predictor order */
+    int precision; /* LPC coefficient precision */
+    int shift; /* LPC quantization shift */
+    int32_t coef[FLAC_MAX_LPC_ORDER]; /* quantized LPC coefficients */
+    FLAC_RICE rice; /* Rice parameters of the residual */
+    uint64_t size; /* size in bits */
+    const int32_t *data; /* samples (wasted bits removed) */
+    int32_t *shifted; /* buffer of data when wasted > 0 */
+    int32_t *residual; /* residual of samples order .. n - 1 */
+} FLAC_SUBFRAME;
+
+//Work buffers of one encoder thread
+typedef struct{
+    int32_t *side; /* left - right */
+    int32_t *mid; /* (left + right) >> 1 */
+    int32_t *scratch; /* residual of a candidate predictor */
+    double *window; /* Tukey window of FLAC_BLOCK_SIZE */
+    double *windowed; /* windowed samples */
+    FLAC_SUBFRAME sub[4]; /* left (or mono), right, side, mid */
+} FLAC_WORK;
+
+//Whole-file encoder shared by the threads
+typedef struct{
+    uint64_t fs; /* Sampling frequency */
+    int16_t bits; /* Quantization bits */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    int64_t length; /* samples per channel */
+    int32_t *data[2]; /* signed samples of each channel */
+    int64_t frames; /* number of frames */
+    int64_t next; /* next frame to encode */
+    FLAC_BITS *out; /* encoded frames */
+    FLAC_CRC crc; /* CRC tables */
+    int failed; /* set when a thread cannot allocate its work buffers */
+    int threads; /* threads of this encoder (0: one per online CPU) */
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_t mutex; /* protects next and failed */
+#endif
+} FLAC_ENCODER;
+
+//Decoded stream
+typedef struct{
+    uint64_t fs; /* Sampling frequency */
+    int16_t bits; /* bits per sample of the stream */
+    int16_t channel; /* number of channels */
+    int64_t total; /* samples per channel in STREAMINFO (0: unknown) */
+    int64_t length; /* samples per channel decoded (at most INT32_MAX, the limit of PCM_SPEC) */
+    int64_t frames; /* frames decoded (the number the next frame must carry) */
+    int64_t cap; /* capacity of data */
+    int32_t *data[8]; /* samples of each channel */
+} FLAC_STREAM;
+
+//Fill the CRC tables
+static void flac_crc_init(FLAC_CRC *crc){
+    int i, j;
+    uint32_t c;
+
+    for(i = 0; i < 256; i++){
+        c = (uint32_t)i;
+        for(j = 0; j < 8; j++){
+            c = (c & 0x80) ? (c << 1) ^ 0x07 : (c << 1);
+        }
+        crc->crc8[i] = (uint8_t)c;
+
+        c = (uint32_t)i << 8;
+        for(j = 0; j < 8; j++){
+            c = (c & 0x8000) ? (c << 1) ^ 0x8005 : (c << 1);
+        }
+        crc->crc16[i] = (uint16_t)c;
+    }
+}
+
+//CRC-8 of n bytes
+static uint8_t flac_crc8(const FLAC_CRC *crc, const uint8_t *buf, size_t n){
+    uint8_t c = 0;
+    size_t i;
+
+    for(i = 0; i < n; i++){
+        c = crc->crc8[c ^ buf[i]];
+    }
+
+    return c;
+}
+
+//CRC-16 of n bytes
+static uint16_t flac_crc16(const FLAC_CRC *crc, const uint8_t *buf, size_t n){
+    uint16_t c = 0;
+    size_t i;
+
+    for(i = 0; i < n; i++){
+        c = (uint16_t)((c << 8) ^ crc->crc16[(c >> 8) ^ buf[i]]);
+    }
+
+    return c;
+}
+
+/* encoder */
+//Initialize a bit buffer
+static void flac_bits_init(FLAC_BITS *bw, size_t cap){
+    bw->cap = (cap < 64) ? 64 : cap;
+    bw->buf = (uint8_t *)malloc(bw->cap);
+    bw->len = 0;
+    bw->acc = 0;
+    bw->bits = 0;
+    bw->error = (bw->buf == NULL);
+    if(bw->error){
+        bw->cap = 0;
+    }
+}
+
+//Append the low n bits of value (n <= 32)
+static void flac_put(FLAC_BITS *bw, uint32_t value, int n){
+    uint8_t *grown;
+
+    if(n == 0 || bw->error){
+        return;
+    }
+
+    if(bw->len + 8 > bw->cap){
+        grown = (uint8_t *)realloc(bw->buf, bw->cap * 2);
+        if(grown == NULL){
+            bw->error = 1;
+            return;
+        }
+        bw->buf = grown;
+        bw->cap *= 2;
+    }
+
+    bw->acc = (bw->acc << n) | ((uint64_t)value & (((uint64_t)1 << n) - 1));
+    bw->bits += n;
+    while(bw->bits >= 8){
+        bw->bits -= 8;
+        bw->buf[bw->len++] = (uint8_t)(bw->acc >> bw->bits);
+    }
+}
+
+//Pad with zero bits up to the next byte
+static void flac_put_align(FLAC_BITS *bw){
+    if(bw->bits > 0){
+        flac_put(bw, 0, 8 - bw->bits);
+    }
+}
+
+//Append one Rice code with parameter k
+static void flac_put_rice(FLAC_BITS *bw, int32_t r, int k){
+    uint32_t u = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31); /* zigzag folded residual */
+    uint32_t q = u >> k; /* unary part */
+
+    while(q >= 31){
+        flac_put(bw, 0, 31);
+        q -= 31;
+    }
+
+    if((int)q + 1 + k <= 32){
+        flac_put(bw, ((uint32_t)1 << k) | (u & (((uint32_t)1 << k) - 1)), (int)q + 1 + k);
+    }else{
+        flac_put(bw, 1, (int)q + 1);
+        flac_put(bw, u & (((uint32_t)1 << k) - 1), k);
+    }
+}
+
+//Best Rice parameter of a partition (estimated bits into *size)
+static int flac_rice_param(uint64_t sum, int32_t count, uint64_t *size){
+    int k, best = 0, k0 = 0;
+    uint64_t bits;
+
+    *size = 0;
+    if(count == 0){
+        return 0;
+    }
+
+    //k0 = floor(log2(mean))
+    while(k0 < 30 && ((uint64_t)count << (k0 + 1)) <= sum){
+        k0++;
+    }
+
+    //sum >> k never underestimates the sum of the unary parts
+    *size = UINT64_MAX;
+    for(k = (k0 > 0) ? k0 - 1 : 0; k <= k0 + 1 && k <= 30; k++){
+        bits = (uint64_t)count * (k + 1) + (sum >> k);
+        if(bits < *size){
+            *size = bits;
+            best = k;
+        }
+    }
+
+    return best;
+}
+
+//Choose the partition order and Rice parameters of a residual (returns bits of the residual section)
+static uint64_t flac_rice_plan(const int32_t *residual, int32_t n, int order, FLAC_RICE *rice){
+    uint64_t sum[1 << FLAC_MAX_PARTITION_ORDER]; /* sums of folded residuals per partition */
+    uint8_t k[1 << FLAC_MAX_PARTITION_ORDER];
+    uint64_t best = UINT64_MAX, total, bits;
+    int32_t i, p, parts, size, start, end, count;
+    int max_order = FLAC_MAX_PARTITION_ORDER, level, method, param_bits;
+    uint32_t u;
+
+    //partitions must divide the block and hold more samples than the warm-up
+    while(max_order > 0 && ((n & ((1 << max_order) - 1)) != 0 || (n >> max_order) <= order)){
+        max_order--;
+    }
+
+    //sums of the finest partitions
+    parts = 1 << max_order;
+    size = n >> max_order;
+    for(p = 0; p < parts; p++){
+        start = (p == 0) ? 0 : p * size - order;
+        end = (p + 1) * size - order;
+        sum[p] = 0;
+        for(i = start; i < end; i++){
+            u = ((uint32_t)residual[i] << 1) ^ (uint32_t)(residual[i] >> 31);
+            sum[p] += u;
+        }
+    }
+
+    //coarser partitions merge pairs of sums
+    for(level = max_order; level >= 0; level--){
+        parts = 1 << level;
+        size = n >> level;
+        total = 0;
+        method = 0;
+        for(p = 0; p < parts; p++){
+            count = (p == 0) ? size - order : size;
+            k[p] = (uint8_t)flac_rice_param(sum[p], count, &bits);
+            total += bits;
+            if(k[p] > 14){
+                method = 1;
+            }
+        }
+        param_bits = method ? 5 : 4;
+        total += 6 + (uint64_t)parts * param_bits;
+
+        if(total < best){
+            best = total;
+            rice->method = method;
+            rice->order = level;
+            memcpy(rice->k, k, parts);
+        }
+
+        for(p = 0; p < parts / 2; p++){
+            sum[p] = sum[2 * p] + sum[2 * p + 1];
+        }
+    }
+
+    return best;
+}
+
+//Residual of a fixed polynomial predictor (returns 0 when it does not fit in 32 bits)
+static int flac_fixed_residual(const int32_t *x, int32_t n, int order, int32_t *residual){
+    int32_t i;
+    int64_t r;
+
+    for(i = order; i < n; i++){
+        switch(order){
+            case 0:
+                r = x[i];
+                break;
+            case 1:
+                r = (int64_t)x[i] - x[i - 1];
+                break;
+            case 2:
+                r = (int64_t)x[i] - 2 * (int64_t)x[i - 1] + x[i - 2];
+                break;
+            case 3:
+                r = (int64_t)x[i] - 3 * (int64_t)x[i - 1] + 3 * (int64_t)x[i - 2] - x[i - 3];
+                break;
+            default:
+                r = (int64_t)x[i] - 4 * (int64_t)x[i - 1] + 6 * (int64_t)x[i - 2] - 4 * (int64_t)x[i - 3] + x[i - 4];
+                break;
+        }
+        if(r > INT32_MAX || r < INT32_MIN){
+            return 0;
+        }
+        residual[i - order] = (int32_t)r;
+    }
+
+    return 1;
+}
+
+//Order of the fixed predictor with the smallest sum of absolute residuals
+static int flac_fixed_order(const int32_t *x, int32_t n){
+    int64_t e0, e1, e2, e3, e4, d1, d2, d3;
+    uint64_t sum[5] = {0, 0, 0, 0, 0};
+    int32_t i;
+    int order, best = 0;
+
+    for(i = 4; i < n; i++){
+        e0 = x[i];
+        e1 = e0 - x[i - 1];
+        d1 = (int64_t)x[i - 1] - x[i - 2];
+        e2 = e1 - d1;
+        d2 = d1 - ((int64_t)x[i - 2] - x[i - 3]);
+        e3 = e2 - d2;
+        d3 = d2 - (((int64_t)x[i - 2] - x[i - 3]) - ((int64_t)x[i - 3] - x[i - 4]));
+        e4 = e3 - d3;
+        sum[0] += (uint64_t)((e0 < 0) ? -e0 : e0);
+        sum[1] += (uint64_t)((e1 < 0) ? -e1 : e1);
+        sum[2] += (uint64_t)((e2 < 0) ? -e2 : e2);
+        sum[3] += (uint64_t)((e3 < 0) ? -e3 : e3);
+        sum[4] += (uint64_t)((e4 < 0) ? -e4 : e4);
+    }
+
+    for(order = 1; order < 5; order++){
+        if(sum[order] < sum[best]){
+            best = order;
+        }
+    }
+
+    return best;
+}
+
+//Quantize LPC coefficients to precision bits (returns the shift, or -1 when they do not fit)
+static int flac_lpc_quantize(const double *lpc, int order, int precision, int32_t *coef){
+    double cmax = 0.0, error = 0.0;
+    int32_t qmax = (1 << (precision - 1)) - 1, qmin = -(1 << (precision - 1)), q;
+    int i, log2cmax, shift;
+
+    for(i = 0; i < order; i++){
+        if(fabs(lpc[i]) > cmax){
+            cmax = fabs(lpc[i]);
+        }
+    }
+    if(cmax <= 0.0){
+        return -1;
+    }
+
+    //cmax in [2^log2cmax, 2^(log2cmax + 1))
+    frexp(cmax, &log2cmax);
+    log2cmax--;
+    shift = precision - log2cmax - 1;
+    if(shift > 15){
+        shift = 15;
+    }else if(shift < 0){
+        return -1;
+    }
+
+    //round with error feedback
+    for(i = 0; i < order; i++){
+        error += lpc[i] * (double)(1 << shift);
+        q = (int32_t)floor(error + 0.5);
+        if(q > qmax){
+            q = qmax;
+        }else if(q < qmin){
+            q = qmin;
+        }
+        error -= q;
+        coef[i] = q;
+    }
+
+    return shift;
+}
+
+//Residual of a quantized LPC predictor (returns 0 when it does not fit in 32 bits)
+static int flac_lpc_residual(const int32_t *x, int32_t n, int order, const int32_t *coef, int shift, int32_t *residual){
+    int32_t i;
+    int j;
+    int64_t sum, r;
+
+    for(i = order; i < n; i++){
+        sum = 0;
+        for(j = 0; j < order; j++){
+            sum += (int64_t)coef[j] * x[i - 1 - j];
+        }
+        r = (int64_t)x[i] - (sum >> shift);
+        if(r > INT32_MAX || r < INT32_MIN){
+            return 0;
+        }
+        residual[i - order] = (int32_t)r;
+    }
+
+    return 1;
+}
+
+//Try an LPC predictor (Tukey window, autocorrelation, Levinson-Durbin), keep it if it is smaller than sub
+static void flac_try_lpc(FLAC_WORK *work, const int32_t *x, int32_t n, int bits, uint64_t header, FLAC_SUBFRAME *sub){
+    double r[FLAC_MAX_LPC_ORDER + 1]; /* autocorrelation */
+    double a[FLAC_MAX_LPC_ORDER + 1] = {0.0}, prev[FLAC_MAX_LPC_ORDER + 1]; /* predictor of the current and previous order */
+    double lpc[FLAC_MAX_LPC_ORDER + 1][FLAC_MAX_LPC_ORDER]; /* predictor of each order */
+    double err[FLAC_MAX_LPC_ORDER + 1]; /* prediction error of each order */
+    double *w = work->windowed;
+    double k, acc, estimate, best_estimate = 0.0;
+    int32_t coef[FLAC_MAX_LPC_ORDER];
+    int32_t i, edge;
+    int max_order = FLAC_MAX_LPC_ORDER, order, best_order = 0, j, shift;
+    int precision = (bits <= 16) ? 12 : 15;
+    FLAC_RICE rice;
+    uint64_t size;
+    int32_t *tmp;
+
+    //window (the one of FLAC_BLOCK_SIZE, or a new one for the shorter last frame)
+    if(n == FLAC_BLOCK_SIZE){
+        for(i = 0; i < n; i++){
+            w[i] = work->window[i] * x[i];
+        }
+    }else{
+        edge = n / 4;
+        for(i = 0; i < n; i++){
+            if(i < edge){
+                w[i] = (0.5 - 0.5 * cos(M_PI * i / edge)) * x[i];
+            }else if(i >= n - edge){
+                w[i] = (0.5 - 0.5 * cos(M_PI * (n - 1 - i) / edge)) * x[i];
+            }else{
+                w[i] = x[i];
+            }
+        }
+    }
+
+    //autocorrelation
+    for(j = 0; j <= max_order; j++){
+        acc = 0.0;
+        for(i = j; i < n; i++){
+            acc += w[i] * w[i - j];
+        }
+        r[j] = acc;
+    }
+    if(r[0] <= 0.0){
+        return;
+    }
+
+    //Levinson-Durbin recursion (x[i] ~ sum a[j] x[i - j])
+    err[0] = r[0];
+    for(order = 1; order <= max_order; order++){
+        acc = r[order];
+        for(j = 1; j < order; j++){
+            acc -= a[j] * r[order - j];
+        }
+        k = acc / err[order - 1];
+        memcpy(prev, a, sizeof(a));
+        a[order] = k;
+        for(j = 1; j < order; j++){
+            a[j] = prev[j] - k * prev[order - j];
+        }
+        err[order] = err[order - 1] * (1.0 - k * k);
+        for(j = 0; j < order; j++){
+            lpc[order][j] = a[j + 1];
+        }
+
+        //expected size: bits per residual of a Laplacian source plus warm-up and coefficients
+        estimate = (err[order] > 0.0) ? 0.5 * log2(err[order] * 0.5 / n) : 0.0;
+        if(estimate < 0.0){
+            estimate = 0.0;
+        }
+        estimate = estimate * (n - order) + order * (bits + precision);
+        if(best_order == 0 || estimate < best_estimate){
+            best_estimate = estimate;
+            best_order = order;
+        }
+        if(err[order] <= 0.0){
+            break;
+        }
+    }
+
+    //quantize and measure the chosen order
+    order = best_order;
+    shift = flac_lpc_quantize(lpc[order], order, precision, coef);
+    if(shift < 0 || !flac_lpc_residual(x, n, order, coef, shift, work->scratch)){
+        return;
+    }
+    size = header + (uint64_t)order * bits + 4 + 5 + (uint64_t)order * precision + flac_rice_plan(work->scratch, n, order, &rice);
+
+    if(size < sub->size){
+        sub->type = FLAC_LPC;
+        sub->order = order;
+        sub->precision = precision;
+        sub->shift = shift;
+        memcpy(sub->coef, coef, sizeof(coef));
+        sub->rice = rice;
+        sub->size = size;
+        tmp = sub->residual;
+        sub->residual = work->scratch;
+        work->scratch = tmp;
+    }
+}
+
+//Choose the encoding of one subframe
+static void flac_analyze(FLAC_WORK *work, const int32_t *x, int32_t n, int bits, FLAC_SUBFRAME *sub){
+    uint32_t any = 0;
+    int32_t i;
+    int order, sbps;
+    uint64_t header, size;
+    FLAC_RICE rice;
+    int32_t *tmp;
+
+    sub->bits = bits;
+    sub->wasted = 0;
+    sub->data = x;
+
+    //constant
+    for(i = 1; i < n; i++){
+        if(x[i] != x[0]){
+            break;
+        }
+    }
+    if(i == n){
+        sub->type = FLAC_CONSTANT;
+        sub->size = 8 + bits;
+        return;
+    }
+
+    //wasted bits
+    for(i = 0; i < n; i++){
+        any |= (uint32_t)x[i];
+    }
+    while(!(any & 1) && sub->wasted < bits - 1){
+        any >>= 1;
+        sub->wasted++;
+    }
+    if(sub->wasted > 0){
+        for(i = 0; i < n; i++){
+            sub->shifted[i] = x[i] >> sub->wasted;
+        }
+        sub->data = sub->shifted;
+    }
+    sbps = bits - sub->wasted;
+    header = 8 + sub->wasted;
+
+    //verbatim
+    sub->type = FLAC_VERBATIM;
+    sub->size = header + (uint64_t)n * sbps;
+
+    //fixed predictor
+    if(n > 4){
+        order = flac_fixed_order(sub->data, n);
+        if(flac_fixed_residual(sub->data, n, order, work->scratch)){
+            size = header + (uint64_t)order * sbps + flac_rice_plan(work->scratch, n, order, &rice);
+            if(size < sub->size){
+                sub->type = FLAC_FIXED;
+                sub->order = order;
+                sub->rice = rice;
+                sub->size = size;
+                tmp = sub->residual;
+                sub->residual = work->scratch;
+                work->scratch = tmp;
+            }
+        }
+    }
+
+    //LPC
+    if(n > 4 * FLAC_MAX_LPC_ORDER){
+        flac_try_lpc(work, sub->data, n, sbps, header, sub);
+    }
+}
+
+//Write a sample of the given width (two's complement)
+static void flac_put_signed(FLAC_BITS *bw, int32_t x, int bits){
+    flac_put(bw, (uint32_t)x, bits);
+}
+
+//Write the residual section
+static void flac_put_residual(FLAC_BITS *bw, const FLAC_SUBFRAME *sub, int32_t n){
+    int32_t p, i, count, parts = 1 << sub->rice.order;
+    const int32_t *res = sub->residual;
+
+    flac_put(bw, sub->rice.method, 2);
+    flac_put(bw, sub->rice.order, 4);
+    for(p = 0; p < parts; p++){
+        count = (n >> sub->rice.order) - ((p == 0) ? sub->order : 0);
+        flac_put(bw, sub->rice.k[p], sub->rice.method ? 5 : 4);
+        for(i = 0; i < count; i++){
+            flac_put_rice(bw, res[i], sub->rice.k[p]);
+        }
+        res += count;
+    }
+}
+
+//Write one subframe
+static void flac_put_subframe(FLAC_BITS *bw, const FLAC_SUBFRAME *sub, int32_t n){
+    int32_t i;
+    int sbps = sub->bits - sub->wasted;
+
+    //type
+    flac_put(bw, 0, 1);
+    switch(sub->type){
+        case FLAC_CONSTANT:
+            flac_put(bw, 0, 6);
+            break;
+        case FLAC_VERBATIM:
+            flac_put(bw, 1, 6);
+            break;
+        case FLAC_FIXED:
+            flac_put(bw, 8 | sub->order, 6);
+            break;
+        default:
+            flac_put(bw, 32 | (sub->order - 1), 6);
+            break;
+    }
+
+    //wasted bits (unary)
+    if(sub->wasted > 0){
+        flac_put(bw, 1, 1);
+        flac_put(bw, 1, sub->wasted);
+    }else{
+        flac_put(bw, 0, 1);
+    }
+
+    switch(sub->type){
+        case FLAC_CONSTANT:
+            flac_put_signed(bw, sub->data[0], sub->bits);
+            break;
+
+        case FLAC_VERBATIM:
+            for(i = 0; i < n; i++){
+                flac_put_signed(bw, sub->data[i], sbps);
+            }
+            break;
+
+        case FLAC_FIXED:
+            for(i = 0; i < sub->order; i++){
+                flac_put_signed(bw, sub->data[i], sbps);
+            }
+            flac_put_residual(bw, sub, n);
+            break;
+
+        default:
+            for(i = 0; i < sub->order; i++){
+                flac_put_signed(bw, sub->data[i], sbps);
+            }
+            flac_put(bw, sub->precision - 1, 4);
+            flac_put(bw, sub->shift, 5);
+            for(i = 0; i < sub->order; i++){
+                flac_put_signed(bw, sub->coef[i], sub->precision);
+            }
+            flac_put_residual(bw, sub, n);
+            break;
+    }
+}
+
+//Block size code of the frame header (6 and 7: size follows the header)
+static int flac_blocksize_code(int32_t n){
+    int code;
+
+    if(n == 192){
+        return 1;
+    }
+    for(code = 2; code <= 5; code++){
+        if(n == (576 << (code - 2))){
+            return code;
+        }
+    }
+    for(code = 8; code <= 15; code++){
+        if(n == (256 << (code - 8))){
+            return code;
+        }
+    }
+
+    return (n <= 256) ? 6 : 7;
+}
+
+//Sample rate code of the frame header (0: from STREAMINFO)
+static int flac_rate_code(uint64_t fs){
+    static const uint64_t rate[12] = {0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000};
+    int code;
+
+    for(code = 1; code < 12; code++){
+        if(fs == rate[code]){
+            return code;
+        }
+    }
+
+    return 0;
+}
+
+//Sample size code of the frame header
+static int flac_size_code(int16_t bits){
+    switch(bits){
+        case 8:
+            return 1;
+        case 16:
+            return 4;
+        case 24:
+            return 6;
+        default:
+            return 7;
+    }
+}
+
+//Encode one frame into its own bit buffer
+static void flac_encode_frame(FLAC_ENCODER *enc, FLAC_WORK *work, int64_t index, FLAC_BITS *bw){
+    int64_t start = index * FLAC_BLOCK_SIZE;
+    int32_t n = (int32_t)((enc->length - start < FLAC_BLOCK_SIZE) ? enc->length - start : FLAC_BLOCK_SIZE);
+    int32_t i;
+    int assignment, code, bytes, c;
+    FLAC_SUBFRAME *first, *second;
+    uint64_t size, best;
+    uint64_t number = (uint64_t)index;
+    const int32_t *L, *R;
+
+    if(enc->channel == 1){
+        flac_analyze(work, enc->data[0] + start, n, enc->bits, &work->sub[0]);
+        assignment = 0;
+        first = &work->sub[0];
+        second = NULL;
+    }else{
+        L = enc->data[0] + start;
+        R = enc->data[1] + start;
+        flac_analyze(work, L, n, enc->bits, &work->sub[0]);
+        flac_analyze(work, R, n, enc->bits, &work->sub[1]);
+        assignment = FLAC_INDEPENDENT;
+        first = &work->sub[0];
+        second = &work->sub[1];
+        best = work->sub[0].size + work->sub[1].size;
+
+        //side needs one more bit, so 32bit frames stay independent
+        if(enc->bits < 32){
+            for(i = 0; i < n; i++){
+                work->side[i] = L[i] - R[i];
+                work->mid[i] = (int32_t)(((int64_t)L[i] + R[i]) >> 1);
+            }
+            flac_analyze(work, work->side, n, enc->bits + 1, &work->sub[2]);
+            flac_analyze(work, work->mid, n, enc->bits, &work->sub[3]);
+
+            size = work->sub[0].size + work->sub[2].size;
+            if(size < best){
+                best = size;
+                assignment = FLAC_LEFT_SIDE;
+                first = &work->sub[0];
+                second = &work->sub[2];
+            }
+            size = work->sub[2].size + work->sub[1].size;
+            if(size < best){
+                best = size;
+                assignment = FLAC_SIDE_RIGHT;
+                first = &work->sub[2];
+                second = &work->sub[1];
+            }
+            size = work->sub[3].size + work->sub[2].size;
+            if(size < best){
+                best = size;
+                assignment = FLAC_MID_SIDE;
+                first = &work->sub[3];
+                second = &work->sub[2];
+            }
+        }
+    }
+
+    //frame header (sync code, fixed block size)
+    bw->len = 0;
+    bw->bits = 0;
+    flac_put(bw, 0xFFF8, 16);
+    code = flac_blocksize_code(n);
+    flac_put(bw, code, 4);
+    flac_put(bw, flac_rate_code(enc->fs), 4);
+    flac_put(bw, assignment, 4);
+    flac_put(bw, flac_size_code(enc->bits), 3);
+    flac_put(bw, 0, 1);
+
+    //frame number (UTF-8 like coding)
+    if(number < 0x80){
+        flac_put(bw, (uint32_t)number, 8);
+    }else{
+        for(bytes = 2; bytes < 7 && number >= ((uint64_t)1 << (5 * bytes + 1)); bytes++){
+        }
+        flac_put(bw, ((0xFF00u >> bytes) & 0xFF) | (uint32_t)(number >> (6 * (bytes - 1))), 8);
+        for(c = bytes - 2; c >= 0; c--){
+            flac_put(bw, 0x80 | (uint32_t)((number >> (6 * c)) & 0x3F), 8);
+        }
+    }
+
+    //block size that is not a standard one
+    if(code == 6){
+        flac_put(bw, n - 1, 8);
+    }else if(code == 7){
+        flac_put(bw, n - 1, 16);
+    }
+    flac_put(bw, flac_crc8(&enc->crc, bw->buf, bw->len), 8);
+
+    //subframes
+    flac_put_subframe(bw, first, n);
+    if(second != NULL){
+        flac_put_subframe(bw, second, n);
+    }
+
+    //footer
+    flac_put_align(bw);
+    flac_put(bw, flac_crc16(&enc->crc, bw->buf, bw->len), 16);
+}
+
+//Allocate the work buffers of one thread (returns 0 if one is missing, flac_work_free releases the others)
+static int flac_work_init(FLAC_WORK *work){
+    int32_t i, edge = FLAC_BLOCK_SIZE / 4;
+    int s;
+
+    work->side = (int32_t *)malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    work->mid = (int32_t *)malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    work->scratch = (int32_t *)malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    work->window = (double *)malloc(FLAC_BLOCK_SIZE * sizeof(double));
+    work->windowed = (double *)malloc(FLAC_BLOCK_SIZE * sizeof(double));
+    for(s = 0; s < 4; s++){
+        work->sub[s].shifted = (int32_t *)malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+        work->sub[s].residual = (int32_t *)malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    }
+    if(work->side == NULL || work->mid == NULL || work->scratch == NULL || work->window == NULL || work->windowed == NULL){
+        return 0;
+    }
+    for(s = 0; s < 4; s++){
+        if(work->sub[s].shifted == NULL || work->sub[s].residual == NULL){
+            return 0;
+        }
+    }
+
+    //Tukey window (half of it tapered)
+    for(i = 0; i < FLAC_BLOCK_SIZE; i++){
+        if(i < edge){
+            work->window[i] = 0.5 - 0.5 * cos(M_PI * i / edge);
+        }else if(i >= FLAC_BLOCK_SIZE - edge){
+            work->window[i] = 0.5 - 0.5 * cos(M_PI * (FLAC_BLOCK_SIZE - 1 - i) / edge);
+        }else{
+            work->window[i] = 1.0;
+        }
+    }
+
+    return 1;
+}
+
+//Free the work buffers of one thread
+static void flac_work_free(FLAC_WORK *work){
+    int s;
+
+    free(work->side);
+    free(work->mid);
+    free(work->scratch);
+    free(work->window);
+    free(work->windowed);
+    for(s = 0; s < 4; s++){
+        free(work->sub[s].shifted);
+        free(work->sub[s].residual);
+    }
+}
+
+//Encoder thread: take frames until none is left
+static void *flac_worker(void *arg){
+    FLAC_ENCODER *enc = (FLAC_ENCODER *)arg;
+    FLAC_WORK work;
+    int64_t index;
+
+    //without work buffers this thread encodes nothing and the file is reported as failed
+    if(!flac_work_init(&work)){
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_lock(&enc->mutex);
+#endif
+        enc->failed = 1;
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_unlock(&enc->mutex);
+#endif
+        flac_work_free(&work);
+        return NULL;
+    }
+    for(;;){
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_lock(&enc->mutex);
+#endif
+        index = enc->next++;
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_unlock(&enc->mutex);
+#endif
+        if(index >= enc->frames){
+            break;
+        }
+        flac_encode_frame(enc, &work, index, &enc->out[index]);
+    }
+    flac_work_free(&work);
+
+    return NULL;
+}
+
+//Encode signed channel arrays and write the FLAC file
+static void flac_write_file(FLAC_ENCODER *enc, char *filename){
+    uint8_t head[42]; /* "fLaC", metadata block header and STREAMINFO */
+    FLAC_BITS info;
+    FILE *fp;
+    int64_t i;
+    int threads = enc->threads;
+    size_t min_frame = 0, max_frame = 0;
+    int32_t block;
+    int ok;
+
+    //file
+    fp = fopen(filename, "wb");
+    if(fp == NULL){
+        wavio_report_error(WAVIO_ERROR_OPEN, "Cannot open the file.");
+        return;
+    }
+
+    //frames in parallel (each one into its own buffer)
+    flac_crc_init(&enc->crc);
+    enc->frames = (enc->length + FLAC_BLOCK_SIZE - 1) / FLAC_BLOCK_SIZE;
+    enc->next = 0;
+    enc->failed = 0;
+    enc->out = (FLAC_BITS *)malloc((enc->frames > 0 ? enc->frames : 1) * sizeof(FLAC_BITS));
+    if(enc->out == NULL){
+        fclose(fp);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the frames.");
+        return;
+    }
+    for(i = 0; i < enc->frames; i++){
+        flac_bits_init(&enc->out[i], (size_t)FLAC_BLOCK_SIZE * enc->channel * (enc->bits / 8) / 2);
+    }
+
+#ifndef WAVIO_NO_THREADS
+    if(threads <= 0){
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(threads > FLAC_MAX_THREADS){
+        threads = FLAC_MAX_THREADS;
+    }
+    if(threads > enc->frames){
+        threads = (int)enc->frames;
+    }
+    pthread_mutex_init(&enc->mutex, NULL);
+    if(threads > 1){
+        pthread_t thread[FLAC_MAX_THREADS];
+        int started = 0, t;
+
+        for(t = 1; t < threads; t++){
+            if(pthread_create(&thread[started], NULL, flac_worker, enc) == 0){
+                started++;
+            }
+        }
+        flac_worker(enc);
+        for(t = 0; t < started; t++){
+            pthread_join(thread[t], NULL);
+        }
+    }else{
+        flac_worker(enc);
+    }
+    pthread_mutex_destroy(&enc->mutex);
+#else
+    (void)threads;
+    flac_worker(enc);
+#endif
+
+    //frame size range (the last frame may be shorter than the others)
+    for(i = 0; i < enc->frames; i++){
+        if(i == 0 || enc->out[i].len < min_frame){
+            min_frame = enc->out[i].len;
+        }
+        if(enc->out[i].len > max_frame){
+            max_frame = enc->out[i].len;
+        }
+    }
+    block = (enc->length < FLAC_BLOCK_SIZE) ? (int32_t)(enc->length > 16 ? enc->length : 16) : FLAC_BLOCK_SIZE;
+
+    //STREAMINFO (MD5 signature is left unset)
+    flac_bits_init(&info, sizeof(head));
+    flac_put(&info, ('f' << 24) | ('L' << 16) | ('a' << 8) | 'C', 32);
+    flac_put(&info, 0x80, 8);
+    flac_put(&info, 34, 24);
+    flac_put(&info, block, 16);
+    flac_put(&info, block, 16);
+    flac_put(&info, (uint32_t)min_frame, 24);
+    flac_put(&info, (uint32_t)max_frame, 24);
+    flac_put(&info, (uint32_t)enc->fs, 20);
+    flac_put(&info, enc->channel - 1, 3);
+    flac_put(&info, enc->bits - 1, 5);
+    flac_put(&info, (uint32_t)((uint64_t)enc->length >> 32), 4);
+    flac_put(&info, (uint32_t)enc->length, 32);
+    for(i = 0; i < 4; i++){
+        flac_put(&info, 0, 32);
+    }
+    ok = !enc->failed && !info.error;
+    if(ok){
+        memcpy(head, info.buf, sizeof(head));
+    }
+    free(info.buf);
+
+    //write (a frame that ran out of memory fails the file)
+    ok = ok && fwrite(head, 1, sizeof(head), fp) == sizeof(head);
+    for(i = 0; i < enc->frames; i++){
+        ok = ok && !enc->out[i].error && fwrite(enc->out[i].buf, 1, enc->out[i].len, fp) == enc->out[i].len;
+        free(enc->out[i].buf);
+    }
+    free(enc->out);
+
+    if(fclose(fp) != 0 || !ok){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot write the file.");
+    }
+}
+
+//Set up the encoder of one container with threads encoding threads (NATIVE samples are clipped and made signed)
+//returns -1 after reporting the error
+static int flac_encoder_init(FLAC_ENCODER *enc, PCM_SPEC *pcm_spec, int16_t channel, int threads){
+    if((pcm_spec->bits != 8 && pcm_spec->bits != 16 && pcm_spec->bits != 24 && pcm_spec->bits != 32) || pcm_spec->fs == 0 || pcm_spec->fs >= (1 << 20)){
+        return wavio_report_error(WAVIO_ERROR_BITS, "Inappropriate quantization bit number or sampling frequency.");
+    }
+
+    enc->fs = pcm_spec->fs;
+    enc->bits = pcm_spec->bits;
+    enc->channel = channel;
+    enc->length = pcm_spec->length;
+    enc->threads = (threads < 0) ? 0 : threads;
+    enc->data[0] = (int32_t *)malloc((pcm_spec->length > 0 ? pcm_spec->length : 1) * sizeof(int32_t));
+    enc->data[1] = (channel == 2) ? (int32_t *)malloc((pcm_spec->length > 0 ? pcm_spec->length : 1) * sizeof(int32_t)) : NULL;
+    if(enc->data[0] == NULL || (channel == 2 && enc->data[1] == NULL)){
+        free(enc->data[0]);
+        free(enc->data[1]);
+        return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+    }
+
+    return 0;
+}
+
+//Copy NATIVE samples into the encoder (clipping like wavwrite, 8bit made signed)
+static void flac_encoder_native(FLAC_ENCODER *enc, int c, const int32_t *src){
+    int32_t i, x;
+    int32_t max = (enc->bits == 32) ? INT32_MAX : (int32_t)((1u << (enc->bits - 1)) - 1);
+    int32_t min = (enc->bits == 32) ? INT32_MIN : -max - 1;
+    int32_t bias = (enc->bits == 8) ? 128 : 0;
+
+    for(i = 0; i < enc->length; i++){
+        x = src[i] - bias;
+        if(x > max){
+            x = max;
+        }else if(x < min){
+            x = min;
+        }
+        enc->data[c][i] = x;
+    }
+}
+
+//Quantize [-1, 1] samples into the encoder
+static void flac_encoder_pcm(FLAC_ENCODER *enc, int c, const double *src){
+    int32_t i;
+
+    wavio_pcm_to_native(src, enc->data[c], (int32_t)enc->length, enc->bits);
+    if(enc->bits == 8){
+        for(i = 0; i < enc->length; i++){
+            enc->data[c][i] -= 128;
+        }
+    }
+}
+
+//Release the encoder samples
+static void flac_encoder_free(FLAC_ENCODER *enc){
+    free(enc->data[0]);
+    free(enc->data[1]);
+}
+
+//save FLAC file from STEREO_PCM_NATIVE struct (threads: encoding threads, 0: one per online CPU)
+void flacwrite_Stereo_Native_Threads(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename, int threads){
+    FLAC_ENCODER enc;
+
+    if(flac_encoder_init(&enc, &stereo_pcm_native->pcm_spec, 2, threads) < 0){
+        return;
+    }
+    flac_encoder_native(&enc, 0, stereo_pcm_native->data[0]);
+    flac_encoder_native(&enc, 1, stereo_pcm_native->data[1]);
+    flac_write_file(&enc, filename);
+    flac_encoder_free(&enc);
+}
+
+//save FLAC file from STEREO_PCM_NATIVE struct
+void flacwrite_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename){
+    flacwrite_Stereo_Native_Threads(stereo_pcm_native, filename, 0);
+}
+
+//save FLAC file from STEREO_PCM struct (threads: encoding threads, 0: one per online CPU)
+void flacwrite_Stereo_Threads(STEREO_PCM *stereo_pcm, char *filename, int threads){
+    FLAC_ENCODER enc;
+
+    if(flac_encoder_init(&enc, &stereo_pcm->pcm_spec, 2, threads) < 0){
+        return;
+    }
+    flac_encoder_pcm(&enc, 0, stereo_pcm->data[0]);
+    flac_encoder_pcm(&enc, 1, stereo_pcm->data[1]);
+    flac_write_file(&enc, filename);
+    flac_encoder_free(&enc);
+}
+
+//save FLAC file from STEREO_PCM struct
+void flacwrite_Stereo(STEREO_PCM *stereo_pcm, char *filename){
+    flacwrite_Stereo_Threads(stereo_pcm, filename, 0);
+}
+
+//save FLAC file from MONO_PCM_NATIVE struct (threads: encoding threads, 0: one per online CPU)
+void flacwrite_Mono_Native_Threads(MONO_PCM_NATIVE *mono_pcm_native, char *filename, int threads){
+    FLAC_ENCODER enc;
+
+    if(flac_encoder_init(&enc, &mono_pcm_native->pcm_spec, 1, threads) < 0){
+        return;
+    }
+    flac_encoder_native(&enc, 0, mono_pcm_native->data);
+    flac_write_file(&enc, filename);
+    flac_encoder_free(&enc);
+}
+
+//save FLAC file from MONO_PCM_NATIVE struct
+void flacwrite_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename){
+    flacwrite_Mono_Native_Threads(mono_pcm_native, filename, 0);
+}
+
+//save FLAC file from MONO_PCM struct (threads: encoding threads, 0: one per online CPU)
+void flacwrite_Mono_Threads(MONO_PCM *mono_pcm, char *filename, int threads){
+    FLAC_ENCODER enc;
+
+    if(flac_encoder_init(&enc, &mono_pcm->pcm_spec, 1, threads) < 0){
+        return;
+    }
+    flac_encoder_pcm(&enc, 0, mono_pcm->data);
+    flac_write_file(&enc, filename);
+    flac_encoder_free(&enc);
+}
+
+//save FLAC file from MONO_PCM struct
+void flacwrite_Mono(MONO_PCM *mono_pcm, char *filename){
+    flacwrite_Mono_Threads(mono_pcm, filename, 0);
+}
+
+/* decoder */
+//Count leading zeros of a non-zero 64bit word
+static int flac_clz(uint64_t x){
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+
+    while(!(x & ((uint64_t)1 << 63))){
+        x <<= 1;
+        n++;
+    }
+
+    return n;
+#endif
+}
+
+//Load whole bytes into the cache
+static void flac_refill(FLAC_READER *br){
+    while(br->bits <= 56 && br->pos < br->len){
+        br->cache |= (uint64_t)br->buf[br->pos++] << (56 - br->bits);
+        br->bits += 8;
+    }
+}
+
+//Read n bits (n <= 32)
+static uint32_t flac_get(FLAC_READER *br, int n){
+    uint32_t v;
+
+    if(n == 0){
+        return 0;
+    }
+    if(br->bits < n){
+        flac_refill(br);
+        if(br->bits < n){
+            br->error = 1;
+            return 0;
+        }
+    }
+    v = (uint32_t)(br->cache >> (64 - n));
+    br->cache <<= n;
+    br->bits -= n;
+
+    return v;
+}
+
+//Read a two's complement value of n bits (n <= 32)
+static int32_t flac_get_signed(FLAC_READER *br, int n){
+    uint32_t v = flac_get(br, n);
+
+    if(n == 0){
+        return 0;
+    }
+    if(n < 32 && (v >> (n - 1))){
+        v |= ~(uint32_t)0 << n;
+    }
+
+    return (int32_t)v;
+}
+
+//Read a unary code (number of zeros before a one)
+static uint32_t flac_get_unary(FLAC_READER *br){
+    uint32_t q = 0;
+    int lz;
+
+    for(;;){
+        if(br->bits == 0){
+            flac_refill(br);
+            if(br->bits == 0){
+                br->error = 1;
+                return 0;
+            }
+        }
+        if(br->cache == 0){
+            q += br->bits;
+            br->bits = 0;
+            continue;
+        }
+        lz = flac_clz(br->cache);
+        q += lz;
+        br->cache = (lz < 63) ? br->cache << (lz + 1) : 0;
+        br->bits -= lz + 1;
+        return q;
+    }
+}
+
+//Skip to the next byte boundary
+static void flac_align(FLAC_READER *br){
+    int drop = br->bits & 7;
+
+    br->cache <<= drop;
+    br->bits -= drop;
+}
+
+//Byte offset of the reader (on a byte boundary)
+static size_t flac_tell(FLAC_READER *br){
+    return br->pos - br->bits / 8;
+}
+
+//Move the reader to a byte offset
+static void flac_seek(FLAC_READER *br, size_t pos){
+    br->pos = pos;
+    br->cache = 0;
+    br->bits = 0;
+}
+
+//Decode a Rice coded residual into res (samples order .. n - 1)
+static int flac_decode_residual(FLAC_READER *br, int32_t *res, int32_t n, int order){
+    int method, porder, p, k, escape, pbits, nbits;
+    int32_t i, size, count;
+    uint32_t u;
+
+    method = (int)flac_get(br, 2);
+    if(method > 1){
+        return 0;
+    }
+    pbits = method ? 5 : 4;
+    escape = method ? 31 : 15;
+    porder = (int)flac_get(br, 4);
+    size = n >> porder;
+    if((size << porder) != n || size < order){
+        return 0;
+    }
+
+    for(p = 0; p < (1 << porder); p++){
+        count = (p == 0) ? size - order : size;
+        k = (int)flac_get(br, pbits);
+        if(k == escape){
+            //unencoded partition
+            nbits = (int)flac_get(br, 5);
+            for(i = 0; i < count; i++){
+                res[i] = flac_get_signed(br, nbits);
+            }
+        }else{
+            for(i = 0; i < count; i++){
+                u = (flac_get_unary(br) << k) | flac_get(br, k);
+                res[i] = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+            }
+        }
+        res += count;
+        if(br->error){
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+//Decode one subframe of n samples with bits per sample
+static int flac_decode_subframe(FLAC_READER *br, int32_t *out, int32_t n, int bits){
+    int type, wasted = 0, order, precision, shift, j;
+    int32_t coef[32];
+    int32_t i;
+    int64_t sum;
+    int32_t sum32;
+
+    if(flac_get(br, 1) != 0){
+        return 0;
+    }
+    type = (int)flac_get(br, 6);
+    if(flac_get(br, 1)){
+        wasted = (int)flac_get_unary(br) + 1;
+        bits -= wasted;
+    }
+    if(bits <= 0 || bits > 32){
+        return 0;
+    }
+
+    if(type == 0){
+        //constant
+        out[0] = flac_get_signed(br, bits);
+        for(i = 1; i < n; i++){
+            out[i] = out[0];
+        }
+    }else if(type == 1){
+        //verbatim
+        for(i = 0; i < n; i++){
+            out[i] = flac_get_signed(br, bits);
+        }
+    }else if(type >= 8 && type <= 12){
+        //fixed polynomial predictor
+        order = type - 8;
+        if(order > n){
+            return 0;
+        }
+        for(i = 0; i < order; i++){
+            out[i] = flac_get_signed(br, bits);
+        }
+        if(!flac_decode_residual(br, out + order, n, order)){
+            return 0;
+        }
+        switch(order){
+            case 1:
+                for(i = 1; i < n; i++){
+                    out[i] += out[i - 1];
+                }
+                break;
+            case 2:
+                for(i = 2; i < n; i++){
+                    out[i] = (int32_t)(out[i] + 2 * (int64_t)out[i - 1] - out[i - 2]);
+                }
+                break;
+            case 3:
+                for(i = 3; i < n; i++){
+                    out[i] = (int32_t)(out[i] + 3 * ((int64_t)out[i - 1] - out[i - 2]) + out[i - 3]);
+                }
+                break;
+            case 4:
+                for(i = 4; i < n; i++){
+                    out[i] = (int32_t)(out[i] + 4 * ((int64_t)out[i - 1] + out[i - 3]) - 6 * (int64_t)out[i - 2] - out[i - 4]);
+                }
+                break;
+        }
+    }else if(type >= 32){
+        //LPC
+        order = type - 31;
+        if(order > n){
+            return 0;
+        }
+        for(i = 0; i < order; i++){
+            out[i] = flac_get_signed(br, bits);
+        }
+        precision = (int)flac_get(br, 4) + 1;
+        shift = flac_get_signed(br, 5);
+        if(precision == 16 || shift < 0){
+            return 0;
+        }
+        for(j = 0; j < order; j++){
+            coef[j] = flac_get_signed(br, precision);
+        }
+        if(!flac_decode_residual(br, out + order, n, order)){
+            return 0;
+        }
+
+        //32bit accumulation when it cannot overflow
+        for(j = 0; (1 << j) < order; j++){
+        }
+        if(bits + precision + j <= 32){
+            for(i = order; i < n; i++){
+                sum32 = 0;
+                for(j = 0; j < order; j++){
+                    sum32 += coef[j] * out[i - 1 - j];
+                }
+                out[i] += sum32 >> shift;
+            }
+        }else{
+            for(i = order; i < n; i++){
+                sum = 0;
+                for(j = 0; j < order; j++){
+                    sum += (int64_t)coef[j] * out[i - 1 - j];
+                }
+                out[i] = (int32_t)(out[i] + (sum >> shift));
+            }
+        }
+    }else{
+        return 0;
+    }
+
+    //restore wasted bits
+    if(wasted > 0){
+        for(i = 0; i < n; i++){
+            out[i] = (int32_t)((uint32_t)out[i] << wasted);
+        }
+    }
+
+    return !br->error;
+}
+
+//Parse and decode one frame (returns 1 on success, 0 at a bad frame, -1 when out of memory)
+static int flac_decode_frame(FLAC_READER *br, FLAC_STREAM *stream, const FLAC_CRC *crc){
+    static const int size_bits[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+    size_t start = flac_tell(br);
+    int code, rate, assignment, bits, channels, c, ones, sbps, variable;
+    int32_t n, i;
+    int64_t m, s, need, cap;
+    uint64_t number;
+    int32_t *grown;
+    uint32_t byte;
+    uint32_t stored, computed; /* CRC in the stream and of the bytes before it */
+
+    //frame header
+    if(flac_get(br, 15) != 0x7FFC){
+        return 0;
+    }
+    variable = (int)flac_get(br, 1);
+    code = (int)flac_get(br, 4);
+    rate = (int)flac_get(br, 4);
+    assignment = (int)flac_get(br, 4);
+    bits = size_bits[flac_get(br, 3)];
+    if(flac_get(br, 1) != 0 || code == 0 || rate == 15 || assignment > FLAC_MID_SIDE){
+        return 0;
+    }
+    if(bits == 0){
+        bits = stream->bits;
+    }
+    channels = (assignment < FLAC_LEFT_SIDE) ? assignment + 1 : 2;
+    if(channels != stream->channel){
+        return 0;
+    }
+
+    //frame number (fixed block size) or sample number (variable block size), UTF-8 like coding
+    byte = flac_get(br, 8);
+    for(ones = 0; ones < 8 && (byte & (0x80u >> ones)); ones++){
+    }
+    if(ones == 1 || ones > 7){
+        return 0;
+    }
+    number = byte & (0x7Fu >> ones);
+    for(c = 1; c < ones; c++){
+        byte = flac_get(br, 8);
+        if((byte & 0xC0) != 0x80){
+            return 0;
+        }
+        number = (number << 6) | (byte & 0x3F);
+    }
+
+    //block size
+    if(code == 1){
+        n = 192;
+    }else if(code <= 5){
+        n = 576 << (code - 2);
+    }else if(code == 6){
+        n = (int32_t)flac_get(br, 8) + 1;
+    }else if(code == 7){
+        n = (int32_t)flac_get(br, 16) + 1;
+    }else{
+        n = 256 << (code - 8);
+    }
+
+    //sample rate that is not a standard one (only skipped)
+    if(rate == 12){
+        flac_get(br, 8);
+    }else if(rate == 13 || rate == 14){
+        flac_get(br, 16);
+    }
+
+    //header CRC (of the bytes before the stored one)
+    if(br->error){
+        return 0;
+    }
+    computed = flac_crc8(crc, br->buf + start, flac_tell(br) - start);
+    stored = flac_get(br, 8);
+    if(br->error || stored != computed){
+        return 0;
+    }
+
+    //a frame that does not follow the previous one means frames are missing
+    if(number != (uint64_t)(variable ? stream->length : stream->frames)){
+        return 0;
+    }
+
+    //grow the channel arrays (a stream longer than PCM_SPEC can hold is refused)
+    need = stream->length + n;
+    if(need > INT32_MAX){
+        return 0;
+    }
+    if(need > stream->cap){
+        cap = (need > 2 * stream->cap) ? need : 2 * stream->cap;
+        for(c = 0; c < channels; c++){
+            grown = (int32_t *)realloc(stream->data[c], cap * sizeof(int32_t));
+            if(grown == NULL){
+                return -1;
+            }
+            stream->data[c] = grown;
+        }
+        stream->cap = cap;
+    }
+
+    //subframes (the side channel has one more bit)
+    for(c = 0; c < channels; c++){
+        sbps = bits;
+        if((assignment == FLAC_LEFT_SIDE && c == 1) || (assignment == FLAC_SIDE_RIGHT && c == 0) || (assignment == FLAC_MID_SIDE && c == 1)){
+            sbps++;
+        }
+        if(!flac_decode_subframe(br, stream->data[c] + stream->length, n, sbps)){
+            return 0;
+        }
+    }
+
+    //footer CRC (of the frame up to the stored one)
+    flac_align(br);
+    if(br->error){
+        return 0;
+    }
+    computed = flac_crc16(crc, br->buf + start, flac_tell(br) - start);
+    stored = flac_get(br, 16);
+    if(br->error || stored != computed){
+        return 0;
+    }
+
+    //undo the stereo decorrelation
+    if(assignment >= FLAC_LEFT_SIDE){
+        int32_t *a = stream->data[0] + stream->length;
+        int32_t *b = stream->data[1] + stream->length;
+
+        for(i = 0; i < n; i++){
+            switch(assignment){
+                case FLAC_LEFT_SIDE:
+                    b[i] = a[i] - b[i];
+                    break;
+                case FLAC_SIDE_RIGHT:
+                    a[i] = a[i] + b[i];
+                    break;
+                default:
+                    s = b[i];
+                    m = ((int64_t)a[i] * 2) | (s & 1);
+                    a[i] = (int32_t)((m + s) >> 1);
+                    b[i] = (int32_t)((m - s) >> 1);
+                    break;
+            }
+        }
+    }
+
+    stream->length += n;
+    stream->frames++;
+
+    return 1;
+}
+
+//Release the channel arrays of a stream
+static void flac_stream_free(FLAC_STREAM *stream){
+    int c;
+
+    for(c = 0; c < 8; c++){
+        free(stream->data[c]);
+        stream->data[c] = NULL;
+    }
+}
+
+//Give up reading a FLAC file: free the file contents and the channel arrays and report the error (returns -1)
+static int flac_reject(FLAC_STREAM *stream, uint8_t *buf, int32_t code, const char *message){
+    free(buf);
+    flac_stream_free(stream);
+
+    return wavio_report_error(code, message);
+}
+
+//Read a whole FLAC file into signed channel arrays (returns -1 after reporting the error)
+static int flac_read_file(FLAC_STREAM *stream, char *filename){
+    FILE *fp;
+    uint8_t *buf;
+    size_t len, pos = 0;
+    FLAC_READER br;
+    FLAC_CRC crc;
+    int last = 0, type, c, ret;
+    uint32_t size;
+    int found = 0;
+    long end;
+
+    //whole file into memory
+    for(c = 0; c < 8; c++){
+        stream->data[c] = NULL;
+    }
+    fp = fopen(filename, "rb");
+    if(fp == NULL){
+        return wavio_report_error(WAVIO_ERROR_OPEN, "Cannot open the file.");
+    }
+    fseek(fp, 0, SEEK_END);
+    end = ftell(fp);
+    len = (end > 0) ? (size_t)end : 0;
+    fseek(fp, 0, SEEK_SET);
+    buf = (uint8_t *)malloc(len > 0 ? len : 1);
+    if(buf == NULL || fread(buf, 1, len, fp) != len){
+        fclose(fp);
+        return flac_reject(stream, buf, WAVIO_ERROR_IO, "Cannot read the file.");
+    }
+    fclose(fp);
+
+    //ID3v2 tag
+    if(len >= 10 && memcmp(buf, "ID3", 3) == 0){
+        pos = 10 + (((size_t)buf[6] & 0x7F) << 21 | ((size_t)buf[7] & 0x7F) << 14 | ((size_t)buf[8] & 0x7F) << 7 | ((size_t)buf[9] & 0x7F));
+        if(buf[5] & 0x10){
+            pos += 10;
+        }
+    }
+    if(pos + 4 > len || memcmp(buf + pos, "fLaC", 4) != 0){
+        return flac_reject(stream, buf, WAVIO_ERROR_FORMAT, "The file is not FLAC file.");
+    }
+    pos += 4;
+
+    //metadata blocks (only STREAMINFO is used)
+    while(!last){
+        if(pos + 4 > len){
+            return flac_reject(stream, buf, WAVIO_ERROR_FORMAT, "The file is not FLAC file.");
+        }
+        last = buf[pos] >> 7;
+        type = buf[pos] & 0x7F;
+        size = ((uint32_t)buf[pos + 1] << 16) | ((uint32_t)buf[pos + 2] << 8) | buf[pos + 3];
+        pos += 4;
+        if(pos + size > len){
+            return flac_reject(stream, buf, WAVIO_ERROR_FORMAT, "The file is not FLAC file.");
+        }
+        if(type == 0 && size >= 34){
+            br.buf = buf + pos + 10;
+            br.len = 8;
+            flac_seek(&br, 0);
+            br.error = 0;
+            stream->fs = flac_get(&br, 20);
+            stream->channel = (int16_t)(flac_get(&br, 3) + 1);
+            stream->bits = (int16_t)(flac_get(&br, 5) + 1);
+            stream->total = (int64_t)flac_get(&br, 4) << 32;
+            stream->total |= flac_get(&br, 32);
+            found = 1;
+        }
+        pos += size;
+    }
+    if(!found){
+        return flac_reject(stream, buf, WAVIO_ERROR_FORMAT, "The file does not have STREAMINFO block.");
+    }
+    if(stream->total > INT32_MAX){
+        return flac_reject(stream, buf, WAVIO_ERROR_FORMAT, "The file is too long.");
+    }
+
+    //channel arrays (the sample count may be unknown)
+    //the 36bit total is only trusted as far as the file size can back it (no more samples per channel than bytes),
+    //the arrays grow beyond that as frames actually decode
+    stream->length = 0;
+    stream->cap = (stream->total > 0) ? stream->total : FLAC_BLOCK_SIZE;
+    if(stream->cap > (int64_t)len + FLAC_BLOCK_SIZE){
+        stream->cap = (int64_t)len + FLAC_BLOCK_SIZE;
+    }
+    for(c = 0; c < stream->channel; c++){
+        stream->data[c] = (int32_t *)malloc(stream->cap * sizeof(int32_t));
+        if(stream->data[c] == NULL){
+            return flac_reject(stream, buf, WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        }
+    }
+
+    //frames: each one must decode and follow the previous one
+    //(bytes without a sync code end the stream, e.g. a trailing ID3v1 tag)
+    flac_crc_init(&crc);
+    br.buf = buf;
+    br.len = len;
+    br.error = 0;
+    flac_seek(&br, pos);
+    stream->frames = 0;
+    while(pos + 2 <= len && (stream->total == 0 || stream->length < stream->total)){
+        if(buf[pos] != 0xFF || (buf[pos + 1] & 0xFE) != 0xF8){
+            break;
+        }
+        ret = flac_decode_frame(&br, stream, &crc);
+        if(ret < 0){
+            return flac_reject(stream, buf, WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        }
+        if(ret == 0){
+            return flac_reject(stream, buf, WAVIO_ERROR_FORMAT, "The file has a broken or missing frame.");
+        }
+        pos = flac_tell(&br);
+    }
+    free(buf);
+
+    //the stream must hold exactly the samples STREAMINFO announces
+    if(stream->total > 0 && stream->length != stream->total){
+        return flac_reject(stream, NULL, WAVIO_ERROR_FORMAT, "The number of samples does not match STREAMINFO.");
+    }
+
+    return 0;
+}
+
+//Convert signed samples of the stream to a NATIVE container width (8, 16, 24 or 32 bits)
+static int16_t flac_native_bits(FLAC_STREAM *stream, int32_t *data){
+    int16_t bits = (stream->bits <= 8) ? 8 : (stream->bits <= 16) ? 16 : (stream->bits <= 24) ? 24 : 32;
+    int shift = bits - stream->bits;
+    int32_t bias = (bits == 8) ? 128 : 0;
+    int64_t i;
+
+    for(i = 0; i < stream->length; i++){
+        data[i] = (int32_t)((uint32_t)data[i] << shift) + bias;
+    }
+
+    return bits;
+}
+
+//Read a FLAC file and check its channel number (returns -1 after reporting the error)
+static int flac_read_channels(FLAC_STREAM *stream, char *filename, int16_t channel){
+    if(flac_read_file(stream, filename) < 0){
+        return -1;
+    }
+    if(stream->channel != channel){
+        return flac_reject(stream, NULL, WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+    }
+
+    return 0;
+}
+
+//Convert the stream to [-1, 1] arrays (returns -1 after reporting the error, the stream is freed either way)
+static int flac_stream_to_pcm(FLAC_STREAM *stream, double **data, int16_t *bits){
+    int c;
+
+    for(c = 0; c < stream->channel; c++){
+        data[c] = (double *)calloc(stream->length > 0 ? stream->length : 1, sizeof(double));
+        if(data[c] == NULL){
+            while(c > 0){
+                free(data[--c]);
+            }
+            return flac_reject(stream, NULL, WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        }
+    }
+    for(c = 0; c < stream->channel; c++){
+        *bits = flac_native_bits(stream, stream->data[c]);
+        wavio_native_to_pcm(stream->data[c], data[c], (int32_t)stream->length, *bits);
+    }
+    flac_stream_free(stream);
+
+    return 0;
+}
+
+//Read and insert STEREO_PCM_NATIVE data
+void flacread_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename){
+    FLAC_STREAM stream;
+
+    if(flac_read_channels(&stream, filename, 2) < 0){
+        return;
+    }
+    stereo_pcm_native->pcm_spec.fs = stream.fs;
+    stereo_pcm_native->pcm_spec.length = (int32_t)stream.length;
+    stereo_pcm_native->pcm_spec.bits = flac_native_bits(&stream, stream.data[0]);
+    flac_native_bits(&stream, stream.data[1]);
+    stereo_pcm_native->data[0] = stream.data[0];
+    stereo_pcm_native->data[1] = stream.data[1];
+}
+
+//Read data and insert STEREO_PCM struct
+void flacread_Stereo(STEREO_PCM *stereo_pcm, char *filename){
+    FLAC_STREAM stream;
+    double *data[2];
+    int16_t bits;
+
+    if(flac_read_channels(&stream, filename, 2) < 0 || flac_stream_to_pcm(&stream, data, &bits) < 0){
+        return;
+    }
+    stereo_pcm->pcm_spec.fs = stream.fs;
+    stereo_pcm->pcm_spec.length = (int32_t)stream.length;
+    stereo_pcm->pcm_spec.bits = bits;
+    stereo_pcm->data[0] = data[0];
+    stereo_pcm->data[1] = data[1];
+}
+
+//Read data and insert MONO_PCM_NATIVE struct
+void flacread_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename){
+    FLAC_STREAM stream;
+
+    if(flac_read_channels(&stream, filename, 1) < 0){
+        return;
+    }
+    mono_pcm_native->pcm_spec.fs = stream.fs;
+    mono_pcm_native->pcm_spec.length = (int32_t)stream.length;
+    mono_pcm_native->pcm_spec.bits = flac_native_bits(&stream, stream.data[0]);
+    mono_pcm_native->data = stream.data[0];
+}
+
+//Read data and insert MONO_PCM struct
+void flacread_Mono(MONO_PCM *mono_pcm, char *filename){
+    FLAC_STREAM stream;
+    double *data[1];
+    int16_t bits;
+
+    if(flac_read_channels(&stream, filename, 1) < 0 || flac_stream_to_pcm(&stream, data, &bits) < 0){
+        return;
+    }
+    mono_pcm->pcm_spec.fs = stream.fs;
+    mono_pcm->pcm_spec.length = (int32_t)stream.length;
+    mono_pcm->pcm_spec.bits = bits;
+    mono_pcm->data = data[0];
+}
+
+
+#ifdef __cplusplus
+}
+#endif
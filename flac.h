@@ -0,0 +1,55 @@
+/*flac.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_FLAC
+#define INCLUDED_FLAC
+
+#include <stdint.h>
+#include "wavio.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//samples per channel in each frame written by the encoder
+#define FLAC_BLOCK_SIZE 4096
+
+//highest LPC order tried by the encoder
+#define FLAC_MAX_LPC_ORDER 8
+
+//highest partition order of the Rice coded residual
+#define FLAC_MAX_PARTITION_ORDER 8
+
+//most threads used by the encoder
+#define FLAC_MAX_THREADS 64
+
+//Prototype declaration for flac.c
+/* using MONO_PCM_NATIVE struct*/
+void flacread_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename);
+void flacwrite_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename);
+void flacwrite_Mono_Native_Threads(MONO_PCM_NATIVE *mono_pcm_native, char *filename, int threads);
+
+/* using MONO_PCM struct */
+void flacread_Mono(MONO_PCM *mono_pcm, char *filename);
+void flacwrite_Mono(MONO_PCM *mono_pcm, char *filename);
+void flacwrite_Mono_Threads(MONO_PCM *mono_pcm, char *filename, int threads);
+
+/* using STEREO_PCM_NATIVE struct */
+void flacread_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename);
+void flacwrite_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename);
+void flacwrite_Stereo_Native_Threads(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename, int threads);
+
+/* using STEREO_PCM struct */
+void flacread_Stereo(STEREO_PCM *stereo_pcm, char *filename);
+void flacwrite_Stereo(STEREO_PCM *stereo_pcm, char *filename);
+void flacwrite_Stereo_Threads(STEREO_PCM *stereo_pcm, char *filename, int threads);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
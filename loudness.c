@@ -0,0 +1,415 @@
+/* loudness.c (beta)*/
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+/* include prototype header file */
+#include "loudness.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//frames K-weighted at once
+#define LOUDNESS_CHUNK 4096
+
+//frames read at once by getLOUDNESSINFO
+#define LOUDNESS_READ_FRAMES 65536
+
+//gates of the integrated loudness (LUFS, LU)
+#define LOUDNESS_ABSOLUTE_GATE -70.0
+#define LOUDNESS_RELATIVE_GATE -10.0
+
+//K-weighting filter for any sampling frequency (the analog prototypes of the 48 kHz coefficients in BS.1770)
+static void loudness_k_weight(BIQUAD *biquad, uint64_t fs){
+    double K, Q, Vh, Vb, a0;
+
+    //high shelf (+4 dB, head effects)
+    K = tan(M_PI * 1681.974450955533 / fs);
+    Q = 0.7071752369554196;
+    Vh = pow(10.0, 3.999843853973347 / 20.0);
+    Vb = pow(Vh, 0.4996667741545416);
+    a0 = 1.0 + K / Q + K * K;
+    biquad[0].b0 = (Vh + Vb * K / Q + K * K) / a0;
+    biquad[0].b1 = 2.0 * (K * K - Vh) / a0;
+    biquad[0].b2 = (Vh - Vb * K / Q + K * K) / a0;
+    biquad[0].a1 = 2.0 * (K * K - 1.0) / a0;
+    biquad[0].a2 = (1.0 - K / Q + K * K) / a0;
+
+    //high pass (RLB weighting)
+    K = tan(M_PI * 38.13547087602444 / fs);
+    Q = 0.5003270373238773;
+    a0 = 1.0 + K / Q + K * K;
+    biquad[1].b0 = 1.0;
+    biquad[1].b1 = -2.0;
+    biquad[1].b2 = 1.0;
+    biquad[1].a1 = 2.0 * (K * K - 1.0) / a0;
+    biquad[1].a2 = (1.0 - K / Q + K * K) / a0;
+}
+
+//Loudness (LUFS) of a mean square summed over channels
+static double loudness_lufs(double z){
+    return (z > 0.0) ? -0.691 + 10.0 * log10(z) : -HUGE_VAL;
+}
+
+//Allocate LOUDNESS struct
+//returns NULL after reporting the error (wavio_set_error_mode)
+LOUDNESS *alloc_Loudness(uint64_t fs, int16_t channel){
+    //allocate LOUDNESS struct
+    LOUDNESS *loudness;
+    BIQUAD biquad[2];
+    int16_t ch;
+
+    if(fs < 8000){
+        wavio_report_error(WAVIO_ERROR_ARGUMENT, "Inappropriate loudness parameter.");
+        return NULL;
+    }
+    if(channel < 1 || channel > 2){
+        wavio_report_error(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+        return NULL;
+    }
+
+    loudness = (LOUDNESS *)calloc(1, sizeof(LOUDNESS));
+    if(loudness == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the loudness meter.");
+        return NULL;
+    }
+    loudness->fs = fs;
+    loudness->channel = channel;
+
+    //K-weighting
+    loudness_k_weight(biquad, fs);
+    loudness->weight = alloc_IIR(biquad, 2, channel);
+    if(loudness->weight == NULL){
+        free_Loudness(loudness);
+        return NULL;
+    }
+
+    //true peak: 4x oversampling below 96 kHz, 2x below 192 kHz
+    if(fs < 96000){
+        loudness->oversample = alloc_Resampler(fs, 4 * fs, channel, RESAMPLE_MEDIUM);
+    }else if(fs < 192000){
+        loudness->oversample = alloc_Resampler(fs, 2 * fs, channel, RESAMPLE_MEDIUM);
+    }else{
+        loudness->oversample = NULL;
+    }
+    if(fs < 192000 && loudness->oversample == NULL){
+        free_Loudness(loudness);
+        return NULL;
+    }
+    loudness->over_cap = 4 * LOUDNESS_CHUNK + 64;
+
+    for(ch = 0; ch < 2; ch++){
+        loudness->work[ch] = (ch < channel) ? (double *)malloc(LOUDNESS_CHUNK * sizeof(double)) : NULL;
+        loudness->over[ch] = (ch < channel) ? (double *)malloc(loudness->over_cap * sizeof(double)) : NULL;
+    }
+
+    //gating blocks
+    loudness->sub_len = (int32_t)((fs + 5) / 10);
+    loudness->sub_fill = 0;
+    loudness->sub_sum = 0.0;
+    memset(loudness->sub, 0, sizeof(loudness->sub));
+    loudness->subs = 0;
+    loudness->block_cap = 1024;
+    loudness->block_count = 0;
+    loudness->blocks = (double *)malloc(loudness->block_cap * sizeof(double));
+    for(ch = 0; ch < channel; ch++){
+        if(loudness->work[ch] == NULL || loudness->over[ch] == NULL){
+            break;
+        }
+    }
+    if(ch < channel || loudness->blocks == NULL){
+        free_Loudness(loudness);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the loudness meter.");
+        return NULL;
+    }
+
+    loudness->momentary_max = -HUGE_VAL;
+    loudness->short_term_max = -HUGE_VAL;
+    loudness->sample_peak = 0.0;
+    loudness->true_peak = 0.0;
+
+    return loudness;
+}
+
+//Free LOUDNESS struct
+void free_Loudness(LOUDNESS *loudness){
+    int16_t ch;
+
+    //free filters and buffers (parts may be missing after a failed alloc_Loudness)
+    if(loudness->weight != NULL){
+        free_IIR(loudness->weight);
+    }
+    if(loudness->oversample != NULL){
+        free_Resampler(loudness->oversample);
+    }
+    for(ch = 0; ch < 2; ch++){
+        free(loudness->work[ch]);
+        free(loudness->over[ch]);
+    }
+    free(loudness->blocks);
+
+    //free LOUDNESS struct
+    free(loudness);
+}
+
+//Mean square of the latest n sub-blocks
+static double loudness_mean(LOUDNESS *loudness, int32_t n){
+    double z = 0.0;
+    int32_t i;
+
+    for(i = 1; i <= n; i++){
+        z += loudness->sub[(loudness->subs - i) % LOUDNESS_SHORT_TERM];
+    }
+
+    return z / n;
+}
+
+//A 100 ms sub-block is complete: update the 400 ms blocks and the short-term window
+//returns -1 after reporting a failed growth of the gating blocks
+static int loudness_sub_block(LOUDNESS *loudness){
+    double *grown;
+    double z;
+
+    loudness->sub[loudness->subs % LOUDNESS_SHORT_TERM] = loudness->sub_sum / loudness->sub_len;
+    loudness->subs++;
+    loudness->sub_sum = 0.0;
+    loudness->sub_fill = 0;
+
+    //momentary: 400 ms blocks overlapping by 75 %
+    if(loudness->subs >= 4){
+        z = loudness_mean(loudness, 4);
+        if(loudness->block_count == loudness->block_cap){
+            grown = (double *)realloc(loudness->blocks, 2 * loudness->block_cap * sizeof(double));
+            if(grown == NULL){
+                return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the gating blocks.");
+            }
+            loudness->blocks = grown;
+            loudness->block_cap *= 2;
+        }
+        loudness->blocks[loudness->block_count++] = z;
+        if(loudness_lufs(z) > loudness->momentary_max){
+            loudness->momentary_max = loudness_lufs(z);
+        }
+    }
+
+    //short-term: 3 s window
+    if(loudness->subs >= LOUDNESS_SHORT_TERM){
+        z = loudness_mean(loudness, LOUDNESS_SHORT_TERM);
+        if(loudness_lufs(z) > loudness->short_term_max){
+            loudness->short_term_max = loudness_lufs(z);
+        }
+    }
+
+    return 0;
+}
+
+//Largest absolute value of n samples
+static double loudness_peak(const double *x, int32_t n, double peak){
+    int32_t i;
+
+    for(i = 0; i < n; i++){
+        peak = (fabs(x[i]) > peak) ? fabs(x[i]) : peak;
+    }
+
+    return peak;
+}
+
+//Peaks of the oversampled output
+static void loudness_over_peak(LOUDNESS *loudness, int32_t n){
+    int16_t ch;
+
+    for(ch = 0; ch < loudness->channel; ch++){
+        loudness->true_peak = loudness_peak(loudness->over[ch], n, loudness->true_peak);
+    }
+}
+
+//Measure consecutive frames of channel arrays (data is not modified)
+//returns -1 after reporting a failed allocation
+int loudness_Block(LOUDNESS *loudness, double **data, int32_t frames){
+    int32_t done = 0;
+    int32_t n, m, i, seg;
+    double sum, *src[2];
+    int16_t ch;
+
+    while(done < frames){
+        n = (frames - done < LOUDNESS_CHUNK) ? frames - done : LOUDNESS_CHUNK;
+
+        //peaks
+        for(ch = 0; ch < loudness->channel; ch++){
+            src[ch] = data[ch] + done;
+            loudness->sample_peak = loudness_peak(src[ch], n, loudness->sample_peak);
+        }
+        if(loudness->oversample != NULL){
+            m = resample_Block(loudness->oversample, src, n, loudness->over, loudness->over_cap);
+            if(m < 0){
+                return -1;
+            }
+            loudness_over_peak(loudness, m);
+        }
+
+        //K-weighting on a copy
+        for(ch = 0; ch < loudness->channel; ch++){
+            memcpy(loudness->work[ch], src[ch], n * sizeof(double));
+        }
+        iir_Block(loudness->weight, loudness->work, n);
+
+        //mean squares of the sub-blocks (channel weights are 1 for left and right)
+        for(i = 0; i < n; i += seg){
+            seg = loudness->sub_len - loudness->sub_fill;
+            seg = (n - i < seg) ? n - i : seg;
+            sum = 0.0;
+            for(ch = 0; ch < loudness->channel; ch++){
+                const double *w = loudness->work[ch] + i;
+                int32_t j;
+
+                for(j = 0; j < seg; j++){
+                    sum += w[j] * w[j];
+                }
+            }
+            loudness->sub_sum += sum;
+            loudness->sub_fill += seg;
+            if(loudness->sub_fill == loudness->sub_len && loudness_sub_block(loudness) != 0){
+                return -1;
+            }
+        }
+
+        done += n;
+    }
+
+    return 0;
+}
+
+//Call after the last block (the interpolator still holds the last samples for the true peak)
+//returns -1 after reporting a failed allocation
+int loudness_Finish(LOUDNESS *loudness){
+    int32_t n;
+
+    if(loudness->oversample == NULL){
+        return 0;
+    }
+    while((n = resample_Flush(loudness->oversample, loudness->over, loudness->over_cap)) > 0){
+        loudness_over_peak(loudness, n);
+    }
+
+    return (n < 0) ? -1 : 0;
+}
+
+//Momentary loudness (LUFS) of the latest 400 ms
+double loudness_Momentary(LOUDNESS *loudness){
+    return (loudness->subs >= 4) ? loudness_lufs(loudness_mean(loudness, 4)) : -HUGE_VAL;
+}
+
+//Short-term loudness (LUFS) of the latest 3 s
+double loudness_Short_Term(LOUDNESS *loudness){
+    return (loudness->subs >= LOUDNESS_SHORT_TERM) ? loudness_lufs(loudness_mean(loudness, LOUDNESS_SHORT_TERM)) : -HUGE_VAL;
+}
+
+//Integrated loudness (LUFS) of everything measured so far (absolute and relative gates)
+double loudness_Integrated(LOUDNESS *loudness){
+    double z, gate;
+    int64_t i, count;
+
+    //absolute gate
+    z = 0.0;
+    count = 0;
+    for(i = 0; i < loudness->block_count; i++){
+        if(loudness_lufs(loudness->blocks[i]) > LOUDNESS_ABSOLUTE_GATE){
+            z += loudness->blocks[i];
+            count++;
+        }
+    }
+    if(count == 0){
+        return -HUGE_VAL;
+    }
+
+    //relative gate
+    gate = loudness_lufs(z / count) + LOUDNESS_RELATIVE_GATE;
+    z = 0.0;
+    count = 0;
+    for(i = 0; i < loudness->block_count; i++){
+        if(loudness_lufs(loudness->blocks[i]) > LOUDNESS_ABSOLUTE_GATE && loudness_lufs(loudness->blocks[i]) > gate){
+            z += loudness->blocks[i];
+            count++;
+        }
+    }
+
+    return (count > 0) ? loudness_lufs(z / count) : -HUGE_VAL;
+}
+
+//True peak (dBTP) of everything measured so far
+double loudness_True_Peak(LOUDNESS *loudness){
+    double peak = (loudness->true_peak > loudness->sample_peak) ? loudness->true_peak : loudness->sample_peak;
+
+    return (peak > 0.0) ? 20.0 * log10(peak) : -HUGE_VAL;
+}
+
+//Measure a WAV file with the streaming reader (memory does not grow with the file)
+//returns -1 after reporting the error (wavio_set_error_mode), info is only filled in on success
+int getLOUDNESSINFO(LOUDNESS_INFO *info, char *filename){
+    WAVREADER *reader = wavopen_Reader(filename);
+    LOUDNESS *loudness;
+    double *data[2];
+    int32_t n;
+    int16_t ch;
+
+    if(reader == NULL){
+        return -1;
+    }
+    loudness = alloc_Loudness(reader->pcm_spec.fs, reader->channel);
+    if(loudness == NULL){
+        wavclose_Reader(reader);
+        return -1;
+    }
+
+    for(ch = 0; ch < 2; ch++){
+        data[ch] = (ch < reader->channel) ? (double *)malloc(LOUDNESS_READ_FRAMES * sizeof(double)) : NULL;
+    }
+    if(data[0] == NULL || (reader->channel == 2 && data[1] == NULL)){
+        free(data[0]);
+        free(data[1]);
+        free_Loudness(loudness);
+        wavclose_Reader(reader);
+        return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the read buffer.");
+    }
+
+    while((n = wavread_Reader(reader, data, LOUDNESS_READ_FRAMES)) > 0){
+        if(loudness_Block(loudness, data, n) != 0){
+            break;
+        }
+    }
+    if(n > 0 || loudness_Finish(loudness) != 0){
+        free(data[0]);
+        free(data[1]);
+        free_Loudness(loudness);
+        wavclose_Reader(reader);
+        return -1;
+    }
+
+    info->integrated = loudness_Integrated(loudness);
+    info->momentary_max = loudness->momentary_max;
+    info->short_term_max = loudness->short_term_max;
+    info->sample_peak = (loudness->sample_peak > 0.0) ? 20.0 * log10(loudness->sample_peak) : -HUGE_VAL;
+    info->true_peak = loudness_True_Peak(loudness);
+
+    free(data[0]);
+    free(data[1]);
+    free_Loudness(loudness);
+    wavclose_Reader(reader);
+
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
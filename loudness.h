@@ -0,0 +1,73 @@
+/*loudness.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_LOUDNESS
+#define INCLUDED_LOUDNESS
+
+#include <stdint.h>
+#include "wavio.h"
+#include "filter.h"
+#include "resample.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//100 ms sub-blocks in the short-term window (3 s)
+#define LOUDNESS_SHORT_TERM 30
+
+//Loudness meter (ITU-R BS.1770-4 / EBU R128), fed block by block
+typedef struct{
+    uint64_t fs; /* Sampling frequency */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    IIR *weight; /* K-weighting filter */
+    RESAMPLER *oversample; /* true-peak interpolator (NULL at 192 kHz and above) */
+    double *work[2]; /* K-weighted copy of a chunk */
+    double *over[2]; /* oversampled chunk */
+    int32_t over_cap; /* capacity of over */
+    int32_t sub_len; /* samples per 100 ms sub-block */
+    int32_t sub_fill; /* samples in the current sub-block */
+    double sub_sum; /* sum of squares of the current sub-block */
+    double sub[LOUDNESS_SHORT_TERM]; /* mean squares of the latest sub-blocks (ring) */
+    int64_t subs; /* completed sub-blocks */
+    double *blocks; /* mean squares of every 400 ms block (gating) */
+    int64_t block_count; /* number of blocks */
+    int64_t block_cap; /* capacity of blocks */
+    double momentary_max; /* maximum momentary loudness (LUFS) */
+    double short_term_max; /* maximum short-term loudness (LUFS) */
+    double sample_peak; /* maximum absolute sample */
+    double true_peak; /* maximum absolute oversampled sample */
+} LOUDNESS;
+
+//Loudness of a whole file
+typedef struct{
+    double integrated; /* integrated loudness (LUFS) */
+    double momentary_max; /* maximum momentary loudness (LUFS) */
+    double short_term_max; /* maximum short-term loudness (LUFS) */
+    double sample_peak; /* sample peak (dBFS) */
+    double true_peak; /* true peak (dBTP) */
+} LOUDNESS_INFO;
+
+//Prototype declaration for loudness.c (alloc_* return NULL and int functions -1 after reporting an error, see wavio_set_error_mode)
+/* using LOUDNESS struct (streaming) */
+LOUDNESS *alloc_Loudness(uint64_t fs, int16_t channel);
+void free_Loudness(LOUDNESS *loudness);
+int loudness_Block(LOUDNESS *loudness, double **data, int32_t frames);
+int loudness_Finish(LOUDNESS *loudness);
+double loudness_Momentary(LOUDNESS *loudness);
+double loudness_Short_Term(LOUDNESS *loudness);
+double loudness_Integrated(LOUDNESS *loudness);
+double loudness_True_Peak(LOUDNESS *loudness);
+
+/* using LOUDNESS_INFO struct */
+int getLOUDNESSINFO(LOUDNESS_INFO *info, char *filename);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
@@ -0,0 +1,469 @@
+/* mix.c (beta)*/
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+/* include pthread (stems summed in parallel, disable with -DWAVIO_NO_THREADS) */
+#ifndef WAVIO_NO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/* include SIMD intrinsics (4 samples per instruction in the accumulator) */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* include prototype header file */
+#include "mix.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//most threads of a mixer
+#define MIX_MAX_THREADS 64
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//Part of a block summed by one thread
+typedef struct{
+    MIXER *mixer;
+    int t; /* thread index (sums the stems t, t + threads, ...) */
+    int32_t frames; /* frames of the block */
+    int32_t error; /* error code of the stem reads (WAVIO_OK if none) */
+} MIX_JOB;
+
+//Shares of a block and the worker threads that sum them
+//(started by the first mix_Block, the workers wait for every block until free_Mixer stops them)
+typedef struct{
+    MIX_JOB job[MIX_MAX_THREADS]; /* share of each thread */
+    int workers; /* threads started (they sum the shares 1 to workers, the calling thread the others) */
+#ifndef WAVIO_NO_THREADS
+    pthread_t thread[MIX_MAX_THREADS];
+    uint64_t round; /* blocks handed out */
+    int busy; /* workers still summing the current block */
+    int stop; /* 1 when the workers are to end */
+    pthread_mutex_t mutex;
+    pthread_cond_t work; /* a block (or the stop) is handed out */
+    pthread_cond_t idle; /* the last worker has finished its share */
+#endif
+} MIX_POOL;
+
+//acc[i] += x[i] * (x[i] < 0 ? gn : gp) for NATIVE samples x (bias removed first)
+static void mix_accumulate(float *acc, const int32_t *x, int32_t n, int32_t bias, float gp, float gn){
+    int32_t i = 0;
+    float v;
+
+#if defined(__SSE2__)
+    __m128i vb = _mm_set1_epi32(bias);
+    __m128 vp = _mm_set1_ps(gp), vn = _mm_set1_ps(gn), zero = _mm_setzero_ps();
+    __m128 s, neg, g;
+
+    for(; i + 4 <= n; i += 4){
+        s = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_loadu_si128((const __m128i *)(x + i)), vb));
+        neg = _mm_cmplt_ps(s, zero);
+        g = _mm_or_ps(_mm_and_ps(neg, vn), _mm_andnot_ps(neg, vp));
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(s, g)));
+    }
+#endif
+    for(; i < n; i++){
+        v = (float)(x[i] - bias);
+        acc[i] += v * ((v < 0.0f) ? gn : gp);
+    }
+}
+
+//acc[i] += src[i]
+static void mix_add(float *acc, const float *src, int32_t n){
+    int32_t i = 0;
+
+#if defined(__SSE2__)
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_loadu_ps(src + i)));
+    }
+#endif
+    for(; i < n; i++){
+        acc[i] += src[i];
+    }
+}
+
+//Read the next frames of the stems of one thread and sum them into its accumulator
+static void *mix_job(void *arg){
+    MIX_JOB *job = (MIX_JOB *)arg;
+    MIXER *mixer = job->mixer;
+    MIX_STEM *stem;
+    float *acc[2];
+    int32_t *in[2];
+    int32_t s, n;
+    int i, o;
+
+    for(o = 0; o < 2; o++){
+        acc[o] = mixer->acc[o] + (size_t)job->t * MIX_BLOCK_FRAMES;
+        in[o] = mixer->in[o] + (size_t)job->t * MIX_BLOCK_FRAMES;
+        memset(acc[o], 0, job->frames * sizeof(float));
+    }
+
+    //a read error is collected from the error code of this thread
+    wavio_last_error();
+
+    for(s = job->t; s < mixer->count; s += mixer->threads){
+        stem = &mixer->stem[s];
+
+        //a stem that has ended adds nothing
+        n = wavread_Reader_Native(stem->reader, in, job->frames);
+        for(i = 0; i < stem->reader->channel; i++){
+            for(o = 0; o < 2; o++){
+                if(stem->gain[i][o] != 0.0f){
+                    mix_accumulate(acc[o], in[i], n, stem->bias, stem->gain[i][o], stem->gain_neg[i][o]);
+                }
+            }
+        }
+    }
+    job->error = wavio_last_error();
+
+    return NULL;
+}
+
+#ifndef WAVIO_NO_THREADS
+//Worker thread: sum its share of every block handed out until the mixer is freed
+static void *mix_worker(void *arg){
+    MIX_JOB *job = (MIX_JOB *)arg;
+    MIX_POOL *pool = (MIX_POOL *)job->mixer->pool;
+    uint64_t round = 0;
+
+    //read errors are handed to the thread calling mix_Block instead of ending the program here
+    wavio_set_error_mode(WAVIO_ERROR_RETURN);
+
+    for(;;){
+        pthread_mutex_lock(&pool->mutex);
+        while(pool->round == round && !pool->stop){
+            pthread_cond_wait(&pool->work, &pool->mutex);
+        }
+        if(pool->stop){
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        round = pool->round;
+        pthread_mutex_unlock(&pool->mutex);
+
+        mix_job(job);
+
+        //the last worker wakes up the calling thread
+        pthread_mutex_lock(&pool->mutex);
+        if(--pool->busy == 0){
+            pthread_cond_signal(&pool->idle);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return NULL;
+}
+#endif
+
+//Mixer with no stems (threads: 0 for one per online CPU)
+//returns NULL after reporting the error (wavio_set_error_mode)
+MIXER *alloc_Mixer(int threads){
+    MIXER *mixer = (MIXER *)calloc(1, sizeof(MIXER));
+
+    if(mixer == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the mixer.");
+        return NULL;
+    }
+
+#ifndef WAVIO_NO_THREADS
+    if(threads <= 0){
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#else
+    threads = 1;
+#endif
+    if(threads > MIX_MAX_THREADS){
+        threads = MIX_MAX_THREADS;
+    }
+    mixer->threads = (threads > 0) ? threads : 1;
+
+    return mixer;
+}
+
+//Close every stem, stop the worker threads and free the mixer
+void free_Mixer(MIXER *mixer){
+    MIX_POOL *pool = (MIX_POOL *)mixer->pool;
+    int32_t s;
+
+    if(pool != NULL){
+#ifndef WAVIO_NO_THREADS
+        int t;
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->stop = 1;
+        pthread_cond_broadcast(&pool->work);
+        pthread_mutex_unlock(&pool->mutex);
+        for(t = 1; t <= pool->workers; t++){
+            pthread_join(pool->thread[t], NULL);
+        }
+        pthread_mutex_destroy(&pool->mutex);
+        pthread_cond_destroy(&pool->work);
+        pthread_cond_destroy(&pool->idle);
+#endif
+        free(pool);
+    }
+
+    for(s = 0; s < mixer->count; s++){
+        wavclose_Reader(mixer->stem[s].reader);
+    }
+    free(mixer->stem);
+    free(mixer->acc[0]);
+    free(mixer->acc[1]);
+    free(mixer->in[0]);
+    free(mixer->in[1]);
+    free(mixer);
+}
+
+//Add a WAV file to the mix
+//gain: linear, pan: -1 (left) to 1 (right), Mono stems are panned with constant power, Stereo stems are balanced
+//returns -1 after reporting the error (wavio_set_error_mode), the mix is unchanged then
+int mix_Add(MIXER *mixer, char *filename, double gain, double pan){
+    MIX_STEM *stem, *grown;
+    WAVREADER *reader = wavopen_Reader(filename);
+    double g[2][2] = {{0.0, 0.0}, {0.0, 0.0}};
+    double pos_scale, neg_scale, theta;
+    int i, o;
+
+    if(reader == NULL){
+        return -1;
+    }
+    if(mixer->count > 0 && reader->pcm_spec.fs != mixer->fs){
+        wavclose_Reader(reader);
+        return wavio_report_error(WAVIO_ERROR_ARGUMENT, "Sampling frequency does not match the mix.");
+    }
+
+    if(mixer->count >= mixer->cap){
+        grown = (MIX_STEM *)realloc(mixer->stem, ((mixer->cap > 0) ? 2 * mixer->cap : 16) * sizeof(MIX_STEM));
+        if(grown == NULL){
+            wavclose_Reader(reader);
+            return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the stems.");
+        }
+        mixer->stem = grown;
+        mixer->cap = (mixer->cap > 0) ? 2 * mixer->cap : 16;
+    }
+    if(mixer->count == 0){
+        mixer->fs = reader->pcm_spec.fs;
+    }
+    stem = &mixer->stem[mixer->count++];
+    stem->reader = reader;
+    if((uint64_t)reader->pcm_spec.length > mixer->length){
+        mixer->length = reader->pcm_spec.length;
+    }
+
+    pan = (pan < -1.0) ? -1.0 : (pan > 1.0) ? 1.0 : pan;
+    if(reader->channel == 1){
+        theta = (pan + 1.0) * M_PI / 4.0;
+        g[0][0] = gain * cos(theta);
+        g[0][1] = gain * sin(theta);
+    }else{
+        g[0][0] = gain * ((pan > 0.0) ? 1.0 - pan : 1.0);
+        g[1][1] = gain * ((pan < 0.0) ? 1.0 + pan : 1.0);
+    }
+
+    //fold the [-1, 1] scaling of wavread_Reader into the gains
+    pos_scale = pow(2.0, reader->pcm_spec.bits - 1) - 1;
+    neg_scale = pow(2.0, reader->pcm_spec.bits - 1);
+    stem->bias = (reader->pcm_spec.bits == 8) ? 128 : 0;
+    for(i = 0; i < 2; i++){
+        for(o = 0; o < 2; o++){
+            stem->gain[i][o] = (float)(g[i][o] / pos_scale);
+            stem->gain_neg[i][o] = (float)(g[i][o] / neg_scale);
+        }
+    }
+
+    return 0;
+}
+
+//Allocate the accumulators and start the worker threads (first mix_Block, returns -1 after reporting the error)
+static int mix_start(MIXER *mixer){
+    MIX_POOL *pool;
+    int t, o;
+
+    if(mixer->threads > mixer->count){
+        mixer->threads = (mixer->count > 0) ? mixer->count : 1;
+    }
+
+    pool = (MIX_POOL *)calloc(1, sizeof(MIX_POOL));
+    for(o = 0; o < 2; o++){
+        mixer->acc[o] = (float *)malloc((size_t)mixer->threads * MIX_BLOCK_FRAMES * sizeof(float));
+        mixer->in[o] = (int32_t *)malloc((size_t)mixer->threads * MIX_BLOCK_FRAMES * sizeof(int32_t));
+    }
+    if(pool == NULL || mixer->acc[0] == NULL || mixer->acc[1] == NULL || mixer->in[0] == NULL || mixer->in[1] == NULL){
+        free(pool);
+        for(o = 0; o < 2; o++){
+            free(mixer->acc[o]);
+            free(mixer->in[o]);
+            mixer->acc[o] = NULL;
+            mixer->in[o] = NULL;
+        }
+        return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the accumulators.");
+    }
+    for(t = 0; t < mixer->threads; t++){
+        pool->job[t].mixer = mixer;
+        pool->job[t].t = t;
+    }
+    mixer->pool = pool;
+
+#ifndef WAVIO_NO_THREADS
+    //shares whose thread cannot be started are summed by the calling thread
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    for(t = 1; t < mixer->threads; t++){
+        if(pthread_create(&pool->thread[t], NULL, mix_worker, &pool->job[t]) != 0){
+            break;
+        }
+        pool->workers++;
+    }
+#endif
+
+    return 0;
+}
+
+//Mix the next frames of every stem into out (Stereo, [-1, 1] before clipping)
+//returns the frames mixed (0 after the longest stem has ended), -1 after reporting the error (wavio_set_error_mode)
+int32_t mix_Block(MIXER *mixer, double **out, int32_t frames){
+    MIX_POOL *pool;
+    int32_t done = 0, n, i;
+    int t, o;
+
+    if(mixer->pool == NULL && mix_start(mixer) != 0){
+        return -1;
+    }
+    pool = (MIX_POOL *)mixer->pool;
+
+    while(done < frames && mixer->position < mixer->length){
+        n = frames - done;
+        if(n > MIX_BLOCK_FRAMES){
+            n = MIX_BLOCK_FRAMES;
+        }
+        if((uint64_t)n > mixer->length - mixer->position){
+            n = (int32_t)(mixer->length - mixer->position);
+        }
+        for(t = 0; t < mixer->threads; t++){
+            pool->job[t].frames = n;
+        }
+
+#ifndef WAVIO_NO_THREADS
+        //hand the block to the workers, this thread sums the first share (and those without a worker) beside them
+        if(pool->workers > 0){
+            pthread_mutex_lock(&pool->mutex);
+            pool->busy = pool->workers;
+            pool->round++;
+            pthread_cond_broadcast(&pool->work);
+            pthread_mutex_unlock(&pool->mutex);
+        }
+#endif
+        mix_job(&pool->job[0]);
+        for(t = pool->workers + 1; t < mixer->threads; t++){
+            mix_job(&pool->job[t]);
+        }
+#ifndef WAVIO_NO_THREADS
+        if(pool->workers > 0){
+            pthread_mutex_lock(&pool->mutex);
+            while(pool->busy > 0){
+                pthread_cond_wait(&pool->idle, &pool->mutex);
+            }
+            pthread_mutex_unlock(&pool->mutex);
+        }
+#endif
+
+        //a stem that could not be read fails the block, in this thread
+        for(t = 0; t < mixer->threads; t++){
+            if(pool->job[t].error != WAVIO_OK){
+                return wavio_report_error(pool->job[t].error, "Cannot read a stem.");
+            }
+        }
+
+        //sum the accumulators of the threads
+        for(o = 0; o < 2; o++){
+            for(t = 1; t < mixer->threads; t++){
+                mix_add(mixer->acc[o], mixer->acc[o] + (size_t)t * MIX_BLOCK_FRAMES, n);
+            }
+            for(i = 0; i < n; i++){
+                out[o][done + i] = mixer->acc[o][i];
+            }
+        }
+
+        done += n;
+        mixer->position += n;
+    }
+
+    return done;
+}
+
+//Mix count WAV files (gain and pan of each, see mix_Add) into a Stereo WAV file of bits bits
+//returns -1 after reporting the error (wavio_set_error_mode), a partly written output is removed
+int mix_Files(char **files, double *gain, double *pan, int32_t count, char *out_file, int16_t bits, int threads){
+    MIXER *mixer = alloc_Mixer(threads);
+    WAVWRITER *writer;
+    double *out[2];
+    int32_t i, n;
+    int32_t error;
+
+    if(mixer == NULL){
+        return -1;
+    }
+    for(i = 0; i < count; i++){
+        if(mix_Add(mixer, files[i], gain[i], pan[i]) != 0){
+            free_Mixer(mixer);
+            return -1;
+        }
+    }
+
+    out[0] = (double *)malloc(MIX_BLOCK_FRAMES * sizeof(double));
+    out[1] = (double *)malloc(MIX_BLOCK_FRAMES * sizeof(double));
+    if(out[0] == NULL || out[1] == NULL){
+        free(out[0]);
+        free(out[1]);
+        free_Mixer(mixer);
+        return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the mix.");
+    }
+
+    writer = wavopen_Writer(out_file, mixer->fs, bits, 2);
+    if(writer == NULL){
+        free(out[0]);
+        free(out[1]);
+        free_Mixer(mixer);
+        return -1;
+    }
+
+    //a failed block write or header update is collected from the error code of this thread
+    wavio_last_error();
+    while(!writer->failed && (n = mix_Block(mixer, out, MIX_BLOCK_FRAMES)) > 0){
+        wavwrite_Writer(writer, out, n);
+    }
+    error = wavio_last_error();
+    wavclose_Writer(writer);
+    if(error == WAVIO_OK){
+        error = wavio_last_error();
+    }
+
+    free(out[0]);
+    free(out[1]);
+    free_Mixer(mixer);
+
+    if(error != WAVIO_OK){
+        remove(out_file);
+        return wavio_report_error(error, "Cannot write the mix.");
+    }
+
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
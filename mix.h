@@ -0,0 +1,57 @@
+/*mix.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_MIX
+#define INCLUDED_MIX
+
+#include <stdint.h>
+#include "wavio.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//frames summed at once by each thread
+#define MIX_BLOCK_FRAMES 4096
+
+//One input file of the mix
+typedef struct{
+    WAVREADER *reader; /* streaming reader of the stem */
+    float gain[2][2]; /* gain from input channel [i] to output channel [o] (sample scaling included) */
+    float gain_neg[2][2]; /* the same for negative samples (NATIVE scaling is asymmetric) */
+    int32_t bias; /* 128 for 8bit (unsigned), 0 otherwise */
+} MIX_STEM;
+
+//Stereo mixer summing many stems block by block
+typedef struct{
+    uint64_t fs; /* Sampling frequency (of the first stem) */
+    int threads; /* threads summing the stems (at most one per stem) */
+    int32_t count; /* number of stems */
+    int32_t cap; /* capacity of stem */
+    MIX_STEM *stem; /* stems */
+    uint64_t length; /* frames of the longest stem */
+    uint64_t position; /* frames already mixed */
+    float *acc[2]; /* accumulator of each thread (threads x MIX_BLOCK_FRAMES per channel) */
+    int32_t *in[2]; /* NATIVE input of each thread (threads x MIX_BLOCK_FRAMES per channel) */
+    void *pool; /* shares of a block and the worker threads (started by the first mix_Block) */
+} MIXER;
+
+//Prototype declaration for mix.c (alloc_Mixer returns NULL and the others -1 after reporting an error, see wavio_set_error_mode)
+/* using MIXER struct (streaming) */
+MIXER *alloc_Mixer(int threads);
+void free_Mixer(MIXER *mixer);
+int mix_Add(MIXER *mixer, char *filename, double gain, double pan);
+int32_t mix_Block(MIXER *mixer, double **out, int32_t frames);
+
+/* using files */
+int mix_Files(char **files, double *gain, double *pan, int32_t count, char *out_file, int16_t bits, int threads);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
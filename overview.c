@@ -0,0 +1,415 @@
+/* overview.c (beta)*/
+
+//st_mtim (nanoseconds of the modification time) is POSIX.1-2008
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/* include prototype header file */
+#include "overview.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//frames read at once while building (a multiple of OVERVIEW_BASE)
+#define OVERVIEW_READ_FRAMES (256 * OVERVIEW_BASE)
+
+//version of the sidecar layout
+#define OVERVIEW_VERSION 2
+
+//bytes of the sidecar before the bins of the levels
+#define OVERVIEW_HEADER_BYTES (4 + sizeof(int32_t) + 3 * sizeof(int64_t) + sizeof(uint64_t) + sizeof(int16_t) + sizeof(int64_t) + sizeof(int32_t))
+
+//Size and modification time (seconds and nanoseconds) of a file (returns 0 on success)
+static int overview_stat(char *filename, int64_t *size, int64_t *mtime, int64_t *mtime_nsec){
+    struct stat st;
+
+    if(stat(filename, &st) != 0){
+        return -1;
+    }
+    *size = (int64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+#if defined(__APPLE__)
+    *mtime_nsec = (int64_t)st.st_mtimespec.tv_nsec;
+#else
+    *mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+#endif
+
+    return 0;
+}
+
+//Bins of level 0 for length frames (at least one bin, even for an empty file)
+static int64_t overview_base_bins(int64_t length){
+    int64_t bins = (length + OVERVIEW_BASE - 1) / OVERVIEW_BASE;
+
+    return (bins > 0) ? bins : 1;
+}
+
+//Frames covered by bin i of level l
+static int64_t overview_bin_frames(OVERVIEW *overview, int32_t l, int64_t i){
+    int64_t size = OVERVIEW_BASE;
+    int32_t k;
+
+    for(k = 0; k < l; k++){
+        size *= OVERVIEW_FACTOR;
+    }
+
+    return (overview->length - i * size < size) ? overview->length - i * size : size;
+}
+
+//Build the coarser levels from level 0 (returns -1 when a level cannot be allocated)
+static int overview_merge(OVERVIEW *overview){
+    OVERVIEW_BIN *src, *dst;
+    int64_t i, j, first, last;
+    double ms, frames, n;
+    int32_t l;
+    int16_t ch;
+
+    for(l = 1; l < OVERVIEW_MAX_LEVELS && overview->bins[l - 1] > 1; l++){
+        overview->bins[l] = (overview->bins[l - 1] + OVERVIEW_FACTOR - 1) / OVERVIEW_FACTOR;
+        overview->level[l] = (OVERVIEW_BIN *)malloc(overview->bins[l] * overview->channel * sizeof(OVERVIEW_BIN));
+        if(overview->level[l] == NULL){
+            return -1;
+        }
+        src = overview->level[l - 1];
+        dst = overview->level[l];
+
+        for(i = 0; i < overview->bins[l]; i++){
+            first = i * OVERVIEW_FACTOR;
+            last = (first + OVERVIEW_FACTOR < overview->bins[l - 1]) ? first + OVERVIEW_FACTOR : overview->bins[l - 1];
+            for(ch = 0; ch < overview->channel; ch++){
+                dst[i * overview->channel + ch] = src[first * overview->channel + ch];
+                ms = 0.0;
+                frames = 0.0;
+                for(j = first; j < last; j++){
+                    OVERVIEW_BIN *b = src + j * overview->channel + ch;
+
+                    dst[i * overview->channel + ch].min = (b->min < dst[i * overview->channel + ch].min) ? b->min : dst[i * overview->channel + ch].min;
+                    dst[i * overview->channel + ch].max = (b->max > dst[i * overview->channel + ch].max) ? b->max : dst[i * overview->channel + ch].max;
+                    n = (double)overview_bin_frames(overview, l - 1, j);
+                    ms += b->ms * n;
+                    frames += n;
+                }
+                dst[i * overview->channel + ch].ms = (float)(ms / frames);
+            }
+        }
+    }
+    overview->levels = l;
+
+    return 0;
+}
+
+//Build the pyramid in one pass of the streaming reader (NULL after the reader has reported the error)
+static OVERVIEW *overview_build(char *filename){
+    OVERVIEW *overview;
+    WAVREADER *reader = wavopen_Reader(filename);
+    double *data[2];
+    OVERVIEW_BIN *bin;
+    int64_t index = 0; /* next bin of level 0 */
+    int32_t n, i, j, m;
+    int32_t error;
+    double lo, hi, sum, x;
+    int16_t ch;
+
+    if(reader == NULL){
+        return NULL;
+    }
+    overview = (OVERVIEW *)malloc(sizeof(OVERVIEW));
+    if(overview == NULL){
+        wavclose_Reader(reader);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the overview.");
+        return NULL;
+    }
+    overview->fs = reader->pcm_spec.fs;
+    overview->channel = reader->channel;
+    overview->length = reader->pcm_spec.length;
+    memset(overview->bins, 0, sizeof(overview->bins));
+    memset(overview->level, 0, sizeof(overview->level));
+
+    //level 0
+    overview->bins[0] = overview_base_bins(overview->length);
+    overview->level[0] = (OVERVIEW_BIN *)calloc(overview->bins[0] * overview->channel, sizeof(OVERVIEW_BIN));
+
+    for(ch = 0; ch < 2; ch++){
+        data[ch] = (ch < reader->channel) ? (double *)malloc(OVERVIEW_READ_FRAMES * sizeof(double)) : NULL;
+    }
+    if(overview->level[0] == NULL || data[0] == NULL || (reader->channel == 2 && data[1] == NULL)){
+        free(data[0]);
+        free(data[1]);
+        wavclose_Reader(reader);
+        free_Overview(overview);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the overview.");
+        return NULL;
+    }
+
+    //a failed read is collected from the error code of this thread (a pyramid of half the file is not kept)
+    wavio_last_error();
+    while((n = wavread_Reader(reader, data, OVERVIEW_READ_FRAMES)) > 0){
+        for(i = 0; i < n && index < overview->bins[0]; i += OVERVIEW_BASE){
+            m = (n - i < OVERVIEW_BASE) ? n - i : OVERVIEW_BASE;
+            for(ch = 0; ch < overview->channel; ch++){
+                lo = data[ch][i];
+                hi = data[ch][i];
+                sum = 0.0;
+                for(j = 0; j < m; j++){
+                    x = data[ch][i + j];
+                    lo = (x < lo) ? x : lo;
+                    hi = (x > hi) ? x : hi;
+                    sum += x * x;
+                }
+                bin = overview->level[0] + index * overview->channel + ch;
+                bin->min = (float)lo;
+                bin->max = (float)hi;
+                bin->ms = (float)(sum / m);
+            }
+            index++;
+        }
+    }
+
+    error = wavio_last_error();
+    free(data[0]);
+    free(data[1]);
+    wavclose_Reader(reader);
+
+    if(error != WAVIO_OK){
+        free_Overview(overview);
+        wavio_report_error(error, "Cannot read the file of the overview.");
+        return NULL;
+    }
+    if(overview_merge(overview) != 0){
+        free_Overview(overview);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the overview.");
+        return NULL;
+    }
+
+    return overview;
+}
+
+//Load the sidecar if it was built from this very file and its bins fit the length (returns NULL otherwise)
+static OVERVIEW *overview_load(char *path, int64_t size, int64_t mtime, int64_t mtime_nsec){
+    FILE *fp = fopen(path, "rb");
+    OVERVIEW *overview;
+    char magic[4];
+    int32_t version, l;
+    int64_t bytes, end;
+    long levels_at;
+    int ok = 1;
+
+    if(fp == NULL){
+        return NULL;
+    }
+
+    overview = (OVERVIEW *)malloc(sizeof(OVERVIEW));
+    if(overview == NULL){
+        fclose(fp);
+        return NULL;
+    }
+    memset(overview->bins, 0, sizeof(overview->bins));
+    memset(overview->level, 0, sizeof(overview->level));
+
+    //header
+    ok = ok && fread(magic, 1, 4, fp) == 4 && memcmp(magic, "WOVW", 4) == 0;
+    ok = ok && fread(&version, sizeof(version), 1, fp) == 1 && version == OVERVIEW_VERSION;
+    ok = ok && fread(&overview->file_size, sizeof(int64_t), 1, fp) == 1 && overview->file_size == size;
+    ok = ok && fread(&overview->file_mtime, sizeof(int64_t), 1, fp) == 1 && overview->file_mtime == mtime;
+    ok = ok && fread(&overview->file_mtime_nsec, sizeof(int64_t), 1, fp) == 1 && overview->file_mtime_nsec == mtime_nsec;
+    ok = ok && fread(&overview->fs, sizeof(uint64_t), 1, fp) == 1;
+    ok = ok && fread(&overview->channel, sizeof(int16_t), 1, fp) == 1 && overview->channel >= 1 && overview->channel <= 2;
+    ok = ok && fread(&overview->length, sizeof(int64_t), 1, fp) == 1 && overview->length >= 0;
+    ok = ok && fread(&overview->levels, sizeof(int32_t), 1, fp) == 1 && overview->levels >= 1 && overview->levels <= OVERVIEW_MAX_LEVELS;
+    ok = ok && fread(overview->bins, sizeof(int64_t), ok ? overview->levels : 0, fp) == (size_t)(ok ? overview->levels : 0);
+
+    //the bins must be the ones overview_build and overview_merge give for the length
+    ok = ok && overview->bins[0] == overview_base_bins(overview->length);
+    for(l = 1; ok && l < overview->levels; l++){
+        ok = overview->bins[l - 1] > 1 && overview->bins[l] == (overview->bins[l - 1] + OVERVIEW_FACTOR - 1) / OVERVIEW_FACTOR;
+    }
+    ok = ok && (overview->levels == OVERVIEW_MAX_LEVELS || overview->bins[overview->levels - 1] == 1);
+
+    //and the sidecar must hold exactly those bins (checked before allocating them)
+    bytes = (int64_t)OVERVIEW_HEADER_BYTES + overview->levels * (int64_t)sizeof(int64_t);
+    for(l = 0; ok && l < overview->levels; l++){
+        bytes += overview->bins[l] * overview->channel * (int64_t)sizeof(OVERVIEW_BIN);
+    }
+    levels_at = ok ? ftell(fp) : -1;
+    ok = ok && levels_at >= 0 && fseek(fp, 0, SEEK_END) == 0;
+    end = ok ? (int64_t)ftell(fp) : -1;
+    ok = ok && end == bytes && fseek(fp, levels_at, SEEK_SET) == 0;
+
+    //levels
+    for(l = 0; ok && l < overview->levels; l++){
+        overview->level[l] = (OVERVIEW_BIN *)malloc(overview->bins[l] * overview->channel * sizeof(OVERVIEW_BIN));
+        ok = overview->level[l] != NULL && fread(overview->level[l], sizeof(OVERVIEW_BIN), overview->bins[l] * overview->channel, fp) == (size_t)(overview->bins[l] * overview->channel);
+    }
+    fclose(fp);
+
+    if(!ok){
+        free_Overview(overview);
+        return NULL;
+    }
+
+    return overview;
+}
+
+//Write the sidecar (to a temporary name first, so readers never see half a file)
+static void overview_save(OVERVIEW *overview, char *path){
+    char *tmp = (char *)malloc(strlen(path) + 5);
+    int32_t version = OVERVIEW_VERSION;
+    int32_t l;
+    int ok = 1;
+    FILE *fp;
+
+    //the cache is optional (e.g. read-only directory)
+    if(tmp == NULL){
+        return;
+    }
+    sprintf(tmp, "%s.tmp", path);
+    fp = fopen(tmp, "wb");
+    if(fp == NULL){
+        free(tmp);
+        return;
+    }
+
+    ok = ok && fwrite("WOVW", 1, 4, fp) == 4;
+    ok = ok && fwrite(&version, sizeof(version), 1, fp) == 1;
+    ok = ok && fwrite(&overview->file_size, sizeof(int64_t), 1, fp) == 1;
+    ok = ok && fwrite(&overview->file_mtime, sizeof(int64_t), 1, fp) == 1;
+    ok = ok && fwrite(&overview->file_mtime_nsec, sizeof(int64_t), 1, fp) == 1;
+    ok = ok && fwrite(&overview->fs, sizeof(uint64_t), 1, fp) == 1;
+    ok = ok && fwrite(&overview->channel, sizeof(int16_t), 1, fp) == 1;
+    ok = ok && fwrite(&overview->length, sizeof(int64_t), 1, fp) == 1;
+    ok = ok && fwrite(&overview->levels, sizeof(int32_t), 1, fp) == 1;
+    ok = ok && fwrite(overview->bins, sizeof(int64_t), overview->levels, fp) == (size_t)overview->levels;
+    for(l = 0; ok && l < overview->levels; l++){
+        ok = fwrite(overview->level[l], sizeof(OVERVIEW_BIN), overview->bins[l] * overview->channel, fp) == (size_t)(overview->bins[l] * overview->channel);
+    }
+    ok = (fclose(fp) == 0) && ok;
+
+    if(!ok || rename(tmp, path) != 0){
+        remove(tmp);
+    }
+    free(tmp);
+}
+
+//Allocate OVERVIEW struct of a WAV file (from the sidecar if it matches size and mtime to the nanosecond, else built and saved)
+//returns NULL after reporting the error (wavio_set_error_mode)
+OVERVIEW *alloc_Overview(char *filename){
+    OVERVIEW *overview;
+    char *path = (char *)malloc(strlen(filename) + strlen(OVERVIEW_SUFFIX) + 1);
+    int64_t size = -1, mtime = -1, mtime_nsec = -1;
+
+    if(path == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the overview.");
+        return NULL;
+    }
+    sprintf(path, "%s%s", filename, OVERVIEW_SUFFIX);
+
+    if(overview_stat(filename, &size, &mtime, &mtime_nsec) == 0){
+        overview = overview_load(path, size, mtime, mtime_nsec);
+        if(overview != NULL){
+            free(path);
+            return overview;
+        }
+    }
+
+    overview = overview_build(filename);
+    if(overview == NULL){
+        free(path);
+        return NULL;
+    }
+    overview->file_size = size;
+    overview->file_mtime = mtime;
+    overview->file_mtime_nsec = mtime_nsec;
+    if(size >= 0){
+        overview_save(overview, path);
+    }
+    free(path);
+
+    return overview;
+}
+
+//Free OVERVIEW struct
+void free_Overview(OVERVIEW *overview){
+    int32_t l;
+
+    //free levels
+    for(l = 0; l < OVERVIEW_MAX_LEVELS; l++){
+        free(overview->level[l]);
+    }
+
+    //free OVERVIEW struct
+    free(overview);
+}
+
+//Min, max and RMS of pixels equal spans of frames [start, end) of one channel (channel: 0 for L or Mono, 1 for R)
+//each pixel reads at most OVERVIEW_FACTOR + 1 bins of the level that fits its span
+//returns the number of pixels written (0 for an empty span or a wrong channel)
+int32_t overview_Query(OVERVIEW *overview, int16_t channel, int64_t start, int64_t end, int32_t pixels, float *min, float *max, float *rms){
+    const OVERVIEW_BIN *b;
+    int64_t a, z, size, i, first, last;
+    double ms, frames, n;
+    float lo, hi;
+    int32_t p, l;
+
+    start = (start < 0) ? 0 : start;
+    end = (end > overview->length) ? overview->length : end;
+    if(end <= start || pixels < 1 || channel < 0 || channel >= overview->channel){
+        return 0;
+    }
+
+    for(p = 0; p < pixels; p++){
+        a = start + (end - start) * p / pixels;
+        z = start + (end - start) * (p + 1) / pixels;
+        if(z <= a){
+            z = a + 1;
+        }
+
+        //coarsest level whose bins are not wider than the pixel
+        l = 0;
+        size = OVERVIEW_BASE;
+        while(l + 1 < overview->levels && size * OVERVIEW_FACTOR <= z - a){
+            size *= OVERVIEW_FACTOR;
+            l++;
+        }
+
+        first = a / size;
+        last = (z - 1) / size;
+        if(last >= overview->bins[l]){
+            last = overview->bins[l] - 1;
+        }
+
+        b = overview->level[l] + first * overview->channel + channel;
+        lo = b->min;
+        hi = b->max;
+        ms = 0.0;
+        frames = 0.0;
+        for(i = first; i <= last; i++){
+            b = overview->level[l] + i * overview->channel + channel;
+            lo = (b->min < lo) ? b->min : lo;
+            hi = (b->max > hi) ? b->max : hi;
+            n = (double)overview_bin_frames(overview, l, i);
+            ms += b->ms * n;
+            frames += n;
+        }
+        min[p] = lo;
+        max[p] = hi;
+        rms[p] = (float)sqrt(ms / frames);
+    }
+
+    return pixels;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,56 @@
+/*overview.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_OVERVIEW
+#define INCLUDED_OVERVIEW
+
+#include <stdint.h>
+#include "wavio.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//frames per bin of the finest level, and bins merged into one bin of the next level
+#define OVERVIEW_BASE 256
+#define OVERVIEW_FACTOR 4
+#define OVERVIEW_MAX_LEVELS 16
+
+//suffix of the sidecar file (next to the WAV file)
+#define OVERVIEW_SUFFIX ".ovw"
+
+//One bin of one channel
+typedef struct{
+    float min; /* minimum sample */
+    float max; /* maximum sample */
+    float ms; /* mean square */
+} OVERVIEW_BIN;
+
+//Min/max/RMS pyramid of a WAV file
+typedef struct{
+    uint64_t fs; /* Sampling frequency */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    int64_t length; /* frames of the file */
+    int64_t file_size; /* size of the file the pyramid was built from */
+    int64_t file_mtime; /* modification time of that file (seconds) */
+    int64_t file_mtime_nsec; /* nanoseconds of that modification time */
+    int32_t levels; /* number of levels */
+    int64_t bins[OVERVIEW_MAX_LEVELS]; /* bins of each level (level l bins cover OVERVIEW_BASE x OVERVIEW_FACTOR^l frames) */
+    OVERVIEW_BIN *level[OVERVIEW_MAX_LEVELS]; /* bins of each level (bin-major, channel-minor) */
+} OVERVIEW;
+
+//Prototype declaration for overview.c
+/* using OVERVIEW struct */
+OVERVIEW *alloc_Overview(char *filename);
+void free_Overview(OVERVIEW *overview);
+int32_t overview_Query(OVERVIEW *overview, int16_t channel, int64_t start, int64_t end, int32_t pixels, float *min, float *max, float *rms);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
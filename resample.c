@@ -0,0 +1,464 @@
+/* resample.c (beta)*/
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+/* include SIMD intrinsics (inner product of the polyphase filter) */
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* include prototype header file */
+#include "resample.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//bank rows above which the phases are interpolated instead of stored one by one
+#ifndef RESAMPLE_MAX_PHASES
+#define RESAMPLE_MAX_PHASES 1024
+#endif
+
+//upper limit of taps per phase (strong decimation widens the kernel)
+#ifndef RESAMPLE_MAX_TAPS
+#define RESAMPLE_MAX_TAPS 8192
+#endif
+
+//frames passed to resample_Block at once by resample_Mono/resample_Stereo
+#define RESAMPLE_CHUNK 65536
+
+//Greatest common divisor
+static uint64_t resample_gcd(uint64_t a, uint64_t b){
+    uint64_t t;
+
+    while(b != 0){
+        t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+//Modified Bessel function of the first kind (order 0)
+static double resample_bessel_i0(double x){
+    double sum = 1.0; /* series sum */
+    double term = 1.0; /* current term */
+    int k;
+
+    for(k = 1; k < 64; k++){
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if(term < sum * 1e-17){
+            break;
+        }
+    }
+
+    return sum;
+}
+
+//Inner product of a bank row and the input (vectorized)
+static double resample_dot(const double *h, const double *x, int32_t n){
+    int32_t k = 0;
+    double sum = 0.0;
+
+#if defined(__AVX__)
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    double lane[4];
+
+    for(; k + 8 <= n; k += 8){
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(h + k), _mm256_loadu_pd(x + k)));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(h + k + 4), _mm256_loadu_pd(x + k + 4)));
+    }
+    _mm256_storeu_pd(lane, _mm256_add_pd(acc0, acc1));
+    sum = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+#elif defined(__SSE2__)
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    double lane[2];
+
+    for(; k + 4 <= n; k += 4){
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(h + k), _mm_loadu_pd(x + k)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(h + k + 2), _mm_loadu_pd(x + k + 2)));
+    }
+    _mm_storeu_pd(lane, _mm_add_pd(acc0, acc1));
+    sum = lane[0] + lane[1];
+#endif
+
+    //remaining taps
+    for(; k < n; k++){
+        sum += h[k] * x[k];
+    }
+
+    return sum;
+}
+
+//Allocate RESAMPLER struct and precompute its filter bank
+//returns NULL after reporting the error (wavio_set_error_mode)
+RESAMPLER *alloc_Resampler(uint64_t fs_in, uint64_t fs_out, int16_t channel, int quality){
+    //taps per phase, Kaiser beta and passband edge (ratio to the Nyquist frequency) of each preset
+    static const int32_t preset_taps[4] = {16, 32, 64, 128};
+    static const double preset_beta[4] = {6.0, 8.0, 10.0, 12.0};
+    static const double preset_rolloff[4] = {0.85, 0.91, 0.945, 0.97};
+
+    RESAMPLER *resampler;
+    uint64_t g; /* gcd of the frequencies */
+    double cutoff; /* cutoff frequency (cycles per input sample) */
+    double d, w, sum;
+    int32_t half; /* half of the taps */
+    int32_t p, k;
+    int c;
+
+    if(fs_in == 0 || fs_out == 0){
+        wavio_report_error(WAVIO_ERROR_ARGUMENT, "Inappropriate resampling parameter.");
+        return NULL;
+    }
+    if(channel < 1 || channel > 2){
+        wavio_report_error(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+        return NULL;
+    }
+    if(quality < RESAMPLE_FAST || quality > RESAMPLE_BEST){
+        quality = RESAMPLE_HIGH;
+    }
+
+    //allocate RESAMPLER struct
+    resampler = (RESAMPLER *)malloc(sizeof(RESAMPLER));
+    if(resampler == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the resampler.");
+        return NULL;
+    }
+
+    //conversion ratio up / down
+    g = resample_gcd(fs_in, fs_out);
+    resampler->fs_in = fs_in;
+    resampler->fs_out = fs_out;
+    resampler->up = fs_out / g;
+    resampler->down = fs_in / g;
+
+    //kernel length (widened by the decimation ratio)
+    resampler->taps = preset_taps[quality];
+    if(resampler->down > resampler->up){
+        resampler->taps *= (int32_t)((resampler->down + resampler->up - 1) / resampler->up);
+    }
+    if(resampler->taps > RESAMPLE_MAX_TAPS){
+        resampler->taps = RESAMPLE_MAX_TAPS;
+    }
+    half = resampler->taps / 2;
+
+    //one row per phase if the ratio is small enough, otherwise interpolated rows
+    resampler->exact = (resampler->up <= RESAMPLE_MAX_PHASES);
+    resampler->phases = resampler->exact ? (int32_t)resampler->up : RESAMPLE_MAX_PHASES;
+
+    //windowed-sinc filter bank: row p is the kernel delayed by p / phases of an input sample
+    cutoff = 0.5 * preset_rolloff[quality];
+    if(resampler->down > resampler->up){
+        cutoff *= (double)resampler->up / (double)resampler->down;
+    }
+    resampler->bank = (double *)calloc((size_t)(resampler->phases + 1) * resampler->taps, sizeof(double));
+    if(resampler->bank == NULL){
+        free(resampler);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the resampler.");
+        return NULL;
+    }
+    for(p = 0; p <= resampler->phases; p++){
+        double *row = resampler->bank + (size_t)p * resampler->taps;
+
+        sum = 0.0;
+        for(k = 0; k < resampler->taps; k++){
+            //distance (input samples) between the tap and the output instant
+            d = (double)(k - half + 1) - (double)p / resampler->phases;
+
+            w = 1.0 - (d / half) * (d / half);
+            w = (w > 0.0) ? resample_bessel_i0(preset_beta[quality] * sqrt(w)) / resample_bessel_i0(preset_beta[quality]) : 0.0;
+
+            row[k] = (d == 0.0) ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * d) / (M_PI * d);
+            row[k] *= w;
+            sum += row[k];
+        }
+
+        //unity gain at DC
+        for(k = 0; k < resampler->taps; k++){
+            row[k] /= sum;
+        }
+    }
+
+    //history starts with half a kernel of silence in front of the first sample
+    resampler->channel = channel;
+    resampler->hist_cap = 2 * resampler->taps + RESAMPLE_CHUNK;
+    resampler->hist_len = half;
+    for(c = 0; c < 2; c++){
+        resampler->history[c] = (c < channel) ? (double *)calloc(resampler->hist_cap, sizeof(double)) : NULL;
+    }
+    if(resampler->history[0] == NULL || (channel == 2 && resampler->history[1] == NULL)){
+        free_Resampler(resampler);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the resampler.");
+        return NULL;
+    }
+    resampler->index = half;
+    resampler->phase = 0;
+    resampler->in_total = 0;
+    resampler->out_total = 0;
+
+    return resampler;
+}
+
+//Free RESAMPLER struct
+void free_Resampler(RESAMPLER *resampler){
+    //free filter bank and history
+    free(resampler->bank);
+    free(resampler->history[0]);
+    free(resampler->history[1]);
+
+    //free RESAMPLER struct
+    free(resampler);
+}
+
+//Append samples (or silence if in is NULL) to the history
+//returns -1 after reporting a failed growth (the history is kept as it was)
+static int resample_append(RESAMPLER *resampler, double **in, int32_t in_len){
+    int32_t cap;
+    double *grown;
+    int c;
+
+    if(resampler->hist_len + in_len > resampler->hist_cap){
+        //the capacity only grows once every channel has grown
+        cap = 2 * (resampler->hist_len + in_len);
+        for(c = 0; c < resampler->channel; c++){
+            grown = (double *)realloc(resampler->history[c], cap * sizeof(double));
+            if(grown == NULL){
+                return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the resampler history.");
+            }
+            resampler->history[c] = grown;
+        }
+        resampler->hist_cap = cap;
+    }
+
+    for(c = 0; c < resampler->channel; c++){
+        if(in != NULL){
+            memcpy(resampler->history[c] + resampler->hist_len, in[c], in_len * sizeof(double));
+        }else{
+            memset(resampler->history[c] + resampler->hist_len, 0, in_len * sizeof(double));
+        }
+    }
+    resampler->hist_len += in_len;
+
+    return 0;
+}
+
+//Produce up to out_max outputs from the history, then drop the samples no longer needed
+static int32_t resample_run(RESAMPLER *resampler, double **out, int32_t out_max){
+    int32_t half = resampler->taps / 2;
+    int32_t n = 0; /* outputs */
+    int32_t keep; /* first history sample still needed */
+    double pos, frac; /* interpolated phase */
+    const double *row;
+    const double *x;
+    int32_t p;
+    int c;
+
+    while(n < out_max && resampler->index + half < (uint64_t)resampler->hist_len){
+        for(c = 0; c < resampler->channel; c++){
+            x = resampler->history[c] + resampler->index - half + 1;
+
+            if(resampler->exact){
+                row = resampler->bank + (size_t)resampler->phase * resampler->taps;
+                out[c][n] = resample_dot(row, x, resampler->taps);
+            }else{
+                pos = (double)resampler->phase * resampler->phases / (double)resampler->up;
+                p = (int32_t)pos;
+                frac = pos - p;
+                row = resampler->bank + (size_t)p * resampler->taps;
+                out[c][n] = (1.0 - frac) * resample_dot(row, x, resampler->taps) + frac * resample_dot(row + resampler->taps, x, resampler->taps);
+            }
+        }
+
+        //advance the output instant by down / up input samples
+        resampler->phase += resampler->down;
+        resampler->index += resampler->phase / resampler->up;
+        resampler->phase %= resampler->up;
+        n++;
+    }
+    resampler->out_total += n;
+
+    //drop consumed input
+    keep = (int32_t)resampler->index - half + 1;
+    if(keep > resampler->hist_len){
+        keep = resampler->hist_len;
+    }
+    if(keep > 0){
+        for(c = 0; c < resampler->channel; c++){
+            memmove(resampler->history[c], resampler->history[c] + keep, (resampler->hist_len - keep) * sizeof(double));
+        }
+        resampler->hist_len -= keep;
+        resampler->index -= keep;
+    }
+
+    return n;
+}
+
+//Upper bound of the outputs that resample_Block produces for in_len more input frames
+int32_t resample_Length(RESAMPLER *resampler, int32_t in_len){
+    uint64_t avail = (uint64_t)resampler->hist_len + in_len; /* history after appending */
+
+    if(avail <= resampler->index){
+        return 1;
+    }
+
+    return (int32_t)(((avail - resampler->index) * resampler->up + resampler->down - 1) / resampler->down + 1);
+}
+
+//Resample one block of input frames (in[channel][in_len])
+//returns the number of output frames written to out (at most out_max), -1 after reporting a failed allocation
+int32_t resample_Block(RESAMPLER *resampler, double **in, int32_t in_len, double **out, int32_t out_max){
+    if(resample_append(resampler, in, in_len) != 0){
+        return -1;
+    }
+    resampler->in_total += in_len;
+
+    return resample_run(resampler, out, out_max);
+}
+
+//Produce the remaining output frames after the last block
+//returns the number of output frames written to out (at most out_max), -1 after reporting a failed allocation
+int32_t resample_Flush(RESAMPLER *resampler, double **out, int32_t out_max){
+    uint64_t total = (resampler->in_total * resampler->up + resampler->down - 1) / resampler->down; /* outputs for the whole input */
+    uint64_t remain, need;
+    int32_t half = resampler->taps / 2;
+
+    if(resampler->out_total >= total){
+        return 0;
+    }
+    remain = total - resampler->out_total;
+    if(remain > (uint64_t)out_max){
+        remain = (uint64_t)out_max;
+    }
+
+    //pad with silence so that the last outputs see a full kernel
+    need = resampler->index + (resampler->phase + (remain - 1) * resampler->down) / resampler->up + half + 1;
+    if(need > (uint64_t)resampler->hist_len && resample_append(resampler, NULL, (int32_t)(need - resampler->hist_len)) != 0){
+        return -1;
+    }
+
+    return resample_run(resampler, out, (int32_t)remain);
+}
+
+//Resample the channel arrays of a whole buffer (-1 after reporting the error)
+static int32_t resample_buffer(RESAMPLER *resampler, double **in, int32_t length, double **out, int32_t out_len){
+    double *src[2]; /* current input chunk */
+    double *dst[2]; /* current output position */
+    int32_t i, n, m;
+    int32_t done = 0; /* output frames */
+    int c;
+
+    for(i = 0; i < length; i += n){
+        n = (length - i < RESAMPLE_CHUNK) ? length - i : RESAMPLE_CHUNK;
+        for(c = 0; c < resampler->channel; c++){
+            src[c] = in[c] + i;
+            dst[c] = out[c] + done;
+        }
+        m = resample_Block(resampler, src, n, dst, out_len - done);
+        if(m < 0){
+            return -1;
+        }
+        done += m;
+    }
+
+    for(c = 0; c < resampler->channel; c++){
+        dst[c] = out[c] + done;
+    }
+    m = resample_Flush(resampler, dst, out_len - done);
+    if(m < 0){
+        return -1;
+    }
+
+    return done + m;
+}
+
+//Resample MONO_PCM struct to fs (out is allocated by alloc_Mono, and only filled in on success)
+void resample_Mono(MONO_PCM *in, MONO_PCM *out, uint64_t fs, int quality){
+    RESAMPLER *resampler = alloc_Resampler(in->pcm_spec.fs, fs, 1, quality);
+    int32_t length;
+    double *data;
+
+    if(resampler == NULL){
+        return;
+    }
+    length = (int32_t)(((uint64_t)in->pcm_spec.length * resampler->up + resampler->down - 1) / resampler->down);
+
+    //initialize the data vector
+    data = (double *)calloc(length > 0 ? length : 1, sizeof(double));
+    if(data == NULL){
+        free_Resampler(resampler);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+
+    //resample
+    if(resample_buffer(resampler, &in->data, in->pcm_spec.length, &data, length) < 0){
+        free(data);
+        free_Resampler(resampler);
+        return;
+    }
+    free_Resampler(resampler);
+
+    //copy pcm_spec with the new sampling frequency
+    out->pcm_spec.fs = fs;
+    out->pcm_spec.bits = in->pcm_spec.bits;
+    out->pcm_spec.length = length;
+    out->data = data;
+}
+
+//Resample STEREO_PCM struct to fs (out is allocated by alloc_Stereo, and only filled in on success)
+void resample_Stereo(STEREO_PCM *in, STEREO_PCM *out, uint64_t fs, int quality){
+    RESAMPLER *resampler = alloc_Resampler(in->pcm_spec.fs, fs, 2, quality);
+    int32_t length;
+    double *data[2];
+
+    if(resampler == NULL){
+        return;
+    }
+    length = (int32_t)(((uint64_t)in->pcm_spec.length * resampler->up + resampler->down - 1) / resampler->down);
+
+    //initialize the data vector
+    data[0] = (double *)calloc(length > 0 ? length : 1, sizeof(double));
+    data[1] = (double *)calloc(length > 0 ? length : 1, sizeof(double));
+    if(data[0] == NULL || data[1] == NULL){
+        free(data[0]);
+        free(data[1]);
+        free_Resampler(resampler);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+
+    //resample
+    if(resample_buffer(resampler, in->data, in->pcm_spec.length, data, length) < 0){
+        free(data[0]);
+        free(data[1]);
+        free_Resampler(resampler);
+        return;
+    }
+    free_Resampler(resampler);
+
+    //copy pcm_spec with the new sampling frequency
+    out->pcm_spec.fs = fs;
+    out->pcm_spec.bits = in->pcm_spec.bits;
+    out->pcm_spec.length = length;
+    out->data[0] = data[0];
+    out->data[1] = data[1];
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,60 @@
+/*resample.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_RESAMPLE
+#define INCLUDED_RESAMPLE
+
+#include <stdint.h>
+#include "wavio.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Quality presets (taps per phase, Kaiser beta and passband edge are chosen in resample.c)
+#define RESAMPLE_FAST 0 /* 16 taps, for previews */
+#define RESAMPLE_MEDIUM 1 /* 32 taps */
+#define RESAMPLE_HIGH 2 /* 64 taps, default for processing */
+#define RESAMPLE_BEST 3 /* 128 taps, for mastering */
+
+//Polyphase resampler (fs_out / fs_in = up / down)
+typedef struct{
+    uint64_t fs_in; /* input sampling frequency */
+    uint64_t fs_out; /* output sampling frequency */
+    uint64_t up; /* interpolation factor (L) */
+    uint64_t down; /* decimation factor (M) */
+    int32_t taps; /* taps per phase */
+    int32_t phases; /* rows of the filter bank */
+    int exact; /* 1: one bank row per phase, 0: interpolate between rows */
+    double *bank; /* filter bank ((phases + 1) x taps) */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    double *history[2]; /* input samples still needed by the next outputs */
+    int32_t hist_len; /* samples in history */
+    int32_t hist_cap; /* capacity of history */
+    uint64_t index; /* input index (in history) of the next output */
+    uint64_t phase; /* phase (0 to up - 1) of the next output */
+    uint64_t in_total; /* input frames received */
+    uint64_t out_total; /* output frames produced */
+} RESAMPLER;
+
+//Prototype declaration for resample.c (alloc_Resampler returns NULL and the block functions -1 after reporting an error, see wavio_set_error_mode)
+/* using RESAMPLER struct (streaming) */
+RESAMPLER *alloc_Resampler(uint64_t fs_in, uint64_t fs_out, int16_t channel, int quality);
+void free_Resampler(RESAMPLER *resampler);
+int32_t resample_Block(RESAMPLER *resampler, double **in, int32_t in_len, double **out, int32_t out_max);
+int32_t resample_Flush(RESAMPLER *resampler, double **out, int32_t out_max);
+int32_t resample_Length(RESAMPLER *resampler, int32_t in_len);
+
+/* using MONO_PCM and STEREO_PCM struct */
+void resample_Mono(MONO_PCM *in, MONO_PCM *out, uint64_t fs, int quality);
+void resample_Stereo(STEREO_PCM *in, STEREO_PCM *out, uint64_t fs, int quality);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
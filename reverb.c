@@ -0,0 +1,428 @@
+/* reverb.c (beta)*/
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+/* include pthread (channels and files in parallel, disable with -DWAVIO_NO_THREADS) */
+#ifndef WAVIO_NO_THREADS
+#include <pthread.h>
+#endif
+
+/* include prototype header file */
+#include "reverb.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//partition size limits of alloc_Impulse (partition = 0 chooses one between them)
+#define REVERB_MIN_PARTITION 256
+#define REVERB_MAX_PARTITION 16384
+
+//Allocate IMPULSE struct from a WAV file (partition: power of 2, or 0 to choose from the length)
+//returns NULL after reporting the error (wavio_set_error_mode)
+IMPULSE *alloc_Impulse(char *filename, int32_t partition){
+    //allocate IMPULSE struct
+    IMPULSE *impulse;
+    PCMINFO pcminfo;
+    MONO_PCM *mono;
+    STEREO_PCM *stereo;
+
+    if(getPCMINFO(&pcminfo, filename) != 0){
+        return NULL;
+    }
+    if(pcminfo.channel < 1 || pcminfo.channel > 2){
+        wavio_report_error(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+        return NULL;
+    }
+    impulse = (IMPULSE *)malloc(sizeof(IMPULSE));
+    if(impulse == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the impulse response.");
+        return NULL;
+    }
+
+    //the whole signal is available, so large partitions only cut the number of spectra to accumulate
+    if(partition == 0){
+        partition = REVERB_MIN_PARTITION;
+    }
+
+    impulse->fs = pcminfo.fs;
+    impulse->channel = pcminfo.channel;
+    impulse->kernel[0] = NULL;
+    impulse->kernel[1] = NULL;
+    if(pcminfo.channel == 1){
+        mono = alloc_Mono();
+        if(mono == NULL){
+            free(impulse);
+            wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the impulse response.");
+            return NULL;
+        }
+        wavread_Mono(mono, filename);
+        if(mono->data != NULL){
+            impulse->length = mono->pcm_spec.length;
+            while(partition < REVERB_MAX_PARTITION && partition * 16 < impulse->length){
+                partition *= 2;
+            }
+            impulse->kernel[0] = alloc_FIR_Kernel(mono->data, mono->pcm_spec.length, partition);
+        }
+        free_Mono(mono);
+    }else{
+        stereo = alloc_Stereo();
+        if(stereo == NULL){
+            free(impulse);
+            wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the impulse response.");
+            return NULL;
+        }
+        wavread_Stereo(stereo, filename);
+        if(stereo->data[0] != NULL){
+            impulse->length = stereo->pcm_spec.length;
+            while(partition < REVERB_MAX_PARTITION && partition * 16 < impulse->length){
+                partition *= 2;
+            }
+            impulse->kernel[0] = alloc_FIR_Kernel(stereo->data[0], stereo->pcm_spec.length, partition);
+            if(impulse->kernel[0] != NULL){
+                impulse->kernel[1] = alloc_FIR_Kernel(stereo->data[1], stereo->pcm_spec.length, partition);
+            }
+        }
+        free_Stereo(stereo);
+    }
+
+    //the reader or alloc_FIR_Kernel has reported why a kernel is missing
+    if(impulse->kernel[0] == NULL || (impulse->channel == 2 && impulse->kernel[1] == NULL)){
+        free_Impulse(impulse);
+        return NULL;
+    }
+
+    return impulse;
+}
+
+//Free IMPULSE struct
+void free_Impulse(IMPULSE *impulse){
+    //free kernels
+    if(impulse->kernel[0] != NULL){
+        free_FIR_Kernel(impulse->kernel[0]);
+    }
+    if(impulse->kernel[1] != NULL){
+        free_FIR_Kernel(impulse->kernel[1]);
+    }
+
+    //free IMPULSE struct
+    free(impulse);
+}
+
+//Convolve MONO_PCM struct (out is allocated by alloc_Mono, length grows by the reverb tail, only filled in on success)
+void reverb_Mono(IMPULSE *impulse, MONO_PCM *in, MONO_PCM *out){
+    int32_t length = in->pcm_spec.length + impulse->length - 1;
+    double *data;
+
+    //initialize the data vector
+    data = (double *)calloc(length, sizeof(double));
+    if(data == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+
+    //convolve with the left (or only) channel of the impulse response
+    if(fir_Convolve(impulse->kernel[0], in->data, in->pcm_spec.length, data, length) != 0){
+        free(data);
+        return;
+    }
+
+    //copy pcm_spec with the new length
+    out->pcm_spec.fs = in->pcm_spec.fs;
+    out->pcm_spec.bits = in->pcm_spec.bits;
+    out->pcm_spec.length = length;
+    out->data = data;
+}
+
+//One channel of reverb_Stereo
+typedef struct{
+    FIR_KERNEL *kernel;
+    const double *x;
+    int32_t in_len;
+    double *y;
+    int32_t out_len;
+    int32_t error; /* error code of fir_Convolve (WAVIO_OK on success) */
+} REVERB_JOB;
+
+//Run one REVERB_JOB (an error is kept in the job instead of ending the program from a second thread)
+static void *reverb_job(void *arg){
+    REVERB_JOB *job = (REVERB_JOB *)arg;
+    int mode = wavio_set_error_mode(WAVIO_ERROR_RETURN);
+
+    job->error = (fir_Convolve(job->kernel, job->x, job->in_len, job->y, job->out_len) == 0) ? WAVIO_OK : wavio_last_error();
+    wavio_set_error_mode(mode);
+
+    return NULL;
+}
+
+//Convolve STEREO_PCM struct (out is allocated by alloc_Stereo, both channels run in parallel, only filled in on success)
+void reverb_Stereo(IMPULSE *impulse, STEREO_PCM *in, STEREO_PCM *out){
+    REVERB_JOB job[2];
+    int32_t length = in->pcm_spec.length + impulse->length - 1;
+    double *data[2];
+    int16_t ch;
+
+    //initialize the data vector
+    data[0] = (double *)calloc(length, sizeof(double));
+    data[1] = (double *)calloc(length, sizeof(double));
+    if(data[0] == NULL || data[1] == NULL){
+        free(data[0]);
+        free(data[1]);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+
+    //a mono impulse response is used for both channels
+    for(ch = 0; ch < 2; ch++){
+        job[ch].kernel = impulse->kernel[(impulse->channel == 2) ? ch : 0];
+        job[ch].x = in->data[ch];
+        job[ch].in_len = in->pcm_spec.length;
+        job[ch].y = data[ch];
+        job[ch].out_len = length;
+    }
+
+#ifndef WAVIO_NO_THREADS
+    {
+        pthread_t thread;
+
+        //right channel in a second thread (in this thread if it cannot be created)
+        if(pthread_create(&thread, NULL, reverb_job, &job[1]) == 0){
+            reverb_job(&job[0]);
+            pthread_join(thread, NULL);
+        }else{
+            reverb_job(&job[0]);
+            reverb_job(&job[1]);
+        }
+    }
+#else
+    reverb_job(&job[0]);
+    reverb_job(&job[1]);
+#endif
+
+    //errors of both channels are reported here, in the calling thread
+    for(ch = 0; ch < 2; ch++){
+        if(job[ch].error != WAVIO_OK){
+            free(data[0]);
+            free(data[1]);
+            wavio_report_error(job[ch].error, "Cannot convolve the signal.");
+            return;
+        }
+    }
+
+    //copy pcm_spec with the new length
+    out->pcm_spec.fs = in->pcm_spec.fs;
+    out->pcm_spec.bits = in->pcm_spec.bits;
+    out->pcm_spec.length = length;
+    out->data[0] = data[0];
+    out->data[1] = data[1];
+}
+
+//Queue of files shared by the threads of reverb_Files
+typedef struct{
+    IMPULSE *impulse;
+    char **in_files;
+    char **out_files;
+    int32_t count;
+    int32_t next; /* next file to take */
+    int32_t failed; /* files that failed */
+    int32_t error; /* error code of the first failed file */
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_t mutex;
+#endif
+} REVERB_QUEUE;
+
+//Convolve one file (written with the channels and bits of the input)
+//returns -1 after reporting the error (the workers return errors), an output that failed to write is removed
+static int reverb_file(IMPULSE *impulse, char *in_file, char *out_file){
+    PCMINFO pcminfo;
+    MONO_PCM *mono_in, *mono_out;
+    STEREO_PCM *stereo_in, *stereo_out;
+    REVERB_JOB job;
+    int16_t ch;
+    int status = -1;
+
+    if(getPCMINFO(&pcminfo, in_file) != 0){
+        return -1;
+    }
+    if(pcminfo.fs != impulse->fs){
+        return wavio_report_error(WAVIO_ERROR_ARGUMENT, "Sampling frequency does not match the impulse response.");
+    }
+
+    //a previous error code must not be taken for a failed write
+    wavio_last_error();
+
+    if(pcminfo.channel == 1){
+        mono_in = alloc_Mono();
+        mono_out = alloc_Mono();
+        if(mono_in != NULL && mono_out != NULL){
+            wavread_Mono(mono_in, in_file);
+            if(mono_in->data != NULL){
+                reverb_Mono(impulse, mono_in, mono_out);
+            }
+            if(mono_out->data != NULL){
+                wavwrite_Mono(mono_out, out_file);
+                status = (wavio_last_error() == WAVIO_OK) ? 0 : -1;
+                if(status != 0){
+                    remove(out_file);
+                }
+            }
+        }else{
+            wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        }
+        if(mono_in != NULL){
+            free_Mono(mono_in);
+        }
+        if(mono_out != NULL){
+            free_Mono(mono_out);
+        }
+    }else{
+        stereo_in = alloc_Stereo();
+        stereo_out = alloc_Stereo();
+        if(stereo_in != NULL && stereo_out != NULL){
+            wavread_Stereo(stereo_in, in_file);
+            if(stereo_in->data[0] != NULL){
+                //files already run in parallel, so channels run one after the other
+                stereo_out->pcm_spec = stereo_in->pcm_spec;
+                stereo_out->pcm_spec.length = stereo_in->pcm_spec.length + impulse->length - 1;
+                for(ch = 0; ch < 2; ch++){
+                    stereo_out->data[ch] = (double *)calloc(stereo_out->pcm_spec.length, sizeof(double));
+                    if(stereo_out->data[ch] == NULL){
+                        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+                        break;
+                    }
+                    job.kernel = impulse->kernel[(impulse->channel == 2) ? ch : 0];
+                    job.x = stereo_in->data[ch];
+                    job.in_len = stereo_in->pcm_spec.length;
+                    job.y = stereo_out->data[ch];
+                    job.out_len = stereo_out->pcm_spec.length;
+                    reverb_job(&job);
+                    if(job.error != WAVIO_OK){
+                        wavio_report_error(job.error, "Cannot convolve the signal.");
+                        break;
+                    }
+                }
+                if(ch == 2){
+                    wavwrite_Stereo(stereo_out, out_file);
+                    status = (wavio_last_error() == WAVIO_OK) ? 0 : -1;
+                    if(status != 0){
+                        remove(out_file);
+                    }
+                }
+            }
+        }else{
+            wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        }
+        if(stereo_in != NULL){
+            free_Stereo(stereo_in);
+        }
+        if(stereo_out != NULL){
+            free_Stereo(stereo_out);
+        }
+    }
+
+    return status;
+}
+
+//Take files from the queue until it is empty
+static void *reverb_worker(void *arg){
+    REVERB_QUEUE *queue = (REVERB_QUEUE *)arg;
+    int32_t index, error;
+    int mode;
+
+    //a file that cannot be convolved is counted as failed instead of ending the program
+    mode = wavio_set_error_mode(WAVIO_ERROR_RETURN);
+
+    for(;;){
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_lock(&queue->mutex);
+#endif
+        index = queue->next++;
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_unlock(&queue->mutex);
+#endif
+        if(index >= queue->count){
+            break;
+        }
+        if(reverb_file(queue->impulse, queue->in_files[index], queue->out_files[index]) != 0){
+            error = wavio_last_error();
+            printf("Error!: Cannot convolve %s.\n", queue->in_files[index]);
+#ifndef WAVIO_NO_THREADS
+            pthread_mutex_lock(&queue->mutex);
+#endif
+            if(queue->failed++ == 0){
+                queue->error = error;
+            }
+#ifndef WAVIO_NO_THREADS
+            pthread_mutex_unlock(&queue->mutex);
+#endif
+        }
+    }
+
+    wavio_set_error_mode(mode);
+
+    return NULL;
+}
+
+//Convolve count files with threads worker threads (the impulse response is shared, not copied)
+//returns the number of files that failed; they are reported once every file has been tried (wavio_set_error_mode)
+int32_t reverb_Files(IMPULSE *impulse, char **in_files, char **out_files, int32_t count, int threads){
+    REVERB_QUEUE queue;
+
+    queue.impulse = impulse;
+    queue.in_files = in_files;
+    queue.out_files = out_files;
+    queue.count = count;
+    queue.next = 0;
+    queue.failed = 0;
+    queue.error = WAVIO_OK;
+
+#ifndef WAVIO_NO_THREADS
+    {
+        pthread_t *thread;
+        int started = 0;
+        int i;
+
+        if(threads > count){
+            threads = count;
+        }
+        pthread_mutex_init(&queue.mutex, NULL);
+
+        //without the thread array this thread works alone
+        thread = (pthread_t *)malloc((threads > 0 ? threads : 1) * sizeof(pthread_t));
+        for(i = 1; i < threads && thread != NULL; i++){
+            if(pthread_create(&thread[started], NULL, reverb_worker, &queue) == 0){
+                started++;
+            }
+        }
+
+        //this thread works too
+        reverb_worker(&queue);
+
+        for(i = 0; i < started; i++){
+            pthread_join(thread[i], NULL);
+        }
+        free(thread);
+        pthread_mutex_destroy(&queue.mutex);
+    }
+#else
+    (void)threads;
+    reverb_worker(&queue);
+#endif
+
+    if(queue.failed > 0){
+        wavio_report_error(queue.error, "Some files could not be convolved.");
+    }
+
+    return queue.failed;
+}
+
+#ifdef __cplusplus
+}
+#endif
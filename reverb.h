@@ -0,0 +1,43 @@
+/*reverb.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_REVERB
+#define INCLUDED_REVERB
+
+#include <stdint.h>
+#include "wavio.h"
+#include "filter.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Impulse response with the spectra of its partitions (read only once loaded, shared by all threads)
+typedef struct{
+    uint64_t fs; /* Sampling frequency */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    int32_t length; /* taps per channel */
+    FIR_KERNEL *kernel[2]; /* partitioned kernel of each channel */
+} IMPULSE;
+
+//Prototype declaration for reverb.c (alloc_Impulse returns NULL after reporting an error, see wavio_set_error_mode)
+/* using IMPULSE struct */
+IMPULSE *alloc_Impulse(char *filename, int32_t partition);
+void free_Impulse(IMPULSE *impulse);
+
+/* using MONO_PCM and STEREO_PCM struct */
+void reverb_Mono(IMPULSE *impulse, MONO_PCM *in, MONO_PCM *out);
+void reverb_Stereo(IMPULSE *impulse, STEREO_PCM *in, STEREO_PCM *out);
+
+/* using files */
+int32_t reverb_Files(IMPULSE *impulse, char **in_files, char **out_files, int32_t count, int threads);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
@@ -0,0 +1,21 @@
+#!/bin/sh
+# tests/run.sh: build and run the stress test (tests/stress.c)
+# sh tests/run.sh [-t] [threads [files per thread]]
+#   -t  build with ThreadSanitizer
+#   CC, CFLAGS and STRESS_INDEX (use the global header index) are taken from the environment
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+cc=${CC:-gcc}
+flags=${CFLAGS:--O2}
+if [ "$1" = "-t" ]; then
+    flags="$flags -g -fsanitize=thread"
+    shift
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+$cc -std=c99 -Wall -Wextra $flags -I"$root" -o "$work/stress" "$root/tests/stress.c" "$root/wavio.c" -lm -pthread
+mkdir "$work/files"
+"$work/stress" "$work/files" "$@"
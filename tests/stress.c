@@ -0,0 +1,290 @@
+/* tests/stress.c */
+/* reads and writes thousands of WAV files from many threads at once (wavio.c) */
+/* sh tests/run.sh [-t] [threads [files per thread]] */
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+
+/* include header files */
+#include "wavio.h"
+
+#define STRESS_FRAMES 2048 /* frames of each file */
+
+//Settings shared by the threads
+typedef struct{
+    const char *dir; /* directory of the test files */
+    int32_t threads; /* worker threads */
+    int32_t files; /* files of each thread */
+} STRESS;
+
+//Work of one thread
+typedef struct{
+    STRESS *stress;
+    int32_t id; /* thread number */
+    int32_t failures; /* checks that failed */
+} STRESS_WORK;
+
+//Quantization bits and channels of file number n
+static int16_t stress_bits(int32_t n){
+    static const int16_t bits[4] = {8, 16, 24, 32};
+    return bits[n % 4];
+}
+
+static int16_t stress_channel(int32_t n){
+    return (int16_t)(1 + (n / 4) % 2);
+}
+
+//Sample i of channel c of file number n
+static double stress_sample(int32_t n, int32_t c, int32_t i){
+    uint32_t h = (uint32_t)n * 2654435761u ^ (uint32_t)(i * 2 + c) * 40503u;
+
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return (double)((int32_t)(h % 256) - 128) / 128.0;
+}
+
+//Path of file number n
+static void stress_path(char *path, size_t size, STRESS *stress, int32_t n){
+    snprintf(path, size, "%s/stress%05ld.wav", stress->dir, (long)n);
+}
+
+//Count a failed check
+static void stress_fail(STRESS_WORK *work, int32_t n, const char *what){
+    fprintf(stderr, "file %ld: %s\n", (long)n, what);
+    work->failures++;
+}
+
+//Write file number n (whole-file writers for even files, the streaming writer for odd ones)
+static void stress_write(STRESS_WORK *work, int32_t n){
+    int16_t bits = stress_bits(n), channel = stress_channel(n);
+    char path[1024];
+    double *data[2];
+    int32_t c, i;
+
+    stress_path(path, sizeof(path), work->stress, n);
+    for(c = 0; c < channel; c++){
+        data[c] = (double *)malloc(STRESS_FRAMES * sizeof(double));
+        for(i = 0; i < STRESS_FRAMES; i++) data[c][i] = stress_sample(n, c, i);
+    }
+
+    if(n % 2 == 0){
+        if(channel == 1){
+            MONO_PCM mono;
+            mono.pcm_spec.fs = 44100;
+            mono.pcm_spec.bits = bits;
+            mono.pcm_spec.length = STRESS_FRAMES;
+            mono.data = data[0];
+            wavwrite_Mono(&mono, path);
+        }else{
+            STEREO_PCM stereo;
+            stereo.pcm_spec.fs = 44100;
+            stereo.pcm_spec.bits = bits;
+            stereo.pcm_spec.length = STRESS_FRAMES;
+            stereo.data[0] = data[0];
+            stereo.data[1] = data[1];
+            wavwrite_Stereo(&stereo, path);
+        }
+    }else{
+        WAVWRITER *writer = wavopen_Writer(path, 44100, bits, channel);
+        if(writer != NULL){
+            //Uneven blocks
+            for(i = 0; i < STRESS_FRAMES; i += 700){
+                double *block[2];
+                int32_t frames = (STRESS_FRAMES - i < 700) ? STRESS_FRAMES - i : 700;
+                for(c = 0; c < channel; c++) block[c] = data[c] + i;
+                wavwrite_Writer(writer, block, frames);
+            }
+            wavclose_Writer(writer);
+        }
+    }
+    if(wavio_last_error() != WAVIO_OK) stress_fail(work, n, "write failed");
+
+    for(c = 0; c < channel; c++) free(data[c]);
+}
+
+//Compare channel c of file number n (within one step of the quantization)
+static int stress_same(int32_t n, int32_t c, const double *data, int32_t offset, int32_t frames){
+    double step = 1.0 / (pow(2.0, stress_bits(n) - 1) - 1);
+    int32_t i;
+
+    for(i = 0; i < frames; i++){
+        if(fabs(data[i] - stress_sample(n, c, offset + i)) > step) return 0;
+    }
+    return 1;
+}
+
+//Read file number n back (whole-file readers for files of the next thread, the streaming reader otherwise)
+static void stress_read(STRESS_WORK *work, int32_t n, int whole){
+    int16_t bits = stress_bits(n), channel = stress_channel(n);
+    char path[1024];
+    int32_t c;
+
+    stress_path(path, sizeof(path), work->stress, n);
+    if(whole){
+        if(channel == 1){
+            MONO_PCM *mono = alloc_Mono();
+            wavread_Mono(mono, path);
+            if(wavio_last_error() != WAVIO_OK) stress_fail(work, n, "read failed");
+            else if(mono->pcm_spec.bits != bits || mono->pcm_spec.length != STRESS_FRAMES) stress_fail(work, n, "wrong format");
+            else if(!stress_same(n, 0, mono->data, 0, STRESS_FRAMES)) stress_fail(work, n, "wrong samples");
+            free_Mono(mono);
+        }else{
+            STEREO_PCM *stereo = alloc_Stereo();
+            wavread_Stereo(stereo, path);
+            if(wavio_last_error() != WAVIO_OK) stress_fail(work, n, "read failed");
+            else if(stereo->pcm_spec.bits != bits || stereo->pcm_spec.length != STRESS_FRAMES) stress_fail(work, n, "wrong format");
+            else if(!stress_same(n, 0, stereo->data[0], 0, STRESS_FRAMES) || !stress_same(n, 1, stereo->data[1], 0, STRESS_FRAMES)) stress_fail(work, n, "wrong samples");
+            free_Stereo(stereo);
+        }
+    }else{
+        WAVREADER *reader = wavopen_Reader(path);
+        double block0[500], block1[500], *block[2];
+        int32_t offset = 0, frames;
+        int same = 1;
+
+        if(reader == NULL){
+            stress_fail(work, n, "open failed");
+            return;
+        }
+        if(reader->pcm_spec.bits != bits || reader->channel != channel || reader->pcm_spec.length != STRESS_FRAMES){
+            stress_fail(work, n, "wrong format");
+            wavclose_Reader(reader);
+            return;
+        }
+        block[0] = block0;
+        block[1] = block1;
+        while((frames = wavread_Reader(reader, block, 500)) > 0){
+            for(c = 0; c < channel; c++){
+                if(!stress_same(n, c, block[c], offset, frames)) same = 0;
+            }
+            offset += frames;
+        }
+        if(frames < 0 || wavio_last_error() != WAVIO_OK) stress_fail(work, n, "read failed");
+        else if(offset != STRESS_FRAMES) stress_fail(work, n, "wrong length");
+        else if(!same) stress_fail(work, n, "wrong samples");
+        wavclose_Reader(reader);
+    }
+}
+
+//Failing calls must report the code and leave the outputs untouched
+static void stress_errors(STRESS_WORK *work, int32_t n){
+    char path[1024];
+    MONO_PCM mono;
+    FILE *fp;
+
+    memset(&mono, 0x5a, sizeof(mono));
+    snprintf(path, sizeof(path), "%s/missing%ld.wav", work->stress->dir, (long)work->id);
+    wavread_Mono(&mono, path);
+    if(wavio_last_error() != WAVIO_ERROR_OPEN || mono.pcm_spec.bits != 0x5a5a) stress_fail(work, n, "missing file not reported");
+
+    snprintf(path, sizeof(path), "%s/broken%ld.wav", work->stress->dir, (long)work->id);
+    fp = fopen(path, "wb");
+    if(fp == NULL){
+        stress_fail(work, n, "cannot create the broken file");
+        return;
+    }
+    fputs("RIFF\x20\0\0\0WAVEjunk", fp);
+    fclose(fp);
+    wavread_Mono(&mono, path);
+    if(wavio_last_error() != WAVIO_ERROR_FORMAT || mono.pcm_spec.bits != 0x5a5a) stress_fail(work, n, "broken file not reported");
+    if(wavopen_Reader(path) != NULL || wavio_last_error() != WAVIO_ERROR_FORMAT) stress_fail(work, n, "broken file opened");
+    if(wavopen_Writer(path, 44100, 12, 2) != NULL || wavio_last_error() != WAVIO_ERROR_BITS) stress_fail(work, n, "12bit writer opened");
+    if(wavopen_Writer(path, 44100, 16, 3) != NULL || wavio_last_error() == WAVIO_OK) stress_fail(work, n, "3 channel writer opened");
+    remove(path);
+}
+
+//Write this thread's files
+static void *stress_write_thread(void *arg){
+    STRESS_WORK *work = (STRESS_WORK *)arg;
+    int32_t k;
+
+    wavio_set_error_mode(WAVIO_ERROR_RETURN);
+    for(k = 0; k < work->stress->files; k++){
+        int32_t n = work->id * work->stress->files + k;
+        stress_write(work, n);
+        if(k % 16 == 0) stress_errors(work, n);
+    }
+    return NULL;
+}
+
+//Read the files of this thread and of the next one
+static void *stress_read_thread(void *arg){
+    STRESS_WORK *work = (STRESS_WORK *)arg;
+    STRESS *stress = work->stress;
+    int32_t next = (work->id + 1) % stress->threads, k;
+
+    wavio_set_error_mode(WAVIO_ERROR_RETURN);
+    for(k = 0; k < stress->files; k++){
+        stress_read(work, work->id * stress->files + k, 0);
+        stress_read(work, next * stress->files + k, 1);
+    }
+    return NULL;
+}
+
+//Run one phase on every thread
+static int stress_phase(STRESS_WORK *work, int32_t threads, void *(*run)(void *)){
+    pthread_t *thread = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    int32_t t, started;
+
+    if(thread == NULL) return 0;
+    for(started = 0; started < threads; started++){
+        if(pthread_create(&thread[started], NULL, run, &work[started]) != 0) break;
+    }
+    for(t = 0; t < started; t++) pthread_join(thread[t], NULL);
+    free(thread);
+    return started == threads;
+}
+
+int main(int argc, char *argv[]){
+    STRESS stress;
+    STRESS_WORK *work;
+    int32_t t, k, failures = 0;
+    char path[1024];
+
+    stress.dir = (argc > 1) ? argv[1] : ".";
+    stress.threads = (argc > 2) ? atoi(argv[2]) : 16;
+    stress.files = (argc > 3) ? atoi(argv[3]) : 256;
+    if(stress.threads < 1 || stress.files < 1){
+        printf("usage: stress [dir [threads [files per thread]]]\n");
+        return 1;
+    }
+    //The header index table is shared by every thread
+    if(getenv("STRESS_INDEX") != NULL){
+        snprintf(path, sizeof(path), "%s/stress.index", stress.dir);
+        wavio_set_index_cache(WAVIO_INDEX_GLOBAL, path);
+    }
+
+    work = (STRESS_WORK *)calloc(stress.threads, sizeof(STRESS_WORK));
+    if(work == NULL) return 1;
+    for(t = 0; t < stress.threads; t++){
+        work[t].stress = &stress;
+        work[t].id = t;
+    }
+
+    //Every file is written before any is read, so the readers see the other threads' files
+    if(!stress_phase(work, stress.threads, stress_write_thread) || !stress_phase(work, stress.threads, stress_read_thread)){
+        printf("cannot start the threads\n");
+        failures++;
+    }
+    for(t = 0; t < stress.threads; t++){
+        failures += work[t].failures;
+        for(k = 0; k < stress.files; k++){
+            stress_path(path, sizeof(path), &stress, t * stress.files + k);
+            remove(path);
+        }
+    }
+    free(work);
+    if(getenv("STRESS_INDEX") != NULL){
+        snprintf(path, sizeof(path), "%s/stress.index", stress.dir);
+        remove(path);
+    }
+
+    printf("%ld threads, %ld files: %s (%ld failures)\n", (long)stress.threads, (long)stress.threads * stress.files, (failures == 0) ? "ok" : "FAILED", (long)failures);
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+/* tests/wpkbench.c */
+/* decode throughput of a 24 bit Stereo WPK file against the same WAV file (wpk.c, wavio.c) */
+/* gcc -O2 -I. -o wpkbench tests/wpkbench.c wpk.c wavio.c -lm -pthread, then ./wpkbench [dir [seconds]] */
+
+/* include standard libraries */
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+
+/* include header files */
+#include "wavio.h"
+#include "wpk.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define BENCH_FS 48000
+#define BENCH_BITS 24
+#define BENCH_RUNS 5 /* best of these runs is reported */
+#define BENCH_READ_FRAMES 4096 /* frames of each streaming read */
+
+//Seconds of a monotonic clock
+static double bench_now(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Size of a file in bytes
+static double bench_size(const char *path){
+    struct stat st;
+
+    return (stat(path, &st) == 0) ? (double)st.st_size : 0.0;
+}
+
+//Music-like 24 bit Stereo signal: a few partials with a slow envelope and a little noise
+static void bench_signal(STEREO_PCM_NATIVE *pcm, int32_t length){
+    uint32_t seed = 1;
+    double env, x;
+    int32_t n;
+    int ch, k;
+
+    pcm->pcm_spec.fs = BENCH_FS;
+    pcm->pcm_spec.bits = BENCH_BITS;
+    pcm->pcm_spec.length = length;
+    for(ch = 0; ch < 2; ch++){
+        for(n = 0; n < length; n++){
+            env = 0.5 + 0.4 * sin(2.0 * M_PI * 0.3 * n / BENCH_FS + ch);
+            x = 0.0;
+            for(k = 1; k <= 5; k++){
+                x += sin(2.0 * M_PI * 110.0 * k * (1.0 + 0.002 * ch) * n / BENCH_FS) / k;
+            }
+            seed = seed * 1664525u + 1013904223u;
+            x = 0.4 * env * x + 1e-4 * ((int32_t)(seed >> 8) / 8388608.0 - 1.0);
+            pcm->data[ch][n] = (int32_t)lrint(x * 8388607.0);
+        }
+    }
+}
+
+//Best time of reading the whole WAV file into STEREO_PCM_NATIVE
+static double bench_wav(char *path){
+    STEREO_PCM_NATIVE pcm;
+    double best = 1e30, t;
+    int r;
+
+    for(r = 0; r < BENCH_RUNS; r++){
+        t = bench_now();
+        wavread_Stereo_Native(&pcm, path);
+        t = bench_now() - t;
+        best = (t < best) ? t : best;
+        free(pcm.data[0]);
+        free(pcm.data[1]);
+    }
+    return best;
+}
+
+//Best time of reading the whole WPK file into STEREO_PCM_NATIVE
+static double bench_wpk(char *path){
+    STEREO_PCM_NATIVE pcm;
+    double best = 1e30, t;
+    int r;
+
+    for(r = 0; r < BENCH_RUNS; r++){
+        t = bench_now();
+        wpkread_Stereo_Native(&pcm, path);
+        t = bench_now() - t;
+        best = (t < best) ? t : best;
+        free(pcm.data[0]);
+        free(pcm.data[1]);
+    }
+    return best;
+}
+
+//Best time of decoding the WPK file block by block into the same buffers (no allocation or page faults per read)
+static double bench_wpk_stream(char *path){
+    WPKREADER *reader;
+    int32_t *data[2];
+    double best = 1e30, t;
+    int r;
+
+    data[0] = (int32_t *)malloc(BENCH_READ_FRAMES * sizeof(int32_t));
+    data[1] = (int32_t *)malloc(BENCH_READ_FRAMES * sizeof(int32_t));
+    if(data[0] == NULL || data[1] == NULL){
+        printf("cannot allocate the buffers\n");
+        exit(1);
+    }
+    for(r = 0; r < BENCH_RUNS; r++){
+        t = bench_now();
+        reader = wpkopen_Reader(path);
+        while(wpkread_Reader_Native(reader, data, BENCH_READ_FRAMES) > 0){
+        }
+        wpkclose_Reader(reader);
+        t = bench_now() - t;
+        best = (t < best) ? t : best;
+    }
+    free(data[0]);
+    free(data[1]);
+    return best;
+}
+
+int main(int argc, char **argv){
+    const char *dir = (argc > 1) ? argv[1] : ".";
+    int32_t seconds = (argc > 2) ? atoi(argv[2]) : 120;
+    STEREO_PCM_NATIVE pcm;
+    char wav[1024], wpk[1024];
+    double mb, t;
+
+    if(seconds < 1){
+        printf("usage: wpkbench [dir [seconds]]\n");
+        return 1;
+    }
+    snprintf(wav, sizeof(wav), "%s/wpkbench.wav", dir);
+    snprintf(wpk, sizeof(wpk), "%s/wpkbench.wpk", dir);
+
+    pcm.data[0] = (int32_t *)malloc((size_t)seconds * BENCH_FS * sizeof(int32_t));
+    pcm.data[1] = (int32_t *)malloc((size_t)seconds * BENCH_FS * sizeof(int32_t));
+    if(pcm.data[0] == NULL || pcm.data[1] == NULL){
+        printf("cannot allocate the signal\n");
+        return 1;
+    }
+    bench_signal(&pcm, seconds * BENCH_FS);
+    wavwrite_Stereo_Native(&pcm, wav);
+    wpkwrite_Stereo_Native(&pcm, wpk);
+    free(pcm.data[0]);
+    free(pcm.data[1]);
+
+    //throughput counts the decoded PCM (3 bytes per sample), both files are in the page cache after the first run
+    mb = (double)seconds * BENCH_FS * 2 * 3 / 1e6;
+    printf("%ld s of 24 bit Stereo: %.1f MB PCM, WPK is %.1f%% of the WAV file\n", (long)seconds, mb, 100.0 * bench_size(wpk) / bench_size(wav));
+    t = bench_wav(wav);
+    printf("wavread_Stereo_Native   %8.1f ms %8.1f MB/s\n", t * 1e3, mb / t);
+    t = bench_wpk(wpk);
+    printf("wpkread_Stereo_Native   %8.1f ms %8.1f MB/s\n", t * 1e3, mb / t);
+    t = bench_wpk_stream(wpk);
+    printf("wpkread_Reader_Native   %8.1f ms %8.1f MB/s\n", t * 1e3, mb / t);
+
+    remove(wav);
+    remove(wpk);
+    return 0;
+}
@@ -0,0 +1,800 @@
+/* transcode.c (beta)*/
+
+/* clock_gettime */
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+
+/* include pthread (work-stealing pool of files, disable with -DWAVIO_NO_THREADS) */
+#ifndef WAVIO_NO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/* include prototype header file */
+#include "transcode.h"
+#include "resample.h"
+#include "dither.h"
+#include "flac.h"
+#include "wpk.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//interval of the progress line (ms)
+#define TRANSCODE_PROGRESS_MS 500
+
+//Counters shared by the workers (read by the progress line)
+typedef struct{
+    int32_t files; /* files converted */
+    int32_t failed; /* files that failed */
+    uint64_t frames; /* input frames converted */
+    uint64_t bytes; /* input PCM bytes converted */
+    double audio; /* seconds of audio converted */
+    double done; /* estimated bytes of the input files converted */
+    double total; /* bytes of all input files */
+    int active; /* workers still running */
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; /* signalled when a worker ends */
+#endif
+} TRANSCODE_COUNTER;
+
+//Input file read block by block (WAV or WPK) or as a whole (FLAC)
+typedef struct{
+    PCM_SPEC pcm_spec; /* fs, bits and length of the file */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    WAVREADER *wav; /* WAV reader (or NULL) */
+    WPKREADER *wpk; /* WPK reader (or NULL) */
+    int32_t *whole[2]; /* NATIVE samples of a FLAC file (or NULL) */
+    int32_t position; /* next frame of whole */
+} TRANSCODE_SOURCE;
+
+//Output file written block by block
+typedef struct{
+    int format; /* TRANSCODE_WAV, TRANSCODE_FLAC or TRANSCODE_WPK */
+    char *filename; /* output file */
+    PCM_SPEC pcm_spec; /* fs, bits and frames written so far */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    WAVWRITER *wav; /* WAV writer (TRANSCODE_WAV) */
+    int32_t *data[2]; /* NATIVE samples kept until close (TRANSCODE_FLAC, TRANSCODE_WPK) */
+    int32_t cap; /* capacity of data in frames */
+} TRANSCODE_SINK;
+
+//Seconds of a monotonic clock
+static double transcode_clock(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//1 if filename ends with ext (case-insensitive)
+static int transcode_has_ext(char *filename, const char *ext){
+    size_t n = strlen(filename), m = strlen(ext), i;
+    char a, b;
+
+    if(n < m){
+        return 0;
+    }
+    for(i = 0; i < m; i++){
+        a = filename[n - m + i];
+        b = ext[i];
+        if(a >= 'A' && a <= 'Z'){
+            a = (char)(a - 'A' + 'a');
+        }
+        if(a != b){
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+//Channels of a FLAC file from its STREAMINFO block (0 if it is not a FLAC file)
+static int16_t transcode_flac_channel(char *filename){
+    uint8_t head[21]; /* "fLaC", block header and STREAMINFO up to the channels */
+    FILE *fp = fopen(filename, "rb");
+    size_t n = 0;
+
+    if(fp != NULL){
+        n = fread(head, 1, sizeof(head), fp);
+        fclose(fp);
+    }
+    if(n != sizeof(head) || memcmp(head, "fLaC", 4) != 0 || (head[4] & 0x7F) != 0){
+        return 0;
+    }
+
+    return (int16_t)(((head[20] >> 1) & 7) + 1);
+}
+
+//Open an input file (returns 0 on error)
+static int transcode_open_source(TRANSCODE_SOURCE *src, char *filename){
+    STEREO_PCM_NATIVE stereo;
+    MONO_PCM_NATIVE mono;
+
+    memset(src, 0, sizeof(TRANSCODE_SOURCE));
+
+    if(transcode_has_ext(filename, ".flac")){
+        //no block reader for FLAC: decode the whole file (the arrays stay NULL if it fails)
+        src->channel = transcode_flac_channel(filename);
+        stereo.data[0] = stereo.data[1] = NULL;
+        mono.data = NULL;
+        if(src->channel == 2){
+            flacread_Stereo_Native(&stereo, filename);
+            if(stereo.data[0] == NULL){
+                return 0;
+            }
+            src->pcm_spec = stereo.pcm_spec;
+            src->whole[0] = stereo.data[0];
+            src->whole[1] = stereo.data[1];
+        }else if(src->channel == 1){
+            flacread_Mono_Native(&mono, filename);
+            if(mono.data == NULL){
+                return 0;
+            }
+            src->pcm_spec = mono.pcm_spec;
+            src->whole[0] = mono.data;
+        }else{
+            return 0;
+        }
+    }else if(transcode_has_ext(filename, ".wpk")){
+        src->wpk = wpkopen_Reader(filename);
+        if(src->wpk == NULL){
+            return 0;
+        }
+        src->pcm_spec = src->wpk->pcm_spec;
+        src->channel = src->wpk->channel;
+    }else{
+        src->wav = wavopen_Reader(filename);
+        if(src->wav == NULL){
+            return 0;
+        }
+        src->pcm_spec = src->wav->pcm_spec;
+        src->channel = src->wav->channel;
+    }
+
+    return 1;
+}
+
+//Read up to frames frames of NATIVE samples
+static int32_t transcode_read_Native(TRANSCODE_SOURCE *src, int32_t **data, int32_t frames){
+    int c;
+
+    if(src->wav != NULL){
+        return wavread_Reader_Native(src->wav, data, frames);
+    }
+    if(src->wpk != NULL){
+        return wpkread_Reader_Native(src->wpk, data, frames);
+    }
+
+    if(frames > src->pcm_spec.length - src->position){
+        frames = src->pcm_spec.length - src->position;
+    }
+    for(c = 0; c < src->channel; c++){
+        memcpy(data[c], src->whole[c] + src->position, frames * sizeof(int32_t));
+    }
+    src->position += frames;
+
+    return frames;
+}
+
+//Read up to frames frames of [-1, 1] samples
+static int32_t transcode_read(TRANSCODE_SOURCE *src, double **data, int32_t frames){
+    int c;
+
+    if(src->wav != NULL){
+        return wavread_Reader(src->wav, data, frames);
+    }
+    if(src->wpk != NULL){
+        return wpkread_Reader(src->wpk, data, frames);
+    }
+
+    if(frames > src->pcm_spec.length - src->position){
+        frames = src->pcm_spec.length - src->position;
+    }
+    for(c = 0; c < src->channel; c++){
+        wavio_native_to_pcm(src->whole[c] + src->position, data[c], frames, src->pcm_spec.bits);
+    }
+    src->position += frames;
+
+    return frames;
+}
+
+//Close the input file
+static void transcode_close_source(TRANSCODE_SOURCE *src){
+    if(src->wav != NULL){
+        wavclose_Reader(src->wav);
+    }
+    if(src->wpk != NULL){
+        wpkclose_Reader(src->wpk);
+    }
+    free(src->whole[0]);
+    free(src->whole[1]);
+}
+
+//Open an output file (returns 0 on error)
+static int transcode_open_sink(TRANSCODE_SINK *sink, int format, char *filename, uint64_t fs, int16_t bits, int16_t channel){
+    memset(sink, 0, sizeof(TRANSCODE_SINK));
+    sink->format = format;
+    sink->filename = filename;
+    sink->pcm_spec.fs = fs;
+    sink->pcm_spec.bits = bits;
+    sink->channel = channel;
+
+    if(format == TRANSCODE_WAV){
+        sink->wav = wavopen_Writer(filename, fs, bits, channel);
+        return sink->wav != NULL;
+    }
+
+    return 1;
+}
+
+//Check the writers of an output file through the error code of the thread (returns ok, a failed file is removed)
+static int transcode_sink_done(TRANSCODE_SINK *sink, int ok){
+    if(wavio_last_error() != WAVIO_OK){
+        ok = 0;
+    }
+    if(!ok){
+        remove(sink->filename);
+    }
+
+    return ok;
+}
+
+//Append frames NATIVE frames (returns 0 on error)
+static int transcode_write(TRANSCODE_SINK *sink, int32_t **data, int32_t frames){
+    int32_t *grown;
+    int32_t cap;
+    int c;
+
+    if(sink->wav != NULL){
+        //a failed block write is left in wavio_last_error for transcode_run
+        wavwrite_Writer_Native(sink->wav, data, frames);
+        return !sink->wav->failed;
+    }
+
+    //FLAC and WPK are written as a whole: keep the samples
+    if(sink->pcm_spec.length + frames > sink->cap){
+        cap = (sink->cap > 0) ? sink->cap : TRANSCODE_BLOCK_FRAMES;
+        while(cap < sink->pcm_spec.length + frames){
+            cap *= 2;
+        }
+        for(c = 0; c < sink->channel; c++){
+            grown = (int32_t *)realloc(sink->data[c], cap * sizeof(int32_t));
+            if(grown == NULL){
+                return 0;
+            }
+            sink->data[c] = grown;
+        }
+        sink->cap = cap;
+    }
+    for(c = 0; c < sink->channel; c++){
+        memcpy(sink->data[c] + sink->pcm_spec.length, data[c], frames * sizeof(int32_t));
+    }
+    sink->pcm_spec.length += frames;
+
+    return 1;
+}
+
+//Finish the output file (returns 0 if it could not be written, the error code of the thread is cleared)
+//ok: 0 if an earlier block failed, the file is then only closed and removed
+static int transcode_close_sink(TRANSCODE_SINK *sink, int ok){
+    STEREO_PCM_NATIVE stereo;
+    MONO_PCM_NATIVE mono;
+
+    if(sink->wav != NULL){
+        wavclose_Writer(sink->wav);
+        return transcode_sink_done(sink, ok);
+    }
+    if(!ok){
+        free(sink->data[0]);
+        free(sink->data[1]);
+        return transcode_sink_done(sink, 0);
+    }
+
+    //files already run in parallel, so each FLAC file is encoded by one thread
+    if(sink->channel == 2){
+        stereo.pcm_spec = sink->pcm_spec;
+        stereo.data[0] = sink->data[0];
+        stereo.data[1] = sink->data[1];
+        if(sink->format == TRANSCODE_FLAC){
+            flacwrite_Stereo_Native_Threads(&stereo, sink->filename, 1);
+        }else{
+            wpkwrite_Stereo_Native(&stereo, sink->filename);
+        }
+    }else{
+        mono.pcm_spec = sink->pcm_spec;
+        mono.data = sink->data[0];
+        if(sink->format == TRANSCODE_FLAC){
+            flacwrite_Mono_Native_Threads(&mono, sink->filename, 1);
+        }else{
+            wpkwrite_Mono_Native(&mono, sink->filename);
+        }
+    }
+    free(sink->data[0]);
+    free(sink->data[1]);
+
+    return transcode_sink_done(sink, 1);
+}
+
+//Add a converted block to the counters
+static void transcode_count(TRANSCODE_COUNTER *counter, TRANSCODE_SOURCE *src, int32_t frames, double size){
+    if(counter == NULL){
+        return;
+    }
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_lock(&counter->mutex);
+#endif
+    counter->frames += frames;
+    counter->bytes += (uint64_t)frames * src->channel * (src->pcm_spec.bits / 8);
+    counter->audio += (double)frames / src->pcm_spec.fs;
+    if(src->pcm_spec.length > 0){
+        counter->done += size * frames / src->pcm_spec.length;
+    }
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_unlock(&counter->mutex);
+#endif
+}
+
+//Quantize (or dither) m frames to the channels of the output and write them (returns 0 on error)
+static int transcode_emit(TRANSCODE_SINK *sink, DITHER *dither, double **data, int32_t **native, int16_t mid_ch, int32_t m){
+    int c;
+
+    if(m <= 0){
+        return 1;
+    }
+
+    //Mono to Stereo after resampling
+    if(sink->channel > mid_ch){
+        memcpy(data[1], data[0], m * sizeof(double));
+    }
+
+    if(dither != NULL){
+        dither_Block(dither, data, native, m);
+    }else{
+        for(c = 0; c < sink->channel; c++){
+            wavio_pcm_to_native(data[c], native[c], m, sink->pcm_spec.bits);
+        }
+    }
+    return transcode_write(sink, native, m);
+}
+
+//Convert one file (returns 0 on error), size: bytes of the input file for the progress
+static int transcode_run(TRANSCODE *transcode, char *in_file, char *out_file, TRANSCODE_COUNTER *counter, double size){
+    TRANSCODE_SOURCE src;
+    TRANSCODE_SINK sink;
+    RESAMPLER *resampler = NULL;
+    DITHER *dither = NULL;
+    uint64_t fs;
+    int16_t bits, channel, mid_ch;
+    double *in[2], *out[2];
+    int32_t *native[2];
+    int32_t n, m, cap, i;
+    int c, ok = 1;
+
+    //errors of the wavio, FLAC and WPK calls below are collected from the error code of this thread
+    wavio_last_error();
+    if(!transcode_open_source(&src, in_file)){
+        return 0;
+    }
+    fs = (transcode->fs > 0) ? transcode->fs : src.pcm_spec.fs;
+    bits = (transcode->bits > 0) ? transcode->bits : src.pcm_spec.bits;
+    channel = (transcode->channel > 0) ? transcode->channel : src.channel;
+
+    //a file that cannot be converted fails here, before its output file exists
+    if(src.pcm_spec.fs == 0){
+        wavio_report_error(WAVIO_ERROR_FORMAT, "Inappropriate sampling frequency.");
+        transcode_close_source(&src);
+        return 0;
+    }
+    if(bits != 8 && bits != 16 && bits != 24 && bits != 32){
+        wavio_report_error(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+        transcode_close_source(&src);
+        return 0;
+    }
+    if(channel < 1 || channel > 2 || src.channel < 1 || src.channel > 2){
+        wavio_report_error(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+        transcode_close_source(&src);
+        return 0;
+    }
+
+    //Stereo to Mono before resampling, Mono to Stereo after it
+    mid_ch = (channel < src.channel) ? channel : src.channel;
+    if(fs != src.pcm_spec.fs){
+        resampler = alloc_Resampler(src.pcm_spec.fs, fs, mid_ch, transcode->quality);
+        ok = (resampler != NULL);
+    }
+    if(ok && transcode->dither != DITHER_NONE && (bits < src.pcm_spec.bits || resampler != NULL)){
+        dither = alloc_Dither(bits, channel, transcode->dither, 0);
+        ok = (dither != NULL);
+    }
+    if(!ok || !transcode_open_sink(&sink, transcode->format, out_file, fs, bits, channel)){
+        if(resampler != NULL){
+            free_Resampler(resampler);
+        }
+        if(dither != NULL){
+            free_Dither(dither);
+        }
+        transcode_close_source(&src);
+        return 0;
+    }
+
+    //same rate, bits and channels: copy the NATIVE samples
+    if(fs == src.pcm_spec.fs && bits == src.pcm_spec.bits && channel == src.channel){
+        for(c = 0; c < 2; c++){
+            native[c] = (int32_t *)malloc(TRANSCODE_BLOCK_FRAMES * sizeof(int32_t));
+        }
+        ok = (native[0] != NULL && native[1] != NULL);
+        while(ok && (n = transcode_read_Native(&src, native, TRANSCODE_BLOCK_FRAMES)) > 0){
+            ok = transcode_write(&sink, native, n);
+            transcode_count(counter, &src, n, size);
+        }
+        free(native[0]);
+        free(native[1]);
+        ok = transcode_close_sink(&sink, ok);
+        transcode_close_source(&src);
+        return ok;
+    }
+
+    cap = (resampler != NULL) ? resample_Length(resampler, TRANSCODE_BLOCK_FRAMES) + 1 : TRANSCODE_BLOCK_FRAMES;
+    for(c = 0; c < 2; c++){
+        in[c] = (double *)malloc(TRANSCODE_BLOCK_FRAMES * sizeof(double));
+        out[c] = (resampler != NULL) ? (double *)malloc(cap * sizeof(double)) : in[c];
+        native[c] = (int32_t *)malloc(cap * sizeof(int32_t));
+        if(in[c] == NULL || out[c] == NULL || native[c] == NULL){
+            ok = 0;
+        }
+    }
+
+    while(ok && (n = transcode_read(&src, in, TRANSCODE_BLOCK_FRAMES)) > 0){
+        if(mid_ch < src.channel){
+            for(i = 0; i < n; i++){
+                in[0][i] = 0.5 * (in[0][i] + in[1][i]);
+            }
+        }
+        m = (resampler != NULL) ? resample_Block(resampler, in, n, out, cap) : n;
+        ok = (m >= 0) && transcode_emit(&sink, dither, out, native, mid_ch, m);
+        transcode_count(counter, &src, n, size);
+    }
+    if(ok && resampler != NULL){
+        while(ok && (m = resample_Flush(resampler, out, cap)) > 0){
+            ok = transcode_emit(&sink, dither, out, native, mid_ch, m);
+        }
+        if(m < 0){
+            ok = 0;
+        }
+    }
+
+    for(c = 0; c < 2; c++){
+        if(out[c] != in[c]){
+            free(out[c]);
+        }
+        free(in[c]);
+        free(native[c]);
+    }
+    if(resampler != NULL){
+        free_Resampler(resampler);
+    }
+    if(dither != NULL){
+        free_Dither(dither);
+    }
+    ok = transcode_close_sink(&sink, ok);
+    transcode_close_source(&src);
+
+    return ok;
+}
+
+//Default conversion: keep everything, WAV output, RESAMPLE_HIGH, TPDF dither
+void transcode_Default(TRANSCODE *transcode){
+    transcode->fs = 0;
+    transcode->bits = 0;
+    transcode->channel = 0;
+    transcode->format = TRANSCODE_WAV;
+    transcode->quality = RESAMPLE_HIGH;
+    transcode->dither = DITHER_TPDF;
+    transcode->progress = 0;
+}
+
+//Convert one file (returns 0 if it could not be read or written)
+int transcode_File(TRANSCODE *transcode, char *in_file, char *out_file){
+    int mode = wavio_set_error_mode(WAVIO_ERROR_RETURN);
+    int ok = transcode_run(transcode, in_file, out_file, NULL, 0.0);
+
+    wavio_set_error_mode(mode);
+
+    return ok;
+}
+
+//Files of one worker: it takes them from the front, other workers steal from the back
+typedef struct{
+    int32_t *task; /* file indices, largest file first */
+    int32_t head; /* next task of the owner */
+    int32_t tail; /* one past the last task */
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_t mutex;
+#endif
+} TRANSCODE_DEQUE;
+
+//Pool of workers converting a list of files
+typedef struct{
+    TRANSCODE *transcode;
+    char **in_files;
+    char **out_files;
+    double *size; /* bytes of each input file */
+    int workers; /* number of workers (and deques) */
+    TRANSCODE_DEQUE *deque; /* one per worker */
+    TRANSCODE_COUNTER counter;
+} TRANSCODE_POOL;
+
+//One worker of the pool
+typedef struct{
+    TRANSCODE_POOL *pool;
+    int id; /* index of its own deque */
+} TRANSCODE_WORKER;
+
+//Take the next file of worker id, or steal the last file of the fullest other deque (-1: nothing left)
+static int32_t transcode_take(TRANSCODE_POOL *pool, int id){
+    TRANSCODE_DEQUE *own = &pool->deque[id], *victim;
+    int32_t task = -1, left, most;
+    int i, best;
+
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_lock(&own->mutex);
+#endif
+    if(own->head < own->tail){
+        task = own->task[own->head++];
+    }
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_unlock(&own->mutex);
+#endif
+
+    //steal from the deque with the most files left until every deque is empty
+    while(task < 0){
+        best = -1;
+        most = 0;
+        for(i = 1; i < pool->workers; i++){
+            victim = &pool->deque[(id + i) % pool->workers];
+#ifndef WAVIO_NO_THREADS
+            pthread_mutex_lock(&victim->mutex);
+#endif
+            left = victim->tail - victim->head;
+#ifndef WAVIO_NO_THREADS
+            pthread_mutex_unlock(&victim->mutex);
+#endif
+            if(left > most){
+                most = left;
+                best = (id + i) % pool->workers;
+            }
+        }
+        if(best < 0){
+            break;
+        }
+
+        victim = &pool->deque[best];
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_lock(&victim->mutex);
+#endif
+        if(victim->head < victim->tail){
+            task = victim->task[--victim->tail];
+        }
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_unlock(&victim->mutex);
+#endif
+    }
+
+    return task;
+}
+
+//Convert files until every deque is empty
+static void *transcode_worker(void *arg){
+    TRANSCODE_WORKER *worker = (TRANSCODE_WORKER *)arg;
+    TRANSCODE_POOL *pool = worker->pool;
+    TRANSCODE_COUNTER *counter = &pool->counter;
+    int32_t task;
+    int ok;
+
+    //a file that cannot be read or written is counted as failed instead of ending the program
+    wavio_set_error_mode(WAVIO_ERROR_RETURN);
+
+    while((task = transcode_take(pool, worker->id)) >= 0){
+        ok = transcode_run(pool->transcode, pool->in_files[task], pool->out_files[task], counter, pool->size[task]);
+        if(!ok){
+            printf("Error!: Cannot convert %s.\n", pool->in_files[task]);
+        }
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_lock(&counter->mutex);
+#endif
+        if(ok){
+            counter->files++;
+        }else{
+            counter->failed++;
+        }
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_unlock(&counter->mutex);
+#endif
+    }
+
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_lock(&counter->mutex);
+    counter->active--;
+    pthread_cond_signal(&counter->cond);
+    pthread_mutex_unlock(&counter->mutex);
+#endif
+
+    return NULL;
+}
+
+//Print the progress line (counter is locked by the caller)
+static void transcode_progress(TRANSCODE_COUNTER *counter, int32_t count, double elapsed, int last){
+    double percent = (counter->total > 0.0) ? 100.0 * counter->done / counter->total : 100.0;
+    double rate = (elapsed > 0.0) ? counter->bytes / elapsed / 1e6 : 0.0;
+    double speed = (elapsed > 0.0) ? counter->audio / elapsed : 0.0;
+    double eta = (counter->done > 0.0) ? elapsed * (counter->total - counter->done) / counter->done : 0.0;
+
+    if(last){
+        percent = 100.0;
+        eta = 0.0;
+    }
+    printf("\r%d/%d files (%d failed) %5.1f%% %.1f MB %.1f MB/s %.0fx real time ETA %.0f s ",
+           counter->files + counter->failed, count, counter->failed, percent, counter->bytes / 1e6, rate, speed, eta);
+    if(last){
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+//File and its size (sorted largest first)
+typedef struct{
+    double size; /* bytes of the input file */
+    int32_t index; /* index in the file list */
+} TRANSCODE_ORDER;
+
+static int transcode_compare(const void *a, const void *b){
+    double x = ((const TRANSCODE_ORDER *)a)->size;
+    double y = ((const TRANSCODE_ORDER *)b)->size;
+
+    return (x < y) - (x > y);
+}
+
+//Convert count files with threads workers (0: one per online CPU), stats may be NULL
+void transcode_Files(TRANSCODE *transcode, char **in_files, char **out_files, int32_t count, int threads, TRANSCODE_STATS *stats){
+    TRANSCODE_POOL pool;
+    TRANSCODE_COUNTER *counter = &pool.counter;
+    TRANSCODE_WORKER *worker;
+    struct stat st;
+    TRANSCODE_ORDER *order;
+    int32_t i;
+    int w;
+    double start = transcode_clock();
+
+#ifndef WAVIO_NO_THREADS
+    if(threads <= 0){
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#else
+    threads = 1;
+#endif
+    if(threads > count){
+        threads = count;
+    }
+    if(threads < 1){
+        threads = 1;
+    }
+
+    memset(&pool, 0, sizeof(pool));
+    pool.transcode = transcode;
+    pool.in_files = in_files;
+    pool.out_files = out_files;
+    pool.workers = threads;
+
+    //largest files first, dealt round robin so that every worker starts with a share of the big ones
+    pool.size = (double *)malloc((count > 0 ? count : 1) * sizeof(double));
+    order = (TRANSCODE_ORDER *)malloc((count > 0 ? count : 1) * sizeof(TRANSCODE_ORDER));
+    for(i = 0; i < count; i++){
+        pool.size[i] = (stat(in_files[i], &st) == 0) ? (double)st.st_size : 0.0;
+        counter->total += pool.size[i];
+        order[i].size = pool.size[i];
+        order[i].index = i;
+    }
+    qsort(order, count, sizeof(TRANSCODE_ORDER), transcode_compare);
+
+    pool.deque = (TRANSCODE_DEQUE *)calloc(threads, sizeof(TRANSCODE_DEQUE));
+    worker = (TRANSCODE_WORKER *)malloc(threads * sizeof(TRANSCODE_WORKER));
+    for(w = 0; w < threads; w++){
+        pool.deque[w].task = (int32_t *)malloc(((count + threads - 1) / threads + 1) * sizeof(int32_t));
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_init(&pool.deque[w].mutex, NULL);
+#endif
+        worker[w].pool = &pool;
+        worker[w].id = w;
+    }
+    for(i = 0; i < count; i++){
+        TRANSCODE_DEQUE *deque = &pool.deque[i % threads];
+        deque->task[deque->tail++] = order[i].index;
+    }
+
+#ifndef WAVIO_NO_THREADS
+    {
+        pthread_t *thread = (pthread_t *)malloc(threads * sizeof(pthread_t));
+        int *started = (int *)calloc(threads, sizeof(int));
+        struct timespec until;
+
+        pthread_mutex_init(&counter->mutex, NULL);
+        pthread_cond_init(&counter->cond, NULL);
+        counter->active = threads;
+
+        //every worker is a thread; this thread prints the progress
+        for(w = 0; w < threads; w++){
+            started[w] = (pthread_create(&thread[w], NULL, transcode_worker, &worker[w]) == 0);
+            if(!started[w]){
+                transcode_worker(&worker[w]);
+            }
+        }
+
+        pthread_mutex_lock(&counter->mutex);
+        while(counter->active > 0){
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += TRANSCODE_PROGRESS_MS * 1000000L;
+            until.tv_sec += until.tv_nsec / 1000000000L;
+            until.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&counter->cond, &counter->mutex, &until);
+            if(transcode->progress && counter->active > 0){
+                transcode_progress(counter, count, transcode_clock() - start, 0);
+            }
+        }
+        pthread_mutex_unlock(&counter->mutex);
+
+        for(w = 0; w < threads; w++){
+            if(started[w]){
+                pthread_join(thread[w], NULL);
+            }
+        }
+        free(thread);
+        free(started);
+        pthread_cond_destroy(&counter->cond);
+        pthread_mutex_destroy(&counter->mutex);
+    }
+#else
+    transcode_worker(&worker[0]);
+#endif
+
+    if(transcode->progress){
+        transcode_progress(counter, count, transcode_clock() - start, 1);
+    }
+    if(stats != NULL){
+        stats->files = counter->files;
+        stats->failed = counter->failed;
+        stats->frames = counter->frames;
+        stats->bytes = counter->bytes;
+        stats->seconds = transcode_clock() - start;
+    }
+
+    for(w = 0; w < threads; w++){
+#ifndef WAVIO_NO_THREADS
+        pthread_mutex_destroy(&pool.deque[w].mutex);
+#endif
+        free(pool.deque[w].task);
+    }
+    free(pool.deque);
+    free(worker);
+    free(order);
+    free(pool.size);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,56 @@
+/*transcode.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_TRANSCODE
+#define INCLUDED_TRANSCODE
+
+#include <stdint.h>
+#include "wavio.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//Output formats
+#define TRANSCODE_WAV 0 /* streamed through wavopen_Writer */
+#define TRANSCODE_FLAC 1 /* flacwrite_*_Native (the samples of one file are kept until it is written) */
+#define TRANSCODE_WPK 2 /* wpkwrite_*_Native (same) */
+
+//frames converted at once by each worker
+#define TRANSCODE_BLOCK_FRAMES 16384
+
+//Conversion applied to every file (0 keeps the value of the input file)
+typedef struct{
+    uint64_t fs; /* output sampling frequency (0: keep) */
+    int16_t bits; /* output quantization bits (0: keep) */
+    int16_t channel; /* output channels, 1 or 2 (0: keep) */
+    int format; /* TRANSCODE_WAV, TRANSCODE_FLAC or TRANSCODE_WPK */
+    int quality; /* RESAMPLE_FAST to RESAMPLE_BEST */
+    int dither; /* DITHER_NONE, DITHER_TPDF or DITHER_SHAPED (used when the bits are reduced or resampled) */
+    int progress; /* 1: print progress and throughput while running */
+} TRANSCODE;
+
+//Totals of a batch (transcode_Files)
+typedef struct{
+    int32_t files; /* files converted */
+    int32_t failed; /* files that could not be read or written */
+    uint64_t frames; /* input frames converted */
+    uint64_t bytes; /* input PCM bytes converted */
+    double seconds; /* wall-clock time */
+} TRANSCODE_STATS;
+
+//Prototype declaration for transcode.c
+/* using TRANSCODE struct */
+void transcode_Default(TRANSCODE *transcode);
+int transcode_File(TRANSCODE *transcode, char *in_file, char *out_file);
+void transcode_Files(TRANSCODE *transcode, char **in_files, char **out_files, int32_t count, int threads, TRANSCODE_STATS *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif
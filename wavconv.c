@@ -0,0 +1,251 @@
+/* wavconv.c (beta)*/
+/* batch conversion of WAV and WPK files (transcode.c) */
+/* gcc -O2 -o wavconv wavconv.c transcode.c wavio.c resample.c dither.c flac.c wpk.c -lm -pthread */
+
+/* getopt */
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/* include header files */
+#include "transcode.h"
+#include "resample.h"
+#include "dither.h"
+
+//Print the usage and end the program
+static void wavconv_usage(void){
+    printf("usage: wavconv -o outdir [options] files...\n");
+    printf("  -o dir     directory of the output files (same base names)\n");
+    printf("  -l file    also convert the files listed in file (one path per line)\n");
+    printf("  -r fs      output sampling frequency (default: keep)\n");
+    printf("  -b bits    output quantization bits: 8, 16, 24 or 32 (default: keep)\n");
+    printf("  -c ch      output channels: 1 or 2 (default: keep)\n");
+    printf("  -f format  wav, flac or wpk (default: wav)\n");
+    printf("  -q n       resampling quality 0 (fast) to 3 (best) (default: 2)\n");
+    printf("  -d type    dither: none, tpdf or shaped (default: tpdf)\n");
+    printf("  -j n       worker threads (default: one per CPU)\n");
+    printf("  -p         store the peak and RMS in PEAK and \"rms \" chunks (wav)\n");
+    printf("  -s         no progress line\n");
+    exit(1);
+}
+
+//Print an allocation error and end the program
+static void wavconv_no_memory(void){
+    printf("Error!: Cannot allocate the file list.\n");
+    exit(1);
+}
+
+//Append a path to the input list
+static void wavconv_add(char ***files, int32_t *count, int32_t *cap, const char *path){
+    char **grown;
+    char *copy;
+
+    if(*count >= *cap){
+        grown = (char **)realloc(*files, ((*cap > 0) ? *cap * 2 : 64) * sizeof(char *));
+        if(grown == NULL){
+            wavconv_no_memory();
+        }
+        *files = grown;
+        *cap = (*cap > 0) ? *cap * 2 : 64;
+    }
+    copy = (char *)malloc(strlen(path) + 1);
+    if(copy == NULL){
+        wavconv_no_memory();
+    }
+    (*files)[(*count)++] = strcpy(copy, path);
+}
+
+//Output path: outdir / base name of in_file with the extension of the format
+static char *wavconv_output(const char *outdir, const char *in_file, int format){
+    const char *ext = (format == TRANSCODE_FLAC) ? ".flac" : (format == TRANSCODE_WPK) ? ".wpk" : ".wav";
+    const char *base = strrchr(in_file, '/');
+    const char *dot;
+    char *out;
+    size_t n;
+
+    base = (base != NULL) ? base + 1 : in_file;
+    dot = strrchr(base, '.');
+    n = (dot != NULL) ? (size_t)(dot - base) : strlen(base);
+
+    out = (char *)malloc(strlen(outdir) + n + strlen(ext) + 2);
+    if(out == NULL){
+        wavconv_no_memory();
+    }
+    sprintf(out, "%s/%.*s%s", outdir, (int)n, base, ext);
+
+    return out;
+}
+
+//Output paths of the list sorted by qsort
+static char **wavconv_sort_files;
+
+//Compare the output paths of two input indices
+static int wavconv_compare(const void *a, const void *b){
+    return strcmp(wavconv_sort_files[*(const int32_t *)a], wavconv_sort_files[*(const int32_t *)b]);
+}
+
+//End the program if two inputs map to the same output path (e.g. a/x.wav and b/x.wav), the workers would write it at once
+static void wavconv_check_outputs(char **in_files, char **out_files, int32_t count){
+    int32_t *order = (int32_t *)malloc((size_t)count * sizeof(int32_t));
+    int32_t i;
+
+    if(order == NULL){
+        wavconv_no_memory();
+    }
+    for(i = 0; i < count; i++){
+        order[i] = i;
+    }
+    wavconv_sort_files = out_files;
+    qsort(order, count, sizeof(int32_t), wavconv_compare);
+
+    for(i = 1; i < count; i++){
+        if(strcmp(out_files[order[i - 1]], out_files[order[i]]) == 0){
+            printf("Error!: %s and %s are both converted to %s.\n", in_files[order[i - 1]], in_files[order[i]], out_files[order[i]]);
+            exit(1);
+        }
+    }
+    free(order);
+}
+
+int main(int argc, char **argv){
+    TRANSCODE transcode;
+    TRANSCODE_STATS stats;
+    char **in_files = NULL, **out_files;
+    char *outdir = NULL;
+    char line[4096];
+    int32_t count = 0, cap = 0, i;
+    int threads = 0;
+    int opt;
+    size_t n;
+    FILE *fp;
+
+    transcode_Default(&transcode);
+    transcode.progress = 1;
+
+    while((opt = getopt(argc, argv, "o:l:r:b:c:f:q:d:j:ps")) != -1){
+        switch(opt){
+            case 'o':
+                outdir = optarg;
+                break;
+
+            case 'l':
+                fp = fopen(optarg, "r");
+                if(fp == NULL){
+                    printf("Error!: Cannot open %s.\n", optarg);
+                    exit(1);
+                }
+                while(fgets(line, sizeof(line), fp) != NULL){
+                    n = strlen(line);
+                    while(n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')){
+                        line[--n] = '\0';
+                    }
+                    if(n > 0){
+                        wavconv_add(&in_files, &count, &cap, line);
+                    }
+                }
+                fclose(fp);
+                break;
+
+            case 'r':
+                transcode.fs = strtoull(optarg, NULL, 10);
+                break;
+
+            case 'b':
+                transcode.bits = (int16_t)atoi(optarg);
+                if(transcode.bits != 8 && transcode.bits != 16 && transcode.bits != 24 && transcode.bits != 32){
+                    printf("Error!: Inappropriate quantization bit number.\n");
+                    exit(1);
+                }
+                break;
+
+            case 'c':
+                transcode.channel = (int16_t)atoi(optarg);
+                if(transcode.channel != 1 && transcode.channel != 2){
+                    printf("Error!: Inappropriate channel number.\n");
+                    exit(1);
+                }
+                break;
+
+            case 'f':
+                if(strcmp(optarg, "wav") == 0){
+                    transcode.format = TRANSCODE_WAV;
+                }else if(strcmp(optarg, "flac") == 0){
+                    transcode.format = TRANSCODE_FLAC;
+                }else if(strcmp(optarg, "wpk") == 0){
+                    transcode.format = TRANSCODE_WPK;
+                }else{
+                    wavconv_usage();
+                }
+                break;
+
+            case 'q':
+                transcode.quality = atoi(optarg);
+                if(transcode.quality < RESAMPLE_FAST || transcode.quality > RESAMPLE_BEST){
+                    wavconv_usage();
+                }
+                break;
+
+            case 'd':
+                if(strcmp(optarg, "none") == 0){
+                    transcode.dither = DITHER_NONE;
+                }else if(strcmp(optarg, "tpdf") == 0){
+                    transcode.dither = DITHER_TPDF;
+                }else if(strcmp(optarg, "shaped") == 0){
+                    transcode.dither = DITHER_SHAPED;
+                }else{
+                    wavconv_usage();
+                }
+                break;
+
+            case 'j':
+                threads = atoi(optarg);
+                break;
+
+            case 'p':
+                wavio_set_level_mode(WAVIO_LEVEL_CHUNK);
+                break;
+
+            case 's':
+                transcode.progress = 0;
+                break;
+
+            default:
+                wavconv_usage();
+        }
+    }
+    for(i = optind; i < argc; i++){
+        wavconv_add(&in_files, &count, &cap, argv[i]);
+    }
+    if(outdir == NULL || count < 1){
+        wavconv_usage();
+    }
+
+    out_files = (char **)malloc(count * sizeof(char *));
+    if(out_files == NULL){
+        wavconv_no_memory();
+    }
+    for(i = 0; i < count; i++){
+        out_files[i] = wavconv_output(outdir, in_files[i], transcode.format);
+    }
+    wavconv_check_outputs(in_files, out_files, count);
+
+    transcode_Files(&transcode, in_files, out_files, count, threads, &stats);
+    printf("%d files converted, %d failed, %.1f MB in %.2f s (%.1f MB/s)\n",
+           stats.files, stats.failed, stats.bytes / 1e6, stats.seconds, (stats.seconds > 0.0) ? stats.bytes / 1e6 / stats.seconds : 0.0);
+
+    for(i = 0; i < count; i++){
+        free(in_files[i]);
+        free(out_files[i]);
+    }
+    free(in_files);
+    free(out_files);
+
+    return (stats.failed > 0) ? 1 : 0;
+}
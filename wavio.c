@@ -1,26 +1,107 @@
 /* wavio.c (beta)*/
 
+/* O_DIRECT, sync_file_range (Linux) */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 /* include standard libraries */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* include pthread (double-buffered pipeline, disable with -DWAVIO_NO_THREADS) */
+#ifndef WAVIO_NO_THREADS
+#include <pthread.h>
+#endif
+
+/* include SIMD intrinsics (byte swapping of big-endian samples, packed 24bit) */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+/* include io_uring (optional backend, build with -DWAVIO_USE_IO_URING -luring) */
+#ifdef WAVIO_USE_IO_URING
+#include <liburing.h>
+#endif
 
 /* include prototype header file */
 #include "wavio.h"
 
+/* thread-local storage (error mode and last error of each thread) */
+#if defined(__cplusplus)
+#define WAVIO_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define WAVIO_THREAD_LOCAL _Thread_local
+#else
+#define WAVIO_THREAD_LOCAL __thread
+#endif
+
 /* extern "C" */
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+//error mode (WAVIO_ERROR_EXIT or WAVIO_ERROR_RETURN) and last error code of the calling thread
+static WAVIO_THREAD_LOCAL int wavio_error_mode = WAVIO_ERROR_EXIT;
+static WAVIO_THREAD_LOCAL int32_t wavio_error = WAVIO_OK;
+
+//Set how errors of the calling thread are reported (returns the previous mode)
+int wavio_set_error_mode(int mode){
+    int previous = wavio_error_mode;
+
+    wavio_error_mode = mode;
+    wavio_error = WAVIO_OK;
+
+    return previous;
+}
+
+//Error code of the last failed call of this thread (WAVIO_OK if none), cleared by reading it
+int32_t wavio_last_error(void){
+    int32_t error = wavio_error;
+
+    wavio_error = WAVIO_OK;
+
+    return error;
+}
+
+//Report an error: print it and end the program, or remember it and let the caller return (returns -1)
+static int32_t wavio_fail(int32_t code, const char *message){
+    wavio_error = code;
+    if(wavio_error_mode == WAVIO_ERROR_EXIT){
+        printf("Error!: %s\n", message);
+        exit(1);
+    }
+
+    return -1;
+}
+
+//Report an error of a module built on wavio (flac.c, wpk.c) through the error mode of the calling thread
+int32_t wavio_report_error(int32_t code, const char *message){
+    return wavio_fail(code, message);
+}
+
 //Allocate RIFF struct
 RIFF *alloc_RIFF(void){
     //allocate RIFF struct
     RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
 
+    if(riff == NULL){
+        return NULL;
+    }
+
     //pointer for RIFF data vector
     riff->data.data = NULL;
 
@@ -41,6 +122,10 @@ STEREO_PCM_NATIVE *alloc_Stereo_Native(void){
     //allocate STEREO_PCM_NATIVE struct
     STEREO_PCM_NATIVE *stereo_pcm_native = (STEREO_PCM_NATIVE *)malloc(sizeof(STEREO_PCM_NATIVE));
 
+    if(stereo_pcm_native == NULL){
+        return NULL;
+    }
+
     //pointer for STEREO_PCM_NATIVE data vector
     stereo_pcm_native->data[0] = NULL;
     stereo_pcm_native->data[1] = NULL;
@@ -63,6 +148,10 @@ STEREO_PCM *alloc_Stereo(void){
     //allocate STEREO_PCM struct
     STEREO_PCM *stereo_pcm = (STEREO_PCM *)malloc(sizeof(STEREO_PCM));
 
+    if(stereo_pcm == NULL){
+        return NULL;
+    }
+
     //pointer for data vector
     stereo_pcm->data[0] = NULL;
     stereo_pcm->data[1] = NULL;
@@ -85,6 +174,10 @@ MONO_PCM_NATIVE *alloc_Mono_Native(void){
     //allocate MONO_PCM_NATIVE struct
     MONO_PCM_NATIVE *mono_pcm_native = (MONO_PCM_NATIVE *)malloc(sizeof(MONO_PCM_NATIVE));
 
+    if(mono_pcm_native == NULL){
+        return NULL;
+    }
+
     //pointer for data vector
     mono_pcm_native->data = NULL;
 
@@ -105,6 +198,10 @@ MONO_PCM *alloc_Mono(void){
     //allocate MONO_PCM struct
     MONO_PCM *mono_pcm = (MONO_PCM *)malloc(sizeof(MONO_PCM));
 
+    if(mono_pcm == NULL){
+        return NULL;
+    }
+
     //pointer for data vector
     mono_pcm->data = NULL;
 
@@ -120,912 +217,3803 @@ void free_Mono(MONO_PCM *mono_pcm){
     free(mono_pcm);
 }
 
-//Read RIFF, fmt, and data chunks
-void wavread_RIFF(RIFF *riff, char *filename){
-    FILE *fp; /* File pointer */
-    uint64_t i = 0; /* for loop */
-    int32_t *init_data; /* For initialize the pointer */
-    int32_t x;
-    int16_t xx;
-
-    //open the file
-    fp = fopen(filename, "rb");
-
-    //judge if the file equals to RIFF chunk
-    fread(riff->chunkID, 1, 4, fp);
+//Allocate STEREO_PCM_COMPACT struct
+STEREO_PCM_COMPACT *alloc_Stereo_Compact(void){
+    //allocate STEREO_PCM_COMPACT struct
+    STEREO_PCM_COMPACT *stereo_pcm_compact = (STEREO_PCM_COMPACT *)malloc(sizeof(STEREO_PCM_COMPACT));
 
-    //if the file doesn't have RIFF format
-    if(strncmp(riff->chunkID, "RIFF", 4) != 0){
-        //Throw the error and end the program.
-        printf("Error!: The file does not have RIFF chunk.\n");
-        free(riff);
-        exit(1);
+    if(stereo_pcm_compact == NULL){
+        return NULL;
     }
 
-    //Read each chunk
-    fread(&riff->chunkSize, 4, 1, fp);
-    fread(riff->formType, 1, 4, fp);
-
-    //if the file is not WAV file.
-    if(strncmp(riff->formType, "WAVE", 4) != 0){
-        //Throw the error and end the program.
-        printf("Error!: The file is not WAV file.\n");
-        free(riff);
-        exit(1);
-    }
+    //pointer for data vector
+    stereo_pcm_compact->data[0] = NULL;
+    stereo_pcm_compact->data[1] = NULL;
 
-    //jump unnecessary chunks.
-    fread(riff->fmt.chunkID, 1, 4, fp);
-    while(strncmp(riff->fmt.chunkID, "fmt ", 4) != 0){
-        //jump every 1 bite untile find the "fmt " chunk
-        fseek(fp, -3, SEEK_CUR);
-        fread(riff->fmt.chunkID, 1, 4, fp);
-    }
+    return stereo_pcm_compact;
+}
 
-    //Read fmt chunk
-    fread(&riff->fmt.chunkSize, 4, 1, fp);
-    fread(&riff->fmt.waveFormatType, 2, 1, fp);
-    fread(&riff->fmt.channel, 2, 1, fp);
-    fread(&riff->fmt.samplesPerSec, 4, 1, fp);
-    fread(&riff->fmt.bytesPerSec, 4, 1, fp);
-    fread(&riff->fmt.blockSize, 2, 1, fp);
-    fread(&riff->fmt.bitsPerSample, 2, 1, fp);
+//Free STEREO_PCM_COMPACT struct
+void free_Stereo_Compact(STEREO_PCM_COMPACT *stereo_pcm_compact){
+    //free STEREO_PCM_COMPACT data vector
+    free(stereo_pcm_compact->data[0]);
+    free(stereo_pcm_compact->data[1]);
 
-    //jump unnecessary chunks.
-    fread(riff->data.chunkID, 1, 4, fp);
-    while (strncmp(riff->data.chunkID, "data", 4) != 0){
-        fseek(fp, -3, SEEK_CUR);
-        fread(riff->data.chunkID, 1, 4, fp);
-    }
+    //free STEREO_PCM_COMPACT struct
+    free(stereo_pcm_compact);
+}
 
-    //Read data chunk
-    fread(&riff->data.chunkSize, 4, 1, fp);
+//Allocate MONO_PCM_COMPACT struct
+MONO_PCM_COMPACT *alloc_Mono_Compact(void){
+    //allocate MONO_PCM_COMPACT struct
+    MONO_PCM_COMPACT *mono_pcm_compact = (MONO_PCM_COMPACT *)malloc(sizeof(MONO_PCM_COMPACT));
 
-    //Define data vector
-    riff->data.data = (int32_t *)calloc((unsigned)riff->data.chunkSize / (riff->fmt.bitsPerSample / 8), sizeof(int32_t));
-    init_data = &riff->data.data[0];
+    if(mono_pcm_compact == NULL){
+        return NULL;
+    }
 
-    switch (riff->fmt.bitsPerSample)
-    {
-        //8bit (unsigned)
-        case 8:
-            for(i = 0; i < riff->data.chunkSize; i++){
-                xx = 0;
-                fread(&xx, 1, 1, fp);
-                *riff->data.data = xx;
-                //printf("%d\n", *riff->data.data);
-                riff->data.data++;
-            }
-            riff->data.data = init_data;
-            break;
-    
-        //16bit (signed)
-        case 16:
-            for(i = 0; i < riff->data.chunkSize / 2; i++){
-                xx = 0;
-                fread(&xx, 2, 1, fp);
-                *riff->data.data = xx;
-                //printf("%d\n", *riff->data.data);
-                riff->data.data++;
-            }
-            riff->data.data = init_data;
-            break;
+    //pointer for data vector
+    mono_pcm_compact->data = NULL;
 
-        //24bit (signed)
-        case 24:
-            for(i = 0; i < riff->data.chunkSize / 3; i++){
-                x = 0;
-                fread(&x, 3, 1, fp);
+    return mono_pcm_compact;
+}
 
-                if(x >= 0x800000){
-                    x -= 0x1000000;
-                }
+//Free MONO_PCM_COMPACT struct
+void free_Mono_Compact(MONO_PCM_COMPACT *mono_pcm_compact){
+    //free MONO_PCM_COMPACT data vector
+    free(mono_pcm_compact->data);
 
-                *riff->data.data = x;
-                //printf("%d\n", *riff->data.data);
-                riff->data.data++;
-            }
-            riff->data.data = init_data;
-            break;
+    //free MONO_PCM_COMPACT struct
+    free(mono_pcm_compact);
+}
 
-        //32bit (signed)
-        case 32:
-            for(i = 0; i < riff->data.chunkSize / 4; i++){
-                x = 0;
-                fread(&x, 4, 1, fp);
-                *riff->data.data = x;
-                //printf("%d\n", *riff->data.data);
-                riff->data.data++;
-            }
-            riff->data.data = init_data;
-            break;
+//Allocate INTERLEAVED_PCM struct
+INTERLEAVED_PCM *alloc_Interleaved(void){
+    //allocate INTERLEAVED_PCM struct
+    INTERLEAVED_PCM *interleaved_pcm = (INTERLEAVED_PCM *)malloc(sizeof(INTERLEAVED_PCM));
 
-        //Error
-        default:
-            printf("Error!: Inappropriate quantization bit number.\n");
-            free_RIFF(riff);
-            exit(1);
-            break;
+    if(interleaved_pcm == NULL){
+        return NULL;
     }
 
-    //for debug
-    /*
-    printf("RIFF ID : %4s\n", riff->chunkID);
-    printf("RIFF chunk size : %d\n", riff->chunkSize);
-    printf("Format type : %4s\n", riff->formType);
-    printf("Format Subchunk ID : %4s\n", riff->fmt.chunkID);
-    printf("chunkSize : %d\n", riff->fmt.chunkSize);
-    printf("waveFormatType : %d\n", riff->fmt.waveFormatType);
-    printf("Channel : %d\n", riff->fmt.channel);
-    printf("Fs : %d\n", riff->fmt.samplesPerSec);
-    printf("Bytes Per Sec : %d\n", riff->fmt.bytesPerSec);
-    printf("Block Size : %d\n", riff->fmt.blockSize);
-    printf("Bits : %d\n", riff->fmt.bitsPerSample);
-    printf("Data Subchunk ID : %4s\n", riff->data.chunkID);
-    printf("Data Subchunk Size : %d\n", riff->data.chunkSize);
-    */
+    //pointer for data vector
+    interleaved_pcm->data = NULL;
 
-    //Close file
-    fclose(fp);
+    return interleaved_pcm;
 }
 
-//Read PCMINFO
-void getPCMINFO(PCMINFO *pcminfo, char *filename){
-    //Define RIFF struct
-    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
-
-    //get RIFF struct data
-    wavread_RIFF(riff, filename);
-
-    //copy properties
-    pcminfo->filename = filename;
-    pcminfo->fs = riff->fmt.samplesPerSec;
-    pcminfo->bits = riff->fmt.bitsPerSample;
-    pcminfo->channel = riff->fmt.channel;
+//Free INTERLEAVED_PCM struct
+void free_Interleaved(INTERLEAVED_PCM *interleaved_pcm){
+    //free INTERLEAVED_PCM data vector
+    free(interleaved_pcm->data);
 
-    //free RIFF struct
-    free_RIFF(riff);
+    //free INTERLEAVED_PCM struct
+    free(interleaved_pcm);
 }
 
-//Read and insert STEREO_PCM_NATIVE data
-void wavread_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename){
-    //Define RIFF struct
-    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
+//Bytes per sample of the COMPACT structs (8bit: 1, 16bit: 2, 24bit and 32bit: 4)
+int16_t wavio_compact_bytes(int16_t bits){
+    return (bits == 8) ? 1 : (bits == 16) ? 2 : 4;
+}
 
-    uint64_t i = 0; /* For loop */
-    int32_t *L, *R; /* For initialize the data vector */
+/* bulk I/O backend for the data chunk */
+//bytes per bulk request
+#ifndef WAVIO_IO_BLOCK_SIZE
+#define WAVIO_IO_BLOCK_SIZE (1 << 20)
+#endif
 
-    //get RIFF struct data
-    wavread_RIFF(riff, filename);
+//number of bulk requests kept in flight (io_uring backend)
+#ifndef WAVIO_IO_QUEUE_DEPTH
+#define WAVIO_IO_QUEUE_DEPTH 8
+#endif
 
-    //copy pcm_spec
-    stereo_pcm_native->pcm_spec.fs = riff->fmt.samplesPerSec;
-    stereo_pcm_native->pcm_spec.bits = riff->fmt.bitsPerSample;
-    stereo_pcm_native->pcm_spec.length = riff->data.chunkSize / (2 * (riff->fmt.bitsPerSample / 8));
+//offset, length and buffer alignment for O_DIRECT
+#ifndef WAVIO_DIRECT_ALIGN
+#define WAVIO_DIRECT_ALIGN 4096
+#endif
 
-    //initialize the data vector
-    stereo_pcm_native->data[0] = (int32_t *)calloc(stereo_pcm_native->pcm_spec.length, sizeof(int32_t));
-    stereo_pcm_native->data[1] = (int32_t *)calloc(stereo_pcm_native->pcm_spec.length, sizeof(int32_t));
-    L = &stereo_pcm_native->data[0][0];
-    R = &stereo_pcm_native->data[1][0];
+//page cache mode for bulk I/O (WAVIO_CACHE_*)
+static int wavio_cache_mode = WAVIO_CACHE_DEFAULT;
 
-    //copy data vector from riff
-    for(i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i += 2){
-        *stereo_pcm_native->data[0] = riff->data.data[i];
-        *stereo_pcm_native->data[1] = riff->data.data[i+1];
+//Data chunk I/O handle
+typedef struct{
+    int fd; /* file descriptor used for the data chunk */
+    int own_fd; /* 1 if fd was opened here (O_DIRECT) and must be closed */
+    uint64_t offset; /* file offset of the data chunk body */
+    int mode; /* WAVIO_CACHE_* in effect for this transfer */
+} WAVIO_IO;
 
-        stereo_pcm_native->data[0]++;
-        stereo_pcm_native->data[1]++;
-    }
+//block callback (context, block buffer, byte position in the data chunk, block size)
+typedef void (*WAVIO_BLOCK_FUNC)(void *ctx, uint8_t *block, uint64_t pos, uint64_t size);
 
-    //reset vector index
-    stereo_pcm_native->data[0] = L;
-    stereo_pcm_native->data[1] = R;
+//Set the page cache mode used by the following reads and writes
+void wavio_set_cache_mode(int mode){
+    wavio_cache_mode = mode;
+}
 
-    //free RIFF struct
-    free_RIFF(riff);
+//block size rounded down to whole samples (or frames)
+static uint64_t wavio_block_size(uint64_t align){
+    return WAVIO_IO_BLOCK_SIZE - WAVIO_IO_BLOCK_SIZE % align;
 }
 
-//Read data and insert STEREO_PCM struct
-void wavread_Stereo(STEREO_PCM *stereo_pcm, char *filename){
-    //Define RIFF struct
-    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
+//Allocate a block buffer (aligned for O_DIRECT, with room for the alignment skew)
+static uint8_t *wavio_alloc_block(uint64_t block){
+    void *buf = NULL;
 
-    uint64_t i = 0; /* For loop */
-    double *L, *R; /* for initialize the pointer */
+    if(posix_memalign(&buf, WAVIO_DIRECT_ALIGN, (size_t)(block + 2 * WAVIO_DIRECT_ALIGN)) != 0){
+        return NULL;
+    }
 
-    //get RIFF struct data
-    wavread_RIFF(riff, filename);
+    return (uint8_t *)buf;
+}
 
-    //copy PCM properties
-    stereo_pcm->pcm_spec.fs = riff->fmt.samplesPerSec;
-    stereo_pcm->pcm_spec.bits = riff->fmt.bitsPerSample;
-    stereo_pcm->pcm_spec.length = riff->data.chunkSize / (2 * (riff->fmt.bitsPerSample / 8));
+//pread until size bytes are read or the end of file
+static uint64_t wavio_pread_full(int fd, uint8_t *buf, uint64_t size, uint64_t offset){
+    uint64_t done = 0; /* bytes read */
+    ssize_t n;
 
-    //initialize the data vector
-    stereo_pcm->data[0] = (double *)calloc(stereo_pcm->pcm_spec.length, sizeof(double));
-    stereo_pcm->data[1] = (double *)calloc(stereo_pcm->pcm_spec.length, sizeof(double));
-    L = &stereo_pcm->data[0][0];
-    R = &stereo_pcm->data[1][0];
-
-    //copy data from riff
-    //if 8bit, because its data have unsigned.
-    if(riff->fmt.bitsPerSample == 8){
-        for(i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i += 2){
-            *stereo_pcm->data[0] = (double)(riff->data.data[i] - 128);
-            *stereo_pcm->data[1] = (double)(riff->data.data[i+1] - 128);
-
-            
-            if(*stereo_pcm->data[0] >= 0){
-                *stereo_pcm->data[0] /= (int)(pow(2.0, stereo_pcm->pcm_spec.bits - 1) - 1);
-            }else{
-                *stereo_pcm->data[0] /= (int)(pow(2.0, stereo_pcm->pcm_spec.bits - 1));
-            }
+    while(done < size){
+        n = pread(fd, buf + done, (size_t)(size - done), (off_t)(offset + done));
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            break;
+        }
+        done += (uint64_t)n;
+    }
 
-            if(*stereo_pcm->data[1] >= 0){
-                *stereo_pcm->data[1] /= (int)(pow(2.0, stereo_pcm->pcm_spec.bits - 1) - 1);
-            }else{
-                *stereo_pcm->data[1] /= (int)(pow(2.0, stereo_pcm->pcm_spec.bits - 1));
-            }
-            
-            //printf("%lf, %lf\n", *stereo_pcm->data[0], *stereo_pcm->data[1]);
+    return done;
+}
+
+//pwrite until size bytes are written or an error occurs
+static uint64_t wavio_pwrite_full(int fd, const uint8_t *buf, uint64_t size, uint64_t offset){
+    uint64_t done = 0; /* bytes written */
+    ssize_t n;
 
-            stereo_pcm->data[0]++;
-            stereo_pcm->data[1]++;
+    while(done < size){
+        n = pwrite(fd, buf + done, (size_t)(size - done), (off_t)(offset + done));
+        if(n < 0 && errno == EINTR){
+            continue;
         }
-    }else{
-        //16, 24, and 32bit
-        for (i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i += 2){
-            *stereo_pcm->data[0] = (double)riff->data.data[i];
-            *stereo_pcm->data[1] = (double)riff->data.data[i+1];
-
-            
-            if(*stereo_pcm->data[0] >= 0){
-                *stereo_pcm->data[0] /= (int)(pow(2.0, stereo_pcm->pcm_spec.bits - 1) - 1);
-            }else{
-                *stereo_pcm->data[0] /= (int)(pow(2.0, stereo_pcm->pcm_spec.bits - 1));
-            }
+        if(n <= 0){
+            break;
+        }
+        done += (uint64_t)n;
+    }
 
-            if(*stereo_pcm->data[1] >= 0){
-                *stereo_pcm->data[1] /= (int)(pow(2.0, stereo_pcm->pcm_spec.bits - 1) - 1);
-            }else{
-                *stereo_pcm->data[1] /= (int)(pow(2.0, stereo_pcm->pcm_spec.bits - 1));
-            }
-            
-           //printf("%lf, %lf\n", *stereo_pcm->data[0], *stereo_pcm->data[1]);
+    return done;
+}
 
-            stereo_pcm->data[0]++;
-            stereo_pcm->data[1]++;
+//Set up the data chunk I/O for fp (flags: O_RDONLY or O_WRONLY)
+static void wavio_io_open(WAVIO_IO *io, FILE *fp, char *filename, long offset, int flags){
+    io->fd = fileno(fp);
+    io->own_fd = 0;
+    io->offset = (uint64_t)offset;
+    io->mode = wavio_cache_mode;
+
+    if(io->mode == WAVIO_CACHE_DIRECT){
+#ifdef O_DIRECT
+        //second descriptor bypassing the page cache
+        int fd = open(filename, flags | O_DIRECT);
+        if(fd >= 0){
+            io->fd = fd;
+            io->own_fd = 1;
+        }else{
+            //file system without O_DIRECT (tmpfs etc.)
+            io->mode = WAVIO_CACHE_DONTNEED;
         }
+#elif defined(F_NOCACHE)
+        //no alignment restrictions, only the caching is switched off
+        fcntl(io->fd, F_NOCACHE, 1);
+        io->mode = WAVIO_CACHE_DEFAULT;
+        (void)filename;
+        (void)flags;
+#else
+        io->mode = WAVIO_CACHE_DONTNEED;
+        (void)filename;
+        (void)flags;
+#endif
     }
 
-    //reset vector index
-    stereo_pcm->data[0] = L;
-    stereo_pcm->data[1] = R;
+#ifdef POSIX_FADV_SEQUENTIAL
+    if(io->mode != WAVIO_CACHE_DEFAULT){
+        posix_fadvise(io->fd, (off_t)io->offset, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+}
 
-    //free RIFF struct
-    free_RIFF(riff);
+//Close the descriptor opened by wavio_io_open
+static void wavio_io_close(WAVIO_IO *io){
+    if(io->own_fd){
+        close(io->fd);
+    }
 }
 
-//Read data and insert MONO_PCM_NATIVE struct
-void wavread_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename){
-    //Define RIFF struct
-    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
-    
-    uint64_t i = 0; /* For loop */
-    int32_t *M; /* for intitialize the data vector pointer */
+//Drop pages of the file range from the page cache (written pages are flushed first)
+static void wavio_io_drop(WAVIO_IO *io, uint64_t pos, uint64_t len, int written){
+    if(io->mode != WAVIO_CACHE_DONTNEED || len == 0){
+        return;
+    }
 
-    //get RIFF struct
-    wavread_RIFF(riff, filename);
+    if(written){
+#ifdef SYNC_FILE_RANGE_WRITE
+        sync_file_range(io->fd, (off_t)(io->offset + pos), (off_t)len, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+        fdatasync(io->fd);
+#endif
+    }
 
-    //copy pcm_spec from riff
-    mono_pcm_native->pcm_spec.fs = riff->fmt.samplesPerSec;
-    mono_pcm_native->pcm_spec.bits = riff->fmt.bitsPerSample;
-    mono_pcm_native->pcm_spec.length = riff->data.chunkSize / (riff->fmt.bitsPerSample / 8);
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(io->fd, (off_t)(io->offset + pos), (off_t)len, POSIX_FADV_DONTNEED);
+#endif
+}
 
-    //initialize the data vector
-    mono_pcm_native->data = (int32_t *)calloc(mono_pcm_native->pcm_spec.length, sizeof(int32_t));
-    M = &mono_pcm_native->data[0];
+//Read len bytes at pos of the data chunk into buf
+//*data is set to the first byte in buf (O_DIRECT reads start at the aligned offset below pos)
+static uint64_t wavio_io_read(WAVIO_IO *io, uint8_t *buf, uint64_t len, uint64_t pos, uint8_t **data){
+    uint64_t skew; /* bytes between the aligned offset and pos */
+    uint64_t got;
+
+    if(io->mode == WAVIO_CACHE_DIRECT){
+        skew = (io->offset + pos) % WAVIO_DIRECT_ALIGN;
+        got = wavio_pread_full(io->fd, buf, (len + skew + WAVIO_DIRECT_ALIGN - 1) / WAVIO_DIRECT_ALIGN * WAVIO_DIRECT_ALIGN, io->offset + pos - skew);
+        *data = buf + skew;
+        got = (got > skew) ? got - skew : 0;
+        return (got < len) ? got : len;
+    }
 
-    //copy data from riff data
-    for(i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i++){
-        *mono_pcm_native->data = riff->data.data[i];
+    *data = buf;
+    got = wavio_pread_full(io->fd, buf, len, io->offset + pos);
+    wavio_io_drop(io, pos, got, 0);
 
-        //printf("%d\n", *mono_pcm_native->data);
+    return got;
+}
 
-        mono_pcm_native->data++;
-    }
+#ifdef WAVIO_USE_IO_URING
+//Queue a read of the k-th request (aligned for O_DIRECT)
+static void wavio_uring_prep(struct io_uring *ring, WAVIO_IO *io, uint8_t *buf, uint64_t len, uint64_t pos, uint64_t *skew, int k){
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
 
-    //set the pointer to first
-    mono_pcm_native->data = M;
+    *skew = 0;
+    if(io->mode == WAVIO_CACHE_DIRECT){
+        *skew = (io->offset + pos) % WAVIO_DIRECT_ALIGN;
+        len = (len + *skew + WAVIO_DIRECT_ALIGN - 1) / WAVIO_DIRECT_ALIGN * WAVIO_DIRECT_ALIGN;
+    }
 
-    //free RIFF struct
-    free_RIFF(riff);
+    io_uring_prep_read(sqe, io->fd, buf, (unsigned)len, io->offset + pos - *skew);
+    io_uring_sqe_set_data(sqe, (void *)(uintptr_t)k);
 }
 
-//Read data and insert MONO_PCM struct
-void wavread_Mono(MONO_PCM *mono_pcm, char *filename){
-    //Define RIFF struct
-    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
+//Wait for the requests still in flight after a failed wait, so that their buffers can be freed
+//(busy: 1 for each request in flight, they are cancelled first)
+//returns -1 if the ring cannot be drained: the buffers must not be freed then
+static int wavio_uring_drain(struct io_uring *ring, const int *busy){
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    int pending = 0; /* completions still to come (requests and cancels) */
+    int ret;
+    int k;
+
+    for(k = 0; k < WAVIO_IO_QUEUE_DEPTH; k++){
+        if(!busy[k]){
+            continue;
+        }
+        pending++;
+        sqe = io_uring_get_sqe(ring);
+        if(sqe != NULL){
+            io_uring_prep_cancel(sqe, (void *)(uintptr_t)k, 0);
+            io_uring_sqe_set_data(sqe, (void *)(uintptr_t)WAVIO_IO_QUEUE_DEPTH);
+            pending++;
+        }
+    }
+    io_uring_submit(ring);
 
-    uint64_t i = 0; /* For loop */
-    double *M; /* for initialize the data vector pointer */
+    //every request completes once (done or -ECANCELED), and so does every cancel
+    while(pending > 0){
+        ret = io_uring_wait_cqe(ring, &cqe);
+        if(ret == -EINTR){
+            continue;
+        }
+        if(ret < 0){
+            return -1;
+        }
+        io_uring_cqe_seen(ring, cqe);
+        pending--;
+    }
 
-    //get RIFF struct
-    wavread_RIFF(riff, filename);
+    return 0;
+}
 
-    //copy PCM_SPEC from RIFF
-    mono_pcm->pcm_spec.fs = riff->fmt.samplesPerSec;
-    mono_pcm->pcm_spec.bits = riff->fmt.bitsPerSample;
-    mono_pcm->pcm_spec.length = riff->data.chunkSize / (riff->fmt.bitsPerSample / 8);
+//Allocate the request buffers of a ring (returns -1 and frees them if one is missing)
+static int wavio_uring_alloc(uint8_t **buf, uint64_t block){
+    int k;
 
-    //initialize the data vector
-    mono_pcm->data = (double *)calloc(mono_pcm->pcm_spec.length, sizeof(double));
-    M = &mono_pcm->data[0];
-
-    //copy data from riff
-    if(riff->fmt.bitsPerSample == 8){
-        for(i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i++){
-            *mono_pcm->data = (double)(riff->data.data[i] - 128);
-
-            if(*mono_pcm->data >= 0){
-                *mono_pcm->data /= (int)(pow(2.0, mono_pcm->pcm_spec.bits - 1) - 1);
-            }else{
-                *mono_pcm->data /= (int)(pow(2.0, mono_pcm->pcm_spec.bits - 1));
+    for(k = 0; k < WAVIO_IO_QUEUE_DEPTH; k++){
+        buf[k] = wavio_alloc_block(block);
+        if(buf[k] == NULL){
+            while(k > 0){
+                free(buf[--k]);
             }
+            return -1;
+        }
+    }
+
+    return 0;
+}
 
-            mono_pcm->data++;
+//Free the request buffers and the ring (the buffers are leaked if requests may still be in flight)
+static void wavio_uring_close(struct io_uring *ring, uint8_t **buf, int drained){
+    int k;
+
+    if(drained){
+        for(k = 0; k < WAVIO_IO_QUEUE_DEPTH; k++){
+            free(buf[k]);
         }
-    }else{
-        for(i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i++){
-            *mono_pcm->data = (double)riff->data.data[i];
+    }
+    io_uring_queue_exit(ring);
+}
 
-            if(*mono_pcm->data >= 0){
-                *mono_pcm->data /= (int)(pow(2.0, mono_pcm->pcm_spec.bits - 1) - 1);
-            }else{
-                *mono_pcm->data /= (int)(pow(2.0, mono_pcm->pcm_spec.bits - 1));
-            }
+//Read blocks with io_uring, keeping WAVIO_IO_QUEUE_DEPTH reads in flight while func converts
+//returns -1 if the ring is not available (caller falls back to pread), -2 if a read failed
+static int64_t wavio_uring_read_blocks(WAVIO_IO *io, uint64_t size, uint64_t align, WAVIO_BLOCK_FUNC func, void *ctx){
+    struct io_uring ring;
+    struct io_uring_cqe *cqe;
+    uint8_t *buf[WAVIO_IO_QUEUE_DEPTH]; /* request buffers */
+    uint64_t pos[WAVIO_IO_QUEUE_DEPTH]; /* position of each request */
+    uint64_t len[WAVIO_IO_QUEUE_DEPTH]; /* length of each request */
+    uint64_t skew[WAVIO_IO_QUEUE_DEPTH]; /* O_DIRECT alignment skew of each request */
+    int busy[WAVIO_IO_QUEUE_DEPTH]; /* 1 while the request is in flight */
+    uint64_t block = wavio_block_size(align);
+    uint64_t next = 0; /* next position to request */
+    uint64_t total = 0; /* bytes passed to func */
+    uint64_t got;
+    int inflight = 0;
+    int failed = 0;
+    int ret;
+    int k;
+
+    if(wavio_uring_alloc(buf, block) < 0){
+        return -1;
+    }
+    if(io_uring_queue_init(WAVIO_IO_QUEUE_DEPTH, &ring, 0) < 0){
+        for(k = 0; k < WAVIO_IO_QUEUE_DEPTH; k++){
+            free(buf[k]);
+        }
+        return -1;
+    }
 
-            mono_pcm->data++;
+    //queue the first requests
+    for(k = 0; k < WAVIO_IO_QUEUE_DEPTH; k++){
+        busy[k] = 0;
+        if(next < size){
+            pos[k] = next;
+            len[k] = (size - next < block) ? size - next : block;
+            wavio_uring_prep(&ring, io, buf[k], len[k], pos[k], &skew[k], k);
+            next += len[k];
+            busy[k] = 1;
+            inflight++;
         }
     }
+    io_uring_submit(&ring);
 
-    //set the pointer to first
-    mono_pcm->data = M;
+    //convert each completed block while the others are still in flight
+    while(inflight > 0){
+        ret = io_uring_wait_cqe(&ring, &cqe);
+        if(ret == -EINTR){
+            continue;
+        }
+        if(ret < 0){
+            failed = 1;
+            break;
+        }
+        k = (int)(uintptr_t)io_uring_cqe_get_data(cqe);
+        ret = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        busy[k] = 0;
+        inflight--;
+        if(ret < 0){
+            failed = 1;
+            break;
+        }
 
-    //free RIFF struct
-    free_RIFF(riff);
-}
+        got = (uint64_t)ret;
+        got = (got > skew[k]) ? got - skew[k] : 0;
+        if(got > len[k]){
+            got = len[k];
+        }
 
-//save WAV file from RIFF struct
-void wavwrite_RIFF(RIFF *riff, char *filename){
-    //variable
-    FILE *fp; /* for write wav file */
-    uint64_t i = 0; /* for loop */
-    int32_t *init_data; /* for initialize data vector */
+        //finish short reads synchronously (a short O_DIRECT read is the end of file)
+        if(got < len[k] && io->mode != WAVIO_CACHE_DIRECT){
+            got += wavio_pread_full(io->fd, buf[k] + got, len[k] - got, io->offset + pos[k] + got);
+        }
+        got -= got % align;
 
-    //open file name with writing name
-    fp = fopen(filename, "wb");
+        if(got > 0){
+            func(ctx, buf[k] + skew[k], pos[k], got);
+            wavio_io_drop(io, pos[k], got, 0);
+            total += got;
+        }
 
-    riff->fmt.chunkSize = 16;
-    riff->fmt.waveFormatType = 1;
+        //reuse the buffer for the next request
+        if(next < size){
+            pos[k] = next;
+            len[k] = (size - next < block) ? size - next : block;
+            wavio_uring_prep(&ring, io, buf[k], len[k], pos[k], &skew[k], k);
+            io_uring_submit(&ring);
+            next += len[k];
+            busy[k] = 1;
+            inflight++;
+        }
+    }
 
-    //for debug
-    /* 
-    printf("RIFF ID : %4s\n", riff->chunkID);
-    printf("RIFF chunk size : %d\n", riff->chunkSize);
-    printf("Format type : %4s\n", riff->formType);
-    printf("Format Subchunk ID : %4s\n", riff->fmt.chunkID);
-    printf("Format Subchunk Size : %d\n", riff->fmt.chunkSize);
-    printf("waveFormatType : %d\n", riff->fmt.waveFormatType);
-    printf("Channel : %d\n", riff->fmt.channel);
-    printf("Fs : %d\n", riff->fmt.samplesPerSec);
-    printf("Bytes Per Sec : %d\n", riff->fmt.bytesPerSec);
-    printf("Block Size : %d\n", riff->fmt.blockSize);
-    printf("Bits : %d\n", riff->fmt.bitsPerSample);
-    printf("Data Subchunk ID : %4s\n", riff->data.chunkID);
-    printf("Data Subchunk Size : %d\n", riff->data.chunkSize);
-    */
+    //a failed wait or read: no buffer is freed while the kernel may still fill it
+    if(failed){
+        wavio_uring_close(&ring, buf, wavio_uring_drain(&ring, busy) == 0);
+        return -2;
+    }
+    wavio_uring_close(&ring, buf, 1);
 
-    //write each chunk
-    fwrite(riff->chunkID, 1, 4, fp); /* "RIFF" */
-    fwrite(&riff->chunkSize, 4, 1, fp);
-    fwrite(riff->formType, 1, 4, fp); /* "WAVE" */
-    fwrite(riff->fmt.chunkID, 1, 4, fp); /* "fmt " */
-    fwrite(&riff->fmt.chunkSize, 4, 1, fp);
-    fwrite(&riff->fmt.waveFormatType, 2, 1, fp); /* PCM: 1 */
-    fwrite(&riff->fmt.channel, 2, 1, fp); /* Mono: 1, Stereo: 2 */
-    fwrite(&riff->fmt.samplesPerSec, 4, 1, fp); /* Sampling frequency */
-    fwrite(&riff->fmt.bytesPerSec, 4, 1, fp);
-    fwrite(&riff->fmt.blockSize, 2, 1, fp);
-    fwrite(&riff->fmt.bitsPerSample, 2, 1, fp); /* Quantization bit */
-    fwrite(riff->data.chunkID, 1, 4, fp);  /* data */
-    fwrite(&riff->data.chunkSize, 4, 1, fp);
+    return (int64_t)total;
+}
 
-    //Define data vector
-    init_data = &riff->data.data[0];
+//Write blocks with io_uring, filling the next block with func while earlier writes are in flight
+//returns -1 if the ring is not available (caller falls back to pwrite)
+static int64_t wavio_uring_write_blocks(WAVIO_IO *io, uint64_t size, uint64_t align, WAVIO_BLOCK_FUNC func, void *ctx){
+    struct io_uring ring;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    uint8_t *buf[WAVIO_IO_QUEUE_DEPTH]; /* request buffers */
+    uint64_t pos[WAVIO_IO_QUEUE_DEPTH]; /* position of each request */
+    uint64_t len[WAVIO_IO_QUEUE_DEPTH]; /* length of each request */
+    int busy[WAVIO_IO_QUEUE_DEPTH]; /* 1 while the request is in flight */
+    uint64_t block = wavio_block_size(align);
+    uint64_t next = 0; /* next position to fill */
+    uint64_t total = 0; /* bytes written */
+    uint64_t done;
+    int inflight = 0;
+    int failed = 0;
+    int ret;
+    int k;
+
+    if(wavio_uring_alloc(buf, block) < 0){
+        return -1;
+    }
+    if(io_uring_queue_init(WAVIO_IO_QUEUE_DEPTH, &ring, 0) < 0){
+        for(k = 0; k < WAVIO_IO_QUEUE_DEPTH; k++){
+            free(buf[k]);
+        }
+        return -1;
+    }
 
-    //write data
-    switch(riff->fmt.bitsPerSample){
-        case 8:
-            //8bit integer(unsigned)
-            for(i = 0; i < riff->data.chunkSize; i++){
-                //clipping
-                if(riff->data.data[i] > 255){
-                    riff->data.data[i] = 255;
-                }else if(riff->data.data[i] < 0){
-                    riff->data.data[i] = 0;
-                }
+    for(k = 0; k < WAVIO_IO_QUEUE_DEPTH; k++){
+        busy[k] = 0;
+    }
 
-                //write data
-                fwrite(&riff->data.data[i], 1, 1, fp);
+    while(next < size || inflight > 0){
+        //find a free buffer
+        for(k = 0; k < WAVIO_IO_QUEUE_DEPTH; k++){
+            if(!busy[k]){
+                break;
             }
-            break;
+        }
 
-        case 16:
-            //16bit integer(signed)
-            for(i = 0; i < riff->data.chunkSize / 2; i++){
-                //clipping
-                if(riff->data.data[i] > 32767){
-                    riff->data.data[i] = 32767;
-                }else if(riff->data.data[i] < -32768){
-                    riff->data.data[i] = -32768;
-                }
+        //fill and queue the next block
+        if(next < size && k < WAVIO_IO_QUEUE_DEPTH){
+            pos[k] = next;
+            len[k] = (size - next < block) ? size - next : block;
+            func(ctx, buf[k], pos[k], len[k]);
+            sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_write(sqe, io->fd, buf[k], (unsigned)len[k], io->offset + pos[k]);
+            io_uring_sqe_set_data(sqe, (void *)(uintptr_t)k);
+            io_uring_submit(&ring);
+            busy[k] = 1;
+            next += len[k];
+            inflight++;
+            continue;
+        }
 
-                //write data
-                fwrite(&riff->data.data[i], 2, 1, fp);
-            }
+        //all buffers busy (or nothing left to fill): wait for a completion
+        ret = io_uring_wait_cqe(&ring, &cqe);
+        if(ret == -EINTR){
+            continue;
+        }
+        if(ret < 0){
+            failed = 1;
             break;
+        }
+        k = (int)(uintptr_t)io_uring_cqe_get_data(cqe);
+        done = (cqe->res > 0) ? (uint64_t)cqe->res : 0;
+        io_uring_cqe_seen(&ring, cqe);
+        inflight--;
+
+        //finish short writes synchronously
+        if(done < len[k]){
+            done += wavio_pwrite_full(io->fd, buf[k] + done, len[k] - done, io->offset + pos[k] + done);
+        }
+        wavio_io_drop(io, pos[k], done, 1);
+        total += done;
+        busy[k] = 0;
+    }
 
-        case 24:
-            //24bit integer(signed)
-            for(i = 0; i < riff->data.chunkSize / 3; i++){
-                //clipping
-                if(riff->data.data[i] > 8388607){
-                    riff->data.data[i] = 8388607;
-                }else if(riff->data.data[i] < -8388608){
-                    riff->data.data[i] = -8388608;
-                }
+    //a failed wait: no buffer is freed while the kernel may still read it (the caller sees a short write)
+    wavio_uring_close(&ring, buf, !failed || wavio_uring_drain(&ring, busy) == 0);
 
-                //write data
-                fwrite(&riff->data.data[i], 3, 1, fp);
-            }
-            break;
+    return (int64_t)total;
+}
+#endif
 
-        case 32:
-            for(i = 0; i < riff->data.chunkSize / 4; i++){
-                //clipping
-                if(riff->data.data[i] > (int64_t)(pow(2.0, 31.0) - 1)){
-                    riff->data.data[i] = (int32_t)(pow(2.0, 31.0) - 1);
-                }else if(riff->data.data[i] < (int64_t)(-1 * pow(2.0, 31.0))){
-                    riff->data.data[i] = -1 * (int32_t)(pow(2.0, 31.0));
-                }
+#ifndef WAVIO_NO_THREADS
+//Double buffer shared by the reader thread and the converting thread
+typedef struct{
+    WAVIO_IO *io; /* data chunk I/O */
+    uint64_t size; /* bytes to read */
+    uint64_t align; /* block alignment */
+    uint8_t *buf[2]; /* raw blocks */
+    uint8_t *data[2]; /* first byte of each block in buf */
+    uint64_t pos[2]; /* position of each block */
+    uint64_t len[2]; /* length of each block */
+    int full[2]; /* 1 while the block waits for conversion */
+    int done; /* 1 when the reader thread has finished */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} WAVIO_PIPE;
+
+//Reader stage: fill the two buffers alternately
+static void *wavio_pipe_reader(void *arg){
+    WAVIO_PIPE *pipe = (WAVIO_PIPE *)arg;
+    uint64_t block = wavio_block_size(pipe->align);
+    uint64_t pos = 0; /* position in the data chunk */
+    uint64_t got;
+    int k = 0;
+
+    while(pos < pipe->size){
+        //wait until the converter has released this buffer
+        pthread_mutex_lock(&pipe->mutex);
+        while(pipe->full[k]){
+            pthread_cond_wait(&pipe->cond, &pipe->mutex);
+        }
+        pthread_mutex_unlock(&pipe->mutex);
 
-                //write data
-                fwrite(&riff->data.data[i], 4, 1, fp);
-            }
+        got = wavio_io_read(pipe->io, pipe->buf[k], (pipe->size - pos < block) ? pipe->size - pos : block, pos, &pipe->data[k]);
+        got -= got % pipe->align;
+        if(got == 0){
             break;
+        }
 
-        default:
-            printf("Error!: Inappropriate quantization bit number.\n");
-            exit(1);
-            break;
+        //hand the block over to the converter
+        pthread_mutex_lock(&pipe->mutex);
+        pipe->pos[k] = pos;
+        pipe->len[k] = got;
+        pipe->full[k] = 1;
+        pthread_cond_signal(&pipe->cond);
+        pthread_mutex_unlock(&pipe->mutex);
+
+        pos += got;
+        k ^= 1;
     }
 
-    //set the pointer to first
-    riff->data.data = init_data;
+    pthread_mutex_lock(&pipe->mutex);
+    pipe->done = 1;
+    pthread_cond_signal(&pipe->cond);
+    pthread_mutex_unlock(&pipe->mutex);
 
-    //save WAV file
-    fclose(fp);
+    return NULL;
 }
 
-//save WAV file from STEREO_PCM_NATIVE struct
-void wavwrite_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename){
-    //variables
-    RIFF *riff; /* for make RIFF struct */
-    uint64_t i; /* for loop */
-    int32_t *L, *R; /* for initialize the pointer */
+//Read with a reader thread while the calling thread converts the previous block
+//returns -1 if the thread cannot be started (caller falls back to the synchronous loop)
+static int64_t wavio_pipe_read_blocks(WAVIO_IO *io, uint64_t size, uint64_t align, WAVIO_BLOCK_FUNC func, void *ctx){
+    WAVIO_PIPE pipe;
+    pthread_t reader;
+    uint64_t block = wavio_block_size(align);
+    uint64_t total = 0; /* bytes passed to func */
+    int k = 0;
+
+    pipe.io = io;
+    pipe.size = size;
+    pipe.align = align;
+    pipe.buf[0] = wavio_alloc_block(block);
+    pipe.buf[1] = wavio_alloc_block(block);
+    if(pipe.buf[0] == NULL || pipe.buf[1] == NULL){
+        free(pipe.buf[0]);
+        free(pipe.buf[1]);
+        return -1;
+    }
+    pipe.full[0] = pipe.full[1] = 0;
+    pipe.done = 0;
+    pthread_mutex_init(&pipe.mutex, NULL);
+    pthread_cond_init(&pipe.cond, NULL);
+
+    if(pthread_create(&reader, NULL, wavio_pipe_reader, &pipe) != 0){
+        pthread_mutex_destroy(&pipe.mutex);
+        pthread_cond_destroy(&pipe.cond);
+        free(pipe.buf[0]);
+        free(pipe.buf[1]);
+        return -1;
+    }
 
-    //Define RIFF struct
-    riff = (RIFF *)malloc(sizeof(RIFF));
-
-    //RIFF chunk ID ("RIFF")
-    riff->chunkID[0] = 'R';
-    riff->chunkID[1] = 'I';
-    riff->chunkID[2] = 'F';
-    riff->chunkID[3] = 'F';
-
-    //RIFF format type ("WAVE")
-    riff->formType[0] = 'W';
-    riff->formType[1] = 'A';
-    riff->formType[2] = 'V';
-    riff->formType[3] = 'E';
-
-    //fmt chunk ID ("fmt ")
-    riff->fmt.chunkID[0] = 'f';
-    riff->fmt.chunkID[1] = 'm';
-    riff->fmt.chunkID[2] = 't';
-    riff->fmt.chunkID[3] = ' ';
-
-    //fmt chunksize (16)
-    riff->fmt.chunkSize = 16;
+    //converter stage: consume the buffers in the order they were filled
+    for(;;){
+        pthread_mutex_lock(&pipe.mutex);
+        while(!pipe.full[k] && !pipe.done){
+            pthread_cond_wait(&pipe.cond, &pipe.mutex);
+        }
+        if(!pipe.full[k]){
+            pthread_mutex_unlock(&pipe.mutex);
+            break;
+        }
+        pthread_mutex_unlock(&pipe.mutex);
 
-    //fmt waveformattype (1: PCM)
-    riff->fmt.waveFormatType = 1;
+        func(ctx, pipe.data[k], pipe.pos[k], pipe.len[k]);
+        total += pipe.len[k];
 
-    //fmt channel (2: Stereo)
-    riff->fmt.channel = 2;
+        //release the buffer to the reader
+        pthread_mutex_lock(&pipe.mutex);
+        pipe.full[k] = 0;
+        pthread_cond_signal(&pipe.cond);
+        pthread_mutex_unlock(&pipe.mutex);
 
-    //fmt samplespersec (sampling frequency)
-    riff->fmt.samplesPerSec = stereo_pcm_native->pcm_spec.fs;
+        k ^= 1;
+    }
 
-    //fmt blocksize
-    riff->fmt.blockSize = 2 * (stereo_pcm_native->pcm_spec.bits / 8);
+    pthread_join(reader, NULL);
+    pthread_mutex_destroy(&pipe.mutex);
+    pthread_cond_destroy(&pipe.cond);
+    free(pipe.buf[0]);
+    free(pipe.buf[1]);
 
-    //fmt bytespersec
-    riff->fmt.bytesPerSec = riff->fmt.blockSize * riff->fmt.samplesPerSec;
+    return (int64_t)total;
+}
+#endif
 
-    //fmt bitspersample
-    riff->fmt.bitsPerSample = stereo_pcm_native->pcm_spec.bits;
+//Read size bytes of the data chunk and pass them to func block by block
+//returns the number of bytes passed to func (less than size if the file is short), -1 if a read failed
+static int64_t wavio_read_blocks(WAVIO_IO *io, uint64_t size, uint64_t align, WAVIO_BLOCK_FUNC func, void *ctx){
+    uint64_t block = wavio_block_size(align);
+    uint64_t pos; /* position in the data chunk */
+    uint64_t got;
+    uint8_t *buf;
+    uint8_t *data;
+
+#ifdef WAVIO_USE_IO_URING
+    int64_t total = wavio_uring_read_blocks(io, size, align, func, ctx);
+    if(total >= 0 || total == -2){
+        return (total >= 0) ? total : -1;
+    }
+#endif
 
-    //data chunkID
-    riff->data.chunkID[0] = 'd';
-    riff->data.chunkID[1] = 'a';
-    riff->data.chunkID[2] = 't';
-    riff->data.chunkID[3] = 'a';
+#ifndef WAVIO_NO_THREADS
+    int64_t piped = wavio_pipe_read_blocks(io, size, align, func, ctx);
+    if(piped >= 0){
+        return piped;
+    }
+#endif
 
-    //calculate each chunksize
-    riff->data.chunkSize = 2 * stereo_pcm_native->pcm_spec.length * (riff->fmt.bitsPerSample / 8);
-    riff->chunkSize = riff->data.chunkSize + 36;
+    //synchronous pread fallback
+    buf = wavio_alloc_block(block);
+    if(buf == NULL){
+        return -1;
+    }
+    for(pos = 0; pos < size; pos += got){
+        got = wavio_io_read(io, buf, (size - pos < block) ? size - pos : block, pos, &data);
+        got -= got % align;
+        if(got == 0){
+            break;
+        }
+        func(ctx, data, pos, got);
+    }
+    free(buf);
 
-    //copy data and calculate data chunk size
-    L = stereo_pcm_native->data[0]; //for initialize pointer
-    R = stereo_pcm_native->data[1]; //for initialize pointer
+    return (int64_t)(pos < size ? pos : size);
+}
 
-    //define riff data vector
-    riff->data.data = (int32_t *)calloc((unsigned)riff->data.chunkSize / (riff->fmt.bitsPerSample / 8), sizeof(int32_t));
+//Write through O_DIRECT: blocks are staged so that every write is aligned,
+//the header bytes in front of the data chunk are read back into the first write
+static uint64_t wavio_direct_write_blocks(WAVIO_IO *io, int hfd, uint64_t size, uint64_t align, WAVIO_BLOCK_FUNC func, void *ctx){
+    uint64_t block = wavio_block_size(align);
+    uint64_t spos; /* file offset of stage[0] (aligned) */
+    uint64_t fill; /* bytes in the stage */
+    uint64_t flush; /* aligned bytes written from the stage */
+    uint64_t pos; /* position in the data chunk */
+    uint64_t len;
+    uint64_t done = 0;
+    uint8_t *tmp = wavio_alloc_block(block); /* packed block */
+    uint8_t *stage = wavio_alloc_block(block); /* aligned staging buffer */
+
+    if(tmp == NULL || stage == NULL){
+        free(tmp);
+        free(stage);
+        return 0;
+    }
+
+    //start the stage with the header bytes sharing the first aligned block
+    spos = io->offset - io->offset % WAVIO_DIRECT_ALIGN;
+    fill = wavio_pread_full(hfd, stage, io->offset - spos, spos);
 
-    for (i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i += 2){
-        //copy data
-        riff->data.data[i] = *stereo_pcm_native->data[0];
-        riff->data.data[i + 1] = *stereo_pcm_native->data[1];
+    for(pos = 0; pos < size; pos += len){
+        len = (size - pos < block) ? size - pos : block;
+        func(ctx, tmp, pos, len);
+        memcpy(stage + fill, tmp, len);
+        fill += len;
 
-        //next pointer
-        stereo_pcm_native->data[0]++;
-        stereo_pcm_native->data[1]++;
+        //write the aligned part, keep the remainder for the next block
+        flush = fill - fill % WAVIO_DIRECT_ALIGN;
+        if(wavio_pwrite_full(io->fd, stage, flush, spos) < flush){
+            break;
+        }
+        memmove(stage, stage + flush, fill - flush);
+        spos += flush;
+        fill -= flush;
+        done += len;
     }
 
-    //initialize the pointer
-    stereo_pcm_native->data[0] = L;
-    stereo_pcm_native->data[1] = R;
+    //pad the last block and cut the file back to its real size
+    if(fill > 0 && done == size){
+        memset(stage + fill, 0, WAVIO_DIRECT_ALIGN - fill);
+        if(wavio_pwrite_full(io->fd, stage, WAVIO_DIRECT_ALIGN, spos) < WAVIO_DIRECT_ALIGN){
+            done -= fill;
+        }
+    }
+    if(ftruncate(io->fd, (off_t)(io->offset + done)) != 0){
+        done = 0;
+    }
 
-    //wavwrite from RIFF struct
-    wavwrite_RIFF(riff, filename);
+    free(tmp);
+    free(stage);
 
-    //free RIFF struct
-    free_RIFF(riff);
+    return done;
 }
 
-//save WAV file from STEREO_PCM struct
-void wavwrite_Stereo(STEREO_PCM *stereo_pcm, char *filename){
-    //variables
-    RIFF *riff;    //riff struct
-    uint64_t i;    //for loop
-    double *L, *R; //for initialize index
-
-    //initialize riff struct
-    riff = (RIFF *)malloc(sizeof(RIFF));
-
-    //RIFF chunk ID ("RIFF")
-    riff->chunkID[0] = 'R';
-    riff->chunkID[1] = 'I';
-    riff->chunkID[2] = 'F';
-    riff->chunkID[3] = 'F';
-
-    //RIFF format type ("WAVE")
-    riff->formType[0] = 'W';
-    riff->formType[1] = 'A';
-    riff->formType[2] = 'V';
-    riff->formType[3] = 'E';
-
-    //fmt chunk ID ("fmt ")
-    riff->fmt.chunkID[0] = 'f';
-    riff->fmt.chunkID[1] = 'm';
-    riff->fmt.chunkID[2] = 't';
-    riff->fmt.chunkID[3] = ' ';
-
-    //fmt chunk size (16)
-    riff->fmt.chunkSize = 16;
+//Fill size bytes of the data chunk block by block with func and write them
+//returns the number of bytes written
+static uint64_t wavio_write_blocks(WAVIO_IO *io, int hfd, uint64_t size, uint64_t align, WAVIO_BLOCK_FUNC func, void *ctx){
+    uint64_t block = wavio_block_size(align);
+    uint64_t pos; /* position in the data chunk */
+    uint64_t len;
+    uint64_t prev = 0; /* length of the previous block */
+    uint64_t done = 0;
+    uint8_t *buf;
+
+    if(io->mode == WAVIO_CACHE_DIRECT){
+        return wavio_direct_write_blocks(io, hfd, size, align, func, ctx);
+    }
 
-    //fmt wavefmttype (1: PCM)
-    riff->fmt.waveFormatType = 1;
+#ifdef WAVIO_USE_IO_URING
+    int64_t total = wavio_uring_write_blocks(io, size, align, func, ctx);
+    if(total >= 0){
+        return (uint64_t)total;
+    }
+#endif
+
+    //pwrite fallback
+    buf = wavio_alloc_block(block);
+    if(buf == NULL){
+        return 0;
+    }
+    for(pos = 0; pos < size; pos += len){
+        len = (size - pos < block) ? size - pos : block;
+        func(ctx, buf, pos, len);
+        if(wavio_pwrite_full(io->fd, buf, len, io->offset + pos) < len){
+            break;
+        }
+
+#ifdef SYNC_FILE_RANGE_WRITE
+        //start writeback of this block, drop the previous one once it is on disk
+        if(io->mode == WAVIO_CACHE_DONTNEED){
+            sync_file_range(io->fd, (off_t)(io->offset + pos), (off_t)len, SYNC_FILE_RANGE_WRITE);
+        }
+#endif
+        wavio_io_drop(io, pos - prev, prev, 1);
+        prev = len;
+        done += len;
+    }
+    wavio_io_drop(io, done - prev, prev, 1);
+    free(buf);
 
-    //fmt channel (2: Stereo)
-    riff->fmt.channel = 2;
+    return done;
+}
 
-    //fmt samplespersec (sampling frequency)
-    riff->fmt.samplesPerSec = stereo_pcm->pcm_spec.fs;
+//Swap the bytes of 16bit and 32bit words
+static uint16_t wavio_bswap16(uint16_t x){
+    return (uint16_t)((x << 8) | (x >> 8));
+}
 
-    //fmt blocksize
-    riff->fmt.blockSize = 2 * (stereo_pcm->pcm_spec.bits / 8);
+static uint32_t wavio_bswap32(uint32_t x){
+    return (x << 24) | ((x << 8) & 0xFF0000) | ((x >> 8) & 0xFF00) | (x >> 24);
+}
 
-    //fmt bytespersec
-    riff->fmt.bytesPerSec = riff->fmt.blockSize * riff->fmt.samplesPerSec;
+//Little-endian loads and stores at any alignment (plain loads and stores on little-endian hosts)
+static uint16_t wavio_load_le16(const uint8_t *p){
+    uint16_t x;
 
-    //fmt bitspersample (Quantization bits)
-    riff->fmt.bitsPerSample = stereo_pcm->pcm_spec.bits;
+    memcpy(&x, p, 2);
+#if WAVIO_BIG_ENDIAN_HOST
+    x = wavio_bswap16(x);
+#endif
 
-    //data chunk ID ("data")
-    riff->data.chunkID[0] = 'd';
-    riff->data.chunkID[1] = 'a';
-    riff->data.chunkID[2] = 't';
-    riff->data.chunkID[3] = 'a';
+    return x;
+}
 
-    //data chunk size
-    riff->data.chunkSize = 2 * stereo_pcm->pcm_spec.length * (riff->fmt.bitsPerSample / 8);
-    riff->chunkSize = riff->data.chunkSize + 36;
+static uint32_t wavio_load_le32(const uint8_t *p){
+    uint32_t x;
 
-    //convert float to integer and copy data
-    L = stereo_pcm->data[0]; //for initialize pointer
-    R = stereo_pcm->data[1]; //for initialize pointer
+    memcpy(&x, p, 4);
+#if WAVIO_BIG_ENDIAN_HOST
+    x = wavio_bswap32(x);
+#endif
 
-    //Define riff data vector
-    riff->data.data = (int32_t *)calloc((unsigned)riff->data.chunkSize / (riff->fmt.bitsPerSample / 8), sizeof(int32_t));
+    return x;
+}
 
-    //copy data
-    if(stereo_pcm->pcm_spec.bits == 8){
-        //8bit (unsigned)
-        for(i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i += 2){
+static void wavio_store_le16(uint8_t *p, uint16_t x){
+#if WAVIO_BIG_ENDIAN_HOST
+    x = wavio_bswap16(x);
+#endif
+    memcpy(p, &x, 2);
+}
 
-            //clipping
-            if(*stereo_pcm->data[0] < -1.0){
-                *stereo_pcm->data[0] = -1.0;
-            }else if(*stereo_pcm->data[0] > 1.0){
-                *stereo_pcm->data[0] = 1.0;
+static void wavio_store_le32(uint8_t *p, uint32_t x){
+#if WAVIO_BIG_ENDIAN_HOST
+    x = wavio_bswap32(x);
+#endif
+    memcpy(p, &x, 4);
+}
+
+//Reverse the byte order of n words of 2, 3, 4 or 8 bytes in place (SSE2 for 2 and 4 bytes)
+void wavio_swap_bytes(void *buf, uint64_t n, int16_t bytes){
+    uint8_t *p = (uint8_t *)buf;
+    uint64_t i = 0;
+    uint16_t y;
+    uint32_t x;
+    uint8_t t;
+    int k;
+
+    switch(bytes){
+        //16bit
+        case 2:
+#if defined(__SSE2__)
+            for(; i + 8 <= n; i += 8){
+                __m128i v = _mm_loadu_si128((const __m128i *)(p + 2 * i));
+                _mm_storeu_si128((__m128i *)(p + 2 * i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+            }
+#endif
+            for(; i < n; i++){
+                memcpy(&y, p + 2 * i, 2);
+                y = wavio_bswap16(y);
+                memcpy(p + 2 * i, &y, 2);
+            }
+            break;
+
+        //24bit
+        case 3:
+            for(; i < n; i++){
+                t = p[3 * i];
+                p[3 * i] = p[3 * i + 2];
+                p[3 * i + 2] = t;
             }
+            break;
+
+        //32bit: swap the bytes, then the 16bit halves
+        case 4:
+#if defined(__SSE2__)
+            for(; i + 4 <= n; i += 4){
+                __m128i v = _mm_loadu_si128((const __m128i *)(p + 4 * i));
+                v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+                _mm_storeu_si128((__m128i *)(p + 4 * i), _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16)));
+            }
+#endif
+            for(; i < n; i++){
+                memcpy(&x, p + 4 * i, 4);
+                x = wavio_bswap32(x);
+                memcpy(p + 4 * i, &x, 4);
+            }
+            break;
 
-            if (*stereo_pcm->data[1] < -1.0){
-                *stereo_pcm->data[1] = -1.0;
-            }else if(*stereo_pcm->data[1] > 1.0){
-                *stereo_pcm->data[1] = 1.0;
+        //64bit
+        case 8:
+            for(; i < n; i++){
+                for(k = 0; k < 4; k++){
+                    t = p[8 * i + k];
+                    p[8 * i + k] = p[8 * i + 7 - k];
+                    p[8 * i + 7 - k] = t;
+                }
             }
+            break;
+    }
+}
+
+//Unpack n packed little-endian 24bit samples into int32_t (4 samples per step with SSE2 or SSSE3)
+static void wavio_unpack24(const uint8_t *src, int32_t *dst, uint64_t n){
+    uint64_t i = 0;
+
+    //each 16 byte load covers 4 samples, so stop 2 samples early to stay inside src
+#if defined(__SSSE3__)
+    const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+
+    for(; i + 6 <= n; i += 4){
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 3 * i)), shuffle);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_srai_epi32(v, 8));
+    }
+#elif defined(__SSE2__)
+    for(; i + 6 <= n; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + 3 * i));
+        __m128i a = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3)); /* samples 0 and 1 */
+        __m128i b = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9)); /* samples 2 and 3 */
+        v = _mm_unpacklo_epi64(a, b);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_srai_epi32(_mm_slli_epi32(v, 8), 8));
+    }
+#endif
+    for(; i < n; i++){
+        dst[i] = (int32_t)(((uint32_t)src[3 * i] << 8) | ((uint32_t)src[3 * i + 1] << 16) | ((uint32_t)src[3 * i + 2] << 24)) >> 8;
+    }
+}
+
+//Clip and pack n int32_t samples into little-endian 24bit triplets (4 samples per step with SSE2 or SSSE3)
+static void wavio_pack24(const int32_t *src, uint8_t *dst, uint64_t n){
+    uint64_t i = 0;
+    int32_t x;
 
-            //8bit (unsigned)
-            riff->data.data[i] = (int32_t)(floor(((*stereo_pcm->data[0] + 1.0) / 2.0) * (pow(2.0, stereo_pcm->pcm_spec.bits) - 1) + 0.5));
-            riff->data.data[i + 1] = (int32_t)(floor(((*stereo_pcm->data[1] + 1.0) / 2.0) * (pow(2.0, stereo_pcm->pcm_spec.bits) - 1) + 0.5));
+    //each 16 byte store covers 4 samples, so stop 2 samples early to stay inside dst
+#if defined(__SSE2__)
+    const __m128i hi = _mm_set1_epi32(8388607), lo = _mm_set1_epi32(-8388608);
+#if defined(__SSSE3__)
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+#else
+    const __m128i mask = _mm_set1_epi32(0xFFFFFF), even = _mm_setr_epi32(-1, 0, -1, 0);
+#endif
 
-            //next pointer
-            stereo_pcm->data[0]++;
-            stereo_pcm->data[1]++;
+    for(; i + 6 <= n; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i m = _mm_cmpgt_epi32(v, hi);
+        v = _mm_or_si128(_mm_and_si128(m, hi), _mm_andnot_si128(m, v));
+        m = _mm_cmplt_epi32(v, lo);
+        v = _mm_or_si128(_mm_and_si128(m, lo), _mm_andnot_si128(m, v));
+#if defined(__SSSE3__)
+        v = _mm_shuffle_epi8(v, shuffle);
+#else
+        //close the gaps: 3 + 3 bytes in each 64bit half, then the two halves
+        v = _mm_and_si128(v, mask);
+        v = _mm_or_si128(_mm_and_si128(v, even), _mm_srli_epi64(_mm_andnot_si128(even, v), 8));
+        v = _mm_or_si128(_mm_move_epi64(v), _mm_slli_si128(_mm_srli_si128(v, 8), 6));
+#endif
+        _mm_storeu_si128((__m128i *)(dst + 3 * i), v);
+    }
+#endif
+    for(; i < n; i++){
+        x = src[i];
+        if(x > 8388607){
+            x = 8388607;
+        }else if(x < -8388608){
+            x = -8388608;
         }
-    }else{
-        //16, 24, and 32bit
-        for(i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i += 2){
-
-            //clipping
-            if (*stereo_pcm->data[0] < -1.0){
-                *stereo_pcm->data[0] = -1.0;
-            }else if (*stereo_pcm->data[0] > 1.0){
-                *stereo_pcm->data[0] = 1.0;
+        dst[3 * i] = (uint8_t)x;
+        dst[3 * i + 1] = (uint8_t)(x >> 8);
+        dst[3 * i + 2] = (uint8_t)(x >> 16);
+    }
+}
+
+//Unpack n little-endian samples into int32_t (8bit stays unsigned)
+static void wavio_unpack_samples(const uint8_t *src, int32_t *dst, uint64_t n, int16_t bits){
+    uint64_t i;
+
+    switch(bits){
+        //8bit (unsigned)
+        case 8:
+            for(i = 0; i < n; i++){
+                dst[i] = src[i];
             }
+            break;
+
+        //16bit (signed)
+        case 16:
+            for(i = 0; i < n; i++){
+                dst[i] = (int16_t)wavio_load_le16(&src[2 * i]);
+            }
+            break;
+
+        //24bit (signed)
+        case 24:
+            wavio_unpack24(src, dst, n);
+            break;
 
-            if (*stereo_pcm->data[1] < -1.0){
-                *stereo_pcm->data[1] = -1.0;
-            }else if (*stereo_pcm->data[1] > 1.0){
-                *stereo_pcm->data[1] = 1.0;
+        //32bit (signed)
+        case 32:
+            for(i = 0; i < n; i++){
+                dst[i] = (int32_t)wavio_load_le32(&src[4 * i]);
             }
+            break;
+    }
+}
 
-            //copy data
-            riff->data.data[i] = (int32_t)(floor(((*stereo_pcm->data[0] + 1.0) / 2.0) * (pow(2.0, (double)stereo_pcm->pcm_spec.bits) - 1.0) + 0.5) - pow(2.0, (double)stereo_pcm->pcm_spec.bits - 1.0));
-            riff->data.data[i + 1] = (int32_t)(floor(((*stereo_pcm->data[1] + 1.0) / 2.0) * (pow(2.0, (double)stereo_pcm->pcm_spec.bits) - 1.0) + 0.5) - pow(2.0, (double)stereo_pcm->pcm_spec.bits - 1.0));
-            
-            //printf("%lf -> %d, %lf -> %d\n", *stereo_pcm->data[0], riff->data.data[i], *stereo_pcm->data[1], riff->data.data[i+1]);
+//Unpack n signed samples of either byte order into int32_t (8bit is signed here, as in AIFF and CAF)
+void wavio_unpack_signed(const uint8_t *src, int32_t *dst, uint64_t n, int16_t bits, int big_endian){
+    uint64_t i = 0;
 
-            //next pointer
-            stereo_pcm->data[0]++;
-            stereo_pcm->data[1]++;
+    //8bit has no byte order
+    if(bits == 8){
+        for(i = 0; i < n; i++){
+            dst[i] = (int8_t)src[i];
         }
+        return;
+    }
+
+    //little-endian: the WAV path
+    if(!big_endian){
+        wavio_unpack_samples(src, dst, n, bits);
+        return;
     }
 
-    //initialize the pointer
-    stereo_pcm->data[0] = L;
-    stereo_pcm->data[1] = R;
+    switch(bits){
+        //16bit: swap the bytes of 8 samples and sign-extend them at once
+        case 16:
+#if defined(__SSE2__)
+            for(; i + 8 <= n; i += 8){
+                __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+                v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+                _mm_storeu_si128((__m128i *)(dst + i), _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+                _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+            }
+#endif
+            for(; i < n; i++){
+                dst[i] = (int16_t)((src[2 * i] << 8) | src[2 * i + 1]);
+            }
+            break;
+
+        //24bit: reverse and widen 4 samples with one shuffle (stop 2 samples early to stay inside src)
+        case 24:
+#if defined(__SSSE3__)
+            {
+                const __m128i shuffle = _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9);
 
-    //wavwrite from riff struct
-    wavwrite_RIFF(riff, filename);
+                for(; i + 6 <= n; i += 4){
+                    __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 3 * i)), shuffle);
+                    _mm_storeu_si128((__m128i *)(dst + i), _mm_srai_epi32(v, 8));
+                }
+            }
+#endif
+            for(; i < n; i++){
+                dst[i] = (int32_t)(((uint32_t)src[3 * i] << 24) | ((uint32_t)src[3 * i + 1] << 16) | ((uint32_t)src[3 * i + 2] << 8)) >> 8;
+            }
+            break;
 
-    //free riff struct
-    free_RIFF(riff);
+        //32bit: swap the bytes, then the 16bit halves of 4 samples at once
+        case 32:
+#if defined(__SSE2__)
+            for(; i + 4 <= n; i += 4){
+                __m128i v = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+                v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+                _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16)));
+            }
+#endif
+            for(; i < n; i++){
+                dst[i] = (int32_t)(((uint32_t)src[4 * i] << 24) | ((uint32_t)src[4 * i + 1] << 16) | ((uint32_t)src[4 * i + 2] << 8) | src[4 * i + 3]);
+            }
+            break;
+    }
 }
 
-//save WAV file from MONO_PCM_NATIVE struct
-void wavwrite_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename){
-    //variables
-    RIFF *riff; //for write wav file from RIFF struct
-    uint64_t i; //for loop
-    int32_t *data;  //for initialize the pointer
-
-    //initialize RIFF struct
-    riff = (RIFF *)malloc(sizeof(RIFF));
-
-    //RIFF chunk ID ("RIFF")
-    riff->chunkID[0] = 'R';
-    riff->chunkID[1] = 'I';
-    riff->chunkID[2] = 'F';
-    riff->chunkID[3] = 'F';
-
-    //RIFF format type ("WAVE")
-    riff->formType[0] = 'W';
-    riff->formType[1] = 'A';
-    riff->formType[2] = 'V';
-    riff->formType[3] = 'E';
-
-    //fmt chunk ID ("fmt ")
-    riff->fmt.chunkID[0] = 'f';
-    riff->fmt.chunkID[1] = 'm';
-    riff->fmt.chunkID[2] = 't';
-    riff->fmt.chunkID[3] = ' ';
-
-    //fmt chunk size (16)
-    riff->fmt.chunkSize = 16;
+//Unpack a block of samples into riff->data.data
+static void wavio_unpack_block(void *ctx, uint8_t *block, uint64_t pos, uint64_t size){
+    RIFF *riff = (RIFF *)ctx;
+    uint64_t bytes = riff->fmt.bitsPerSample / 8; /* bytes per sample */
 
-    //fmt wavefmttype (1: PCM)
-    riff->fmt.waveFormatType = 1;
+    wavio_unpack_samples(block, riff->data.data + pos / bytes, size / bytes, riff->fmt.bitsPerSample);
+}
 
-    //fmt channel (1: Mono)
-    riff->fmt.channel = 1;
+//frames converted at once from a raw block
+#define WAVIO_DECODE_FRAMES 1024
+
+//Channel arrays of a PCM struct (decode destination or encode source)
+typedef struct{
+    int16_t bits; /* Quantization bits */
+    int16_t channel; /* 1: Mono, 2: Stereo */
+    int32_t *native[2]; /* NATIVE destination (or NULL) */
+    double *pcm[2]; /* [-1, 1] destination (or NULL) */
+    WAVIO_OPS *ops; /* operators applied to pcm (or NULL) */
+    WAVIO_LEVEL *level; /* peak and RMS of the samples read or written (or NULL) */
+    uint64_t start; /* frame of the signal at pcm[c][0] (fades, peak position) */
+    uint64_t length; /* frames of the signal (fade-out) */
+} WAVIO_DECODE;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
-    //fmt samplespersec (sampling frequency)
-    riff->fmt.samplesPerSec = mono_pcm_native->pcm_spec.fs;
+//Fade gain of frame of the signal (1 outside the fades)
+static double wavio_ops_fade_gain(WAVIO_OPS *ops, uint64_t frame, uint64_t length){
+    double f = 1.0, t;
 
-    //fmt blocksize
-    riff->fmt.blockSize = (mono_pcm_native->pcm_spec.bits / 8);
+    if(frame < (uint64_t)ops->fade_in){
+        t = (double)frame / ops->fade_in;
+        f *= (ops->fade_shape == WAVIO_FADE_COSINE) ? 0.5 - 0.5 * cos(M_PI * t) : t;
+    }
+    if(ops->fade_out > 0 && frame + ops->fade_out >= length){
+        t = (frame < length) ? (double)(length - 1 - frame) / ops->fade_out : 0.0;
+        f *= (ops->fade_shape == WAVIO_FADE_COSINE) ? 0.5 - 0.5 * cos(M_PI * t) : t;
+    }
 
-    //fmt bytespersec
-    riff->fmt.bytesPerSec = riff->fmt.blockSize * riff->fmt.samplesPerSec;
+    return f;
+}
+
+//1 if frames first to first + n - 1 are outside the fades
+static int wavio_ops_flat(WAVIO_OPS *ops, uint64_t first, uint64_t n, uint64_t length){
+    return first >= (uint64_t)ops->fade_in && first + n + ops->fade_out <= length;
+}
 
-    //fmt bitspersample(Quantization bit)
-    riff->fmt.bitsPerSample = mono_pcm_native->pcm_spec.bits;
+//Apply the operators to n samples of channel c in place: y = (x + offset) * gain * fade
+//measure: 1 to add the samples going in to the measurement (readers)
+static void wavio_ops_run(WAVIO_OPS *ops, int c, double *y, uint64_t n, uint64_t first, uint64_t length, int measure){
+    double g = ops->gain[c], off = ops->offset[c];
+    double lo = ops->min[c], hi = ops->max[c], sum = 0.0, x;
+    uint64_t j = 0;
+
+    if(measure){
+#if defined(__SSE2__)
+        //two accumulators of two lanes each
+        __m128d lo0 = _mm_set1_pd(lo), lo1 = lo0, hi0 = _mm_set1_pd(hi), hi1 = hi0;
+        __m128d s0 = _mm_setzero_pd(), s1 = s0, v0, v1;
+        double l[2], h[2], s[2];
+
+        for(; j + 4 <= n; j += 4){
+            v0 = _mm_loadu_pd(y + j);
+            v1 = _mm_loadu_pd(y + j + 2);
+            lo0 = _mm_min_pd(lo0, v0);
+            lo1 = _mm_min_pd(lo1, v1);
+            hi0 = _mm_max_pd(hi0, v0);
+            hi1 = _mm_max_pd(hi1, v1);
+            s0 = _mm_add_pd(s0, v0);
+            s1 = _mm_add_pd(s1, v1);
+        }
+        _mm_storeu_pd(l, _mm_min_pd(lo0, lo1));
+        _mm_storeu_pd(h, _mm_max_pd(hi0, hi1));
+        _mm_storeu_pd(s, _mm_add_pd(s0, s1));
+        lo = (l[0] < l[1]) ? l[0] : l[1];
+        hi = (h[0] > h[1]) ? h[0] : h[1];
+        sum = s[0] + s[1];
+#endif
+        for(; j < n; j++){
+            x = y[j];
+            lo = (x < lo) ? x : lo;
+            hi = (x > hi) ? x : hi;
+            sum += x;
+        }
+        ops->min[c] = lo;
+        ops->max[c] = hi;
+        ops->sum[c] += sum;
+        ops->count[c] += n;
+    }
 
-    //data chunk ID ("data")
-    riff->data.chunkID[0] = 'd';
-    riff->data.chunkID[1] = 'a';
-    riff->data.chunkID[2] = 't';
-    riff->data.chunkID[3] = 'a';
+    //outside the fades: gain and offset only (nothing to do for gain 1 and offset 0)
+    if(wavio_ops_flat(ops, first, n, length)){
+        if(g == 1.0 && off == 0.0){
+            return;
+        }
+        j = 0;
+#if defined(__SSE2__)
+        {
+            __m128d vg = _mm_set1_pd(g), vo = _mm_set1_pd(off);
 
-    //data chunk size
-    riff->data.chunkSize = mono_pcm_native->pcm_spec.length * (riff->fmt.bitsPerSample / 8);
-    riff->chunkSize = riff->data.chunkSize + 36;
+            for(; j + 2 <= n; j += 2){
+                _mm_storeu_pd(y + j, _mm_mul_pd(_mm_add_pd(_mm_loadu_pd(y + j), vo), vg));
+            }
+        }
+#endif
+        for(; j < n; j++){
+            y[j] = (y[j] + off) * g;
+        }
+    }else{
+        for(j = 0; j < n; j++){
+            y[j] = (y[j] + off) * g * wavio_ops_fade_gain(ops, first + j, length);
+        }
+    }
+}
 
-    //set the pointer for initialize
-    data = &mono_pcm_native->data[0];
+/* levels */
+//peak and RMS measurement of the following opens and writes (WAVIO_LEVEL_*)
+static int wavio_level_mode = WAVIO_LEVEL_OFF;
 
-    //define data vector
-    riff->data.data = (int32_t *)calloc((unsigned)riff->data.chunkSize / (riff->fmt.bitsPerSample / 8), sizeof(int32_t));
+//Set the peak and RMS measurement of the following opens and whole-file writes
+void wavio_set_level_mode(int mode){
+    wavio_level_mode = mode;
+}
+
+//Add n frames of interleaved NATIVE samples (frame first of the signal) to the peak and RMS of each channel
+//two lanes: the channels of a Stereo frame, or the even and odd frames of Mono
+static void wavio_level_add(WAVIO_LEVEL *level, const int32_t *tmp, uint64_t n, int16_t channel, int16_t bits, uint64_t first){
+    double bias = (bits == 8) ? 128.0 : 0.0; /* 8bit is unsigned */
+    double pos_inv = 1.0 / (pow(2.0, bits - 1) - 1); /* 1 / divisor for x >= 0 */
+    double neg_inv = 1.0 / pow(2.0, bits - 1); /* 1 / divisor for x < 0 */
+    double peak[2] = {0.0, 0.0}, at[2] = {0.0, 0.0}, sum[2] = {0.0, 0.0}; /* of each lane */
+    uint64_t m = n * channel; /* samples */
+    uint64_t k = 0;
+    double x;
+    int l, c;
+
+#if defined(__SSE2__)
+    {
+        __m128d vb = _mm_set1_pd(bias), vp = _mm_set1_pd(pos_inv), vn = _mm_set1_pd(neg_inv);
+        __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1.0), sign = _mm_set1_pd(-0.0);
+        __m128d idx = (channel == 2) ? zero : _mm_set_pd(1.0, 0.0); /* frame of each lane */
+        __m128d step = _mm_set1_pd((channel == 2) ? 1.0 : 2.0);
+        __m128d s = zero, best = zero, pos = zero, v, neg, gt;
+
+        for(; k + 2 <= m; k += 2){
+            v = _mm_sub_pd(_mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)(tmp + k))), vb);
+            neg = _mm_cmplt_pd(v, zero);
+            v = _mm_mul_pd(v, _mm_or_pd(_mm_and_pd(neg, vn), _mm_andnot_pd(neg, vp)));
+
+            //|x| clipped like the writers, its square and the first frame of the largest
+            v = _mm_min_pd(_mm_andnot_pd(sign, v), one);
+            s = _mm_add_pd(s, _mm_mul_pd(v, v));
+            gt = _mm_cmpgt_pd(v, best);
+            best = _mm_max_pd(best, v);
+            pos = _mm_or_pd(_mm_and_pd(gt, idx), _mm_andnot_pd(gt, pos));
+            idx = _mm_add_pd(idx, step);
+        }
+        _mm_storeu_pd(peak, best);
+        _mm_storeu_pd(at, pos);
+        _mm_storeu_pd(sum, s);
+    }
+#endif
+    for(; k < m; k++){
+        l = (int)(k & 1);
+        x = (double)tmp[k] - bias;
+        x = fabs(x * ((x < 0.0) ? neg_inv : pos_inv));
+        x = (x > 1.0) ? 1.0 : x;
+        sum[l] += x * x;
+        if(x > peak[l]){
+            peak[l] = x;
+            at[l] = (double)(k / channel);
+        }
+    }
+
+    //Mono: both lanes are the channel (the earlier frame on a tie)
+    if(channel == 1){
+        sum[0] += sum[1];
+        if(peak[1] > peak[0] || (peak[1] == peak[0] && at[1] < at[0])){
+            peak[0] = peak[1];
+            at[0] = at[1];
+        }
+    }
+
+    for(c = 0; c < channel; c++){
+        level->square[c] += sum[c];
+        if(peak[c] > level->peak[c]){
+            level->peak[c] = peak[c];
+            level->position[c] = first + (uint64_t)at[c];
+        }
+    }
+    level->channel = channel;
+    level->frames += n;
+}
+
+//Add n frames of a raw block to the peak and RMS (Interleaved reads and writes)
+static void wavio_level_raw(WAVIO_LEVEL *level, const uint8_t *raw, uint64_t n, int16_t channel, int16_t bits, uint64_t first){
+    int32_t tmp[2 * WAVIO_DECODE_FRAMES]; /* unpacked samples */
+    uint64_t frame = channel * (bits / 8); /* bytes per frame */
+    uint64_t i, m;
+
+    for(i = 0; i < n; i += m){
+        m = (n - i < WAVIO_DECODE_FRAMES) ? n - i : WAVIO_DECODE_FRAMES;
+        wavio_unpack_samples(raw + i * frame, tmp, m * channel, bits);
+        wavio_level_add(level, tmp, m, channel, bits, first + i);
+    }
+}
+
+//Windows of the data chunk hashed into its fingerprint ("rms " chunk)
+#define WAVIO_FINGERPRINT_WINDOWS 16
+#define WAVIO_FINGERPRINT_BYTES 512
+
+//Fingerprint of the data chunk body (size bytes at offset): 64bit FNV-1a over WAVIO_FINGERPRINT_WINDOWS windows
+//spread evenly from its first to its last byte (the whole body when it is shorter), so it costs a few reads
+//returns 0 if the body cannot be read
+static int wavio_data_fingerprint(int fd, uint64_t offset, uint64_t size, uint64_t *hash){
+    uint8_t buf[WAVIO_FINGERPRINT_BYTES];
+    uint64_t h = 14695981039346656037ull; /* FNV offset basis */
+    uint64_t pos, len, i;
+    int k, windows = WAVIO_FINGERPRINT_WINDOWS;
+
+    if(size <= (uint64_t)WAVIO_FINGERPRINT_WINDOWS * WAVIO_FINGERPRINT_BYTES){
+        windows = (int)((size + WAVIO_FINGERPRINT_BYTES - 1) / WAVIO_FINGERPRINT_BYTES);
+    }
+    for(k = 0; k < windows; k++){
+        if(windows < WAVIO_FINGERPRINT_WINDOWS){
+            pos = (uint64_t)k * WAVIO_FINGERPRINT_BYTES;
+        }else{
+            pos = (uint64_t)k * (size - WAVIO_FINGERPRINT_BYTES) / (WAVIO_FINGERPRINT_WINDOWS - 1);
+        }
+        len = (size - pos < WAVIO_FINGERPRINT_BYTES) ? size - pos : WAVIO_FINGERPRINT_BYTES;
+        if(wavio_pread_full(fd, buf, len, offset + pos) < len){
+            return 0;
+        }
+        for(i = 0; i < len; i++){
+            h = (h ^ buf[i]) * 1099511628211ull; /* FNV prime */
+        }
+    }
 
-    for (i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i++){
-        //copy data
-        riff->data.data[i] = *mono_pcm_native->data;
+    *hash = h;
+    return 1;
+}
 
-        //next pointer
-        mono_pcm_native->data++;
+//Append the PEAK and "rms " chunks after the data chunk body (size bytes at offset, fd readable)
+//returns the bytes appended (pad byte included) for the RIFF chunk size
+static uint64_t wavio_write_levels(int fd, uint64_t offset, uint64_t size, WAVIO_LEVEL *level){
+    uint8_t buf[1 + (16 + 2 * 8) + (32 + 2 * 8)]; /* pad byte and the two chunks */
+    uint64_t end = offset + size; /* end of the data chunk body */
+    uint64_t pad = end & 1; /* chunks start at even offsets */
+    uint64_t body = 8 + 8 * (uint64_t)level->channel; /* size of the PEAK body */
+    uint8_t *p = buf + pad;
+    uint32_t bits;
+    uint64_t rms, hash;
+    float value;
+    double r;
+    int c;
+
+    buf[0] = 0;
+
+    //the chunks are only trusted while the data chunk still has this fingerprint
+    if(!wavio_data_fingerprint(fd, offset, size, &hash)){
+        wavio_fail(WAVIO_ERROR_IO, "Cannot read back the data chunk.");
+        return 0;
     }
 
-    //reset pointer
-    mono_pcm_native->data = data;
+    //PEAK: version, time stamp, then the peak (float) and its frame of each channel
+    memcpy(p, "PEAK", 4);
+    wavio_store_le32(p + 4, (uint32_t)body);
+    wavio_store_le32(p + 8, 1);
+    wavio_store_le32(p + 12, (uint32_t)time(NULL));
+    for(c = 0; c < level->channel; c++){
+        value = (float)level->peak[c];
+        memcpy(&bits, &value, 4);
+        wavio_store_le32(p + 16 + 8 * c, bits);
+        wavio_store_le32(p + 20 + 8 * c, (uint32_t)level->position[c]);
+    }
+    p += 8 + body;
+
+    //"rms ": frames measured, size and fingerprint of the data chunk body (64bit each), then the RMS (double) of each channel
+    memcpy(p, "rms ", 4);
+    wavio_store_le32(p + 4, (uint32_t)(body + 16));
+    wavio_store_le32(p + 8, (uint32_t)level->frames);
+    wavio_store_le32(p + 12, (uint32_t)(level->frames >> 32));
+    wavio_store_le32(p + 16, (uint32_t)size);
+    wavio_store_le32(p + 20, (uint32_t)(size >> 32));
+    wavio_store_le32(p + 24, (uint32_t)hash);
+    wavio_store_le32(p + 28, (uint32_t)(hash >> 32));
+    for(c = 0; c < level->channel; c++){
+        r = wavio_level_rms(level, (int16_t)c);
+        memcpy(&rms, &r, 8);
+        wavio_store_le32(p + 32 + 8 * c, (uint32_t)rms);
+        wavio_store_le32(p + 36 + 8 * c, (uint32_t)(rms >> 32));
+    }
+    p += 24 + body;
 
-    //save wav file from riff struct
-    wavwrite_RIFF(riff, filename);
+    if(wavio_pwrite_full(fd, buf, (uint64_t)(p - buf), end) < (uint64_t)(p - buf)){
+        wavio_fail(WAVIO_ERROR_IO, "Cannot write the level chunks.");
+    }
 
-    //free riff struct
-    free_RIFF(riff);
+    return (uint64_t)(p - buf);
 }
 
-//save WAV file from STEREO_PCM_NATIVE struct
-void wavwrite_Mono(MONO_PCM *mono_pcm, char *filename){
-    //variables
-    RIFF *riff;   //for write wav file from RIFF struct
-    uint64_t i;   //for loop
-    double *data; //for initialize the pointer
-
-    //initialize RIFF struct
-    riff = (RIFF *)malloc(sizeof(RIFF));
-
-    //RIFF chunk ID ("RIFF")
-    riff->chunkID[0] = 'R';
-    riff->chunkID[1] = 'I';
-    riff->chunkID[2] = 'F';
-    riff->chunkID[3] = 'F';
-
-    //RIFF format type ("WAVE")
-    riff->formType[0] = 'W';
-    riff->formType[1] = 'A';
-    riff->formType[2] = 'V';
-    riff->formType[3] = 'E';
-
-    //fmt chunk ID ("fmt ")
-    riff->fmt.chunkID[0] = 'f';
-    riff->fmt.chunkID[1] = 'm';
-    riff->fmt.chunkID[2] = 't';
-    riff->fmt.chunkID[3] = ' ';
-
-    //fmt chunk size (16)
-    riff->fmt.chunkSize = 16;
+//Convert a raw block straight into the channel arrays
+static void wavio_decode_block(void *ctx, uint8_t *block, uint64_t pos, uint64_t size){
+    WAVIO_DECODE *dec = (WAVIO_DECODE *)ctx;
+    int32_t tmp[2 * WAVIO_DECODE_FRAMES]; /* unpacked samples */
+    uint64_t bytes = dec->bits / 8; /* bytes per sample */
+    uint64_t frame = pos / (bytes * dec->channel); /* first frame of the block */
+    uint64_t frames = size / (bytes * dec->channel); /* frames in the block */
+    uint64_t i, j, n;
+    int c;
+    int32_t bias = (dec->bits == 8) ? 128 : 0; /* 8bit is unsigned */
+    double pos_scale = pow(2.0, dec->bits - 1) - 1; /* divisor for x >= 0 */
+    double neg_scale = pow(2.0, dec->bits - 1); /* divisor for x < 0 */
+    double x;
+
+    for(i = 0; i < frames; i += n){
+        n = (frames - i < WAVIO_DECODE_FRAMES) ? frames - i : WAVIO_DECODE_FRAMES;
+        wavio_unpack_samples(block + i * bytes * dec->channel, tmp, n * dec->channel, dec->bits);
+        if(dec->level != NULL){
+            wavio_level_add(dec->level, tmp, n, dec->channel, dec->bits, dec->start + frame + i);
+        }
 
-    //fmt wavefmttype (1: PCM)
-    riff->fmt.waveFormatType = 1;
+        for(c = 0; c < dec->channel; c++){
+            //NATIVE: deinterleave only
+            if(dec->native[c] != NULL){
+                int32_t *dst = dec->native[c] + frame + i;
+                for(j = 0; j < n; j++){
+                    dst[j] = tmp[j * dec->channel + c];
+                }
+            }
 
-    //fmt channel (1: Mono)
-    riff->fmt.channel = 1;
+            //PCM: deinterleave and normalize to [-1, 1] (then the operators, while the chunk is in cache)
+            if(dec->pcm[c] != NULL){
+                double *dst = dec->pcm[c] + frame + i;
+                for(j = 0; j < n; j++){
+                    x = (double)(tmp[j * dec->channel + c] - bias);
+                    dst[j] = (x >= 0) ? x / pos_scale : x / neg_scale;
+                }
+                if(dec->ops != NULL){
+                    wavio_ops_run(dec->ops, c, dst, n, dec->start + frame + i, dec->length, 1);
+                }
+            }
+        }
+    }
+}
 
-    //fmt samplespersec (sampling frequency)
-    riff->fmt.samplesPerSec = mono_pcm->pcm_spec.fs;
+//Pack n int32_t samples into little-endian bytes (with clipping, 8bit is unsigned)
+static void wavio_pack_samples(const int32_t *src, uint8_t *dst, uint64_t n, int16_t bits){
+    uint64_t i;
+    int32_t x;
 
-    //fmt blocksize
-    riff->fmt.blockSize = (mono_pcm->pcm_spec.bits / 8);
+    switch(bits){
+        //8bit integer(unsigned)
+        case 8:
+            for(i = 0; i < n; i++){
+                x = src[i];
+                if(x > 255){
+                    x = 255;
+                }else if(x < 0){
+                    x = 0;
+                }
+                dst[i] = (uint8_t)x;
+            }
+            break;
 
-    //fmt bytespersec
-    riff->fmt.bytesPerSec = riff->fmt.blockSize * riff->fmt.samplesPerSec;
+        //16bit integer(signed)
+        case 16:
+            for(i = 0; i < n; i++){
+                x = src[i];
+                if(x > 32767){
+                    x = 32767;
+                }else if(x < -32768){
+                    x = -32768;
+                }
+                wavio_store_le16(&dst[2 * i], (uint16_t)x);
+            }
+            break;
 
-    //fmt bitspersample(Quantization bit)
-    riff->fmt.bitsPerSample = mono_pcm->pcm_spec.bits;
+        //24bit integer(signed)
+        case 24:
+            wavio_pack24(src, dst, n);
+            break;
 
-    //data chunk ID ("data")
-    riff->data.chunkID[0] = 'd';
-    riff->data.chunkID[1] = 'a';
-    riff->data.chunkID[2] = 't';
-    riff->data.chunkID[3] = 'a';
+        //32bit integer(signed)
+        case 32:
+            for(i = 0; i < n; i++){
+                wavio_store_le32(&dst[4 * i], (uint32_t)src[i]);
+            }
+            break;
+    }
+}
 
-    //data chunk size
-    riff->data.chunkSize = mono_pcm->pcm_spec.length * (riff->fmt.bitsPerSample / 8);
-    riff->chunkSize = riff->data.chunkSize + 36;
+//Pack a block of riff->data.data into little-endian samples
+static void wavio_pack_block(void *ctx, uint8_t *block, uint64_t pos, uint64_t size){
+    RIFF *riff = (RIFF *)ctx;
+    uint64_t bytes = riff->fmt.bitsPerSample / 8; /* bytes per sample */
 
-    //set the pointer for initialize
-    data = &mono_pcm->data[0];
+    wavio_pack_samples(riff->data.data + pos / bytes, block, size / bytes, riff->fmt.bitsPerSample);
+}
 
-    //define data vector
-    riff->data.data = (int32_t *)calloc(riff->data.chunkSize / (riff->fmt.bitsPerSample / 8), sizeof(int32_t));
+//Convert channel arrays into a raw block (the rounding of wavwrite_Stereo/wavwrite_Mono)
+static void wavio_encode_block(void *ctx, uint8_t *block, uint64_t pos, uint64_t size){
+    WAVIO_DECODE *enc = (WAVIO_DECODE *)ctx;
+    int32_t tmp[2 * WAVIO_DECODE_FRAMES]; /* samples before packing */
+    double y[WAVIO_DECODE_FRAMES]; /* samples after the operators */
+    uint64_t bytes = enc->bits / 8; /* bytes per sample */
+    uint64_t frame = pos / (bytes * enc->channel); /* first frame of the block */
+    uint64_t frames = size / (bytes * enc->channel); /* frames in the block */
+    uint64_t i, j, n;
+    int c;
+    double full = pow(2.0, enc->bits) - 1.0; /* number of steps */
+    double half = (enc->bits == 8) ? 0.0 : pow(2.0, enc->bits - 1.0); /* offset of signed formats */
+    double g, off; /* gain and offset of the operators outside the fades */
+    double x;
+
+    for(i = 0; i < frames; i += n){
+        n = (frames - i < WAVIO_DECODE_FRAMES) ? frames - i : WAVIO_DECODE_FRAMES;
+
+        for(c = 0; c < enc->channel; c++){
+            //NATIVE: interleave only
+            if(enc->native[c] != NULL){
+                const int32_t *src = enc->native[c] + frame + i;
+                for(j = 0; j < n; j++){
+                    tmp[j * enc->channel + c] = src[j];
+                }
+            }
 
-    if(mono_pcm->pcm_spec.bits == 8){
-        for(i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i++){
-            //clipping
-            if(*mono_pcm->data < -1.0){
-                *mono_pcm->data = -1.0;
-            }else if(*mono_pcm->data >1.0){
-                *mono_pcm->data = 1.0;
+            //PCM: apply the operators, clip, quantize and interleave
+            if(enc->pcm[c] != NULL){
+                const double *src = enc->pcm[c] + frame + i;
+                g = 1.0;
+                off = 0.0;
+                if(enc->ops != NULL){
+                    if(wavio_ops_flat(enc->ops, enc->start + frame + i, n, enc->length)){
+                        g = enc->ops->gain[c];
+                        off = enc->ops->offset[c];
+                    }else{
+                        //fades: on a copy (the arrays of the caller are not changed)
+                        memcpy(y, src, n * sizeof(double));
+                        wavio_ops_run(enc->ops, c, y, n, enc->start + frame + i, enc->length, 0);
+                        src = y;
+                    }
+                }
+                for(j = 0; j < n; j++){
+                    x = (src[j] + off) * g;
+                    if(x < -1.0){
+                        x = -1.0;
+                    }else if(x > 1.0){
+                        x = 1.0;
+                    }
+                    tmp[j * enc->channel + c] = (int32_t)(floor(((x + 1.0) / 2.0) * full + 0.5) - half);
+                }
             }
+        }
 
-            //copy data
-            riff->data.data[i] = (int32_t)(floor(floor(((*mono_pcm->data + 1.0) / 2.0) * (pow(2.0, riff->fmt.bitsPerSample) - 1.0) + 0.5)));
-        
-            //next pointer
-            mono_pcm->data++;
+        if(enc->level != NULL){
+            wavio_level_add(enc->level, tmp, n, enc->channel, enc->bits, enc->start + frame + i);
         }
-    }else{
-        for (i = 0; i < riff->data.chunkSize / (riff->fmt.bitsPerSample / 8); i++){
-            //clipping
-            if (*mono_pcm->data < -1.0){
-                *mono_pcm->data = -1.0;
-            }else if (*mono_pcm->data > 1.0){
-                *mono_pcm->data = 1.0;
-            }
+        wavio_pack_samples(tmp, block + i * bytes * enc->channel, n * enc->channel, enc->bits);
+    }
+}
 
-            //copy data
-            riff->data.data[i] = (int32_t)(floor(((*mono_pcm->data + 1.0) / 2.0) * (pow(2.0, riff->fmt.bitsPerSample) - 1.0) + 0.5) - (pow(2.0, riff->fmt.bitsPerSample - 1.0)));
-        
-            //next pointer
-            mono_pcm->data++;
+//Channel arrays of a COMPACT struct (decode destination or encode source)
+typedef struct{
+    int16_t bits; /* Quantization bits */
+    int16_t channel; /* 1: Mono, 2: Stereo */
+    void *data[2]; /* uint8_t, int16_t or int32_t samples of each channel */
+} WAVIO_COMPACT;
+
+//Deinterleave a raw block straight into COMPACT channel arrays (no widening for 8bit and 16bit)
+static void wavio_compact_decode_block(void *ctx, uint8_t *block, uint64_t pos, uint64_t size){
+    WAVIO_COMPACT *com = (WAVIO_COMPACT *)ctx;
+    int32_t tmp[2 * WAVIO_DECODE_FRAMES]; /* unpacked samples (24bit and 32bit stereo) */
+    uint64_t bytes = com->bits / 8; /* bytes per sample */
+    uint64_t frame = pos / (bytes * com->channel); /* first frame of the block */
+    uint64_t frames = size / (bytes * com->channel); /* frames in the block */
+    uint64_t i = 0, j, n;
+
+    //mono: the file layout is the container layout
+    if(com->channel == 1){
+        if(com->bits == 8 || (com->bits == 16 && !WAVIO_BIG_ENDIAN_HOST)){
+            memcpy((uint8_t *)com->data[0] + frame * bytes, block, size);
+        }else if(com->bits == 16){
+            int16_t *dst = (int16_t *)com->data[0] + frame;
+            for(i = 0; i < frames; i++){
+                dst[i] = (int16_t)wavio_load_le16(block + 2 * i);
+            }
+        }else{
+            wavio_unpack_samples(block, (int32_t *)com->data[0] + frame, frames, com->bits);
         }
+        return;
     }
 
-    //reset pointer
-    mono_pcm->data = data;
+    switch(com->bits){
+        //8bit
+        case 8:{
+            uint8_t *L = (uint8_t *)com->data[0] + frame, *R = (uint8_t *)com->data[1] + frame;
+            for(i = 0; i < frames; i++){
+                L[i] = block[2 * i];
+                R[i] = block[2 * i + 1];
+            }
+            break;
+        }
 
-    //save wav file from riff struct
-    wavwrite_RIFF(riff, filename);
+        //16bit: split 8 frames per step (low and high halves of each 32bit frame)
+        case 16:{
+            int16_t *L = (int16_t *)com->data[0] + frame, *R = (int16_t *)com->data[1] + frame;
+#if defined(__SSE2__)
+            for(; i + 8 <= frames; i += 8){
+                __m128i a = _mm_loadu_si128((const __m128i *)(block + 4 * i));
+                __m128i b = _mm_loadu_si128((const __m128i *)(block + 4 * i + 16));
+                _mm_storeu_si128((__m128i *)(L + i), _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16)));
+                _mm_storeu_si128((__m128i *)(R + i), _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+            }
+#endif
+            for(; i < frames; i++){
+                L[i] = (int16_t)wavio_load_le16(block + 4 * i);
+                R[i] = (int16_t)wavio_load_le16(block + 4 * i + 2);
+            }
+            break;
+        }
+
+        //24bit and 32bit: unpack a few frames at a time, then split them
+        default:{
+            int32_t *L = (int32_t *)com->data[0] + frame, *R = (int32_t *)com->data[1] + frame;
+            for(i = 0; i < frames; i += n){
+                n = (frames - i < WAVIO_DECODE_FRAMES) ? frames - i : WAVIO_DECODE_FRAMES;
+                wavio_unpack_samples(block + i * bytes * 2, tmp, 2 * n, com->bits);
+                for(j = 0; j < n; j++){
+                    L[i + j] = tmp[2 * j];
+                    R[i + j] = tmp[2 * j + 1];
+                }
+            }
+            break;
+        }
+    }
+}
+
+//Interleave COMPACT channel arrays into a raw block (24bit is clipped as in wavwrite_Stereo_Native)
+static void wavio_compact_encode_block(void *ctx, uint8_t *block, uint64_t pos, uint64_t size){
+    WAVIO_COMPACT *com = (WAVIO_COMPACT *)ctx;
+    int32_t tmp[2 * WAVIO_DECODE_FRAMES]; /* interleaved samples (24bit and 32bit stereo) */
+    uint64_t bytes = com->bits / 8; /* bytes per sample */
+    uint64_t frame = pos / (bytes * com->channel); /* first frame of the block */
+    uint64_t frames = size / (bytes * com->channel); /* frames in the block */
+    uint64_t i = 0, j, n;
+
+    //mono: the container layout is the file layout
+    if(com->channel == 1){
+        if(com->bits == 8 || (com->bits == 16 && !WAVIO_BIG_ENDIAN_HOST)){
+            memcpy(block, (const uint8_t *)com->data[0] + frame * bytes, size);
+        }else if(com->bits == 16){
+            const int16_t *src = (const int16_t *)com->data[0] + frame;
+            for(i = 0; i < frames; i++){
+                wavio_store_le16(block + 2 * i, (uint16_t)src[i]);
+            }
+        }else{
+            wavio_pack_samples((const int32_t *)com->data[0] + frame, block, frames, com->bits);
+        }
+        return;
+    }
+
+    switch(com->bits){
+        //8bit
+        case 8:{
+            const uint8_t *L = (const uint8_t *)com->data[0] + frame, *R = (const uint8_t *)com->data[1] + frame;
+            for(i = 0; i < frames; i++){
+                block[2 * i] = L[i];
+                block[2 * i + 1] = R[i];
+            }
+            break;
+        }
+
+        //16bit: interleave 8 frames per step
+        case 16:{
+            const int16_t *L = (const int16_t *)com->data[0] + frame, *R = (const int16_t *)com->data[1] + frame;
+#if defined(__SSE2__)
+            for(; i + 8 <= frames; i += 8){
+                __m128i l = _mm_loadu_si128((const __m128i *)(L + i));
+                __m128i r = _mm_loadu_si128((const __m128i *)(R + i));
+                _mm_storeu_si128((__m128i *)(block + 4 * i), _mm_unpacklo_epi16(l, r));
+                _mm_storeu_si128((__m128i *)(block + 4 * i + 16), _mm_unpackhi_epi16(l, r));
+            }
+#endif
+            for(; i < frames; i++){
+                wavio_store_le16(block + 4 * i, (uint16_t)L[i]);
+                wavio_store_le16(block + 4 * i + 2, (uint16_t)R[i]);
+            }
+            break;
+        }
+
+        //24bit and 32bit: interleave a few frames at a time, then pack them
+        default:{
+            const int32_t *L = (const int32_t *)com->data[0] + frame, *R = (const int32_t *)com->data[1] + frame;
+            for(i = 0; i < frames; i += n){
+                n = (frames - i < WAVIO_DECODE_FRAMES) ? frames - i : WAVIO_DECODE_FRAMES;
+                for(j = 0; j < n; j++){
+                    tmp[2 * j] = L[i + j];
+                    tmp[2 * j + 1] = R[i + j];
+                }
+                wavio_pack_samples(tmp, block + i * bytes * 2, 2 * n, com->bits);
+            }
+            break;
+        }
+    }
+}
+
+//Copy a raw block into an interleaved array at the COMPACT width (8bit and 16bit are plain copies)
+static void wavio_interleaved_decode_block(void *ctx, uint8_t *block, uint64_t pos, uint64_t size){
+    WAVIO_COMPACT *com = (WAVIO_COMPACT *)ctx;
+    uint64_t bytes = com->bits / 8; /* bytes per sample */
+    uint64_t i;
+
+    if(com->bits == 8 || (com->bits == 16 && !WAVIO_BIG_ENDIAN_HOST)){
+        memcpy((uint8_t *)com->data[0] + pos, block, size);
+    }else if(com->bits == 16){
+        int16_t *dst = (int16_t *)com->data[0] + pos / 2;
+        for(i = 0; i < size / 2; i++){
+            dst[i] = (int16_t)wavio_load_le16(block + 2 * i);
+        }
+    }else{
+        wavio_unpack_samples(block, (int32_t *)com->data[0] + pos / bytes, size / bytes, com->bits);
+    }
+}
+
+//Copy an interleaved array at the COMPACT width into a raw block
+static void wavio_interleaved_encode_block(void *ctx, uint8_t *block, uint64_t pos, uint64_t size){
+    WAVIO_COMPACT *com = (WAVIO_COMPACT *)ctx;
+    uint64_t bytes = com->bits / 8; /* bytes per sample */
+    uint64_t i;
+
+    if(com->bits == 8 || (com->bits == 16 && !WAVIO_BIG_ENDIAN_HOST)){
+        memcpy(block, (const uint8_t *)com->data[0] + pos, size);
+    }else if(com->bits == 16){
+        const int16_t *src = (const int16_t *)com->data[0] + pos / 2;
+        for(i = 0; i < size / 2; i++){
+            wavio_store_le16(block + 2 * i, (uint16_t)src[i]);
+        }
+    }else{
+        wavio_pack_samples((const int32_t *)com->data[0] + pos / bytes, block, size / bytes, com->bits);
+    }
+}
+
+//Block function that also measures the blocks it fills (COMPACT and Interleaved whole-file writers)
+typedef struct{
+    WAVIO_BLOCK_FUNC func; /* fills the block */
+    void *ctx; /* context of func */
+    WAVIO_LEVEL *level; /* peak and RMS of the blocks filled so far */
+    int16_t bits; /* Quantization bits */
+    int16_t channel; /* 1: Mono, 2: Stereo */
+} WAVIO_MEASURE;
+
+//Fill a raw block with the wrapped function, then measure it
+static void wavio_measure_block(void *ctx, uint8_t *block, uint64_t pos, uint64_t size){
+    WAVIO_MEASURE *measure = (WAVIO_MEASURE *)ctx;
+    uint64_t frame = measure->channel * (measure->bits / 8); /* bytes per frame */
+
+    measure->func(measure->ctx, block, pos, size);
+    wavio_level_raw(measure->level, block, size / frame, measure->channel, measure->bits, pos / frame);
+}
+
+//View one channel of an INTERLEAVED_PCM struct (channel: 0 for L or Mono, 1 for R, ...)
+CHANNEL_VIEW wavio_channel_view(INTERLEAVED_PCM *interleaved_pcm, int16_t channel){
+    CHANNEL_VIEW view;
+    int16_t bytes = wavio_compact_bytes(interleaved_pcm->pcm_spec.bits); /* bytes per sample */
+
+    if(channel < 0 || channel >= interleaved_pcm->channel){
+        wavio_fail(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+        memset(&view, 0, sizeof(view));
+        return view;
+    }
+
+    view.data = (uint8_t *)interleaved_pcm->data + channel * bytes;
+    view.bits = interleaved_pcm->pcm_spec.bits;
+    view.stride = interleaved_pcm->channel;
+    view.length = interleaved_pcm->pcm_spec.length;
+
+    return view;
+}
+
+//Get the i-th sample of a view as NATIVE
+int32_t wavio_view_get(const CHANNEL_VIEW *view, int32_t i){
+    uint64_t k = (uint64_t)i * view->stride; /* index in the interleaved array */
+
+    switch(view->bits){
+        case 8:
+            return ((const uint8_t *)view->data)[k];
+        case 16:
+            return ((const int16_t *)view->data)[k];
+        default:
+            return ((const int32_t *)view->data)[k];
+    }
+}
+
+//Gather n samples of a view from start into a NATIVE array
+void wavio_view_read_Native(const CHANNEL_VIEW *view, int32_t start, int32_t n, int32_t *dst){
+    uint64_t k = (uint64_t)start * view->stride; /* index in the interleaved array */
+    int32_t i;
+
+    switch(view->bits){
+        case 8:{
+            const uint8_t *src = (const uint8_t *)view->data + k;
+            for(i = 0; i < n; i++){
+                dst[i] = src[(uint64_t)i * view->stride];
+            }
+            break;
+        }
+        case 16:{
+            const int16_t *src = (const int16_t *)view->data + k;
+            for(i = 0; i < n; i++){
+                dst[i] = src[(uint64_t)i * view->stride];
+            }
+            break;
+        }
+        default:{
+            const int32_t *src = (const int32_t *)view->data + k;
+            for(i = 0; i < n; i++){
+                dst[i] = src[(uint64_t)i * view->stride];
+            }
+            break;
+        }
+    }
+}
+
+//Gather n samples of a view from start into a [-1, 1] array
+void wavio_view_read(const CHANNEL_VIEW *view, int32_t start, int32_t n, double *dst){
+    int32_t tmp[WAVIO_DECODE_FRAMES]; /* gathered samples */
+    int32_t i, m;
+
+    for(i = 0; i < n; i += m){
+        m = (n - i < WAVIO_DECODE_FRAMES) ? n - i : WAVIO_DECODE_FRAMES;
+        wavio_view_read_Native(view, start + i, m, tmp);
+        wavio_native_to_pcm(tmp, dst + i, m, view->bits);
+    }
+}
+
+//Normalize n NATIVE samples to [-1, 1] (the scaling of wavread_Stereo/wavread_Mono, 8bit is unsigned)
+void wavio_native_to_pcm(const int32_t *src, double *dst, int32_t n, int16_t bits){
+    int32_t i;
+    int32_t bias = (bits == 8) ? 128 : 0; /* 8bit is unsigned */
+    double pos_scale = pow(2.0, bits - 1) - 1; /* divisor for x >= 0 */
+    double neg_scale = pow(2.0, bits - 1); /* divisor for x < 0 */
+    double x;
+
+    for(i = 0; i < n; i++){
+        x = (double)(src[i] - bias);
+        dst[i] = (x >= 0) ? x / pos_scale : x / neg_scale;
+    }
+}
+
+//Clip and quantize n samples in [-1, 1] to NATIVE (the rounding of wavwrite_Stereo/wavwrite_Mono)
+void wavio_pcm_to_native(const double *src, int32_t *dst, int32_t n, int16_t bits){
+    int32_t i;
+    double full = pow(2.0, bits) - 1.0; /* number of steps */
+    double half = (bits == 8) ? 0.0 : pow(2.0, bits - 1.0); /* offset of signed formats */
+    double x;
+
+    for(i = 0; i < n; i++){
+        x = src[i];
+        if(x < -1.0){
+            x = -1.0;
+        }else if(x > 1.0){
+            x = 1.0;
+        }
+        dst[i] = (int32_t)(floor(((x + 1.0) / 2.0) * full + 0.5) - half);
+    }
+}
+
+/* header index */
+//chunks remembered per file
+#define WAVIO_MAX_CHUNKS 32
+
+//name of the index file in WAVIO_INDEX_DIRECTORY mode
+#define WAVIO_INDEX_NAME ".wavio_index"
+
+//longest path of an index file or key
+#define WAVIO_PATH_MAX 4096
+
+//Parsed header and chunk offsets of a file
+typedef struct{
+    RIFF riff; /* RIFF, fmt and data chunk headers (riff.data.data is not used) */
+    int64_t data_offset; /* file offset of the data chunk body */
+    int32_t count; /* number of chunks */
+    WAVIO_CHUNK chunk[WAVIO_MAX_CHUNKS]; /* chunks in file order */
+} WAVIO_INDEX;
+
+//header index cache mode (WAVIO_INDEX_*) and the index file of WAVIO_INDEX_GLOBAL
+static int wavio_index_mode = WAVIO_INDEX_OFF;
+static char wavio_index_path[WAVIO_PATH_MAX];
+
+//Set the header index cache used by the following opens
+void wavio_set_index_cache(int mode, char *path){
+    if(mode == WAVIO_INDEX_GLOBAL){
+        if(path == NULL || strlen(path) >= WAVIO_PATH_MAX){
+            wavio_fail(WAVIO_ERROR_ARGUMENT, "Inappropriate index file.");
+            return;
+        }
+        strcpy(wavio_index_path, path);
+    }
+    wavio_index_mode = mode;
+}
+
+//Size and modification time (ns) of a file (returns 0 on success)
+static int wavio_file_id(char *filename, int64_t *size, int64_t *mtime){
+    struct stat st;
+
+    if(stat(filename, &st) != 0){
+        return -1;
+    }
+    *size = (int64_t)st.st_size;
+#ifdef __linux__
+    *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    *mtime = (int64_t)st.st_mtime * 1000000000;
+#endif
+
+    return 0;
+}
+
+//Index file holding filename and the key of filename in it
+static void wavio_index_location(char *filename, char *index_file, char *key){
+    char *slash = strrchr(filename, '/');
+    char *real;
+
+    if(wavio_index_mode == WAVIO_INDEX_DIRECTORY){
+        //basename in the index of its own directory
+        if(slash == NULL){
+            snprintf(index_file, WAVIO_PATH_MAX, "%s", WAVIO_INDEX_NAME);
+            snprintf(key, WAVIO_PATH_MAX, "%s", filename);
+        }else{
+            snprintf(index_file, WAVIO_PATH_MAX, "%.*s/%s", (int)(slash - filename), filename, WAVIO_INDEX_NAME);
+            snprintf(key, WAVIO_PATH_MAX, "%s", slash + 1);
+        }
+    }else{
+        //absolute path in the global index
+        snprintf(index_file, WAVIO_PATH_MAX, "%s", wavio_index_path);
+        real = (filename[0] == '/') ? NULL : realpath(filename, NULL);
+        snprintf(key, WAVIO_PATH_MAX, "%s", (real != NULL) ? real : filename);
+        free(real);
+    }
+}
+
+//One record of the index file
+typedef struct{
+    int64_t size; /* size of the file */
+    int64_t mtime; /* modification time of the file (ns) */
+    char *key; /* basename or absolute path */
+    WAVIO_INDEX index; /* parsed header */
+} WAVIO_RECORD;
+
+//Records of the index file used last (reloaded when that file changes)
+typedef struct{
+    char file[WAVIO_PATH_MAX]; /* index file */
+    int64_t size; /* size of the index file when loaded */
+    int64_t mtime; /* modification time of the index file when loaded */
+    int32_t count; /* number of records */
+    int32_t cap; /* capacity of record */
+    WAVIO_RECORD *record; /* records in file order */
+} WAVIO_INDEX_TABLE;
+
+static WAVIO_INDEX_TABLE wavio_index_table;
+#ifndef WAVIO_NO_THREADS
+static pthread_mutex_t wavio_index_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+//Parse one line of the index file (returns 1 on success)
+//line: size mtime RIFF and fmt fields, data size and offset, chunks (hex ID, offset, size), key
+static int wavio_index_parse(char *line, WAVIO_RECORD *record){
+    char *p, hex[9];
+    long long f_size, f_mtime, riff_size, fmt_size, bytes, offset, chunk_offset;
+    unsigned long long fs;
+    long long chunk_size;
+    unsigned int data_size, id[4];
+    short type, channel, block, bits;
+    int count, n, i, k;
+    WAVIO_INDEX *index = &record->index;
+
+    if(sscanf(line, "%lld %lld %lld %lld %hd %hd %llu %lld %hd %hd %u %lld %d%n",
+              &f_size, &f_mtime, &riff_size, &fmt_size, &type, &channel, &fs, &bytes, &block, &bits, &data_size, &offset, &count, &n) != 13){
+        return 0;
+    }
+    if(count < 0 || count > WAVIO_MAX_CHUNKS){
+        return 0;
+    }
+
+    //chunks
+    p = line + n;
+    for(i = 0; i < count; i++){
+        if(sscanf(p, " %8s %lld %lld%n", hex, &chunk_offset, &chunk_size, &n) != 3 || sscanf(hex, "%2x%2x%2x%2x", &id[0], &id[1], &id[2], &id[3]) != 4){
+            return 0;
+        }
+        for(k = 0; k < 4; k++){
+            index->chunk[i].id[k] = (char)id[k];
+        }
+        index->chunk[i].offset = chunk_offset;
+        index->chunk[i].size = chunk_size;
+        p += n;
+    }
+
+    //key is the rest of the line
+    if(*p != ' '){
+        return 0;
+    }
+    p[strcspn(p, "\r\n")] = '\0';
+
+    record->size = f_size;
+    record->mtime = f_mtime;
+    record->key = (char *)malloc(strlen(p + 1) + 1);
+    if(record->key == NULL){
+        wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the index record.");
+        return 0;
+    }
+    strcpy(record->key, p + 1);
+
+    memset(&index->riff, 0, sizeof(RIFF));
+    memcpy(index->riff.chunkID, "RIFF", 4);
+    index->riff.chunkSize = riff_size;
+    memcpy(index->riff.formType, "WAVE", 4);
+    memcpy(index->riff.fmt.chunkID, "fmt ", 4);
+    index->riff.fmt.chunkSize = fmt_size;
+    index->riff.fmt.waveFormatType = type;
+    index->riff.fmt.channel = channel;
+    index->riff.fmt.samplesPerSec = fs;
+    index->riff.fmt.bytesPerSec = bytes;
+    index->riff.fmt.blockSize = block;
+    index->riff.fmt.bitsPerSample = bits;
+    memcpy(index->riff.data.chunkID, "data", 4);
+    index->riff.data.chunkSize = data_size;
+    index->data_offset = offset;
+    index->count = count;
+
+    return 1;
+}
+
+//Add a record to the table (takes the key)
+//returns 0 if the table cannot grow (the key is freed and the table is reloaded on the next lookup)
+static int wavio_index_add(WAVIO_RECORD *record){
+    WAVIO_INDEX_TABLE *table = &wavio_index_table;
+    WAVIO_RECORD *grown;
+    int32_t cap;
+
+    if(table->count == table->cap){
+        cap = (table->cap > 0) ? 2 * table->cap : 64;
+        grown = (WAVIO_RECORD *)realloc(table->record, cap * sizeof(WAVIO_RECORD));
+        if(grown == NULL){
+            free(record->key);
+            table->file[0] = '\0';
+            wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the index table.");
+            return 0;
+        }
+        table->record = grown;
+        table->cap = cap;
+    }
+    table->record[table->count++] = *record;
+
+    return 1;
+}
+
+//Make the table hold the current contents of index_file (returns 0 if there is no index file)
+static int wavio_index_load(char *index_file){
+    WAVIO_INDEX_TABLE *table = &wavio_index_table;
+    WAVIO_RECORD record;
+    int64_t size, mtime;
+    char *line;
+    int32_t i;
+    FILE *fp;
+
+    if(wavio_file_id(index_file, &size, &mtime) != 0){
+        return 0;
+    }
+    if(strcmp(table->file, index_file) == 0 && table->size == size && table->mtime == mtime){
+        return 1;
+    }
+
+    //drop the old records
+    for(i = 0; i < table->count; i++){
+        free(table->record[i].key);
+    }
+    table->count = 0;
+    table->file[0] = '\0';
+
+    fp = fopen(index_file, "r");
+    if(fp == NULL){
+        return 0;
+    }
+    line = (char *)malloc(2 * WAVIO_PATH_MAX);
+    if(line == NULL){
+        fclose(fp);
+        wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the index line.");
+        return 0;
+    }
+    while(fgets(line, 2 * WAVIO_PATH_MAX, fp) != NULL){
+        if(wavio_index_parse(line, &record) && !wavio_index_add(&record)){
+            free(line);
+            fclose(fp);
+            return 0;
+        }
+    }
+    free(line);
+    fclose(fp);
+
+    snprintf(table->file, WAVIO_PATH_MAX, "%s", index_file);
+    table->size = size;
+    table->mtime = mtime;
+
+    return 1;
+}
+
+//Look up a file of this size and mtime in the index (returns 1 and fills index on a hit)
+static int wavio_index_lookup(char *filename, int64_t size, int64_t mtime, WAVIO_INDEX *index){
+    char index_file[WAVIO_PATH_MAX], key[WAVIO_PATH_MAX];
+    WAVIO_RECORD *record;
+    int found = 0;
+    int32_t i;
+
+    wavio_index_location(filename, index_file, key);
+
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_lock(&wavio_index_lock);
+#endif
+    if(wavio_index_load(index_file)){
+        //the last record of the key wins (records are only appended)
+        for(i = wavio_index_table.count - 1; i >= 0; i--){
+            record = wavio_index_table.record + i;
+            if(strcmp(record->key, key) == 0){
+                if(record->size == size && record->mtime == mtime){
+                    *index = record->index;
+                    found = 1;
+                }
+                break;
+            }
+        }
+    }
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_unlock(&wavio_index_lock);
+#endif
+
+    return found;
+}
+
+//Append the record of a file to the index (the cache is optional, so failures are ignored)
+static void wavio_index_store(char *filename, int64_t size, int64_t mtime, WAVIO_INDEX *index){
+    char index_file[WAVIO_PATH_MAX], key[WAVIO_PATH_MAX];
+    char *line = (char *)malloc(2 * WAVIO_PATH_MAX);
+    const uint8_t *id;
+    WAVIO_RECORD record;
+    int64_t old_size, old_mtime;
+    size_t len;
+    int reload, i;
+    FILE *fp;
+
+    if(line == NULL){
+        wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the index line.");
+        return;
+    }
+    wavio_index_location(filename, index_file, key);
+
+    len = snprintf(line, 2 * WAVIO_PATH_MAX, "%lld %lld %lld %lld %hd %hd %llu %lld %hd %hd %u %lld %d",
+                   (long long)size, (long long)mtime, (long long)index->riff.chunkSize, (long long)index->riff.fmt.chunkSize,
+                   index->riff.fmt.waveFormatType, index->riff.fmt.channel, (unsigned long long)index->riff.fmt.samplesPerSec,
+                   (long long)index->riff.fmt.bytesPerSec, index->riff.fmt.blockSize, index->riff.fmt.bitsPerSample,
+                   index->riff.data.chunkSize, (long long)index->data_offset, index->count);
+    for(i = 0; i < index->count && len < 2 * WAVIO_PATH_MAX; i++){
+        id = (const uint8_t *)index->chunk[i].id;
+        len += snprintf(line + len, 2 * WAVIO_PATH_MAX - len, " %02x%02x%02x%02x %lld %lld",
+                        id[0], id[1], id[2], id[3], (long long)index->chunk[i].offset, (long long)index->chunk[i].size);
+    }
+    if(len < 2 * WAVIO_PATH_MAX){
+        len += snprintf(line + len, 2 * WAVIO_PATH_MAX - len, " %s\n", key);
+    }
+    if(len >= 2 * WAVIO_PATH_MAX || strchr(key, '\n') != NULL){
+        free(line);
+        return;
+    }
+
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_lock(&wavio_index_lock);
+#endif
+    //the table stays valid if nobody else wrote the index file since it was loaded
+    reload = !(strcmp(wavio_index_table.file, index_file) == 0 && wavio_file_id(index_file, &old_size, &old_mtime) == 0
+               && old_size == wavio_index_table.size && old_mtime == wavio_index_table.mtime);
+
+    //one write per record (O_APPEND keeps concurrent records whole)
+    fp = fopen(index_file, "a");
+    if(fp != NULL){
+        fwrite(line, 1, len, fp);
+        fclose(fp);
+
+        if(!reload && wavio_index_parse(line, &record) && wavio_index_add(&record)){
+            wavio_file_id(index_file, &wavio_index_table.size, &wavio_index_table.mtime);
+        }
+    }
+#ifndef WAVIO_NO_THREADS
+    pthread_mutex_unlock(&wavio_index_lock);
+#endif
+    free(line);
+}
+
+//Walk the chunks from offset (flags: WAVIO_WALK_*), stops at the end of the file or at a non-printable ID
+//returns the number of chunks stored in chunk (at most max)
+int32_t wavio_walk_chunks(FILE *fp, int64_t offset, int flags, WAVIO_CHUNK *chunk, int32_t max){
+    uint8_t head[12]; /* chunk ID and size */
+    int head_size = (flags & WAVIO_WALK_SIZE64) ? 12 : 8; /* bytes of the chunk header */
+    int64_t pos = offset; /* file offset of the chunk header */
+    uint64_t size;
+    int32_t count = 0;
+    int i;
+
+    while(count < max && fseek(fp, (long)pos, SEEK_SET) == 0 && fread(head, 1, head_size, fp) == (size_t)head_size){
+        //not a chunk ID (e.g. after a data chunk with a wrong size)
+        for(i = 0; i < 4; i++){
+            if(head[i] < 0x20 || head[i] > 0x7e){
+                return count;
+            }
+        }
+
+        size = 0;
+        if(flags & WAVIO_WALK_BIG_ENDIAN){
+            for(i = 4; i < head_size; i++){
+                size = (size << 8) | head[i];
+            }
+        }else{
+            for(i = head_size - 1; i >= 4; i--){
+                size = (size << 8) | head[i];
+            }
+        }
+
+        //64bit size of -1: the chunk runs to the end of the file
+        if((flags & WAVIO_WALK_SIZE64) && (int64_t)size < 0){
+            fseek(fp, 0, SEEK_END);
+            size = (uint64_t)(ftell(fp) - (pos + head_size));
+        }
+
+        memcpy(chunk[count].id, head, 4);
+        chunk[count].offset = pos + head_size;
+        chunk[count].size = (int64_t)size;
+        count++;
+
+        pos += head_size + (int64_t)size;
+        if(flags & WAVIO_WALK_EVEN){
+            pos += (int64_t)(size & 1);
+        }
+    }
+
+    return count;
+}
+
+//Find the fmt and data chunks of a RIFF file
+static int wavio_walk_riff(FILE *fp, WAVIO_INDEX *index, int64_t *fmt_offset){
+    int32_t i;
+
+    index->count = wavio_walk_chunks(fp, 12, WAVIO_WALK_EVEN, index->chunk, WAVIO_MAX_CHUNKS);
+    index->data_offset = -1;
+    *fmt_offset = -1;
+
+    for(i = 0; i < index->count; i++){
+        if(memcmp(index->chunk[i].id, "fmt ", 4) == 0 && *fmt_offset < 0){
+            *fmt_offset = index->chunk[i].offset;
+        }
+        if(memcmp(index->chunk[i].id, "data", 4) == 0 && index->data_offset < 0){
+            index->data_offset = index->chunk[i].offset;
+            index->riff.data.chunkSize = (uint32_t)index->chunk[i].size;
+        }
+    }
+
+    return *fmt_offset >= 0 && index->data_offset >= 0;
+}
+
+//Read the RIFF, fmt and data chunk headers into out and seek to the data chunk body
+//returns the file offset of the data chunk body (-1 on error, out is left untouched)
+static long wavio_read_header(RIFF *out, FILE *fp, char *filename){
+    RIFF parsed; /* headers parsed so far */
+    RIFF *riff = &parsed;
+    WAVIO_INDEX index; /* chunk offsets */
+    int64_t fmt_offset; /* file offset of the fmt chunk body */
+    int64_t size = 0, mtime = 0; /* identity of the file for the index cache */
+    uint8_t field[20]; /* little-endian header fields */
+    int cached = 0;
+    int walked;
+    long offset;
+
+    //known file: no parsing at all
+    if(wavio_index_mode != WAVIO_INDEX_OFF && wavio_file_id(filename, &size, &mtime) == 0){
+        cached = 1;
+        if(wavio_index_lookup(filename, size, mtime, &index)){
+            *out = index.riff;
+            fseek(fp, (long)index.data_offset, SEEK_SET);
+            return (long)index.data_offset;
+        }
+    }
+
+    //clear the fields (the 2 and 4 byte fields below are unpacked into wider members)
+    memset(riff, 0, sizeof(RIFF));
+
+    //judge if the file equals to RIFF chunk
+    fread(riff->chunkID, 1, 4, fp);
+
+    //if the file doesn't have RIFF format
+    if(strncmp(riff->chunkID, "RIFF", 4) != 0){
+        return wavio_fail(WAVIO_ERROR_FORMAT, "The file does not have RIFF chunk.");
+    }
+
+    //Read each chunk
+    fread(field, 1, 4, fp);
+    riff->chunkSize = wavio_load_le32(field);
+    fread(riff->formType, 1, 4, fp);
+
+    //if the file is not WAV file.
+    if(strncmp(riff->formType, "WAVE", 4) != 0){
+        return wavio_fail(WAVIO_ERROR_FORMAT, "The file is not WAV file.");
+    }
+
+    //jump unnecessary chunks.
+    walked = wavio_walk_riff(fp, &index, &fmt_offset);
+    if(walked){
+        fseek(fp, (long)fmt_offset - 8, SEEK_SET);
+        fread(riff->fmt.chunkID, 1, 4, fp);
+    }else{
+        //chunk sizes are broken: scan from the first chunk
+        index.count = 0;
+        fseek(fp, 12, SEEK_SET);
+        fread(riff->fmt.chunkID, 1, 4, fp);
+        while(strncmp(riff->fmt.chunkID, "fmt ", 4) != 0){
+            //jump every 1 bite untile find the "fmt " chunk
+            fseek(fp, -3, SEEK_CUR);
+            if(fread(riff->fmt.chunkID, 1, 4, fp) != 4){
+                return wavio_fail(WAVIO_ERROR_FORMAT, "The file does not have fmt chunk.");
+            }
+        }
+    }
+
+    //Read fmt chunk (little-endian fields)
+    fread(field, 1, 20, fp);
+    riff->fmt.chunkSize = wavio_load_le32(field);
+    riff->fmt.waveFormatType = (int16_t)wavio_load_le16(field + 4);
+    riff->fmt.channel = (int16_t)wavio_load_le16(field + 6);
+    riff->fmt.samplesPerSec = wavio_load_le32(field + 8);
+    riff->fmt.bytesPerSec = wavio_load_le32(field + 12);
+    riff->fmt.blockSize = (int16_t)wavio_load_le16(field + 16);
+    riff->fmt.bitsPerSample = (int16_t)wavio_load_le16(field + 18);
+
+    //jump unnecessary chunks.
+    if(walked){
+        fseek(fp, (long)index.data_offset - 8, SEEK_SET);
+    }
+    fread(riff->data.chunkID, 1, 4, fp);
+    while (strncmp(riff->data.chunkID, "data", 4) != 0){
+        fseek(fp, -3, SEEK_CUR);
+        if(fread(riff->data.chunkID, 1, 4, fp) != 4){
+            return wavio_fail(WAVIO_ERROR_FORMAT, "The file does not have data chunk.");
+        }
+    }
+
+    //Read data chunk
+    fread(field, 1, 4, fp);
+    riff->data.chunkSize = wavio_load_le32(field);
+
+    //check the quantization bits
+    switch(riff->fmt.bitsPerSample){
+        case 8:
+        case 16:
+        case 24:
+        case 32:
+            break;
+
+        //Error
+        default:
+            return wavio_fail(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+    }
+
+    //for debug
+    /*
+    printf("RIFF ID : %4s\n", riff->chunkID);
+    printf("RIFF chunk size : %d\n", riff->chunkSize);
+    printf("Format type : %4s\n", riff->formType);
+    printf("Format Subchunk ID : %4s\n", riff->fmt.chunkID);
+    printf("chunkSize : %d\n", riff->fmt.chunkSize);
+    printf("waveFormatType : %d\n", riff->fmt.waveFormatType);
+    printf("Channel : %d\n", riff->fmt.channel);
+    printf("Fs : %d\n", riff->fmt.samplesPerSec);
+    printf("Bytes Per Sec : %d\n", riff->fmt.bytesPerSec);
+    printf("Block Size : %d\n", riff->fmt.blockSize);
+    printf("Bits : %d\n", riff->fmt.bitsPerSample);
+    printf("Data Subchunk ID : %4s\n", riff->data.chunkID);
+    printf("Data Subchunk Size : %d\n", riff->data.chunkSize);
+    */
+
+    offset = ftell(fp);
+    *out = parsed;
+
+    //remember the parse for the next open
+    if(cached){
+        index.riff = *riff;
+        index.riff.data.data = NULL;
+        index.data_offset = offset;
+        wavio_index_store(filename, size, mtime, &index);
+    }
+
+    return offset;
+}
+
+//Open a file and read its headers (NULL on error, riff is left untouched)
+static FILE *wavio_open_header(RIFF *riff, char *filename, long *offset){
+    FILE *fp = fopen(filename, "rb");
+
+    if(fp == NULL){
+        wavio_fail(WAVIO_ERROR_OPEN, "Cannot open the file.");
+        return NULL;
+    }
+
+    *offset = wavio_read_header(riff, fp, filename);
+    if(*offset < 0){
+        fclose(fp);
+        return NULL;
+    }
+
+    return fp;
+}
+
+//Read RIFF, fmt, and data chunks
+void wavread_RIFF(RIFF *riff, char *filename){
+    FILE *fp; /* File pointer */
+    long offset; /* offset of the data chunk body */
+    WAVIO_IO io; /* data chunk I/O */
+
+    //open the file and read the headers
+    fp = wavio_open_header(riff, filename, &offset);
+    if(fp == NULL){
+        return;
+    }
+
+    //Define data vector
+    riff->data.data = (int32_t *)calloc((unsigned)riff->data.chunkSize / (riff->fmt.bitsPerSample / 8), sizeof(int32_t));
+
+    //read the data chunk in bulk and unpack each block as it arrives
+    wavio_io_open(&io, fp, filename, offset, O_RDONLY);
+    if((riff->data.chunkSize > 0 && riff->data.data == NULL) || wavio_read_blocks(&io, riff->data.chunkSize, riff->fmt.bitsPerSample / 8, wavio_unpack_block, riff) < 0){
+        free(riff->data.data);
+        riff->data.data = NULL;
+        wavio_fail(WAVIO_ERROR_IO, "Cannot read the data chunk.");
+    }
+    wavio_io_close(&io);
+
+    //Close file
+    fclose(fp);
+}
+
+//Read PCMINFO (returns -1 after reporting the error, pcminfo is untouched then)
+int getPCMINFO(PCMINFO *pcminfo, char *filename){
+    //Define RIFF struct
+    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
+    FILE *fp; /* File pointer */
+    long offset; /* offset of the data chunk body */
+
+    if(riff == NULL){
+        return wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the header.");
+    }
+
+    //get RIFF header only
+    fp = wavio_open_header(riff, filename, &offset);
+    if(fp == NULL){
+        free(riff);
+        return -1;
+    }
+    fclose(fp);
+
+    //copy properties
+    pcminfo->filename = filename;
+    pcminfo->fs = riff->fmt.samplesPerSec;
+    pcminfo->bits = riff->fmt.bitsPerSample;
+    pcminfo->channel = riff->fmt.channel;
+
+    //free RIFF struct
+    free(riff);
+
+    return 0;
+}
+
+//Decode the data chunk straight into channel arrays
+//(reading the next block overlaps the conversion of the current one)
+//returns -1 if the arrays are missing or a read failed (the arrays are freed)
+static int wavio_read_decode(FILE *fp, char *filename, long offset, WAVIO_DECODE *dec, int32_t length){
+    uint64_t frame = dec->channel * (dec->bits / 8); /* bytes per frame */
+    WAVIO_IO io; /* data chunk I/O */
+    int64_t got = -1;
+    int c;
+
+    dec->level = NULL;
+    dec->start = 0;
+    dec->length = (dec->ops != NULL && dec->ops->length > 0) ? (uint64_t)dec->ops->length : (uint64_t)length;
+    for(c = 0; c < dec->channel; c++){
+        if(length > 0 && dec->native[c] == NULL && dec->pcm[c] == NULL){
+            break;
+        }
+    }
+    if(c == dec->channel){
+        wavio_io_open(&io, fp, filename, offset, O_RDONLY);
+        got = wavio_read_blocks(&io, (uint64_t)length * frame, frame, wavio_decode_block, dec);
+        wavio_io_close(&io);
+    }
+
+    if(got < 0){
+        for(c = 0; c < 2; c++){
+            free(dec->native[c]);
+            free(dec->pcm[c]);
+        }
+        return wavio_fail(WAVIO_ERROR_IO, "Cannot read the data chunk.");
+    }
+
+    return 0;
+}
+
+//Read and insert STEREO_PCM_NATIVE data
+void wavread_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename){
+    //Define RIFF struct
+    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
+    FILE *fp; /* File pointer */
+    long offset; /* offset of the data chunk body */
+    WAVIO_DECODE dec; /* decode destination */
+    int32_t length; /* frames */
+
+    //open the file and read the headers
+    fp = wavio_open_header(riff, filename, &offset);
+    if(fp == NULL){
+        free(riff);
+        return;
+    }
+
+    //initialize the data vector
+    length = riff->data.chunkSize / (2 * (riff->fmt.bitsPerSample / 8));
+    dec.native[0] = (int32_t *)calloc(length, sizeof(int32_t));
+    dec.native[1] = (int32_t *)calloc(length, sizeof(int32_t));
+
+    //decode data chunk into the data vector (the struct is only filled in when it succeeds)
+    dec.channel = 2;
+    dec.pcm[0] = dec.pcm[1] = NULL;
+    dec.ops = NULL;
+    dec.bits = riff->fmt.bitsPerSample;
+    if(wavio_read_decode(fp, filename, offset, &dec, length) == 0){
+        //copy pcm_spec
+        stereo_pcm_native->pcm_spec.fs = riff->fmt.samplesPerSec;
+        stereo_pcm_native->pcm_spec.bits = riff->fmt.bitsPerSample;
+        stereo_pcm_native->pcm_spec.length = length;
+        stereo_pcm_native->data[0] = dec.native[0];
+        stereo_pcm_native->data[1] = dec.native[1];
+    }
+
+    //Close file
+    fclose(fp);
+
+    //free RIFF struct
+    free(riff);
+}
+
+//Read data and insert STEREO_PCM struct
+void wavread_Stereo(STEREO_PCM *stereo_pcm, char *filename){
+    wavread_Stereo_Ops(stereo_pcm, filename, NULL);
+}
+
+//Read data and insert STEREO_PCM struct, applying (and measuring for) the operators while decoding
+void wavread_Stereo_Ops(STEREO_PCM *stereo_pcm, char *filename, WAVIO_OPS *ops){
+    //Define RIFF struct
+    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
+    FILE *fp; /* File pointer */
+    long offset; /* offset of the data chunk body */
+    WAVIO_DECODE dec; /* decode destination */
+    int32_t length; /* frames */
+
+    //open the file and read the headers
+    fp = wavio_open_header(riff, filename, &offset);
+    if(fp == NULL){
+        free(riff);
+        return;
+    }
+
+    //initialize the data vector
+    length = riff->data.chunkSize / (2 * (riff->fmt.bitsPerSample / 8));
+    dec.pcm[0] = (double *)calloc(length, sizeof(double));
+    dec.pcm[1] = (double *)calloc(length, sizeof(double));
+
+    //decode data chunk into the data vector (8bit is unsigned, the others are signed)
+    dec.channel = 2;
+    dec.native[0] = dec.native[1] = NULL;
+    dec.ops = ops;
+    dec.bits = riff->fmt.bitsPerSample;
+    if(wavio_read_decode(fp, filename, offset, &dec, length) == 0){
+        //copy PCM properties
+        stereo_pcm->pcm_spec.fs = riff->fmt.samplesPerSec;
+        stereo_pcm->pcm_spec.bits = riff->fmt.bitsPerSample;
+        stereo_pcm->pcm_spec.length = length;
+        stereo_pcm->data[0] = dec.pcm[0];
+        stereo_pcm->data[1] = dec.pcm[1];
+    }
+
+    //Close file
+    fclose(fp);
+
+    //free RIFF struct
+    free(riff);
+}
+
+//Read data and insert MONO_PCM_NATIVE struct
+void wavread_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename){
+    //Define RIFF struct
+    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
+    FILE *fp; /* File pointer */
+    long offset; /* offset of the data chunk body */
+    WAVIO_DECODE dec; /* decode destination */
+    int32_t length; /* frames */
+
+    //open the file and read the headers
+    fp = wavio_open_header(riff, filename, &offset);
+    if(fp == NULL){
+        free(riff);
+        return;
+    }
+
+    //initialize the data vector
+    length = riff->data.chunkSize / (riff->fmt.bitsPerSample / 8);
+    dec.native[0] = (int32_t *)calloc(length, sizeof(int32_t));
+
+    //decode data chunk into the data vector (the struct is only filled in when it succeeds)
+    dec.channel = 1;
+    dec.native[1] = NULL;
+    dec.pcm[0] = dec.pcm[1] = NULL;
+    dec.ops = NULL;
+    dec.bits = riff->fmt.bitsPerSample;
+    if(wavio_read_decode(fp, filename, offset, &dec, length) == 0){
+        //copy pcm_spec from riff
+        mono_pcm_native->pcm_spec.fs = riff->fmt.samplesPerSec;
+        mono_pcm_native->pcm_spec.bits = riff->fmt.bitsPerSample;
+        mono_pcm_native->pcm_spec.length = length;
+        mono_pcm_native->data = dec.native[0];
+    }
+
+    //Close file
+    fclose(fp);
+
+    //free RIFF struct
+    free(riff);
+}
+
+//Read data and insert MONO_PCM struct
+void wavread_Mono(MONO_PCM *mono_pcm, char *filename){
+    wavread_Mono_Ops(mono_pcm, filename, NULL);
+}
+
+//Read data and insert MONO_PCM struct, applying (and measuring for) the operators while decoding
+void wavread_Mono_Ops(MONO_PCM *mono_pcm, char *filename, WAVIO_OPS *ops){
+    //Define RIFF struct
+    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
+    FILE *fp; /* File pointer */
+    long offset; /* offset of the data chunk body */
+    WAVIO_DECODE dec; /* decode destination */
+    int32_t length; /* frames */
+
+    //open the file and read the headers
+    fp = wavio_open_header(riff, filename, &offset);
+    if(fp == NULL){
+        free(riff);
+        return;
+    }
+
+    //initialize the data vector
+    length = riff->data.chunkSize / (riff->fmt.bitsPerSample / 8);
+    dec.pcm[0] = (double *)calloc(length, sizeof(double));
+
+    //decode data chunk into the data vector (8bit is unsigned, the others are signed)
+    dec.channel = 1;
+    dec.native[0] = dec.native[1] = NULL;
+    dec.pcm[1] = NULL;
+    dec.ops = ops;
+    dec.bits = riff->fmt.bitsPerSample;
+    if(wavio_read_decode(fp, filename, offset, &dec, length) == 0){
+        //copy PCM_SPEC from RIFF
+        mono_pcm->pcm_spec.fs = riff->fmt.samplesPerSec;
+        mono_pcm->pcm_spec.bits = riff->fmt.bitsPerSample;
+        mono_pcm->pcm_spec.length = length;
+        mono_pcm->data = dec.pcm[0];
+    }
+
+    //Close file
+    fclose(fp);
+
+    //free RIFF struct
+    free(riff);
+}
+
+//Read the data chunk into COMPACT channel arrays (channel: 1 or 2)
+static void wavio_read_compact(PCM_SPEC *pcm_spec, void **data, int16_t channel, char *filename){
+    //Define RIFF struct
+    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
+    FILE *fp; /* File pointer */
+    long offset; /* offset of the data chunk body */
+    uint64_t frame; /* bytes per frame */
+    WAVIO_COMPACT com; /* decode destination */
+    WAVIO_IO io; /* data chunk I/O */
+    int32_t length; /* frames */
+    int64_t got = -1;
+    int c;
+
+    //open the file and read the headers
+    fp = wavio_open_header(riff, filename, &offset);
+    if(fp == NULL){
+        free(riff);
+        return;
+    }
+
+    //initialize the data vector at the sample width of the file
+    length = riff->data.chunkSize / (channel * (riff->fmt.bitsPerSample / 8));
+    com.bits = riff->fmt.bitsPerSample;
+    com.channel = channel;
+    com.data[1] = NULL;
+    for(c = 0; c < channel; c++){
+        com.data[c] = calloc(length, wavio_compact_bytes(com.bits));
+    }
+
+    //deinterleave data chunk into the data vector in one pass
+    frame = channel * (com.bits / 8);
+    if(length == 0 || (com.data[0] != NULL && (channel == 1 || com.data[1] != NULL))){
+        wavio_io_open(&io, fp, filename, offset, O_RDONLY);
+        got = wavio_read_blocks(&io, (uint64_t)length * frame, frame, wavio_compact_decode_block, &com);
+        wavio_io_close(&io);
+    }
+
+    //copy PCM_SPEC from RIFF (the struct is only filled in when the read succeeds)
+    if(got < 0){
+        free(com.data[0]);
+        free(com.data[1]);
+        wavio_fail(WAVIO_ERROR_IO, "Cannot read the data chunk.");
+    }else{
+        pcm_spec->fs = riff->fmt.samplesPerSec;
+        pcm_spec->bits = riff->fmt.bitsPerSample;
+        pcm_spec->length = length;
+        for(c = 0; c < channel; c++){
+            data[c] = com.data[c];
+        }
+    }
+
+    //Close file
+    fclose(fp);
+
+    //free RIFF struct
+    free(riff);
+}
+
+//Read data and insert STEREO_PCM_COMPACT struct
+void wavread_Stereo_Compact(STEREO_PCM_COMPACT *stereo_pcm_compact, char *filename){
+    wavio_read_compact(&stereo_pcm_compact->pcm_spec, stereo_pcm_compact->data, 2, filename);
+}
+
+//Read data and insert MONO_PCM_COMPACT struct
+void wavread_Mono_Compact(MONO_PCM_COMPACT *mono_pcm_compact, char *filename){
+    wavio_read_compact(&mono_pcm_compact->pcm_spec, &mono_pcm_compact->data, 1, filename);
+}
+
+//Read data and insert INTERLEAVED_PCM struct (any number of channels, frames as in the file)
+void wavread_Interleaved(INTERLEAVED_PCM *interleaved_pcm, char *filename){
+    //Define RIFF struct
+    RIFF *riff = (RIFF *)malloc(sizeof(RIFF));
+    FILE *fp; /* File pointer */
+    long offset; /* offset of the data chunk body */
+    uint64_t frame; /* bytes per frame */
+    WAVIO_COMPACT com; /* decode destination */
+    WAVIO_IO io; /* data chunk I/O */
+    int32_t length; /* frames */
+    int64_t got = -1;
+
+    //open the file and read the headers
+    fp = wavio_open_header(riff, filename, &offset);
+    if(fp == NULL){
+        free(riff);
+        return;
+    }
+
+    //initialize the data vector at the sample width of the file
+    frame = riff->fmt.channel * (riff->fmt.bitsPerSample / 8);
+    length = (frame > 0) ? (int32_t)(riff->data.chunkSize / frame) : 0;
+    com.bits = riff->fmt.bitsPerSample;
+    com.channel = riff->fmt.channel;
+    com.data[0] = calloc((uint64_t)length * riff->fmt.channel, wavio_compact_bytes(riff->fmt.bitsPerSample));
+    com.data[1] = NULL;
+
+    //copy data chunk into the data vector (widening only 24bit)
+    if(length == 0 || com.data[0] != NULL){
+        wavio_io_open(&io, fp, filename, offset, O_RDONLY);
+        got = wavio_read_blocks(&io, (uint64_t)length * frame, frame, wavio_interleaved_decode_block, &com);
+        wavio_io_close(&io);
+    }
+
+    //copy PCM_SPEC from RIFF (the struct is only filled in when the read succeeds)
+    if(got < 0){
+        free(com.data[0]);
+        wavio_fail(WAVIO_ERROR_IO, "Cannot read the data chunk.");
+    }else{
+        interleaved_pcm->channel = riff->fmt.channel;
+        interleaved_pcm->pcm_spec.fs = riff->fmt.samplesPerSec;
+        interleaved_pcm->pcm_spec.bits = riff->fmt.bitsPerSample;
+        interleaved_pcm->pcm_spec.length = length;
+        interleaved_pcm->data = com.data[0];
+    }
+
+    //Close file
+    fclose(fp);
+
+    //free RIFF struct
+    free(riff);
+}
+
+//Open a WAV file for block-by-block reading
+WAVREADER *wavopen_Reader(char *filename){
+    //allocate WAVREADER struct
+    WAVREADER *reader = (WAVREADER *)malloc(sizeof(WAVREADER));
+    RIFF *riff = (RIFF *)malloc(sizeof(RIFF)); /* header */
+    long offset; /* offset of the data chunk body */
+
+    if(reader == NULL || riff == NULL){
+        free(riff);
+        free(reader);
+        wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the reader.");
+        return NULL;
+    }
+
+    //open the file and read the headers
+    reader->fp = wavio_open_header(riff, filename, &offset);
+    if(reader->fp == NULL){
+        free(riff);
+        free(reader);
+        return NULL;
+    }
+
+    //Mono and Stereo only
+    if(riff->fmt.channel < 1 || riff->fmt.channel > 2){
+        fclose(reader->fp);
+        free(riff);
+        free(reader);
+        wavio_fail(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+        return NULL;
+    }
+
+    //copy properties
+    reader->pcm_spec.fs = riff->fmt.samplesPerSec;
+    reader->pcm_spec.bits = riff->fmt.bitsPerSample;
+    reader->pcm_spec.length = riff->data.chunkSize / (riff->fmt.channel * (riff->fmt.bitsPerSample / 8));
+    reader->channel = riff->fmt.channel;
+    reader->position = 0;
+    reader->level_mode = wavio_level_mode;
+    wavio_level_init(&reader->level);
+    reader->level.channel = reader->channel;
+
+    //data chunk I/O and raw block buffer
+    reader->io = malloc(sizeof(WAVIO_IO));
+    if(reader->io == NULL){
+        fclose(reader->fp);
+        free(riff);
+        free(reader);
+        wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the reader.");
+        return NULL;
+    }
+    wavio_io_open((WAVIO_IO *)reader->io, reader->fp, filename, offset, O_RDONLY);
+    reader->buf = wavio_alloc_block(wavio_block_size(reader->channel * (reader->pcm_spec.bits / 8)));
+
+    free(riff);
+
+    if(reader->buf == NULL){
+        wavclose_Reader(reader);
+        wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the block buffer.");
+        return NULL;
+    }
+
+    return reader;
+}
+
+//Read up to frames frames from the reader into the decode destination
+static int32_t wavio_reader_decode(WAVREADER *reader, WAVIO_DECODE *dec, int32_t frames){
+    uint64_t frame = reader->channel * (reader->pcm_spec.bits / 8); /* bytes per frame */
+    uint64_t block = wavio_block_size(frame) / frame; /* frames per block */
+    uint64_t n, got;
+    int32_t done = 0; /* frames decoded */
+    WAVIO_DECODE part; /* destination of the current block */
+    uint8_t *raw;
+    int c;
+
+    dec->bits = reader->pcm_spec.bits;
+    dec->channel = reader->channel;
+    dec->level = (reader->level_mode != WAVIO_LEVEL_OFF) ? &reader->level : NULL;
+    dec->length = (dec->ops != NULL && dec->ops->length > 0) ? (uint64_t)dec->ops->length : (uint64_t)reader->pcm_spec.length;
+
+    while(done < frames && reader->position < (uint64_t)reader->pcm_spec.length){
+        n = (uint64_t)(frames - done);
+        if(n > block){
+            n = block;
+        }
+        if(n > (uint64_t)reader->pcm_spec.length - reader->position){
+            n = (uint64_t)reader->pcm_spec.length - reader->position;
+        }
+
+        got = wavio_io_read((WAVIO_IO *)reader->io, reader->buf, n * frame, reader->position * frame, &raw) / frame;
+        if(got == 0){
+            break;
+        }
+
+        //decode into the arrays at the current position
+        part = *dec;
+        for(c = 0; c < dec->channel; c++){
+            part.native[c] = (dec->native[c] != NULL) ? dec->native[c] + done : NULL;
+            part.pcm[c] = (dec->pcm[c] != NULL) ? dec->pcm[c] + done : NULL;
+        }
+        part.start = reader->position;
+        wavio_decode_block(&part, raw, 0, got * frame);
+
+        reader->position += got;
+        done += (int32_t)got;
+    }
+
+    return done;
+}
+
+//Read the next frames into [-1, 1] channel arrays (data[0]: L or Mono, data[1]: R)
+//returns the number of frames read (0 at the end of the data)
+int32_t wavread_Reader(WAVREADER *reader, double **data, int32_t frames){
+    return wavread_Reader_Ops(reader, data, frames, NULL);
+}
+
+//Read the next frames into [-1, 1] channel arrays, applying (and measuring for) the operators
+//returns the number of frames read (0 at the end of the data)
+int32_t wavread_Reader_Ops(WAVREADER *reader, double **data, int32_t frames, WAVIO_OPS *ops){
+    WAVIO_DECODE dec; /* decode destination */
+    int c;
+
+    for(c = 0; c < 2; c++){
+        dec.native[c] = NULL;
+        dec.pcm[c] = (c < reader->channel) ? data[c] : NULL;
+    }
+    dec.ops = ops;
+
+    return wavio_reader_decode(reader, &dec, frames);
+}
+
+//Read the next frames into NATIVE channel arrays
+//returns the number of frames read (0 at the end of the data)
+int32_t wavread_Reader_Native(WAVREADER *reader, int32_t **data, int32_t frames){
+    WAVIO_DECODE dec; /* decode destination */
+    int c;
+
+    for(c = 0; c < 2; c++){
+        dec.native[c] = (c < reader->channel) ? data[c] : NULL;
+        dec.pcm[c] = NULL;
+    }
+    dec.ops = NULL;
+
+    return wavio_reader_decode(reader, &dec, frames);
+}
+
+//Read the next frames interleaved at the COMPACT width (data: frames * channel samples)
+//returns the number of frames read (0 at the end of the data)
+int32_t wavread_Reader_Interleaved(WAVREADER *reader, void *data, int32_t frames){
+    uint64_t frame = reader->channel * (reader->pcm_spec.bits / 8); /* bytes per frame */
+    uint64_t block = wavio_block_size(frame) / frame; /* frames per block */
+    uint64_t sample = reader->channel * wavio_compact_bytes(reader->pcm_spec.bits); /* bytes per frame in data */
+    uint64_t n, got;
+    int32_t done = 0; /* frames read */
+    WAVIO_COMPACT com; /* destination of the current block */
+    uint8_t *raw;
+
+    com.bits = reader->pcm_spec.bits;
+    com.channel = reader->channel;
+    com.data[1] = NULL;
+
+    while(done < frames && reader->position < (uint64_t)reader->pcm_spec.length){
+        n = (uint64_t)(frames - done);
+        if(n > block){
+            n = block;
+        }
+        if(n > (uint64_t)reader->pcm_spec.length - reader->position){
+            n = (uint64_t)reader->pcm_spec.length - reader->position;
+        }
+
+        got = wavio_io_read((WAVIO_IO *)reader->io, reader->buf, n * frame, reader->position * frame, &raw) / frame;
+        if(got == 0){
+            break;
+        }
+
+        //copy into the array at the current position
+        com.data[0] = (uint8_t *)data + done * sample;
+        wavio_interleaved_decode_block(&com, raw, 0, got * frame);
+        if(reader->level_mode != WAVIO_LEVEL_OFF){
+            wavio_level_raw(&reader->level, raw, got, reader->channel, reader->pcm_spec.bits, reader->position);
+        }
+
+        reader->position += got;
+        done += (int32_t)got;
+    }
+
+    return done;
+}
+
+//Close the reader
+void wavclose_Reader(WAVREADER *reader){
+    wavio_io_close((WAVIO_IO *)reader->io);
+    fclose(reader->fp);
+    free(reader->io);
+    free(reader->buf);
+    free(reader);
+}
+
+//Write RIFF, fmt chunk and the data chunk header (returns 0 if it could not be written)
+static int wavio_write_header(RIFF *riff, FILE *fp){
+    uint8_t head[44]; /* packed little-endian header */
+
+    memcpy(head, riff->chunkID, 4); /* "RIFF" */
+    wavio_store_le32(head + 4, (uint32_t)riff->chunkSize);
+    memcpy(head + 8, riff->formType, 4); /* "WAVE" */
+    memcpy(head + 12, riff->fmt.chunkID, 4); /* "fmt " */
+    wavio_store_le32(head + 16, (uint32_t)riff->fmt.chunkSize);
+    wavio_store_le16(head + 20, (uint16_t)riff->fmt.waveFormatType); /* PCM: 1 */
+    wavio_store_le16(head + 22, (uint16_t)riff->fmt.channel); /* Mono: 1, Stereo: 2 */
+    wavio_store_le32(head + 24, (uint32_t)riff->fmt.samplesPerSec); /* Sampling frequency */
+    wavio_store_le32(head + 28, (uint32_t)riff->fmt.bytesPerSec);
+    wavio_store_le16(head + 32, (uint16_t)riff->fmt.blockSize);
+    wavio_store_le16(head + 34, (uint16_t)riff->fmt.bitsPerSample); /* Quantization bit */
+    memcpy(head + 36, riff->data.chunkID, 4); /* data */
+    wavio_store_le32(head + 40, riff->data.chunkSize);
+
+    return fwrite(head, 1, sizeof(head), fp) == sizeof(head) && fflush(fp) == 0;
+}
+
+//Close a file written by a whole-file writer (ok: 0 if the header or the data chunk fell short)
+static void wavio_close_written(FILE *fp, int ok){
+    if(fclose(fp) != 0 || !ok){
+        wavio_fail(WAVIO_ERROR_IO, "Cannot write the file.");
+    }
+}
+
+//save WAV file from RIFF struct
+void wavwrite_RIFF(RIFF *riff, char *filename){
+    //variable
+    FILE *fp; /* for write wav file */
+    long offset; /* offset of the data chunk body */
+    WAVIO_IO io; /* data chunk I/O */
+    RIFF header = *riff; /* header as written (riff itself is not modified) */
+    int ok; /* 0 once a write fell short */
+
+    //check the quantization bits
+    switch(riff->fmt.bitsPerSample){
+        case 8:
+        case 16:
+        case 24:
+        case 32:
+            break;
+
+        default:
+            wavio_fail(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+            return;
+    }
+
+    //open file name with writing name (readable for the O_DIRECT header block)
+    fp = fopen(filename, "w+b");
+    if(fp == NULL){
+        wavio_fail(WAVIO_ERROR_OPEN, "Cannot open the file.");
+        return;
+    }
+
+    header.fmt.chunkSize = 16;
+    header.fmt.waveFormatType = 1;
+
+    //for debug
+    /* 
+    printf("RIFF ID : %4s\n", riff->chunkID);
+    printf("RIFF chunk size : %d\n", riff->chunkSize);
+    printf("Format type : %4s\n", riff->formType);
+    printf("Format Subchunk ID : %4s\n", riff->fmt.chunkID);
+    printf("Format Subchunk Size : %d\n", riff->fmt.chunkSize);
+    printf("waveFormatType : %d\n", riff->fmt.waveFormatType);
+    printf("Channel : %d\n", riff->fmt.channel);
+    printf("Fs : %d\n", riff->fmt.samplesPerSec);
+    printf("Bytes Per Sec : %d\n", riff->fmt.bytesPerSec);
+    printf("Block Size : %d\n", riff->fmt.blockSize);
+    printf("Bits : %d\n", riff->fmt.bitsPerSample);
+    printf("Data Subchunk ID : %4s\n", riff->data.chunkID);
+    printf("Data Subchunk Size : %d\n", riff->data.chunkSize);
+    */
+
+    //write each chunk
+    ok = wavio_write_header(&header, fp);
+
+    //write the data chunk in bulk, packing the next block while earlier ones are written
+    offset = ftell(fp);
+    wavio_io_open(&io, fp, filename, offset, O_WRONLY);
+    ok &= wavio_write_blocks(&io, fileno(fp), riff->data.chunkSize, riff->fmt.bitsPerSample / 8, wavio_pack_block, riff) == riff->data.chunkSize;
+    wavio_io_close(&io);
+
+    //save WAV file
+    wavio_close_written(fp, ok);
+}
+
+//Fill the fields of RIFF struct for a PCM file (data.data is left untouched)
+static void wavio_init_header(RIFF *riff, uint64_t fs, int16_t bits, int16_t channel, uint32_t size){
+    memcpy(riff->chunkID, "RIFF", 4);
+    memcpy(riff->formType, "WAVE", 4);
+    memcpy(riff->fmt.chunkID, "fmt ", 4);
+    riff->fmt.chunkSize = 16;
+    riff->fmt.waveFormatType = 1;
+    riff->fmt.channel = channel;
+    riff->fmt.samplesPerSec = fs;
+    riff->fmt.blockSize = channel * (bits / 8);
+    riff->fmt.bytesPerSec = riff->fmt.blockSize * riff->fmt.samplesPerSec;
+    riff->fmt.bitsPerSample = bits;
+    memcpy(riff->data.chunkID, "data", 4);
+    riff->data.chunkSize = size;
+    riff->chunkSize = riff->data.chunkSize + 36;
+}
+
+//Open a WAV file for block-by-block writing (sizes are filled in by wavclose_Writer)
+WAVWRITER *wavopen_Writer(char *filename, uint64_t fs, int16_t bits, int16_t channel){
+    //allocate WAVWRITER struct
+    WAVWRITER *writer;
+    RIFF riff; /* header */
+    WAVIO_IO *io; /* data chunk I/O */
+
+    //check the format
+    if((bits != 8 && bits != 16 && bits != 24 && bits != 32) || channel < 1 || channel > 2){
+        wavio_fail(WAVIO_ERROR_BITS, "Inappropriate quantization bit number or channel number.");
+        return NULL;
+    }
+
+    writer = (WAVWRITER *)malloc(sizeof(WAVWRITER));
+    if(writer == NULL){
+        wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the writer.");
+        return NULL;
+    }
+    writer->pcm_spec.fs = fs;
+    writer->pcm_spec.bits = bits;
+    writer->pcm_spec.length = 0;
+    writer->channel = channel;
+    writer->fill = 0;
+    writer->written = 0;
+    writer->failed = 0;
+    writer->level_mode = wavio_level_mode;
+    wavio_level_init(&writer->level);
+    writer->level.channel = channel;
+
+    //write the header with an empty data chunk
+    writer->fp = fopen(filename, "w+b");
+    if(writer->fp == NULL){
+        free(writer);
+        wavio_fail(WAVIO_ERROR_OPEN, "Cannot open the file.");
+        return NULL;
+    }
+    wavio_init_header(&riff, fs, bits, channel, 0);
+    io = wavio_write_header(&riff, writer->fp) ? (WAVIO_IO *)malloc(sizeof(WAVIO_IO)) : NULL;
+    if(io == NULL){
+        fclose(writer->fp);
+        free(writer);
+        wavio_fail(WAVIO_ERROR_IO, "Cannot write the header.");
+        return NULL;
+    }
+
+    //data chunk I/O (blocks of any size are written, so O_DIRECT falls back to DONTNEED)
+    wavio_io_open(io, writer->fp, filename, ftell(writer->fp), O_WRONLY);
+    if(io->own_fd){
+        close(io->fd);
+        io->fd = fileno(writer->fp);
+        io->own_fd = 0;
+        io->mode = WAVIO_CACHE_DONTNEED;
+    }
+    writer->io = io;
+    writer->buf = wavio_alloc_block(wavio_block_size(channel * (bits / 8)));
+    if(writer->buf == NULL){
+        wavio_io_close(io);
+        fclose(writer->fp);
+        free(io);
+        free(writer);
+        wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the block buffer.");
+        return NULL;
+    }
+
+    return writer;
+}
+
+//Write the filled part of the block buffer
+static void wavio_writer_flush(WAVWRITER *writer){
+    WAVIO_IO *io = (WAVIO_IO *)writer->io;
+    uint64_t done; /* bytes written */
+
+    if(writer->fill == 0){
+        return;
+    }
+
+    done = wavio_pwrite_full(io->fd, writer->buf, writer->fill, io->offset + writer->written);
+    wavio_io_drop(io, writer->written, done, 1);
+    writer->written += done;
+
+    //report the first short write (wavclose_Writer reports it again)
+    if(done < writer->fill && !writer->failed){
+        writer->failed = 1;
+        wavio_fail(WAVIO_ERROR_IO, "Cannot write the data chunk.");
+    }
+    writer->fill = 0;
+}
+
+//Encode frames from the channel arrays into the block buffer
+static void wavio_writer_encode(WAVWRITER *writer, WAVIO_DECODE *enc, int32_t frames){
+    uint64_t frame = writer->channel * (writer->pcm_spec.bits / 8); /* bytes per frame */
+    uint64_t block = wavio_block_size(frame); /* bytes per block */
+    uint64_t n;
+    int32_t done = 0; /* frames encoded */
+    WAVIO_DECODE part; /* source of the current part */
+    int c;
+
+    enc->bits = writer->pcm_spec.bits;
+    enc->channel = writer->channel;
+    enc->level = (writer->level_mode != WAVIO_LEVEL_OFF) ? &writer->level : NULL;
+    enc->length = (enc->ops != NULL && enc->ops->length > 0) ? (uint64_t)enc->ops->length : UINT64_MAX;
+
+    while(done < frames){
+        n = (block - writer->fill) / frame;
+        if(n > (uint64_t)(frames - done)){
+            n = (uint64_t)(frames - done);
+        }
+
+        //encode from the arrays at the current position
+        part = *enc;
+        for(c = 0; c < enc->channel; c++){
+            part.native[c] = (enc->native[c] != NULL) ? enc->native[c] + done : NULL;
+            part.pcm[c] = (enc->pcm[c] != NULL) ? enc->pcm[c] + done : NULL;
+        }
+        part.start = (uint64_t)writer->pcm_spec.length;
+        wavio_encode_block(&part, writer->buf + writer->fill, 0, n * frame);
+
+        writer->fill += n * frame;
+        writer->pcm_spec.length += (int32_t)n;
+        done += (int32_t)n;
+
+        //write full blocks
+        if(writer->fill + frame > block){
+            wavio_writer_flush(writer);
+        }
+    }
+}
+
+//Write frames from [-1, 1] channel arrays (data[0]: L or Mono, data[1]: R)
+void wavwrite_Writer(WAVWRITER *writer, double **data, int32_t frames){
+    wavwrite_Writer_Ops(writer, data, frames, NULL);
+}
+
+//Write frames from [-1, 1] channel arrays, applying the operators (ops->length ends the fade-out)
+void wavwrite_Writer_Ops(WAVWRITER *writer, double **data, int32_t frames, WAVIO_OPS *ops){
+    WAVIO_DECODE enc; /* encode source */
+    int c;
+
+    for(c = 0; c < 2; c++){
+        enc.native[c] = NULL;
+        enc.pcm[c] = (c < writer->channel) ? data[c] : NULL;
+    }
+    enc.ops = ops;
+
+    wavio_writer_encode(writer, &enc, frames);
+}
+
+//Write frames from NATIVE channel arrays
+void wavwrite_Writer_Native(WAVWRITER *writer, int32_t **data, int32_t frames){
+    WAVIO_DECODE enc; /* encode source */
+    int c;
+
+    for(c = 0; c < 2; c++){
+        enc.native[c] = (c < writer->channel) ? data[c] : NULL;
+        enc.pcm[c] = NULL;
+    }
+    enc.ops = NULL;
+
+    wavio_writer_encode(writer, &enc, frames);
+}
+
+//Write interleaved frames at the COMPACT width (data: frames * channel samples)
+void wavwrite_Writer_Interleaved(WAVWRITER *writer, const void *data, int32_t frames){
+    uint64_t frame = writer->channel * (writer->pcm_spec.bits / 8); /* bytes per frame */
+    uint64_t block = wavio_block_size(frame); /* bytes per block */
+    uint64_t sample = writer->channel * wavio_compact_bytes(writer->pcm_spec.bits); /* bytes per frame in data */
+    uint64_t n;
+    int32_t done = 0; /* frames copied */
+    WAVIO_COMPACT com; /* source of the current part */
+
+    com.bits = writer->pcm_spec.bits;
+    com.channel = writer->channel;
+    com.data[1] = NULL;
+
+    while(done < frames){
+        n = (block - writer->fill) / frame;
+        if(n > (uint64_t)(frames - done)){
+            n = (uint64_t)(frames - done);
+        }
+
+        //copy from the array at the current position
+        com.data[0] = (uint8_t *)data + done * sample;
+        wavio_interleaved_encode_block(&com, writer->buf + writer->fill, 0, n * frame);
+        if(writer->level_mode != WAVIO_LEVEL_OFF){
+            wavio_level_raw(&writer->level, writer->buf + writer->fill, n, writer->channel, writer->pcm_spec.bits, (uint64_t)writer->pcm_spec.length);
+        }
+
+        writer->fill += n * frame;
+        writer->pcm_spec.length += (int32_t)n;
+        done += (int32_t)n;
+
+        //write full blocks
+        if(writer->fill + frame > block){
+            wavio_writer_flush(writer);
+        }
+    }
+}
+
+//Write the remaining frames, fill in the chunk sizes and close the writer
+void wavclose_Writer(WAVWRITER *writer){
+    WAVIO_IO *io = (WAVIO_IO *)writer->io;
+    uint8_t size[4]; /* little-endian chunk size */
+    uint64_t tail = 0; /* bytes after the data chunk */
+    int ok; /* 0 once a write fell short */
+
+    wavio_writer_flush(writer);
+
+    //PEAK and "rms " chunks after the data chunk
+    if(writer->level_mode == WAVIO_LEVEL_CHUNK){
+        tail = wavio_write_levels(fileno(writer->fp), io->offset, writer->written, &writer->level);
+    }
+
+    //RIFF chunk size and data chunk size
+    wavio_store_le32(size, (uint32_t)(io->offset - 8 + writer->written + tail));
+    ok = wavio_pwrite_full(io->fd, size, 4, 4) == 4;
+    wavio_store_le32(size, (uint32_t)writer->written);
+    ok &= wavio_pwrite_full(io->fd, size, 4, io->offset - 4) == 4;
+
+    wavio_io_close(io);
+    if(fclose(writer->fp) != 0 || !ok || writer->failed){
+        wavio_fail(WAVIO_ERROR_IO, "Cannot write the file.");
+    }
+    free(writer->io);
+    free(writer->buf);
+    free(writer);
+}
+
+//Append the PEAK and "rms " chunks after the data chunk of a whole-file writer (size bytes at offset) and fix the RIFF chunk size
+//returns 0 if a write fell short
+static int wavio_write_level_chunks(FILE *fp, long offset, uint64_t size, WAVIO_LEVEL *level){
+    uint8_t riff_size[4]; /* little-endian RIFF chunk size */
+
+    wavio_store_le32(riff_size, (uint32_t)(offset - 8 + size + wavio_write_levels(fileno(fp), (uint64_t)offset, size, level)));
+    return wavio_pwrite_full(fileno(fp), riff_size, 4, 4) == 4;
+}
+
+//Write channel arrays as a WAV file (the arrays and their struct are only read)
+static void wavio_write_arrays(PCM_SPEC *pcm_spec, int16_t channel, WAVIO_DECODE *enc, char *filename){
+    RIFF riff; /* header */
+    FILE *fp; /* for write wav file */
+    long offset; /* offset of the data chunk body */
+    WAVIO_IO io; /* data chunk I/O */
+    WAVIO_LEVEL level; /* peak and RMS for the PEAK and "rms " chunks */
+    int ok; /* 0 once a write fell short */
+
+    //check the quantization bits
+    switch(pcm_spec->bits){
+        case 8:
+        case 16:
+        case 24:
+        case 32:
+            break;
+
+        default:
+            wavio_fail(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+            return;
+    }
+
+    //open file name with writing name (readable for the O_DIRECT header block)
+    fp = fopen(filename, "w+b");
+    if(fp == NULL){
+        wavio_fail(WAVIO_ERROR_OPEN, "Cannot open the file.");
+        return;
+    }
+
+    //write each chunk
+    wavio_init_header(&riff, pcm_spec->fs, pcm_spec->bits, channel, (uint32_t)pcm_spec->length * channel * (pcm_spec->bits / 8));
+    ok = wavio_write_header(&riff, fp);
+
+    //clip, quantize and interleave the arrays block by block into the data chunk
+    enc->bits = pcm_spec->bits;
+    enc->channel = channel;
+    enc->level = NULL;
+    if(wavio_level_mode == WAVIO_LEVEL_CHUNK){
+        wavio_level_init(&level);
+        enc->level = &level;
+    }
+    enc->start = 0;
+    enc->length = (enc->ops != NULL && enc->ops->length > 0) ? (uint64_t)enc->ops->length : (uint64_t)pcm_spec->length;
+    offset = ftell(fp);
+    wavio_io_open(&io, fp, filename, offset, O_WRONLY);
+    ok &= wavio_write_blocks(&io, fileno(fp), riff.data.chunkSize, channel * (pcm_spec->bits / 8), wavio_encode_block, enc) == riff.data.chunkSize;
+    wavio_io_close(&io);
+
+    //PEAK and "rms " chunks after the data chunk
+    if(enc->level != NULL && ok){
+        level.channel = channel;
+        ok &= wavio_write_level_chunks(fp, offset, riff.data.chunkSize, &level);
+    }
+
+    //save WAV file
+    wavio_close_written(fp, ok);
+}
+
+//save WAV file from STEREO_PCM_NATIVE struct
+void wavwrite_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename){
+    WAVIO_DECODE enc; /* encode source */
+
+    enc.native[0] = stereo_pcm_native->data[0];
+    enc.native[1] = stereo_pcm_native->data[1];
+    enc.pcm[0] = enc.pcm[1] = NULL;
+    enc.ops = NULL;
+    wavio_write_arrays(&stereo_pcm_native->pcm_spec, 2, &enc, filename);
+}
+
+//save WAV file from STEREO_PCM struct
+void wavwrite_Stereo(STEREO_PCM *stereo_pcm, char *filename){
+    wavwrite_Stereo_Ops(stereo_pcm, filename, NULL);
+}
+
+//save WAV file from STEREO_PCM struct, applying the operators while encoding (the arrays are not changed)
+void wavwrite_Stereo_Ops(STEREO_PCM *stereo_pcm, char *filename, WAVIO_OPS *ops){
+    WAVIO_DECODE enc; /* encode source */
+
+    enc.native[0] = enc.native[1] = NULL;
+    enc.pcm[0] = stereo_pcm->data[0];
+    enc.pcm[1] = stereo_pcm->data[1];
+    enc.ops = ops;
+    wavio_write_arrays(&stereo_pcm->pcm_spec, 2, &enc, filename);
+}
+
+//save WAV file from MONO_PCM_NATIVE struct
+void wavwrite_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename){
+    WAVIO_DECODE enc; /* encode source */
+
+    enc.native[0] = mono_pcm_native->data;
+    enc.native[1] = NULL;
+    enc.pcm[0] = enc.pcm[1] = NULL;
+    enc.ops = NULL;
+    wavio_write_arrays(&mono_pcm_native->pcm_spec, 1, &enc, filename);
+}
+
+//save WAV file from MONO_PCM struct
+void wavwrite_Mono(MONO_PCM *mono_pcm, char *filename){
+    wavwrite_Mono_Ops(mono_pcm, filename, NULL);
+}
+
+//save WAV file from MONO_PCM struct, applying the operators while encoding (the array is not changed)
+void wavwrite_Mono_Ops(MONO_PCM *mono_pcm, char *filename, WAVIO_OPS *ops){
+    WAVIO_DECODE enc; /* encode source */
+
+    enc.native[0] = enc.native[1] = NULL;
+    enc.pcm[0] = mono_pcm->data;
+    enc.pcm[1] = NULL;
+    enc.ops = ops;
+    wavio_write_arrays(&mono_pcm->pcm_spec, 1, &enc, filename);
+}
+
+//Write COMPACT channel arrays as a WAV file (channel: 1 or 2)
+static void wavio_write_compact(PCM_SPEC *pcm_spec, void **data, int16_t channel, char *filename){
+    RIFF riff; /* header */
+    FILE *fp; /* for write wav file */
+    long offset; /* offset of the data chunk body */
+    WAVIO_COMPACT com; /* encode source */
+    WAVIO_MEASURE measure; /* measuring wrapper of the encode (WAVIO_LEVEL_CHUNK) */
+    WAVIO_LEVEL level; /* peak and RMS for the PEAK and "rms " chunks */
+    WAVIO_IO io; /* data chunk I/O */
+    int ok; /* 0 once a write fell short */
+
+    //check the quantization bits
+    switch(pcm_spec->bits){
+        case 8:
+        case 16:
+        case 24:
+        case 32:
+            break;
+
+        default:
+            wavio_fail(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+            return;
+    }
+
+    //open file name with writing name (readable for the O_DIRECT header block)
+    fp = fopen(filename, "w+b");
+    if(fp == NULL){
+        wavio_fail(WAVIO_ERROR_OPEN, "Cannot open the file.");
+        return;
+    }
+
+    //write each chunk
+    wavio_init_header(&riff, pcm_spec->fs, pcm_spec->bits, channel, (uint32_t)pcm_spec->length * channel * (pcm_spec->bits / 8));
+    ok = wavio_write_header(&riff, fp);
+
+    //interleave the data vector into the data chunk in one pass
+    com.bits = pcm_spec->bits;
+    com.channel = channel;
+    com.data[0] = data[0];
+    com.data[1] = (channel == 2) ? data[1] : NULL;
+    measure.func = wavio_compact_encode_block;
+    measure.ctx = &com;
+    measure.level = NULL;
+    if(wavio_level_mode == WAVIO_LEVEL_CHUNK){
+        wavio_level_init(&level);
+        level.channel = channel;
+        measure.level = &level;
+        measure.bits = pcm_spec->bits;
+        measure.channel = channel;
+    }
+    offset = ftell(fp);
+    wavio_io_open(&io, fp, filename, offset, O_WRONLY);
+    if(measure.level != NULL){
+        ok &= wavio_write_blocks(&io, fileno(fp), riff.data.chunkSize, channel * (pcm_spec->bits / 8), wavio_measure_block, &measure) == riff.data.chunkSize;
+    }else{
+        ok &= wavio_write_blocks(&io, fileno(fp), riff.data.chunkSize, channel * (pcm_spec->bits / 8), wavio_compact_encode_block, &com) == riff.data.chunkSize;
+    }
+    wavio_io_close(&io);
+
+    //PEAK and "rms " chunks after the data chunk
+    if(measure.level != NULL && ok){
+        ok &= wavio_write_level_chunks(fp, offset, riff.data.chunkSize, &level);
+    }
+
+    //save WAV file
+    wavio_close_written(fp, ok);
+}
+
+//save WAV file from INTERLEAVED_PCM struct
+void wavwrite_Interleaved(INTERLEAVED_PCM *interleaved_pcm, char *filename){
+    RIFF riff; /* header */
+    FILE *fp; /* for write wav file */
+    long offset; /* offset of the data chunk body */
+    uint64_t frame; /* bytes per frame */
+    WAVIO_COMPACT com; /* encode source */
+    WAVIO_MEASURE measure; /* measuring wrapper of the encode (WAVIO_LEVEL_CHUNK, Mono and Stereo) */
+    WAVIO_LEVEL level; /* peak and RMS for the PEAK and "rms " chunks */
+    WAVIO_IO io; /* data chunk I/O */
+    int ok; /* 0 once a write fell short */
+
+    //check the quantization bits
+    switch(interleaved_pcm->pcm_spec.bits){
+        case 8:
+        case 16:
+        case 24:
+        case 32:
+            break;
+
+        default:
+            wavio_fail(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+            return;
+    }
+
+    //open file name with writing name (readable for the O_DIRECT header block)
+    fp = fopen(filename, "w+b");
+    if(fp == NULL){
+        wavio_fail(WAVIO_ERROR_OPEN, "Cannot open the file.");
+        return;
+    }
+
+    //write each chunk
+    frame = interleaved_pcm->channel * (interleaved_pcm->pcm_spec.bits / 8);
+    wavio_init_header(&riff, interleaved_pcm->pcm_spec.fs, interleaved_pcm->pcm_spec.bits, interleaved_pcm->channel, (uint32_t)(interleaved_pcm->pcm_spec.length * frame));
+    ok = wavio_write_header(&riff, fp);
+
+    //copy the data vector into the data chunk
+    com.bits = interleaved_pcm->pcm_spec.bits;
+    com.channel = interleaved_pcm->channel;
+    com.data[0] = interleaved_pcm->data;
+    com.data[1] = NULL;
+    measure.func = wavio_interleaved_encode_block;
+    measure.ctx = &com;
+    measure.level = NULL;
+    if(wavio_level_mode == WAVIO_LEVEL_CHUNK && interleaved_pcm->channel >= 1 && interleaved_pcm->channel <= 2){
+        wavio_level_init(&level);
+        level.channel = interleaved_pcm->channel;
+        measure.level = &level;
+        measure.bits = interleaved_pcm->pcm_spec.bits;
+        measure.channel = interleaved_pcm->channel;
+    }
+    offset = ftell(fp);
+    wavio_io_open(&io, fp, filename, offset, O_WRONLY);
+    if(measure.level != NULL){
+        ok &= wavio_write_blocks(&io, fileno(fp), riff.data.chunkSize, frame, wavio_measure_block, &measure) == riff.data.chunkSize;
+    }else{
+        ok &= wavio_write_blocks(&io, fileno(fp), riff.data.chunkSize, frame, wavio_interleaved_encode_block, &com) == riff.data.chunkSize;
+    }
+    wavio_io_close(&io);
+
+    //PEAK and "rms " chunks after the data chunk
+    if(measure.level != NULL && ok){
+        ok &= wavio_write_level_chunks(fp, offset, riff.data.chunkSize, &level);
+    }
+
+    //save WAV file
+    wavio_close_written(fp, ok);
+}
+
+//save WAV file from STEREO_PCM_COMPACT struct
+void wavwrite_Stereo_Compact(STEREO_PCM_COMPACT *stereo_pcm_compact, char *filename){
+    wavio_write_compact(&stereo_pcm_compact->pcm_spec, stereo_pcm_compact->data, 2, filename);
+}
+
+//save WAV file from MONO_PCM_COMPACT struct
+void wavwrite_Mono_Compact(MONO_PCM_COMPACT *mono_pcm_compact, char *filename){
+    wavio_write_compact(&mono_pcm_compact->pcm_spec, &mono_pcm_compact->data, 1, filename);
+}
+
+/* operators */
+//No operators (gain 1, no offset, no fades) and an empty measurement
+void wavio_ops_init(WAVIO_OPS *ops){
+    int c;
+
+    for(c = 0; c < 2; c++){
+        ops->gain[c] = 1.0;
+        ops->offset[c] = 0.0;
+        ops->min[c] = HUGE_VAL;
+        ops->max[c] = -HUGE_VAL;
+        ops->sum[c] = 0.0;
+        ops->count[c] = 0;
+    }
+    ops->length = 0;
+    ops->fade_in = 0;
+    ops->fade_out = 0;
+    ops->fade_shape = WAVIO_FADE_LINEAR;
+}
+
+//Multiply the gain of every channel by db decibels
+void wavio_ops_gain(WAVIO_OPS *ops, double db){
+    double g = pow(10.0, db / 20.0);
+
+    ops->gain[0] *= g;
+    ops->gain[1] *= g;
+}
+
+//Fade in over the first fade_in frames and out over the last fade_out frames
+//length: frames of the signal (0: the length of the file or struct, required for wavwrite_Writer_Ops)
+void wavio_ops_fade(WAVIO_OPS *ops, int64_t fade_in, int64_t fade_out, int64_t length, int shape){
+    ops->fade_in = (fade_in > 0) ? fade_in : 0;
+    ops->fade_out = (fade_out > 0) ? fade_out : 0;
+    ops->length = (length > 0) ? length : 0;
+    ops->fade_shape = shape;
+}
+
+//Subtract the mean of each channel measured so far
+void wavio_ops_remove_dc(WAVIO_OPS *ops){
+    int c;
+
+    for(c = 0; c < 2; c++){
+        ops->offset[c] = (ops->count[c] > 0) ? -ops->sum[c] / (double)ops->count[c] : 0.0;
+    }
+}
+
+//Peak of the measured samples after the offset (before the gain)
+double wavio_ops_peak(WAVIO_OPS *ops){
+    double peak = 0.0, a;
+    int c;
+
+    for(c = 0; c < 2; c++){
+        if(ops->count[c] > 0){
+            a = fabs(ops->max[c] + ops->offset[c]);
+            peak = (a > peak) ? a : peak;
+            a = fabs(ops->min[c] + ops->offset[c]);
+            peak = (a > peak) ? a : peak;
+        }
+    }
+
+    return peak;
+}
+
+//Set the gain so that the measured peak (after the offset) becomes db dBFS (same gain for every channel)
+void wavio_ops_normalize(WAVIO_OPS *ops, double db){
+    double peak = wavio_ops_peak(ops);
+
+    if(peak > 0.0){
+        ops->gain[0] = ops->gain[1] = pow(10.0, db / 20.0) / peak;
+    }
+}
+
+//Set the gain so that the peak of level becomes db dBFS (same gain for every channel)
+//(level from wavread_Level or a reader: normalization without a measuring pass)
+void wavio_ops_normalize_level(WAVIO_OPS *ops, const WAVIO_LEVEL *level, double db){
+    double peak = wavio_level_peak(level);
+
+    if(peak > 0.0){
+        ops->gain[0] = ops->gain[1] = pow(10.0, db / 20.0) / peak;
+    }
+}
+
+/* levels */
+//Empty measurement
+void wavio_level_init(WAVIO_LEVEL *level){
+    int c;
+
+    level->channel = 0;
+    level->frames = 0;
+    for(c = 0; c < 2; c++){
+        level->peak[c] = 0.0;
+        level->position[c] = 0;
+        level->square[c] = 0.0;
+    }
+}
+
+//Largest peak of the channels
+double wavio_level_peak(const WAVIO_LEVEL *level){
+    double peak = 0.0;
+    int c;
+
+    for(c = 0; c < level->channel; c++){
+        peak = (level->peak[c] > peak) ? level->peak[c] : peak;
+    }
+
+    return peak;
+}
+
+//RMS of channel c ([-1, 1] scale)
+double wavio_level_rms(const WAVIO_LEVEL *level, int16_t c){
+    if(level->frames == 0 || c < 0 || c >= level->channel){
+        return 0.0;
+    }
+
+    return sqrt(level->square[c] / (double)level->frames);
+}
+
+//Peak and RMS of a WAV file from its PEAK and "rms " chunks (no pass over the samples)
+//if they are missing or the fingerprint of the data chunk in "rms " does not match, the samples are read once to measure them
+//returns 1 if the chunks were used, 0 if the samples were read (-1 on error)
+int wavread_Level(WAVIO_LEVEL *level, char *filename){
+    RIFF riff; /* header */
+    FILE *fp; /* File pointer */
+    long offset; /* offset of the data chunk body */
+    WAVIO_CHUNK chunk[WAVIO_MAX_CHUNKS]; /* chunks in file order */
+    WAVIO_LEVEL found; /* level from the chunks */
+    WAVREADER *reader; /* for the pass over the samples */
+    int32_t *data[2]; /* NATIVE block of the pass */
+    uint8_t body[32 + 2 * 8]; /* chunk body */
+    uint64_t size; /* bytes of the PEAK body read ("rms " has 16 more) */
+    uint64_t frames, rms, hash;
+    uint32_t bits;
+    float value;
+    double r;
+    int32_t count, i;
+    int c, have = 0;
+
+    //open the file and read the headers
+    fp = wavio_open_header(&riff, filename, &offset);
+    if(fp == NULL){
+        return -1;
+    }
+    if(riff.fmt.channel < 1 || riff.fmt.channel > 2){
+        fclose(fp);
+        return wavio_fail(WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+    }
+    wavio_level_init(&found);
+    found.channel = riff.fmt.channel;
+    frames = riff.data.chunkSize / (riff.fmt.channel * (riff.fmt.bitsPerSample / 8));
+    size = 8 + 8 * (uint64_t)found.channel;
+
+    //PEAK and "rms " chunks (anywhere in the file)
+    count = wavio_walk_chunks(fp, 12, WAVIO_WALK_EVEN, chunk, WAVIO_MAX_CHUNKS);
+    for(i = 0; i < count; i++){
+        if(chunk[i].size < (int64_t)size || fseek(fp, (long)chunk[i].offset, SEEK_SET) != 0){
+            continue;
+        }
+        if(memcmp(chunk[i].id, "PEAK", 4) == 0 && fread(body, 1, size, fp) == size){
+            //PEAK has no fingerprint of its own: it is only used next to a matching "rms " chunk
+            for(c = 0; c < found.channel; c++){
+                bits = wavio_load_le32(body + 8 + 8 * c);
+                memcpy(&value, &bits, 4);
+                found.peak[c] = fabs((double)value);
+                found.position[c] = wavio_load_le32(body + 12 + 8 * c);
+            }
+            have |= 1;
+        }else if(memcmp(chunk[i].id, "rms ", 4) == 0 && chunk[i].size >= (int64_t)(size + 16) && fread(body, 1, size + 16, fp) == size + 16){
+            //the RMS of another data chunk (other length, size or samples) is stale
+            if((wavio_load_le32(body) | ((uint64_t)wavio_load_le32(body + 4) << 32)) != frames
+                || (wavio_load_le32(body + 8) | ((uint64_t)wavio_load_le32(body + 12) << 32)) != riff.data.chunkSize
+                || !wavio_data_fingerprint(fileno(fp), (uint64_t)offset, riff.data.chunkSize, &hash)
+                || (wavio_load_le32(body + 16) | ((uint64_t)wavio_load_le32(body + 20) << 32)) != hash){
+                continue;
+            }
+            for(c = 0; c < found.channel; c++){
+                rms = wavio_load_le32(body + 24 + 8 * c) | ((uint64_t)wavio_load_le32(body + 28 + 8 * c) << 32);
+                memcpy(&r, &rms, 8);
+                found.square[c] = r * r * (double)frames;
+            }
+            found.frames = frames;
+            have |= 2;
+        }
+    }
+    fclose(fp);
+
+    if(have == 3){
+        *level = found;
+        return 1;
+    }
+
+    //no chunks: one pass over the samples
+    reader = wavopen_Reader(filename);
+    if(reader == NULL){
+        return -1;
+    }
+    reader->level_mode = WAVIO_LEVEL_MEASURE;
+    data[0] = (int32_t *)malloc(WAVIO_DECODE_FRAMES * sizeof(int32_t));
+    data[1] = (int32_t *)malloc(WAVIO_DECODE_FRAMES * sizeof(int32_t));
+    if(data[0] == NULL || data[1] == NULL){
+        free(data[0]);
+        free(data[1]);
+        wavclose_Reader(reader);
+        return wavio_fail(WAVIO_ERROR_IO, "Cannot allocate the measuring buffers.");
+    }
+    while(wavread_Reader_Native(reader, data, WAVIO_DECODE_FRAMES) > 0){
+    }
+    *level = reader->level;
+    free(data[0]);
+    free(data[1]);
+    wavclose_Reader(reader);
 
-    //free riff struct
-    free_RIFF(riff);
+    return 0;
 }
 
 #ifdef __cplusplus
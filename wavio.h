@@ -4,8 +4,18 @@
 #ifndef INCLUDED_WAVIO
 #define INCLUDED_WAVIO
 
+#include <stdio.h>
 #include <stdint.h>
 
+//Byte order of the host (1: big-endian, the files stay little-endian either way)
+#ifndef WAVIO_BIG_ENDIAN_HOST
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WAVIO_BIG_ENDIAN_HOST 1
+#else
+#define WAVIO_BIG_ENDIAN_HOST 0
+#endif
+#endif
+
 //extern "C"
 #ifdef __cplusplus
 extern "C"
@@ -71,6 +81,33 @@ typedef struct{
     double *data; /* Mono PCM */
 } MONO_PCM;
 
+//NATIVE PCM Stereo at the sample width of the file (8bit: uint8_t, 16bit: int16_t, 24bit and 32bit: int32_t)
+typedef struct{
+    PCM_SPEC pcm_spec;
+    void *data[2]; /* Stereo Sound data (wavio_compact_bytes(bits) bytes per sample) */
+} STEREO_PCM_COMPACT;
+
+//NATIVE PCM Mono at the sample width of the file (8bit: uint8_t, 16bit: int16_t, 24bit and 32bit: int32_t)
+typedef struct{
+    PCM_SPEC pcm_spec;
+    void *data; /* Mono PCM data (wavio_compact_bytes(bits) bytes per sample) */
+} MONO_PCM_COMPACT;
+
+//NATIVE PCM with interleaved frames (sample width as in the COMPACT structs)
+typedef struct{
+    PCM_SPEC pcm_spec;
+    int16_t channel; /* channels per frame */
+    void *data; /* length * channel samples, frame after frame */
+} INTERLEAVED_PCM;
+
+//One channel of INTERLEAVED_PCM without copying (wavio_channel_view)
+typedef struct{
+    void *data; /* first sample of the channel */
+    int16_t bits; /* Quantization bits */
+    int16_t stride; /* distance between two samples in samples (= channels) */
+    int32_t length; /* The number of samples */
+} CHANNEL_VIEW;
+
 //PCM Information(Filename, Fs, bits, channel)
 typedef struct{
     char *filename; /* Filename */
@@ -79,6 +116,100 @@ typedef struct{
     int16_t channel; /* channels */
 } PCMINFO;
 
+//Operators fused into the [-1, 1] conversion loops (y = (x + offset) * gain * fade)
+//the readers also measure the samples x going in (wavio_ops_remove_dc, wavio_ops_normalize)
+typedef struct{
+    double gain[2]; /* linear gain of each channel */
+    double offset[2]; /* added before the gain (DC removal) */
+    int64_t length; /* frames of the signal, where the fade-out ends (0: length of the file or struct) */
+    int64_t fade_in; /* frames of the fade-in */
+    int64_t fade_out; /* frames of the fade-out */
+    int fade_shape; /* WAVIO_FADE_LINEAR or WAVIO_FADE_COSINE */
+    double min[2]; /* smallest sample measured */
+    double max[2]; /* largest sample measured */
+    double sum[2]; /* sum of the samples measured */
+    uint64_t count[2]; /* samples measured */
+} WAVIO_OPS;
+
+//Peak and RMS of each channel (measured while reading or writing, stored in the PEAK and "rms " chunks)
+typedef struct{
+    int16_t channel; /* channels measured */
+    uint64_t frames; /* frames measured */
+    double peak[2]; /* largest |x| of each channel ([-1, 1] scale) */
+    uint64_t position[2]; /* frame of the peak */
+    double square[2]; /* sum of x * x of each channel (wavio_level_rms) */
+} WAVIO_LEVEL;
+
+//Streaming reader (block by block, Mono or Stereo)
+typedef struct{
+    PCM_SPEC pcm_spec; /* fs, bits and length (frames) of the file */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    uint64_t position; /* frames already read */
+    int level_mode; /* WAVIO_LEVEL_* of this reader (from wavio_set_level_mode) */
+    WAVIO_LEVEL level; /* peak and RMS of the frames read so far */
+    FILE *fp; /* file pointer */
+    void *io; /* data chunk I/O (internal) */
+    uint8_t *buf; /* raw block buffer (internal) */
+} WAVREADER;
+
+//Streaming writer (block by block, Mono or Stereo)
+typedef struct{
+    PCM_SPEC pcm_spec; /* fs, bits and length (frames written so far) */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    FILE *fp; /* file pointer */
+    void *io; /* data chunk I/O (internal) */
+    uint8_t *buf; /* raw block buffer (internal) */
+    uint64_t fill; /* bytes waiting in buf */
+    uint64_t written; /* bytes of the data chunk already written */
+    int failed; /* 1 once a block could not be written */
+    int level_mode; /* WAVIO_LEVEL_* of this writer (from wavio_set_level_mode) */
+    WAVIO_LEVEL level; /* peak and RMS of the frames written so far */
+} WAVWRITER;
+
+//One chunk of a RIFF, AIFF or CAF file (wavio_walk_chunks)
+typedef struct{
+    char id[4]; /* chunk ID */
+    int64_t offset; /* file offset of the chunk body */
+    int64_t size; /* size of the chunk body */
+} WAVIO_CHUNK;
+
+//Layout of the chunk headers (wavio_walk_chunks)
+#define WAVIO_WALK_BIG_ENDIAN 1 /* sizes are big-endian (AIFF, CAF) */
+#define WAVIO_WALK_SIZE64 2 /* sizes are 64bit (CAF) */
+#define WAVIO_WALK_EVEN 4 /* chunks are padded to even sizes (RIFF, AIFF) */
+
+//Page cache mode for bulk reads and writes (wavio_set_cache_mode)
+#define WAVIO_CACHE_DEFAULT 0 /* through the page cache */
+#define WAVIO_CACHE_DONTNEED 1 /* drop the pages behind the transfer (posix_fadvise) */
+#define WAVIO_CACHE_DIRECT 2 /* bypass the page cache (O_DIRECT, aligned buffers) */
+
+//Header index cache (parsed headers and chunk offsets keyed by path, size and mtime)
+#define WAVIO_INDEX_OFF 0 /* parse the header on every open */
+#define WAVIO_INDEX_DIRECTORY 1 /* ".wavio_index" in the directory of each file */
+#define WAVIO_INDEX_GLOBAL 2 /* one index file for every directory */
+
+//Fade curves (wavio_ops_fade)
+#define WAVIO_FADE_LINEAR 0 /* straight line */
+#define WAVIO_FADE_COSINE 1 /* raised cosine (S-shaped) */
+
+//Peak and RMS measurement (wavio_set_level_mode; the whole-file readers never measure, use wavread_Level)
+#define WAVIO_LEVEL_OFF 0 /* not measured */
+#define WAVIO_LEVEL_MEASURE 1 /* the streaming readers and writers measure into their level */
+#define WAVIO_LEVEL_CHUNK 2 /* wavclose_Writer and every whole-file writer (Interleaved: Mono and Stereo only) also store it in PEAK and "rms " chunks after the data chunk */
+
+//Error reporting of the calling thread (wavio_set_error_mode; every module reports through wavio_report_error)
+#define WAVIO_ERROR_EXIT 0 /* print the error and end the program */
+#define WAVIO_ERROR_RETURN 1 /* return without touching the outputs (NULL from wavopen_* and wpkopen_Reader) */
+
+//Error codes (wavio_last_error)
+#define WAVIO_OK 0 /* no error */
+#define WAVIO_ERROR_OPEN 1 /* the file cannot be opened */
+#define WAVIO_ERROR_FORMAT 2 /* not a RIFF/WAVE file or a chunk is missing */
+#define WAVIO_ERROR_BITS 3 /* inappropriate quantization bit number */
+#define WAVIO_ERROR_CHANNEL 4 /* inappropriate channel number */
+#define WAVIO_ERROR_ARGUMENT 5 /* other inappropriate argument */
+#define WAVIO_ERROR_IO 6 /* reading or writing the data chunk failed (or no memory for it) */
+
 //Prototype declaration for wavio.c
 /* using RIFF struct */ 
 RIFF *alloc_RIFF(void);
@@ -97,6 +228,8 @@ MONO_PCM *alloc_Mono(void);
 void free_Mono(MONO_PCM *mono_pcm);
 void wavread_Mono(MONO_PCM *mono_pcm, char *filename);
 void wavwrite_Mono(MONO_PCM *mono_pcm, char *filename);
+void wavread_Mono_Ops(MONO_PCM *mono_pcm, char *filename, WAVIO_OPS *ops);
+void wavwrite_Mono_Ops(MONO_PCM *mono_pcm, char *filename, WAVIO_OPS *ops);
 
 /* using STEREO_PCM_NATIVE struct */
 STEREO_PCM_NATIVE *alloc_Stereo_Native(void);
@@ -109,9 +242,78 @@ STEREO_PCM *alloc_Stereo(void);
 void free_Stereo(STEREO_PCM *stereo_pcm);
 void wavread_Stereo(STEREO_PCM *stereo_pcm, char *filename);
 void wavwrite_Stereo(STEREO_PCM *stereo_pcm, char *filename);
+void wavread_Stereo_Ops(STEREO_PCM *stereo_pcm, char *filename, WAVIO_OPS *ops);
+void wavwrite_Stereo_Ops(STEREO_PCM *stereo_pcm, char *filename, WAVIO_OPS *ops);
+
+/* using STEREO_PCM_COMPACT struct */
+STEREO_PCM_COMPACT *alloc_Stereo_Compact(void);
+void free_Stereo_Compact(STEREO_PCM_COMPACT *stereo_pcm_compact);
+void wavread_Stereo_Compact(STEREO_PCM_COMPACT *stereo_pcm_compact, char *filename);
+void wavwrite_Stereo_Compact(STEREO_PCM_COMPACT *stereo_pcm_compact, char *filename);
+
+/* using MONO_PCM_COMPACT struct */
+MONO_PCM_COMPACT *alloc_Mono_Compact(void);
+void free_Mono_Compact(MONO_PCM_COMPACT *mono_pcm_compact);
+void wavread_Mono_Compact(MONO_PCM_COMPACT *mono_pcm_compact, char *filename);
+void wavwrite_Mono_Compact(MONO_PCM_COMPACT *mono_pcm_compact, char *filename);
+int16_t wavio_compact_bytes(int16_t bits);
+
+/* using INTERLEAVED_PCM struct */
+INTERLEAVED_PCM *alloc_Interleaved(void);
+void free_Interleaved(INTERLEAVED_PCM *interleaved_pcm);
+void wavread_Interleaved(INTERLEAVED_PCM *interleaved_pcm, char *filename);
+void wavwrite_Interleaved(INTERLEAVED_PCM *interleaved_pcm, char *filename);
+
+/* using CHANNEL_VIEW struct */
+CHANNEL_VIEW wavio_channel_view(INTERLEAVED_PCM *interleaved_pcm, int16_t channel);
+int32_t wavio_view_get(const CHANNEL_VIEW *view, int32_t i);
+void wavio_view_read_Native(const CHANNEL_VIEW *view, int32_t start, int32_t n, int32_t *dst);
+void wavio_view_read(const CHANNEL_VIEW *view, int32_t start, int32_t n, double *dst);
+
+/* using WAVREADER struct (streaming) */
+WAVREADER *wavopen_Reader(char *filename);
+int32_t wavread_Reader(WAVREADER *reader, double **data, int32_t frames);
+int32_t wavread_Reader_Ops(WAVREADER *reader, double **data, int32_t frames, WAVIO_OPS *ops);
+int32_t wavread_Reader_Native(WAVREADER *reader, int32_t **data, int32_t frames);
+int32_t wavread_Reader_Interleaved(WAVREADER *reader, void *data, int32_t frames);
+void wavclose_Reader(WAVREADER *reader);
+
+/* using WAVWRITER struct (streaming) */
+WAVWRITER *wavopen_Writer(char *filename, uint64_t fs, int16_t bits, int16_t channel);
+void wavwrite_Writer(WAVWRITER *writer, double **data, int32_t frames);
+void wavwrite_Writer_Ops(WAVWRITER *writer, double **data, int32_t frames, WAVIO_OPS *ops);
+void wavwrite_Writer_Native(WAVWRITER *writer, int32_t **data, int32_t frames);
+void wavwrite_Writer_Interleaved(WAVWRITER *writer, const void *data, int32_t frames);
+void wavclose_Writer(WAVWRITER *writer);
+
+/* using WAVIO_OPS struct (operators) */
+void wavio_ops_init(WAVIO_OPS *ops);
+void wavio_ops_gain(WAVIO_OPS *ops, double db);
+void wavio_ops_fade(WAVIO_OPS *ops, int64_t fade_in, int64_t fade_out, int64_t length, int shape);
+void wavio_ops_remove_dc(WAVIO_OPS *ops);
+void wavio_ops_normalize(WAVIO_OPS *ops, double db);
+double wavio_ops_peak(WAVIO_OPS *ops);
+void wavio_ops_normalize_level(WAVIO_OPS *ops, const WAVIO_LEVEL *level, double db);
+
+/* using WAVIO_LEVEL struct (peak and RMS) */
+void wavio_level_init(WAVIO_LEVEL *level);
+double wavio_level_peak(const WAVIO_LEVEL *level);
+double wavio_level_rms(const WAVIO_LEVEL *level, int16_t c);
+int wavread_Level(WAVIO_LEVEL *level, char *filename);
 
 /* others */
-void getPCMINFO(PCMINFO *pcminfo, char *filename);
+int getPCMINFO(PCMINFO *pcminfo, char *filename);
+void wavio_set_cache_mode(int mode);
+void wavio_set_index_cache(int mode, char *path);
+void wavio_set_level_mode(int mode);
+int wavio_set_error_mode(int mode);
+int32_t wavio_last_error(void);
+int32_t wavio_report_error(int32_t code, const char *message);
+void wavio_native_to_pcm(const int32_t *src, double *dst, int32_t n, int16_t bits);
+void wavio_pcm_to_native(const double *src, int32_t *dst, int32_t n, int16_t bits);
+void wavio_swap_bytes(void *buf, uint64_t n, int16_t bytes);
+void wavio_unpack_signed(const uint8_t *src, int32_t *dst, uint64_t n, int16_t bits, int big_endian);
+int32_t wavio_walk_chunks(FILE *fp, int64_t offset, int flags, WAVIO_CHUNK *chunk, int32_t max);
 
 
 #ifdef __cplusplus
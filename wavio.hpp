@@ -0,0 +1,366 @@
+/*wavio.hpp (Beta)*/
+
+//include guard
+#ifndef INCLUDED_WAVIO_HPP
+#define INCLUDED_WAVIO_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <cmath>
+#include <utility>
+#include <stdint.h>
+#include "wavio.h"
+
+//frames converted at once by the streaming templates
+#ifndef WAVIO_CXX_FRAMES
+#define WAVIO_CXX_FRAMES 1024
+#endif
+
+namespace wavio{
+
+//Sample type of the COMPACT width (8bit is unsigned, the others are signed)
+template<int Bits> struct Sample;
+
+template<> struct Sample<8>{
+    typedef uint8_t type;
+    static int32_t bias(){ return 128; }
+    static int32_t clip(int32_t x){ return (x > 255) ? 255 : (x < 0) ? 0 : x; }
+};
+
+template<> struct Sample<16>{
+    typedef int16_t type;
+    static int32_t bias(){ return 0; }
+    static int32_t clip(int32_t x){ return (x > 32767) ? 32767 : (x < -32768) ? -32768 : x; }
+};
+
+template<> struct Sample<24>{
+    typedef int32_t type;
+    static int32_t bias(){ return 0; }
+    static int32_t clip(int32_t x){ return (x > 8388607) ? 8388607 : (x < -8388608) ? -8388608 : x; }
+};
+
+template<> struct Sample<32>{
+    typedef int32_t type;
+    static int32_t bias(){ return 0; }
+    static int32_t clip(int32_t x){ return x; }
+};
+
+//Conversion between one sample and the output type (same formulas as the C readers and writers)
+template<int Bits, typename Out> struct Convert;
+
+//NATIVE: widen, clip on the way back
+template<int Bits> struct Convert<Bits, int32_t>{
+    typedef typename Sample<Bits>::type sample_type;
+    static int32_t decode(sample_type x){ return (int32_t)x; }
+    static sample_type encode(int32_t x){ return (sample_type)Sample<Bits>::clip(x); }
+};
+
+//[-1, 1] in double: the scaling of wavread_Stereo and the rounding of wavwrite_Stereo
+template<int Bits> struct Convert<Bits, double>{
+    typedef typename Sample<Bits>::type sample_type;
+    static double decode(sample_type s){
+        const double pos_scale = (double)((1LL << (Bits - 1)) - 1); /* divisor for x >= 0 */
+        const double neg_scale = (double)(1LL << (Bits - 1)); /* divisor for x < 0 */
+        double x = (double)((int32_t)s - Sample<Bits>::bias());
+        return (x >= 0) ? x / pos_scale : x / neg_scale;
+    }
+    static sample_type encode(double x){
+        const double full = (double)((1LL << Bits) - 1); /* number of steps */
+        const double half = (Bits == 8) ? 0.0 : (double)(1LL << (Bits - 1)); /* offset of signed formats */
+        x = (x < -1.0) ? -1.0 : (x > 1.0) ? 1.0 : x;
+        return (sample_type)(int32_t)(std::floor(((x + 1.0) / 2.0) * full + 0.5) - half);
+    }
+};
+
+//[-1, 1] in float: the same formulas in single precision (not bit-exact with the double path)
+template<int Bits> struct Convert<Bits, float>{
+    typedef typename Sample<Bits>::type sample_type;
+    static float decode(sample_type s){
+        const float pos_scale = (float)((1LL << (Bits - 1)) - 1); /* divisor for x >= 0 */
+        const float neg_scale = (float)(1LL << (Bits - 1)); /* divisor for x < 0 */
+        float x = (float)((int32_t)s - Sample<Bits>::bias());
+        return (x >= 0) ? x / pos_scale : x / neg_scale;
+    }
+    static sample_type encode(float x){
+        return Convert<Bits, double>::encode((double)x);
+    }
+};
+
+//Deinterleave and convert, or convert and interleave, with every format decision made at compile time
+template<int Bits, int Channels, typename Out> struct Codec{
+    typedef typename Sample<Bits>::type sample_type;
+
+    //interleaved COMPACT samples -> channel arrays
+    static void decode(const sample_type *src, Out *const *dst, size_t frames){
+        for(int c = 0; c < Channels; c++){
+            Out *d = dst[c];
+            const sample_type *s = src + c;
+            for(size_t i = 0; i < frames; i++){
+                d[i] = Convert<Bits, Out>::decode(s[i * Channels]);
+            }
+        }
+    }
+
+    //channel arrays -> interleaved COMPACT samples
+    static void encode(const Out *const *src, sample_type *dst, size_t frames){
+        for(int c = 0; c < Channels; c++){
+            const Out *s = src[c];
+            sample_type *d = dst + c;
+            for(size_t i = 0; i < frames; i++){
+                d[i * Channels] = Convert<Bits, Out>::encode(s[i]);
+            }
+        }
+    }
+};
+
+//Read the next frames of a reader whose format is known at compile time
+//returns the number of frames read (0 at the end of the data, or after an error in WAVIO_ERROR_RETURN mode)
+template<int Bits, int Channels, typename Out>
+int32_t read(WAVREADER *reader, Out *const *dst, int32_t frames){
+    typename Sample<Bits>::type buf[Channels * WAVIO_CXX_FRAMES]; /* interleaved block */
+    Out *part[Channels]; /* destination of the current block */
+    int32_t done = 0, n, got;
+    int c;
+
+    if(reader->pcm_spec.bits != Bits || reader->channel != Channels){
+        wavio_report_error(WAVIO_ERROR_FORMAT, "The file does not match the template format.");
+        return 0;
+    }
+
+    while(done < frames){
+        n = (frames - done < WAVIO_CXX_FRAMES) ? frames - done : WAVIO_CXX_FRAMES;
+        got = wavread_Reader_Interleaved(reader, buf, n);
+        if(got == 0){
+            break;
+        }
+        for(c = 0; c < Channels; c++){
+            part[c] = dst[c] + done;
+        }
+        Codec<Bits, Channels, Out>::decode(buf, part, (size_t)got);
+        done += got;
+    }
+
+    return done;
+}
+
+//Write frames to a writer whose format is known at compile time
+template<int Bits, int Channels, typename Out>
+void write(WAVWRITER *writer, const Out *const *src, int32_t frames){
+    typename Sample<Bits>::type buf[Channels * WAVIO_CXX_FRAMES]; /* interleaved block */
+    const Out *part[Channels]; /* source of the current block */
+    int32_t done = 0, n;
+    int c;
+
+    if(writer->pcm_spec.bits != Bits || writer->channel != Channels){
+        wavio_report_error(WAVIO_ERROR_FORMAT, "The file does not match the template format.");
+        return;
+    }
+
+    while(done < frames){
+        n = (frames - done < WAVIO_CXX_FRAMES) ? frames - done : WAVIO_CXX_FRAMES;
+        for(c = 0; c < Channels; c++){
+            part[c] = src[c] + done;
+        }
+        Codec<Bits, Channels, Out>::encode(part, buf, (size_t)n);
+        wavwrite_Writer_Interleaved(writer, buf, n);
+        done += n;
+    }
+}
+
+//Read the next frames, choosing the specialization once per call (Mono or Stereo, 8/16/24/32bit)
+template<typename Out>
+int32_t read(WAVREADER *reader, Out *const *dst, int32_t frames){
+    switch(reader->channel * 100 + reader->pcm_spec.bits){
+        case 108: return read<8, 1, Out>(reader, dst, frames);
+        case 116: return read<16, 1, Out>(reader, dst, frames);
+        case 124: return read<24, 1, Out>(reader, dst, frames);
+        case 132: return read<32, 1, Out>(reader, dst, frames);
+        case 208: return read<8, 2, Out>(reader, dst, frames);
+        case 216: return read<16, 2, Out>(reader, dst, frames);
+        case 224: return read<24, 2, Out>(reader, dst, frames);
+        case 232: return read<32, 2, Out>(reader, dst, frames);
+    }
+
+    wavio_report_error(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+    return 0;
+}
+
+//Write frames, choosing the specialization once per call (Mono or Stereo, 8/16/24/32bit)
+template<typename Out>
+void write(WAVWRITER *writer, const Out *const *src, int32_t frames){
+    switch(writer->channel * 100 + writer->pcm_spec.bits){
+        case 108: write<8, 1, Out>(writer, src, frames); return;
+        case 116: write<16, 1, Out>(writer, src, frames); return;
+        case 124: write<24, 1, Out>(writer, src, frames); return;
+        case 132: write<32, 1, Out>(writer, src, frames); return;
+        case 208: write<8, 2, Out>(writer, src, frames); return;
+        case 216: write<16, 2, Out>(writer, src, frames); return;
+        case 224: write<24, 2, Out>(writer, src, frames); return;
+        case 232: write<32, 2, Out>(writer, src, frames); return;
+    }
+
+    wavio_report_error(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+}
+
+//Non-owning view of n contiguous samples (std::span-style)
+template<typename T> class Span{
+public:
+    Span() : data_(NULL), size_(0){}
+    Span(T *data, size_t size) : data_(data), size_(size){}
+
+    T *data() const{ return data_; }
+    size_t size() const{ return size_; }
+    bool empty() const{ return size_ == 0; }
+    T &operator[](size_t i) const{ return data_[i]; }
+    T *begin() const{ return data_; }
+    T *end() const{ return data_ + size_; }
+
+    //view of count samples from offset
+    Span subspan(size_t offset, size_t count) const{ return Span(data_ + offset, count); }
+
+private:
+    T *data_;
+    size_t size_;
+};
+
+//Sample type, channels and C functions of each PCM struct
+template<typename T> struct PCMTraits;
+
+template<> struct PCMTraits<STEREO_PCM>{
+    typedef double sample_type;
+    static const int channels = 2;
+    static STEREO_PCM *alloc(){ return alloc_Stereo(); }
+    static void free(STEREO_PCM *p){ free_Stereo(p); }
+    static void read(STEREO_PCM *p, char *filename){ wavread_Stereo(p, filename); }
+    static void write(STEREO_PCM *p, char *filename){ wavwrite_Stereo(p, filename); }
+    static double *&data(STEREO_PCM *p, int c){ return p->data[c]; }
+};
+
+template<> struct PCMTraits<STEREO_PCM_NATIVE>{
+    typedef int32_t sample_type;
+    static const int channels = 2;
+    static STEREO_PCM_NATIVE *alloc(){ return alloc_Stereo_Native(); }
+    static void free(STEREO_PCM_NATIVE *p){ free_Stereo_Native(p); }
+    static void read(STEREO_PCM_NATIVE *p, char *filename){ wavread_Stereo_Native(p, filename); }
+    static void write(STEREO_PCM_NATIVE *p, char *filename){ wavwrite_Stereo_Native(p, filename); }
+    static int32_t *&data(STEREO_PCM_NATIVE *p, int c){ return p->data[c]; }
+};
+
+template<> struct PCMTraits<MONO_PCM>{
+    typedef double sample_type;
+    static const int channels = 1;
+    static MONO_PCM *alloc(){ return alloc_Mono(); }
+    static void free(MONO_PCM *p){ free_Mono(p); }
+    static void read(MONO_PCM *p, char *filename){ wavread_Mono(p, filename); }
+    static void write(MONO_PCM *p, char *filename){ wavwrite_Mono(p, filename); }
+    static double *&data(MONO_PCM *p, int){ return p->data; }
+};
+
+template<> struct PCMTraits<MONO_PCM_NATIVE>{
+    typedef int32_t sample_type;
+    static const int channels = 1;
+    static MONO_PCM_NATIVE *alloc(){ return alloc_Mono_Native(); }
+    static void free(MONO_PCM_NATIVE *p){ free_Mono_Native(p); }
+    static void read(MONO_PCM_NATIVE *p, char *filename){ wavread_Mono_Native(p, filename); }
+    static void write(MONO_PCM_NATIVE *p, char *filename){ wavwrite_Mono_Native(p, filename); }
+    static int32_t *&data(MONO_PCM_NATIVE *p, int){ return p->data; }
+};
+
+//Move-only owner of a PCM struct and its sample buffers (alloc_* on construction, free_* on destruction)
+//the constructors throw std::bad_alloc when the struct or its buffers cannot be allocated
+template<typename T> class PCM{
+public:
+    typedef typename PCMTraits<T>::sample_type sample_type;
+    static const int channels = PCMTraits<T>::channels;
+
+    //empty struct (no samples)
+    PCM() : p_(PCMTraits<T>::alloc()){
+        if(p_ == NULL){
+            throw std::bad_alloc();
+        }
+        p_->pcm_spec.fs = 0;
+        p_->pcm_spec.bits = 0;
+        p_->pcm_spec.length = 0;
+    }
+
+    //zero-filled samples
+    PCM(uint64_t fs, int16_t bits, int32_t length) : p_(PCMTraits<T>::alloc()){
+        if(p_ == NULL){
+            throw std::bad_alloc();
+        }
+        p_->pcm_spec.fs = fs;
+        p_->pcm_spec.bits = bits;
+        p_->pcm_spec.length = length;
+        for(int c = 0; c < channels; c++){
+            PCMTraits<T>::data(p_, c) = (sample_type *)calloc(length > 0 ? length : 1, sizeof(sample_type));
+            if(PCMTraits<T>::data(p_, c) == NULL){
+                //the destructor does not run for a throwing constructor
+                PCMTraits<T>::free(p_);
+                throw std::bad_alloc();
+            }
+        }
+    }
+
+    //take over a struct from alloc_* (or NULL)
+    explicit PCM(T *p) : p_(p){}
+
+    ~PCM(){
+        if(p_ != NULL){
+            PCMTraits<T>::free(p_);
+        }
+    }
+
+    //moves hand over the struct and its buffers, copies are not allowed
+    PCM(PCM &&other) noexcept : p_(other.p_){ other.p_ = NULL; }
+    PCM &operator=(PCM &&other) noexcept{
+        std::swap(p_, other.p_);
+        return *this;
+    }
+    PCM(const PCM &) = delete;
+    PCM &operator=(const PCM &) = delete;
+
+    //read a whole file
+    static PCM read(const char *filename){
+        PCM pcm;
+        PCMTraits<T>::read(pcm.p_, const_cast<char *>(filename));
+        return pcm;
+    }
+
+    //write a whole file
+    void write(const char *filename) const{
+        PCMTraits<T>::write(p_, const_cast<char *>(filename));
+    }
+
+    //the C struct (still owned)
+    T *get() const{ return p_; }
+    T *operator->() const{ return p_; }
+    explicit operator bool() const{ return p_ != NULL; }
+
+    //give up ownership (the caller frees it with free_*)
+    T *release(){
+        T *p = p_;
+        p_ = NULL;
+        return p;
+    }
+
+    //samples of one channel (0: L or Mono, 1: R)
+    Span<sample_type> channel(int c) const{
+        return Span<sample_type>(PCMTraits<T>::data(p_, c), (size_t)p_->pcm_spec.length);
+    }
+    size_t length() const{ return (size_t)p_->pcm_spec.length; }
+
+private:
+    T *p_;
+};
+
+typedef PCM<STEREO_PCM> StereoPCM;
+typedef PCM<STEREO_PCM_NATIVE> StereoPCMNative;
+typedef PCM<MONO_PCM> MonoPCM;
+typedef PCM<MONO_PCM_NATIVE> MonoPCMNative;
+
+}
+
+//close include guard
+#endif
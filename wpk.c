@@ -0,0 +1,842 @@
+/* wpk.c (beta)*/
+
+/* include standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* include SIMD intrinsics (group unpacking) */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* include prototype header file */
+#include "wpk.h"
+
+/* extern "C" */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//File layout (little-endian)
+//  header: "WPK1", version, channel, bits, reserved (uint16_t), block (uint32_t), fs, length, blocks, index offset (uint64_t)
+//  blocks: one per WPK_BLOCK frames, each channel in turn as 32bit words
+//      word 0: predictor order | side flag << 8 (the second channel is stored as right - left)
+//      warm-up samples (order words), bit width of each group (4 per word), packed groups
+//  index: file offset of each block and of the end of the last one (uint64_t)
+//A group of WPK_GROUP residuals with width w takes 4 * w words: lane l holds samples l, l + 4, l + 8, ...
+//packed one after another, and the words of the 4 lanes are interleaved, so one 128bit load feeds all lanes.
+
+//lanes of a group (one 128bit vector of 32bit words)
+#define WPK_LANES 4
+
+//Store little-endian integers
+static void wpk_put16(uint8_t *p, uint16_t x){
+    p[0] = (uint8_t)x;
+    p[1] = (uint8_t)(x >> 8);
+}
+
+static void wpk_put32(uint8_t *p, uint32_t x){
+    wpk_put16(p, (uint16_t)x);
+    wpk_put16(p + 2, (uint16_t)(x >> 16));
+}
+
+static void wpk_put64(uint8_t *p, uint64_t x){
+    wpk_put32(p, (uint32_t)x);
+    wpk_put32(p + 4, (uint32_t)(x >> 32));
+}
+
+//Load little-endian integers
+static uint16_t wpk_get16(const uint8_t *p){
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t wpk_get32(const uint8_t *p){
+    return wpk_get16(p) | ((uint32_t)wpk_get16(p + 2) << 16);
+}
+
+static uint64_t wpk_get64(const uint8_t *p){
+    return wpk_get32(p) | ((uint64_t)wpk_get32(p + 4) << 32);
+}
+
+//Bit width of a value (0 for 0)
+static int wpk_width(uint32_t x){
+    int w = 0;
+
+    while(x != 0){
+        x >>= 1;
+        w++;
+    }
+
+    return w;
+}
+
+//Pack one group of WPK_GROUP values with width w into 4 * w words
+static void wpk_pack(const uint32_t *in, uint32_t *out, int w){
+    int i, l, bit, word, off;
+
+    memset(out, 0, WPK_LANES * w * sizeof(uint32_t));
+    for(i = 0; i < WPK_GROUP / WPK_LANES; i++){
+        bit = i * w;
+        word = bit >> 5;
+        off = bit & 31;
+        for(l = 0; l < WPK_LANES; l++){
+            out[word * WPK_LANES + l] |= in[i * WPK_LANES + l] << off;
+            if(off + w > 32){
+                out[(word + 1) * WPK_LANES + l] |= in[i * WPK_LANES + l] >> (32 - off);
+            }
+        }
+    }
+}
+
+//Unpack one group of width w and undo the zigzag
+static void wpk_unpack(const uint32_t *in, uint32_t *out, int w){
+    const uint32_t mask = (w == 32) ? 0xFFFFFFFFu : ((1u << w) - 1);
+    int i, bit, word, off;
+
+#if defined(__SSE2__)
+    //one 128bit vector holds the same sample of all 4 lanes
+    __m128i m = _mm_set1_epi32((int)mask), one = _mm_set1_epi32(1), zero = _mm_setzero_si128(), v;
+
+    for(i = 0; i < WPK_GROUP / WPK_LANES; i++){
+        bit = i * w;
+        word = bit >> 5;
+        off = bit & 31;
+        v = _mm_srl_epi32(_mm_loadu_si128((const __m128i *)(in + word * WPK_LANES)), _mm_cvtsi32_si128(off));
+        if(off + w > 32){
+            v = _mm_or_si128(v, _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(in + (word + 1) * WPK_LANES)), _mm_cvtsi32_si128(32 - off)));
+        }
+        v = _mm_and_si128(v, m);
+        v = _mm_xor_si128(_mm_srli_epi32(v, 1), _mm_sub_epi32(zero, _mm_and_si128(v, one)));
+        _mm_storeu_si128((__m128i *)(out + i * WPK_LANES), v);
+    }
+#else
+    int l;
+    uint32_t u;
+
+    for(i = 0; i < WPK_GROUP / WPK_LANES; i++){
+        bit = i * w;
+        word = bit >> 5;
+        off = bit & 31;
+        for(l = 0; l < WPK_LANES; l++){
+            u = in[word * WPK_LANES + l] >> off;
+            if(off + w > 32){
+                u |= in[(word + 1) * WPK_LANES + l] << (32 - off);
+            }
+            u &= mask;
+            out[i * WPK_LANES + l] = (u >> 1) ^ (0u - (u & 1));
+        }
+    }
+#endif
+}
+
+//Residual of the order-th difference (modulo 2^32, the first order samples are warm-up)
+static void wpk_residual(const uint32_t *x, int32_t n, int order, uint32_t *r){
+    int32_t i;
+
+    for(i = 0; i < order && i < n; i++){
+        r[i] = 0;
+    }
+    switch(order){
+        case 0:
+            for(i = 0; i < n; i++){
+                r[i] = x[i];
+            }
+            break;
+        case 1:
+            for(i = 1; i < n; i++){
+                r[i] = x[i] - x[i - 1];
+            }
+            break;
+        case 2:
+            for(i = 2; i < n; i++){
+                r[i] = x[i] - 2 * x[i - 1] + x[i - 2];
+            }
+            break;
+        default:
+            for(i = 3; i < n; i++){
+                r[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+            }
+            break;
+    }
+
+    //zigzag (small magnitudes get small codes) and zero padding of the last group
+    for(i = 0; i < n; i++){
+        r[i] = (r[i] << 1) ^ (uint32_t)((int32_t)r[i] >> 31);
+    }
+    for(; i % WPK_GROUP != 0; i++){
+        r[i] = 0;
+    }
+}
+
+//Words of a packed channel and the width of each group
+static uint64_t wpk_measure(const uint32_t *r, int32_t n, int order, uint8_t *width){
+    int32_t g, i, groups = (n + WPK_GROUP - 1) / WPK_GROUP;
+    uint64_t words = 1 + order + (groups + 3) / 4;
+    uint32_t any;
+
+    for(g = 0; g < groups; g++){
+        any = 0;
+        for(i = 0; i < WPK_GROUP; i++){
+            any |= r[g * WPK_GROUP + i];
+        }
+        width[g] = (uint8_t)wpk_width(any);
+        words += WPK_LANES * width[g];
+    }
+
+    return words;
+}
+
+//Encode one channel of one block (returns the number of words)
+static uint64_t wpk_encode_channel(const uint32_t *x, int32_t n, int side, uint32_t *r, uint32_t *out){
+    uint8_t width[WPK_BLOCK / WPK_GROUP], best_width[WPK_BLOCK / WPK_GROUP];
+    int32_t g, groups = (n + WPK_GROUP - 1) / WPK_GROUP;
+    int order, best_order = 0;
+    uint64_t words, best = UINT64_MAX, pos;
+
+    //smallest difference order
+    for(order = 0; order <= WPK_MAX_ORDER && order < n; order++){
+        wpk_residual(x, n, order, r);
+        words = wpk_measure(r, n, order, width);
+        if(words < best){
+            best = words;
+            best_order = order;
+            memcpy(best_width, width, groups);
+        }
+    }
+
+    //header, warm-up and widths
+    out[0] = (uint32_t)best_order | ((uint32_t)side << 8);
+    pos = 1;
+    for(order = 0; order < best_order; order++){
+        out[pos++] = x[order];
+    }
+    memset(out + pos, 0, ((groups + 3) / 4) * sizeof(uint32_t));
+    for(g = 0; g < groups; g++){
+        out[pos + g / 4] |= (uint32_t)best_width[g] << (8 * (g % 4));
+    }
+    pos += (groups + 3) / 4;
+
+    //groups
+    wpk_residual(x, n, best_order, r);
+    for(g = 0; g < groups; g++){
+        wpk_pack(r + g * WPK_GROUP, out + pos, best_width[g]);
+        pos += WPK_LANES * best_width[g];
+    }
+
+    return pos;
+}
+
+//Decode one channel of one block into out (returns the number of words used, 0 on a bad block)
+static uint64_t wpk_decode_channel(const uint32_t *in, uint64_t avail, int32_t n, int32_t *out, const int32_t *left){
+    uint32_t tmp[WPK_GROUP];
+    uint32_t *x = (uint32_t *)out;
+    int32_t g, i, groups = (n + WPK_GROUP - 1) / WPK_GROUP, count;
+    int order, side, w;
+    uint64_t pos;
+
+    if(avail < 1){
+        return 0;
+    }
+    order = (int)(in[0] & 0xFF);
+    side = (int)((in[0] >> 8) & 1);
+    pos = 1 + order + (groups + 3) / 4;
+    if(order > WPK_MAX_ORDER || pos > avail || (side && left == NULL)){
+        return 0;
+    }
+
+    //unpack the residual
+    for(g = 0; g < groups; g++){
+        w = (int)((in[1 + order + g / 4] >> (8 * (g % 4))) & 0xFF);
+        if(w > 32 || pos + WPK_LANES * w > avail){
+            return 0;
+        }
+        count = (n - g * WPK_GROUP < WPK_GROUP) ? n - g * WPK_GROUP : WPK_GROUP;
+        if(w == 0){
+            memset(x + g * WPK_GROUP, 0, count * sizeof(uint32_t));
+        }else if(count == WPK_GROUP){
+            wpk_unpack(in + pos, x + g * WPK_GROUP, w);
+        }else{
+            wpk_unpack(in + pos, tmp, w);
+            memcpy(x + g * WPK_GROUP, tmp, count * sizeof(uint32_t));
+        }
+        pos += WPK_LANES * w;
+    }
+
+    //warm-up and running sums of the differences
+    for(i = 0; i < order && i < n; i++){
+        x[i] = in[1 + i];
+    }
+    switch(order){
+        case 1:
+            for(i = 1; i < n; i++){
+                x[i] += x[i - 1];
+            }
+            break;
+        case 2:
+            for(i = 2; i < n; i++){
+                x[i] += 2 * x[i - 1] - x[i - 2];
+            }
+            break;
+        case 3:
+            for(i = 3; i < n; i++){
+                x[i] += 3 * (x[i - 1] - x[i - 2]) + x[i - 3];
+            }
+            break;
+    }
+
+    //right = side + left
+    if(side){
+        for(i = 0; i < n; i++){
+            x[i] += (uint32_t)left[i];
+        }
+    }
+
+    return pos;
+}
+
+//Frames of block b
+static int32_t wpk_block_frames(int64_t length, int64_t b){
+    int64_t rest = length - b * WPK_BLOCK;
+
+    return (int32_t)((rest < WPK_BLOCK) ? rest : WPK_BLOCK);
+}
+
+//Release the buffers of wpk_write_file
+static void wpk_free_buffers(uint32_t *out, uint32_t *side_out, uint32_t *r, uint32_t *side, uint64_t *index){
+    free(out);
+    free(side_out);
+    free(r);
+    free(side);
+    free(index);
+}
+
+//Encode signed or NATIVE channel arrays and write the WPK file (errors are reported through wavio_report_error)
+static void wpk_write_file(char *filename, uint64_t fs, int16_t bits, int16_t channel, int64_t length, int32_t **data){
+    uint8_t head[WPK_HEADER_SIZE];
+    uint8_t entry[8];
+    int64_t blocks = (length + WPK_BLOCK - 1) / WPK_BLOCK, b;
+    uint64_t *index, offset = WPK_HEADER_SIZE, words, side_words;
+    uint32_t *out, *side_out, *r, *side;
+    int32_t n, i;
+    int c, ok;
+    FILE *fp;
+
+    fp = fopen(filename, "wb");
+    if(fp == NULL){
+        wavio_report_error(WAVIO_ERROR_OPEN, "Cannot open the file.");
+        return;
+    }
+
+    //buffers for the worst case of one channel (every group 32 bits wide)
+    out = (uint32_t *)malloc((1 + WPK_MAX_ORDER + WPK_BLOCK / WPK_GROUP + WPK_BLOCK) * sizeof(uint32_t));
+    side_out = (uint32_t *)malloc((1 + WPK_MAX_ORDER + WPK_BLOCK / WPK_GROUP + WPK_BLOCK) * sizeof(uint32_t));
+    r = (uint32_t *)malloc(WPK_BLOCK * sizeof(uint32_t));
+    side = (uint32_t *)malloc(WPK_BLOCK * sizeof(uint32_t));
+    index = (uint64_t *)malloc((blocks + 1) * sizeof(uint64_t));
+    if(out == NULL || side_out == NULL || r == NULL || side == NULL || index == NULL){
+        fclose(fp);
+        wpk_free_buffers(out, side_out, r, side, index);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the buffers.");
+        return;
+    }
+
+    //header (completed when the index position is known)
+    memset(head, 0, sizeof(head));
+    ok = fwrite(head, 1, sizeof(head), fp) == sizeof(head);
+
+    for(b = 0; ok && b < blocks; b++){
+        index[b] = offset;
+        n = wpk_block_frames(length, b);
+        for(c = 0; c < channel; c++){
+            words = wpk_encode_channel((const uint32_t *)data[c] + b * WPK_BLOCK, n, 0, r, out);
+
+            //the second channel may be cheaper as right - left
+            if(c == 1){
+                for(i = 0; i < n; i++){
+                    side[i] = (uint32_t)data[1][b * WPK_BLOCK + i] - (uint32_t)data[0][b * WPK_BLOCK + i];
+                }
+                side_words = wpk_encode_channel(side, n, 1, r, side_out);
+                if(side_words < words){
+                    words = side_words;
+                    memcpy(out, side_out, words * sizeof(uint32_t));
+                }
+            }
+            //packed words are little-endian in the file
+#if WAVIO_BIG_ENDIAN_HOST
+            wavio_swap_bytes(out, words, 4);
+#endif
+            ok = ok && fwrite(out, sizeof(uint32_t), words, fp) == words;
+            offset += words * sizeof(uint32_t);
+        }
+    }
+
+    //index
+    if(ok){
+        index[blocks] = offset;
+    }
+    for(b = 0; ok && b <= blocks; b++){
+        wpk_put64(entry, index[b]);
+        ok = fwrite(entry, 1, 8, fp) == 8;
+    }
+
+    //header
+    memcpy(head, "WPK1", 4);
+    wpk_put16(head + 4, 1);
+    wpk_put16(head + 6, (uint16_t)channel);
+    wpk_put16(head + 8, (uint16_t)bits);
+    wpk_put32(head + 12, WPK_BLOCK);
+    wpk_put64(head + 16, fs);
+    wpk_put64(head + 24, (uint64_t)length);
+    wpk_put64(head + 32, (uint64_t)blocks);
+    wpk_put64(head + 40, offset);
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(head, 1, sizeof(head), fp) == sizeof(head);
+    if(fclose(fp) != 0 || !ok){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot write the file.");
+    }
+
+    wpk_free_buffers(out, side_out, r, side, index);
+}
+
+//Clip NATIVE samples to the range of bits (like wavwrite), NULL after reporting a failed allocation
+static int32_t *wpk_clip_native(const int32_t *src, int32_t length, int16_t bits){
+    int32_t *dst = (int32_t *)malloc((length > 0 ? length : 1) * sizeof(int32_t));
+    int32_t i, x, max, min;
+
+    if(dst == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return NULL;
+    }
+    if(bits == 8){
+        min = 0;
+        max = 255;
+    }else{
+        max = (bits >= 32) ? INT32_MAX : (int32_t)((1u << (bits - 1)) - 1);
+        min = -max - 1;
+    }
+    for(i = 0; i < length; i++){
+        x = src[i];
+        if(x > max){
+            x = max;
+        }else if(x < min){
+            x = min;
+        }
+        dst[i] = x;
+    }
+
+    return dst;
+}
+
+//Check the quantization bit number of a container (returns -1 after reporting it)
+static int wpk_check_bits(int16_t bits){
+    if(bits != 8 && bits != 16 && bits != 24 && bits != 32){
+        return wavio_report_error(WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+    }
+
+    return 0;
+}
+
+//save WPK file from STEREO_PCM_NATIVE struct
+void wpkwrite_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename){
+    PCM_SPEC *spec = &stereo_pcm_native->pcm_spec;
+    int32_t *data[2];
+
+    if(wpk_check_bits(spec->bits) < 0 || (data[0] = wpk_clip_native(stereo_pcm_native->data[0], spec->length, spec->bits)) == NULL){
+        return;
+    }
+    data[1] = wpk_clip_native(stereo_pcm_native->data[1], spec->length, spec->bits);
+    if(data[1] != NULL){
+        wpk_write_file(filename, spec->fs, spec->bits, 2, spec->length, data);
+    }
+    free(data[0]);
+    free(data[1]);
+}
+
+//save WPK file from STEREO_PCM struct
+void wpkwrite_Stereo(STEREO_PCM *stereo_pcm, char *filename){
+    PCM_SPEC *spec = &stereo_pcm->pcm_spec;
+    int32_t *data[2];
+    int c;
+
+    if(wpk_check_bits(spec->bits) < 0){
+        return;
+    }
+    for(c = 0; c < 2; c++){
+        data[c] = (int32_t *)malloc((spec->length > 0 ? spec->length : 1) * sizeof(int32_t));
+        if(data[c] == NULL){
+            free(data[0]);
+            wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+            return;
+        }
+        wavio_pcm_to_native(stereo_pcm->data[c], data[c], spec->length, spec->bits);
+    }
+    wpk_write_file(filename, spec->fs, spec->bits, 2, spec->length, data);
+    free(data[0]);
+    free(data[1]);
+}
+
+//save WPK file from MONO_PCM_NATIVE struct
+void wpkwrite_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename){
+    PCM_SPEC *spec = &mono_pcm_native->pcm_spec;
+    int32_t *data[1];
+
+    if(wpk_check_bits(spec->bits) < 0 || (data[0] = wpk_clip_native(mono_pcm_native->data, spec->length, spec->bits)) == NULL){
+        return;
+    }
+    wpk_write_file(filename, spec->fs, spec->bits, 1, spec->length, data);
+    free(data[0]);
+}
+
+//save WPK file from MONO_PCM struct
+void wpkwrite_Mono(MONO_PCM *mono_pcm, char *filename){
+    PCM_SPEC *spec = &mono_pcm->pcm_spec;
+    int32_t *data[1];
+
+    if(wpk_check_bits(spec->bits) < 0){
+        return;
+    }
+    data[0] = (int32_t *)malloc((spec->length > 0 ? spec->length : 1) * sizeof(int32_t));
+    if(data[0] == NULL){
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        return;
+    }
+    wavio_pcm_to_native(mono_pcm->data, data[0], spec->length, spec->bits);
+    wpk_write_file(filename, spec->fs, spec->bits, 1, spec->length, data);
+    free(data[0]);
+}
+
+//Give up on a WPK file that cannot be read: close it, free the reader and report the error (returns NULL)
+static WPKREADER *wpk_reject(WPKREADER *reader, int32_t code, const char *message){
+    wpkclose_Reader(reader);
+    wavio_report_error(code, message);
+
+    return NULL;
+}
+
+//Open a WPK file and read its header and block index
+//(the header must agree with itself and the index must point between the header and itself)
+WPKREADER *wpkopen_Reader(char *filename){
+    WPKREADER *reader;
+    uint8_t head[WPK_HEADER_SIZE];
+    uint8_t *entry;
+    uint64_t index_offset, length, blocks, file_size;
+    int64_t b;
+    long end;
+    FILE *fp;
+
+    fp = fopen(filename, "rb");
+    if(fp == NULL){
+        wavio_report_error(WAVIO_ERROR_OPEN, "Cannot open the file.");
+        return NULL;
+    }
+    if(fread(head, 1, sizeof(head), fp) != sizeof(head) || memcmp(head, "WPK1", 4) != 0 || wpk_get32(head + 12) != WPK_BLOCK){
+        fclose(fp);
+        wavio_report_error(WAVIO_ERROR_FORMAT, "The file is not WPK file.");
+        return NULL;
+    }
+
+    reader = (WPKREADER *)malloc(sizeof(WPKREADER));
+    if(reader == NULL){
+        fclose(fp);
+        wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the reader.");
+        return NULL;
+    }
+    reader->fp = fp;
+    reader->index = NULL;
+    reader->cache[0] = NULL;
+    reader->cache[1] = NULL;
+    reader->buf_cap = 0;
+    reader->buf = NULL;
+    reader->cached = -1;
+    reader->position = 0;
+    reader->channel = (int16_t)wpk_get16(head + 6);
+    reader->pcm_spec.bits = (int16_t)wpk_get16(head + 8);
+    reader->pcm_spec.fs = wpk_get64(head + 16);
+    length = wpk_get64(head + 24);
+    blocks = wpk_get64(head + 32);
+    index_offset = wpk_get64(head + 40);
+    if(reader->channel < 1 || reader->channel > 2){
+        return wpk_reject(reader, WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+    }
+    if(reader->pcm_spec.bits != 8 && reader->pcm_spec.bits != 16 && reader->pcm_spec.bits != 24 && reader->pcm_spec.bits != 32){
+        return wpk_reject(reader, WAVIO_ERROR_BITS, "Inappropriate quantization bit number.");
+    }
+
+    //length must fit PCM_SPEC and the block count must be the one it implies
+    if(length > INT32_MAX || blocks != (length + WPK_BLOCK - 1) / WPK_BLOCK){
+        return wpk_reject(reader, WAVIO_ERROR_FORMAT, "The file is not WPK file.");
+    }
+    reader->pcm_spec.length = (int32_t)length;
+    reader->blocks = (int64_t)blocks;
+
+    //the index (blocks + 1 entries) must lie between the header and the end of the file
+    fseek(fp, 0, SEEK_END);
+    end = ftell(fp);
+    file_size = (end > 0) ? (uint64_t)end : 0;
+    if(index_offset < WPK_HEADER_SIZE || index_offset > file_size || (file_size - index_offset) / 8 < blocks + 1){
+        return wpk_reject(reader, WAVIO_ERROR_FORMAT, "The file does not have block index.");
+    }
+
+    //block index
+    entry = (uint8_t *)malloc((blocks + 1) * 8);
+    reader->index = (uint64_t *)malloc((blocks + 1) * sizeof(uint64_t));
+    if(entry == NULL || reader->index == NULL){
+        free(entry);
+        return wpk_reject(reader, WAVIO_ERROR_IO, "Cannot allocate the block index.");
+    }
+    fseek(fp, (long)index_offset, SEEK_SET);
+    if(fread(entry, 8, blocks + 1, fp) != (size_t)(blocks + 1)){
+        free(entry);
+        return wpk_reject(reader, WAVIO_ERROR_FORMAT, "The file does not have block index.");
+    }
+    for(b = 0; b <= reader->blocks; b++){
+        reader->index[b] = wpk_get64(entry + 8 * b);
+    }
+    free(entry);
+
+    //blocks follow one another from the end of the header up to the index
+    for(b = 0; b <= reader->blocks; b++){
+        if(reader->index[b] < ((b == 0) ? WPK_HEADER_SIZE : reader->index[b - 1]) || reader->index[b] > index_offset){
+            return wpk_reject(reader, WAVIO_ERROR_FORMAT, "Broken block index.");
+        }
+    }
+
+    //decoded block buffers
+    reader->cache[0] = (int32_t *)malloc(WPK_BLOCK * sizeof(int32_t));
+    reader->cache[1] = (reader->channel == 2) ? (int32_t *)malloc(WPK_BLOCK * sizeof(int32_t)) : NULL;
+    if(reader->cache[0] == NULL || (reader->channel == 2 && reader->cache[1] == NULL)){
+        return wpk_reject(reader, WAVIO_ERROR_IO, "Cannot allocate the block buffers.");
+    }
+
+    return reader;
+}
+
+//Read and decode block b into out (one array per channel), returns -1 after reporting the error
+static int wpk_load_block(WPKREADER *reader, int64_t b, int32_t **out){
+    uint64_t size = reader->index[b + 1] - reader->index[b], words = size / sizeof(uint32_t), used, pos = 0;
+    int32_t n = wpk_block_frames(reader->pcm_spec.length, b);
+    uint32_t *buf;
+    int c;
+
+    if(words > reader->buf_cap){
+        buf = (uint32_t *)realloc(reader->buf, words * sizeof(uint32_t));
+        if(buf == NULL){
+            return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the block buffers.");
+        }
+        reader->buf = buf;
+        reader->buf_cap = words;
+    }
+    fseek(reader->fp, (long)reader->index[b], SEEK_SET);
+    if(fread(reader->buf, sizeof(uint32_t), words, reader->fp) != words){
+        return wavio_report_error(WAVIO_ERROR_IO, "Cannot read the file.");
+    }
+#if WAVIO_BIG_ENDIAN_HOST
+    wavio_swap_bytes(reader->buf, words, 4);
+#endif
+
+    for(c = 0; c < reader->channel; c++){
+        used = wpk_decode_channel(reader->buf + pos, words - pos, n, out[c], (c == 1) ? out[0] : NULL);
+        if(used == 0){
+            return wavio_report_error(WAVIO_ERROR_FORMAT, "Broken block.");
+        }
+        pos += used;
+    }
+
+    return 0;
+}
+
+//Move the read position to a frame
+void wpkseek_Reader(WPKREADER *reader, uint64_t frame){
+    reader->position = (frame < (uint64_t)reader->pcm_spec.length) ? frame : (uint64_t)reader->pcm_spec.length;
+}
+
+//Read up to frames NATIVE frames from the read position (returns frames read, fewer than asked at a broken block)
+int32_t wpkread_Reader_Native(WPKREADER *reader, int32_t **data, int32_t frames){
+    int32_t done = 0, n, start;
+    int64_t b;
+    int c;
+
+    while(done < frames && reader->position < (uint64_t)reader->pcm_spec.length){
+        b = (int64_t)(reader->position / WPK_BLOCK);
+        if(b != reader->cached){
+            reader->cached = -1;
+            if(wpk_load_block(reader, b, reader->cache) < 0){
+                break;
+            }
+            reader->cached = b;
+        }
+        start = (int32_t)(reader->position - (uint64_t)b * WPK_BLOCK);
+        n = wpk_block_frames(reader->pcm_spec.length, b) - start;
+        if(n > frames - done){
+            n = frames - done;
+        }
+        for(c = 0; c < reader->channel; c++){
+            memcpy(data[c] + done, reader->cache[c] + start, n * sizeof(int32_t));
+        }
+        done += n;
+        reader->position += n;
+    }
+
+    return done;
+}
+
+//Read up to frames frames in [-1, 1] from the read position (returns frames read)
+int32_t wpkread_Reader(WPKREADER *reader, double **data, int32_t frames){
+    int32_t tmp[WPK_BLOCK];
+    int32_t *native[2];
+    int32_t done = 0, n, got;
+    int c;
+
+    while(done < frames){
+        n = (frames - done < WPK_BLOCK / 2) ? frames - done : WPK_BLOCK / 2;
+        native[0] = tmp;
+        native[1] = tmp + WPK_BLOCK / 2;
+        got = wpkread_Reader_Native(reader, native, n);
+        for(c = 0; c < reader->channel; c++){
+            wavio_native_to_pcm(native[c], data[c] + done, got, reader->pcm_spec.bits);
+        }
+        done += got;
+        if(got < n){
+            break;
+        }
+    }
+
+    return done;
+}
+
+//Close a WPK reader
+void wpkclose_Reader(WPKREADER *reader){
+    fclose(reader->fp);
+    free(reader->index);
+    free(reader->cache[0]);
+    free(reader->cache[1]);
+    free(reader->buf);
+    free(reader);
+}
+
+//Read a whole WPK file into NATIVE channel arrays (blocks are decoded straight into them)
+//returns the reader for its pcm_spec, or NULL after reporting the error (data is not set then)
+static WPKREADER *wpk_read_file(char *filename, int16_t channel, int32_t **data){
+    WPKREADER *reader = wpkopen_Reader(filename);
+    int32_t *out[2];
+    int64_t b;
+    int c;
+
+    if(reader == NULL){
+        return NULL;
+    }
+    if(reader->channel != channel){
+        return wpk_reject(reader, WAVIO_ERROR_CHANNEL, "Inappropriate channel number.");
+    }
+    for(c = 0; c < channel; c++){
+        data[c] = (int32_t *)calloc(reader->pcm_spec.length > 0 ? reader->pcm_spec.length : 1, sizeof(int32_t));
+        if(data[c] == NULL){
+            while(c > 0){
+                free(data[--c]);
+            }
+            return wpk_reject(reader, WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        }
+    }
+    for(b = 0; b < reader->blocks; b++){
+        for(c = 0; c < channel; c++){
+            out[c] = data[c] + b * WPK_BLOCK;
+        }
+        if(wpk_load_block(reader, b, out) < 0){
+            for(c = 0; c < channel; c++){
+                free(data[c]);
+            }
+            wpkclose_Reader(reader);
+            return NULL;
+        }
+    }
+
+    return reader;
+}
+
+//Convert NATIVE channel arrays of a whole file to [-1, 1] (returns -1 after reporting the error, native is freed either way)
+static int wpk_native_to_pcm(WPKREADER *reader, int32_t **native, double **data){
+    int c;
+
+    for(c = 0; c < reader->channel; c++){
+        data[c] = (double *)calloc(reader->pcm_spec.length > 0 ? reader->pcm_spec.length : 1, sizeof(double));
+        if(data[c] == NULL){
+            while(c > 0){
+                free(data[--c]);
+            }
+            for(c = 0; c < reader->channel; c++){
+                free(native[c]);
+            }
+            wpkclose_Reader(reader);
+            return wavio_report_error(WAVIO_ERROR_IO, "Cannot allocate the samples.");
+        }
+    }
+    for(c = 0; c < reader->channel; c++){
+        wavio_native_to_pcm(native[c], data[c], reader->pcm_spec.length, reader->pcm_spec.bits);
+        free(native[c]);
+    }
+
+    return 0;
+}
+
+//Read and insert STEREO_PCM_NATIVE data
+void wpkread_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename){
+    int32_t *data[2];
+    WPKREADER *reader = wpk_read_file(filename, 2, data);
+
+    if(reader == NULL){
+        return;
+    }
+    stereo_pcm_native->pcm_spec = reader->pcm_spec;
+    stereo_pcm_native->data[0] = data[0];
+    stereo_pcm_native->data[1] = data[1];
+    wpkclose_Reader(reader);
+}
+
+//Read data and insert STEREO_PCM struct
+void wpkread_Stereo(STEREO_PCM *stereo_pcm, char *filename){
+    int32_t *native[2];
+    double *data[2];
+    WPKREADER *reader = wpk_read_file(filename, 2, native);
+
+    if(reader == NULL || wpk_native_to_pcm(reader, native, data) < 0){
+        return;
+    }
+    stereo_pcm->pcm_spec = reader->pcm_spec;
+    stereo_pcm->data[0] = data[0];
+    stereo_pcm->data[1] = data[1];
+    wpkclose_Reader(reader);
+}
+
+//Read data and insert MONO_PCM_NATIVE struct
+void wpkread_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename){
+    int32_t *data[1];
+    WPKREADER *reader = wpk_read_file(filename, 1, data);
+
+    if(reader == NULL){
+        return;
+    }
+    mono_pcm_native->pcm_spec = reader->pcm_spec;
+    mono_pcm_native->data = data[0];
+    wpkclose_Reader(reader);
+}
+
+//Read data and insert MONO_PCM struct
+void wpkread_Mono(MONO_PCM *mono_pcm, char *filename){
+    int32_t *native[1];
+    double *data[1];
+    WPKREADER *reader = wpk_read_file(filename, 1, native);
+
+    if(reader == NULL || wpk_native_to_pcm(reader, native, data) < 0){
+        return;
+    }
+    mono_pcm->pcm_spec = reader->pcm_spec;
+    mono_pcm->data = data[0];
+    wpkclose_Reader(reader);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
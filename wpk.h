@@ -0,0 +1,73 @@
+/*wpk.h (Beta)*/
+
+//include guard
+#ifndef INCLUDED_WPK
+#define INCLUDED_WPK
+
+#include <stdio.h>
+#include <stdint.h>
+#include "wavio.h"
+
+//extern "C"
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//frames per block (the unit of random access)
+#define WPK_BLOCK 4096
+
+//samples packed with one bit width (4 lanes of 32 samples)
+#define WPK_GROUP 128
+
+//highest order of the difference predictor
+#define WPK_MAX_ORDER 3
+
+//size of the file header in bytes
+#define WPK_HEADER_SIZE 48
+
+//Block reader of a WPK file (random access through the block index)
+typedef struct{
+    PCM_SPEC pcm_spec; /* fs, bits and length (frames) of the file */
+    int16_t channel; /* Mono: 1, Stereo: 2 */
+    uint64_t position; /* next frame to read */
+    FILE *fp; /* file pointer */
+    int64_t blocks; /* number of blocks */
+    uint64_t *index; /* file offset of each block (blocks + 1 entries, the last one is the end of the data) */
+    int64_t cached; /* block held in cache (-1: none) */
+    int32_t *cache[2]; /* decoded samples of that block */
+    uint32_t *buf; /* packed block */
+    uint64_t buf_cap; /* capacity of buf in words */
+} WPKREADER;
+
+//Prototype declaration for wpk.c
+/* using MONO_PCM_NATIVE struct*/
+void wpkread_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename);
+void wpkwrite_Mono_Native(MONO_PCM_NATIVE *mono_pcm_native, char *filename);
+
+/* using MONO_PCM struct */
+void wpkread_Mono(MONO_PCM *mono_pcm, char *filename);
+void wpkwrite_Mono(MONO_PCM *mono_pcm, char *filename);
+
+/* using STEREO_PCM_NATIVE struct */
+void wpkread_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename);
+void wpkwrite_Stereo_Native(STEREO_PCM_NATIVE *stereo_pcm_native, char *filename);
+
+/* using STEREO_PCM struct */
+void wpkread_Stereo(STEREO_PCM *stereo_pcm, char *filename);
+void wpkwrite_Stereo(STEREO_PCM *stereo_pcm, char *filename);
+
+/* using WPKREADER struct (random access) */
+WPKREADER *wpkopen_Reader(char *filename);
+void wpkseek_Reader(WPKREADER *reader, uint64_t frame);
+int32_t wpkread_Reader(WPKREADER *reader, double **data, int32_t frames);
+int32_t wpkread_Reader_Native(WPKREADER *reader, int32_t **data, int32_t frames);
+void wpkclose_Reader(WPKREADER *reader);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//close include guard
+#endif